@@ -0,0 +1,53 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// Кадры двоичного протокола сервера: заголовок из 16 байт в little endian и данные
+//   0  uint32  размер данных
+//   4  uint32  статус ответа, 0 — успех; в запросах 0
+//   8  uint64  номер запроса, сервер возвращает его в ответе
+//   16 данные: ClientToServer в запросе, ServerToClient или текст ошибки в ответе
+// Ответы на запросы одного соединения приходят по мере готовности, не по порядку.
+
+constexpr size_t FRAME_HEADER_SIZE{16};
+constexpr uint32_t FRAME_STATUS_OK{0};
+// сервер перегружен и запрос не обрабатывал; в данных текст с предлагаемой паузой
+constexpr uint32_t FRAME_STATUS_OVERLOADED{3};
+// в запросе больше токенов, чем допускает сервер
+constexpr uint32_t FRAME_STATUS_TOO_LARGE{4};
+
+/// @brief Заголовок кадра
+struct FrameHeader {
+    uint32_t size{0};
+    uint32_t status{FRAME_STATUS_OK};
+    uint64_t request_id{0};
+};
+
+inline std::array<char, FRAME_HEADER_SIZE> EncodeFrameHeader(const FrameHeader& header) {
+    std::array<char, FRAME_HEADER_SIZE> bytes;
+    for (size_t i = 0; i < 4; ++i) {
+        bytes[i] = static_cast<char>(header.size >> (8 * i));
+        bytes[4 + i] = static_cast<char>(header.status >> (8 * i));
+    }
+    for (size_t i = 0; i < 8; ++i) {
+        bytes[8 + i] = static_cast<char>(header.request_id >> (8 * i));
+    }
+    return bytes;
+}
+
+/// @param bytes не меньше FRAME_HEADER_SIZE байт
+inline FrameHeader DecodeFrameHeader(const char* bytes) {
+    const auto byte = [bytes](size_t i) {
+        return static_cast<uint64_t>(static_cast<unsigned char>(bytes[i]));
+    };
+    FrameHeader header;
+    for (size_t i = 0; i < 4; ++i) {
+        header.size |= static_cast<uint32_t>(byte(i) << (8 * i));
+        header.status |= static_cast<uint32_t>(byte(4 + i) << (8 * i));
+    }
+    for (size_t i = 0; i < 8; ++i) {
+        header.request_id |= byte(8 + i) << (8 * i);
+    }
+    return header;
+}
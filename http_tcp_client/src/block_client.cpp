@@ -0,0 +1,135 @@
+#include "block_client.h"
+
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/beast/http.hpp>
+
+#include <unordered_set>
+
+#include <exchange.pb.h>
+
+namespace {
+    namespace beast = boost::beast;
+    namespace http = beast::http;
+    namespace net = boost::asio;
+    using tcp = net::ip::tcp;
+    using namespace std::literals;
+
+    // запас буфера чтения: http::read читает не больше свободного места в буфере
+    constexpr size_t READ_BUFFER_SIZE{256 * 1024};
+}
+
+BlockClient::BlockClient(std::string host, std::string port, std::string target, ClientBlockCache& cache) :
+    host_(std::move(host)),
+    port_(std::move(port)),
+    target_(std::move(target)),
+    cache_(cache) {
+    buffer_.reserve(READ_BUFFER_SIZE);
+}
+
+std::vector<CachedBlock> BlockClient::Fetch(std::span<const std::string> hashes) {
+    ++stats_.fetches;
+    std::vector<CachedBlock> blocks(hashes.size());
+    // недостающие токены без повторов, в порядке первого появления
+    std::vector<std::string_view> missing;
+    std::unordered_set<std::string_view> seen;
+    for (size_t i = 0; i < hashes.size(); ++i) {
+        if (auto block = cache_.Find(hashes[i])) {
+            blocks[i] = std::move(*block);
+            ++stats_.hashes_from_cache;
+        } else if (seen.insert(hashes[i]).second) {
+            missing.push_back(hashes[i]);
+        }
+    }
+    if (missing.empty()) {
+        return blocks;
+    }
+
+    const auto fetched = Request(missing);
+    for (size_t i = 0; i < hashes.size(); ++i) {
+        if (blocks[i]) {
+            continue;
+        }
+        if (auto it = fetched.find(hashes[i]); it != fetched.end()) {
+            blocks[i] = it->second;
+        }
+    }
+    return blocks;
+}
+
+std::unordered_map<std::string, CachedBlock> BlockClient::Request(const std::vector<std::string_view>& hashes) {
+    Exchange::ClientToServer client_to_server;
+    for (const std::string_view hash : hashes) {
+        client_to_server.add_hashes(hash.data(), hash.size());
+    }
+    const std::string body = RoundTrip(client_to_server.SerializeAsString());
+    ++stats_.requests;
+    stats_.hashes_requested += hashes.size();
+    stats_.response_bytes += body.size();
+
+    Exchange::ServerToClient server_to_client;
+    if (!server_to_client.ParseFromString(body)) {
+        throw beast::system_error(beast::errc::make_error_code(beast::errc::bad_message), "parse server response"s);
+    }
+    std::unordered_map<std::string, CachedBlock> fetched;
+    fetched.reserve(server_to_client.hash_and_block_size());
+    for (auto& hash_and_block : *server_to_client.mutable_hash_and_block()) {
+        // блок переносится в кэш без копирования
+        auto block = cache_.Insert(hash_and_block.hash(), std::move(*hash_and_block.mutable_block()));
+        fetched.insert_or_assign(std::move(*hash_and_block.mutable_hash()), std::move(block));
+    }
+    stats_.hashes_from_server += fetched.size();
+    return fetched;
+}
+
+std::string BlockClient::RoundTrip(const std::string& body) {
+    http::request<http::string_body> req{http::verb::get, target_, 11};
+    req.set(http::field::host, host_);
+    req.set(http::field::content_type, "text/html");
+    req.keep_alive(true);
+    req.body() = body;
+    req.prepare_payload();
+
+    // сервер мог закрыть простаивающее соединение: одна повторная попытка на новом
+    for (int attempt = 0;; ++attempt) {
+        const bool reused = stream_.has_value();
+        if (!reused) {
+            Connect();
+        }
+        beast::error_code ec;
+        http::write(*stream_, req, ec);
+
+        http::response_parser<http::string_body> parser;
+        // ответ может содержать десятки блоков до 1 МБ
+        parser.body_limit(boost::none);
+        if (!ec) {
+            http::read(*stream_, buffer_, parser, ec);
+        }
+        if (ec) {
+            stream_.reset();
+            buffer_.clear();
+            if (reused && attempt == 0) {
+                continue;
+            }
+            throw beast::system_error(ec, "fetch"s);
+        }
+
+        auto res = parser.release();
+        if (!res.keep_alive()) {
+            stream_.reset();
+            buffer_.clear();
+        }
+        if (res.result() != http::status::ok) {
+            throw beast::system_error(beast::errc::make_error_code(beast::errc::protocol_error),
+                "server responded "s + std::to_string(res.result_int()));
+        }
+        return std::move(res.body());
+    }
+}
+
+void BlockClient::Connect() {
+    tcp::resolver resolver(ioc_);
+    const auto endpoints = resolver.resolve(host_, port_);
+    stream_.emplace(ioc_);
+    stream_->connect(endpoints);
+    stream_->socket().set_option(tcp::no_delay(true));
+}
@@ -0,0 +1,61 @@
+#pragma once
+#include <boost/asio/io_context.hpp>
+#include <boost/beast/core/flat_buffer.hpp>
+#include <boost/beast/core/tcp_stream.hpp>
+
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "client_block_cache.h"
+
+/// @brief Счётчики обращений клиента к серверу
+struct BlockClientStats {
+    uint64_t fetches{0};
+    // запросов к серверу: выборка целиком из кэша сервер не трогает
+    uint64_t requests{0};
+    uint64_t hashes_requested{0};
+    uint64_t hashes_from_cache{0};
+    uint64_t hashes_from_server{0};
+    uint64_t response_bytes{0};
+};
+
+/// @brief Синхронный клиент сервера блоков с локальным кэшем.
+/// Fetch отдаёт блоки из кэша, а у сервера запрашивает только недостающие
+/// токены одним запросом по keep-alive соединению. Полученные блоки кладутся в кэш.
+/// Не потокобезопасен: для параллельных выборок нужен клиент на поток,
+/// кэш при этом может быть общим.
+class BlockClient {
+public:
+    BlockClient(std::string host, std::string port, std::string target, ClientBlockCache& cache);
+
+    /// @brief Блоки по токенам в порядке запроса.
+    /// Для токенов, которых нет на сервере, возвращается пустой CachedBlock.
+    /// @throws boost::system::system_error при ошибке соединения или неразборчивом ответе
+    std::vector<CachedBlock> Fetch(std::span<const std::string> hashes);
+
+    const BlockClientStats& Stats() const {
+        return stats_;
+    }
+
+private:
+    /// @brief Запрос недостающих токенов и разбор ответа в кэш
+    std::unordered_map<std::string, CachedBlock> Request(const std::vector<std::string_view>& hashes);
+    std::string RoundTrip(const std::string& body);
+    void Connect();
+
+private:
+    std::string host_;
+    std::string port_;
+    std::string target_;
+    ClientBlockCache& cache_;
+
+    boost::asio::io_context ioc_;
+    std::optional<boost::beast::tcp_stream> stream_;
+    boost::beast::flat_buffer buffer_;
+
+    BlockClientStats stats_;
+};
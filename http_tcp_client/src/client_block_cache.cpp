@@ -0,0 +1,277 @@
+#include "client_block_cache.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <system_error>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace {
+    using namespace std::literals;
+
+    constexpr std::string_view SPILL_MAGIC{"BLKSPL01"};
+    constexpr std::string_view SPILL_PREFIX{"spill-"};
+    constexpr std::string_view SPILL_SUFFIX{".seg"};
+    // накладные расходы на запись в памяти помимо блока и токена
+    constexpr uint64_t ENTRY_OVERHEAD{96};
+
+    // Заголовок записи в файле, за ним следуют токен и блок.
+    // Нулевой размер токена — конец записей: файл заранее заполнен нулями.
+    struct RecordHeader {
+        uint32_t hash_size;
+        uint32_t block_size;
+    };
+
+    [[noreturn]] void ThrowErrno(const std::string& what) {
+        throw std::system_error(errno, std::generic_category(), what);
+    }
+
+    std::filesystem::path SpillPath(const std::filesystem::path& directory, uint64_t generation) {
+        return directory / (std::string(SPILL_PREFIX) + std::to_string(generation) + std::string(SPILL_SUFFIX));
+    }
+}
+
+/// @brief Файл с вытесненными блоками, заранее увеличенный до полного размера
+/// и отображённый в память целиком. Записи только дописываются.
+class ClientBlockCache::SpillSegment {
+public:
+    SpillSegment(std::filesystem::path path, uint64_t capacity) :
+        path_(std::move(path)) {
+        fd_ = ::open(path_.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (fd_ < 0) {
+            ThrowErrno("open "s + path_.string());
+        }
+        const off_t size = ::lseek(fd_, 0, SEEK_END);
+        // существующий файл открывается с прежним размером
+        capacity_ = size > 0 ? static_cast<uint64_t>(size) : std::max<uint64_t>(capacity, SPILL_MAGIC.size());
+        if (size <= 0 && ::ftruncate(fd_, static_cast<off_t>(capacity_)) != 0) {
+            ::close(fd_);
+            ThrowErrno("ftruncate "s + path_.string());
+        }
+        void* data = ::mmap(nullptr, capacity_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+        if (data == MAP_FAILED) {
+            ::close(fd_);
+            ThrowErrno("mmap "s + path_.string());
+        }
+        data_ = static_cast<char*>(data);
+        if (size <= 0) {
+            std::memcpy(data_, SPILL_MAGIC.data(), SPILL_MAGIC.size());
+        }
+        used_ = SPILL_MAGIC.size();
+    }
+
+    ~SpillSegment() {
+        ::munmap(data_, capacity_);
+        ::close(fd_);
+        if (remove_) {
+            std::error_code ec;
+            std::filesystem::remove(path_, ec);
+        }
+    }
+
+    SpillSegment(const SpillSegment&) = delete;
+    SpillSegment& operator=(const SpillSegment&) = delete;
+
+    bool Valid() const {
+        return std::string_view(data_, SPILL_MAGIC.size()) == SPILL_MAGIC;
+    }
+
+    /// @brief Обходит записи файла и ставит позицию записи после последней целой
+    template <typename Fn>
+    void Scan(Fn&& fn) {
+        uint64_t offset = SPILL_MAGIC.size();
+        while (offset + sizeof(RecordHeader) <= capacity_) {
+            RecordHeader header;
+            std::memcpy(&header, data_ + offset, sizeof(header));
+            const uint64_t end = offset + sizeof(header) + header.hash_size + header.block_size;
+            if (header.hash_size == 0 || end > capacity_) {
+                break;
+            }
+            const std::string_view hash(data_ + offset + sizeof(header), header.hash_size);
+            fn(hash, offset + sizeof(header) + header.hash_size, header.block_size);
+            offset = end;
+        }
+        used_ = offset;
+    }
+
+    /// @brief Дописывает запись
+    /// @return смещение блока или std::nullopt, если места не осталось
+    std::optional<uint64_t> Append(std::string_view hash, std::string_view block) {
+        const uint64_t size = sizeof(RecordHeader) + hash.size() + block.size();
+        if (used_ + size > capacity_) {
+            return std::nullopt;
+        }
+        // сначала данные, потом заголовок: запись без заголовка при обходе не видна
+        char* out = data_ + used_;
+        std::memcpy(out + sizeof(RecordHeader), hash.data(), hash.size());
+        std::memcpy(out + sizeof(RecordHeader) + hash.size(), block.data(), block.size());
+        const RecordHeader header{static_cast<uint32_t>(hash.size()), static_cast<uint32_t>(block.size())};
+        std::memcpy(out, &header, sizeof(header));
+        const uint64_t block_offset = used_ + sizeof(RecordHeader) + hash.size();
+        used_ += size;
+        return block_offset;
+    }
+
+    const char* Data() const {
+        return data_;
+    }
+
+    uint64_t Used() const {
+        return used_;
+    }
+
+    /// @brief Удалить файл, когда отпустят последнюю ссылку на отображение
+    void RemoveOnClose() {
+        remove_ = true;
+    }
+
+private:
+    std::filesystem::path path_;
+    int fd_{-1};
+    char* data_{nullptr};
+    uint64_t capacity_{0};
+    uint64_t used_{0};
+    bool remove_{false};
+};
+
+ClientBlockCache::ClientBlockCache(BlockCacheOptions options) :
+    options_(std::move(options)) {
+    if (!options_.spill_directory.empty()) {
+        OpenSpill();
+    }
+}
+
+ClientBlockCache::~ClientBlockCache() = default;
+
+std::optional<CachedBlock> ClientBlockCache::Find(std::string_view hash) {
+    std::lock_guard lock(mutex_);
+    if (auto it = entries_.find(hash); it != entries_.end()) {
+        lru_.splice(lru_.begin(), lru_, it->second);
+        ++stats_.hits;
+        const auto& block = it->second->block;
+        return CachedBlock{{block->data(), block->size()}, block};
+    }
+    if (auto it = spilled_.find(std::string(hash)); it != spilled_.end()) {
+        ++stats_.hits;
+        ++stats_.spill_hits;
+        const auto& location = it->second;
+        return CachedBlock{{location.segment->Data() + location.offset, location.size}, location.segment};
+    }
+    ++stats_.misses;
+    return std::nullopt;
+}
+
+CachedBlock ClientBlockCache::Insert(std::string_view hash, std::string block) {
+    auto data = std::make_shared<const std::string>(std::move(block));
+    CachedBlock result{{data->data(), data->size()}, data};
+    const uint64_t cost = data->size() + hash.size() + ENTRY_OVERHEAD;
+
+    std::lock_guard lock(mutex_);
+    if (entries_.contains(hash) || cost > options_.memory_bytes) {
+        return result;
+    }
+    lru_.push_front({std::string(hash), std::move(data)});
+    entries_.emplace(lru_.front().hash, lru_.begin());
+    memory_bytes_ += cost;
+    ++stats_.insertions;
+    while (memory_bytes_ > options_.memory_bytes) {
+        Evict();
+    }
+    return result;
+}
+
+void ClientBlockCache::Evict() {
+    const Entry& entry = lru_.back();
+    if (active_) {
+        Spill(entry);
+    }
+    memory_bytes_ -= entry.block->size() + entry.hash.size() + ENTRY_OVERHEAD;
+    entries_.erase(std::string_view{entry.hash});
+    lru_.pop_back();
+    ++stats_.evictions;
+}
+
+void ClientBlockCache::Spill(const Entry& entry) {
+    if (spilled_.contains(entry.hash)) {
+        return;
+    }
+    auto offset = active_->Append(entry.hash, *entry.block);
+    if (!offset) {
+        RotateSpill();
+        offset = active_->Append(entry.hash, *entry.block);
+        if (!offset) {
+            // блок больше половины бюджета диска
+            return;
+        }
+    }
+    spilled_.emplace(entry.hash, SpillLocation{active_, *offset, entry.block->size()});
+    ++stats_.spilled;
+}
+
+void ClientBlockCache::OpenSpill() {
+    std::filesystem::create_directories(options_.spill_directory);
+
+    // файлы прошлых запусков по возрастанию поколения
+    std::vector<uint64_t> generations;
+    for (const auto& file : std::filesystem::directory_iterator(options_.spill_directory)) {
+        const std::string name = file.path().filename().string();
+        if (name.starts_with(SPILL_PREFIX) && name.ends_with(SPILL_SUFFIX)) {
+            try {
+                generations.push_back(std::stoull(name.substr(SPILL_PREFIX.size(), name.size() - SPILL_PREFIX.size() - SPILL_SUFFIX.size())));
+            } catch (const std::exception&) {
+            }
+        }
+    }
+    std::sort(generations.begin(), generations.end());
+    // хранятся только два последних поколения
+    while (generations.size() > 2) {
+        std::error_code ec;
+        std::filesystem::remove(SpillPath(options_.spill_directory, generations.front()), ec);
+        generations.erase(generations.begin());
+    }
+
+    const uint64_t segment_capacity = options_.spill_bytes / 2;
+    for (const uint64_t generation : generations) {
+        auto segment = std::make_shared<SpillSegment>(SpillPath(options_.spill_directory, generation), segment_capacity);
+        if (!segment->Valid()) {
+            segment->RemoveOnClose();
+            continue;
+        }
+        // записи более нового файла заменяют записи старого
+        segment->Scan([this, &segment](std::string_view hash, uint64_t offset, uint64_t size) {
+            spilled_.insert_or_assign(std::string(hash), SpillLocation{segment, offset, size});
+        });
+        previous_ = std::move(active_);
+        active_ = std::move(segment);
+        generation_ = generation + 1;
+    }
+    if (!active_) {
+        active_ = std::make_shared<SpillSegment>(SpillPath(options_.spill_directory, generation_++), segment_capacity);
+    }
+}
+
+void ClientBlockCache::RotateSpill() {
+    if (previous_) {
+        // старое поколение уходит целиком, файл удаляется после последнего читателя
+        std::erase_if(spilled_, [this](const auto& item) {
+            return item.second.segment == previous_;
+        });
+        previous_->RemoveOnClose();
+    }
+    previous_ = std::move(active_);
+    active_ = std::make_shared<SpillSegment>(SpillPath(options_.spill_directory, generation_++), options_.spill_bytes / 2);
+}
+
+BlockCacheStats ClientBlockCache::Stats() const {
+    std::lock_guard lock(mutex_);
+    BlockCacheStats stats = stats_;
+    stats.memory_blocks = entries_.size();
+    stats.memory_bytes = memory_bytes_;
+    stats.spill_blocks = spilled_.size();
+    stats.spill_bytes = (active_ ? active_->Used() : 0) + (previous_ ? previous_->Used() : 0);
+    return stats;
+}
@@ -0,0 +1,116 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+/// @brief Блок из кэша клиента: байты и владелец памяти, в которой они лежат.
+/// Байты остаются валидными, пока жив owner, даже если блок уже вытеснен из кэша.
+struct CachedBlock {
+    std::span<const char> bytes;
+    std::shared_ptr<const void> owner;
+
+    std::string_view View() const {
+        return {bytes.data(), bytes.size()};
+    }
+
+    explicit operator bool() const {
+        return owner != nullptr;
+    }
+};
+
+/// @brief Параметры кэша блоков клиента
+struct BlockCacheOptions {
+    // бюджет памяти под блоки
+    uint64_t memory_bytes{256ull * 1024 * 1024};
+    // каталог для вытесненных из памяти блоков, пустой — без диска
+    std::filesystem::path spill_directory;
+    // бюджет диска: два файла по половине, старый удаляется целиком
+    uint64_t spill_bytes{1024ull * 1024 * 1024};
+};
+
+/// @brief Счётчики кэша блоков клиента
+struct BlockCacheStats {
+    uint64_t hits{0};
+    // из них найдено на диске
+    uint64_t spill_hits{0};
+    uint64_t misses{0};
+    uint64_t insertions{0};
+    uint64_t evictions{0};
+    uint64_t spilled{0};
+    uint64_t memory_blocks{0};
+    uint64_t memory_bytes{0};
+    uint64_t spill_blocks{0};
+    uint64_t spill_bytes{0};
+
+    double HitRate() const {
+        const uint64_t lookups = hits + misses;
+        return lookups == 0 ? 0.0 : static_cast<double>(hits) / static_cast<double>(lookups);
+    }
+};
+
+/// @brief Кэш блоков по токенам на стороне клиента. Блок по токену неизменен,
+/// поэтому кэш не проверяет свежесть. Блоки лежат в памяти с вытеснением LRU
+/// в пределах бюджета; если задан каталог, вытесненные блоки дописываются
+/// в отображённый в память файл и читаются оттуда без копирования.
+/// Файлы переживают перезапуск: при открытии каталога индекс восстанавливается по ним.
+/// Потокобезопасен.
+class ClientBlockCache {
+public:
+    explicit ClientBlockCache(BlockCacheOptions options = {});
+    ~ClientBlockCache();
+
+    ClientBlockCache(const ClientBlockCache&) = delete;
+    ClientBlockCache& operator=(const ClientBlockCache&) = delete;
+
+    /// @brief Блок по токену из памяти или с диска
+    std::optional<CachedBlock> Find(std::string_view hash);
+
+    /// @brief Кладёт блок в кэш
+    /// @return блок, владеющий данными, даже если он не поместился в кэш
+    CachedBlock Insert(std::string_view hash, std::string block);
+
+    BlockCacheStats Stats() const;
+
+private:
+    class SpillSegment;
+
+    struct Entry {
+        std::string hash;
+        std::shared_ptr<const std::string> block;
+    };
+
+    struct SpillLocation {
+        std::shared_ptr<SpillSegment> segment;
+        uint64_t offset;
+        uint64_t size;
+    };
+
+    // вызываются под mutex_
+    void Evict();
+    void Spill(const Entry& entry);
+    void OpenSpill();
+    void RotateSpill();
+
+private:
+    BlockCacheOptions options_;
+    mutable std::mutex mutex_;
+
+    // голова — недавно использованные
+    std::list<Entry> lru_;
+    std::unordered_map<std::string_view, std::list<Entry>::iterator> entries_;
+    uint64_t memory_bytes_{0};
+
+    std::unordered_map<std::string, SpillLocation> spilled_;
+    std::shared_ptr<SpillSegment> active_;
+    std::shared_ptr<SpillSegment> previous_;
+    uint64_t generation_{0};
+
+    BlockCacheStats stats_;
+};
@@ -0,0 +1,98 @@
+#pragma once
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <vector>
+
+/// @brief Гистограмма задержек в духе HdrHistogram: логарифмические диапазоны,
+/// каждый из которых делится на 128 равных корзин. Относительная погрешность
+/// значения процентиля не больше 1/128, память постоянна при любом числе замеров.
+class LatencyHistogram {
+public:
+    LatencyHistogram() :
+        buckets_(BUCKET_COUNT, 0) {
+    }
+
+    void Record(uint64_t value) {
+        ++buckets_[BucketIndex(value)];
+        ++count_;
+        sum_ += value;
+        max_ = std::max(max_, value);
+        min_ = std::min(min_, value);
+    }
+
+    void Merge(const LatencyHistogram& other) {
+        for (size_t i = 0; i < BUCKET_COUNT; ++i) {
+            buckets_[i] += other.buckets_[i];
+        }
+        count_ += other.count_;
+        sum_ += other.sum_;
+        max_ = std::max(max_, other.max_);
+        min_ = std::min(min_, other.min_);
+    }
+
+    /// @brief Значение, не меньше которого q-я доля замеров
+    /// @param q доля от 0 до 1
+    /// @return верхняя граница корзины процентиля, но не больше максимума
+    uint64_t Percentile(double q) const {
+        if (count_ == 0) {
+            return 0;
+        }
+        const auto rank = std::max<uint64_t>(1, static_cast<uint64_t>(q * static_cast<double>(count_) + 0.5));
+        uint64_t cumulative = 0;
+        for (size_t i = 0; i < BUCKET_COUNT; ++i) {
+            cumulative += buckets_[i];
+            if (cumulative >= rank) {
+                return std::min(BucketUpperBound(i), max_);
+            }
+        }
+        return max_;
+    }
+
+    uint64_t Count() const {
+        return count_;
+    }
+
+    uint64_t Max() const {
+        return max_;
+    }
+
+    uint64_t Min() const {
+        return count_ == 0 ? 0 : min_;
+    }
+
+    double Mean() const {
+        return count_ == 0 ? 0.0 : static_cast<double>(sum_) / static_cast<double>(count_);
+    }
+
+private:
+    static constexpr int SUB_BITS{7};
+    static constexpr uint64_t SUB_COUNT{uint64_t{1} << SUB_BITS};
+    static constexpr size_t BUCKET_COUNT{(64 - SUB_BITS + 1) * SUB_COUNT};
+
+    static size_t BucketIndex(uint64_t value) {
+        if (value < SUB_COUNT) {
+            return value;
+        }
+        // value = mantissa << shift, mantissa в [SUB_COUNT, 2 * SUB_COUNT)
+        const int shift = std::bit_width(value) - SUB_BITS - 1;
+        const uint64_t mantissa = value >> shift;
+        return (shift + 1) * SUB_COUNT + (mantissa - SUB_COUNT);
+    }
+
+    static uint64_t BucketUpperBound(size_t index) {
+        if (index < SUB_COUNT) {
+            return index;
+        }
+        const int shift = static_cast<int>(index / SUB_COUNT) - 1;
+        const uint64_t mantissa = index % SUB_COUNT + SUB_COUNT;
+        return ((mantissa + 1) << shift) - 1;
+    }
+
+private:
+    std::vector<uint64_t> buckets_;
+    uint64_t count_{0};
+    uint64_t sum_{0};
+    uint64_t max_{0};
+    uint64_t min_{UINT64_MAX};
+};
@@ -0,0 +1,548 @@
+#include "load_generator.h"
+
+#include <boost/asio/steady_timer.hpp>
+#include <boost/asio/strand.hpp>
+#include <boost/beast/core.hpp>
+#include <boost/beast/http.hpp>
+#include <boost/property_tree/json_parser.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <random>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <exchange.pb.h>
+
+#include "binary_protocol.h"
+
+namespace {
+    namespace beast = boost::beast;
+    namespace http = beast::http;
+    namespace net = boost::asio;
+    using tcp = net::ip::tcp;
+    using Clock = std::chrono::steady_clock;
+    using namespace std::literals;
+
+    // запас буфера чтения ответов
+    constexpr size_t READ_BUFFER_SIZE{256 * 1024};
+
+    /// @brief Выбор номера токена: равномерно или по закону Ципфа,
+    /// при котором токен ранга k запрашивается с частотой ~ 1 / k^s
+    class KeySampler {
+    public:
+        KeySampler(uint64_t key_space, double zipf) :
+            key_space_(std::max<uint64_t>(1, key_space)) {
+            if (zipf <= 0.0) {
+                return;
+            }
+            cdf_.resize(key_space_);
+            double sum = 0.0;
+            for (uint64_t k = 0; k < key_space_; ++k) {
+                sum += 1.0 / std::pow(static_cast<double>(k + 1), zipf);
+                cdf_[k] = sum;
+            }
+            for (double& value : cdf_) {
+                value /= sum;
+            }
+        }
+
+        uint64_t Sample(std::mt19937_64& random) const {
+            if (cdf_.empty()) {
+                return std::uniform_int_distribution<uint64_t>(0, key_space_ - 1)(random);
+            }
+            const double u = std::uniform_real_distribution<double>(0.0, 1.0)(random);
+            const auto it = std::lower_bound(cdf_.begin(), cdf_.end(), u);
+            return std::min<uint64_t>(it - cdf_.begin(), key_space_ - 1);
+        }
+
+    private:
+        uint64_t key_space_;
+        std::vector<double> cdf_;
+    };
+
+    /// @brief Токен из 128 символов, однозначно определяемый номером
+    void AppendKeyHash(std::string& out, uint64_t key) {
+        static constexpr std::string_view CHARACTERS = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwyz"sv;
+        // splitmix64 от номера токена
+        uint64_t state = key * 0x9e3779b97f4a7c15ull + 0x632be59bd9b4e019ull;
+        for (size_t i = 0; i < 128; i += 8) {
+            state += 0x9e3779b97f4a7c15ull;
+            uint64_t word = state;
+            word = (word ^ (word >> 30)) * 0xbf58476d1ce4e5b9ull;
+            word = (word ^ (word >> 27)) * 0x94d049bb133111ebull;
+            word ^= word >> 31;
+            for (size_t j = 0; j < 8; ++j) {
+                out.push_back(CHARACTERS[(word & 0xFF) * CHARACTERS.size() >> 8]);
+                word >>= 8;
+            }
+        }
+    }
+
+    // Общее для соединений расписание запросов
+    struct Schedule {
+        const LoadOptions& options;
+        tcp::resolver::results_type endpoints;
+        KeySampler sampler;
+        Clock::time_point start;
+        std::atomic<uint64_t> next_slot{0};
+
+        /// @brief Следующий запрос расписания
+        /// @param intended запланированный момент отправки
+        /// @return false, если запросов больше нет
+        bool Next(Clock::time_point& intended) {
+            const uint64_t slot = next_slot.fetch_add(1, std::memory_order_relaxed);
+            if (options.requests > 0 && slot >= options.requests) {
+                return false;
+            }
+            const auto now = Clock::now();
+            intended = now;
+            if (options.rate > 0.0) {
+                intended = start + std::chrono::duration_cast<Clock::duration>(
+                    std::chrono::duration<double>(static_cast<double>(slot) / options.rate));
+            }
+            if (options.duration > 0.0
+                && intended - start >= std::chrono::duration<double>(options.duration)) {
+                return false;
+            }
+            return true;
+        }
+    };
+
+    // Keep-alive соединение, отправляющее запросы по расписанию по одному
+    class LoadConnection : public std::enable_shared_from_this<LoadConnection> {
+    public:
+        LoadConnection(net::io_context& ioc, Schedule& schedule, uint64_t seed) :
+            stream_(net::make_strand(ioc)),
+            timer_(stream_.get_executor()),
+            schedule_(schedule),
+            random_(seed) {
+            // http::async_read читает не больше свободного места в буфере, но не меньше 512 байт:
+            // без запаса большие тела читались бы по 512 байт за системный вызов
+            buffer_.reserve(READ_BUFFER_SIZE);
+        }
+
+        void Start() {
+            stream_.expires_after(30s);
+            stream_.async_connect(schedule_.endpoints,
+                beast::bind_front_handler(&LoadConnection::OnConnect, shared_from_this()));
+        }
+
+        const LatencyHistogram& Latency() const {
+            return latency_;
+        }
+
+        uint64_t Requests() const {
+            return requests_;
+        }
+
+        uint64_t Errors() const {
+            return errors_;
+        }
+
+        uint64_t ResponseBytes() const {
+            return response_bytes_;
+        }
+
+    private:
+        void OnConnect(beast::error_code ec, tcp::endpoint) {
+            if (ec) {
+                ++errors_;
+                std::cerr << "connect: "sv << ec.message() << std::endl;
+                return;
+            }
+            stream_.socket().set_option(tcp::no_delay(true), ec);
+            Next();
+        }
+
+        void Next() {
+            if (!schedule_.Next(intended_)) {
+                beast::error_code ec;
+                stream_.socket().shutdown(tcp::socket::shutdown_both, ec);
+                return;
+            }
+            if (intended_ > Clock::now()) {
+                timer_.expires_at(intended_);
+                timer_.async_wait([self = shared_from_this()](beast::error_code ec) {
+                    if (!ec) {
+                        self->Send();
+                    }
+                });
+                return;
+            }
+            Send();
+        }
+
+        void Send() {
+            Exchange::ClientToServer client_to_server;
+            std::string hash;
+            for (unsigned i = 0; i < schedule_.options.hashes_per_request; ++i) {
+                hash.clear();
+                AppendKeyHash(hash, schedule_.sampler.Sample(random_));
+                client_to_server.add_hashes(hash);
+            }
+
+            request_ = {};
+            request_.version(11);
+            request_.method(http::verb::get);
+            request_.target(schedule_.options.target);
+            request_.set(http::field::host, schedule_.options.host);
+            request_.set(http::field::content_type, "text/html");
+            request_.keep_alive(true);
+            client_to_server.SerializeToString(&request_.body());
+            request_.prepare_payload();
+
+            stream_.expires_after(30s);
+            http::async_write(stream_, request_,
+                beast::bind_front_handler(&LoadConnection::OnWrite, shared_from_this()));
+        }
+
+        void OnWrite(beast::error_code ec, std::size_t) {
+            if (ec) {
+                ++errors_;
+                std::cerr << "write: "sv << ec.message() << std::endl;
+                return;
+            }
+            parser_.emplace();
+            // ответ может содержать десятки блоков до 1 МБ
+            parser_->body_limit(boost::none);
+            http::async_read(stream_, buffer_, *parser_,
+                beast::bind_front_handler(&LoadConnection::OnRead, shared_from_this()));
+        }
+
+        void OnRead(beast::error_code ec, std::size_t) {
+            if (ec) {
+                ++errors_;
+                std::cerr << "read: "sv << ec.message() << std::endl;
+                return;
+            }
+            const auto latency = Clock::now() - intended_;
+            latency_.Record(std::chrono::duration_cast<std::chrono::nanoseconds>(latency).count());
+            ++requests_;
+
+            const auto& response = parser_->get();
+            if (response.result() != http::status::ok) {
+                ++errors_;
+            }
+            response_bytes_ += response.body().size();
+            if (!response.keep_alive()) {
+                return;
+            }
+            Next();
+        }
+
+    private:
+        beast::tcp_stream stream_;
+        net::steady_timer timer_;
+        beast::flat_buffer buffer_;
+        http::request<http::string_body> request_;
+        std::optional<http::response_parser<http::string_body>> parser_;
+        Schedule& schedule_;
+        std::mt19937_64 random_;
+        Clock::time_point intended_;
+
+        LatencyHistogram latency_;
+        uint64_t requests_{0};
+        uint64_t errors_{0};
+        uint64_t response_bytes_{0};
+    };
+
+    // Соединение двоичного протокола: до in_flight запросов одновременно,
+    // каждый в своём слоте расписания; ответы сопоставляются с запросами по номеру
+    class BinaryLoadConnection : public std::enable_shared_from_this<BinaryLoadConnection> {
+    public:
+        BinaryLoadConnection(net::io_context& ioc, Schedule& schedule, uint64_t seed) :
+            stream_(net::make_strand(ioc)),
+            schedule_(schedule),
+            random_(seed) {
+        }
+
+        void Start() {
+            stream_.expires_after(30s);
+            stream_.async_connect(schedule_.endpoints,
+                beast::bind_front_handler(&BinaryLoadConnection::OnConnect, shared_from_this()));
+        }
+
+        const LatencyHistogram& Latency() const {
+            return latency_;
+        }
+
+        uint64_t Requests() const {
+            return requests_;
+        }
+
+        uint64_t Errors() const {
+            return errors_;
+        }
+
+        uint64_t ResponseBytes() const {
+            return response_bytes_;
+        }
+
+    private:
+        // Запрос, ожидающий ответа
+        struct Pending {
+            size_t slot;
+            Clock::time_point intended;
+        };
+
+        void OnConnect(beast::error_code ec, tcp::endpoint) {
+            if (ec) {
+                ++errors_;
+                std::cerr << "connect: "sv << ec.message() << std::endl;
+                return;
+            }
+            stream_.expires_never();
+            const size_t slots = std::max(1u, schedule_.options.in_flight);
+            for (size_t slot = 0; slot < slots; ++slot) {
+                timers_.push_back(std::make_unique<net::steady_timer>(stream_.get_executor()));
+            }
+            Read();
+            for (size_t slot = 0; slot < slots; ++slot) {
+                Next(slot);
+            }
+        }
+
+        void Next(size_t slot) {
+            Clock::time_point intended;
+            if (!schedule_.Next(intended)) {
+                ++idle_slots_;
+                if (idle_slots_ == timers_.size() && pending_.empty()) {
+                    Close();
+                }
+                return;
+            }
+            if (intended > Clock::now()) {
+                timers_[slot]->expires_at(intended);
+                timers_[slot]->async_wait([self = shared_from_this(), slot, intended](beast::error_code ec) {
+                    if (!ec) {
+                        self->Send(slot, intended);
+                    }
+                });
+                return;
+            }
+            Send(slot, intended);
+        }
+
+        void Send(size_t slot, Clock::time_point intended) {
+            Exchange::ClientToServer client_to_server;
+            std::string hash;
+            for (unsigned i = 0; i < schedule_.options.hashes_per_request; ++i) {
+                hash.clear();
+                AppendKeyHash(hash, schedule_.sampler.Sample(random_));
+                client_to_server.add_hashes(hash);
+            }
+            const uint64_t id = next_id_++;
+            pending_.emplace(id, Pending{slot, intended});
+
+            const auto header = EncodeFrameHeader({static_cast<uint32_t>(client_to_server.ByteSizeLong()), FRAME_STATUS_OK, id});
+            write_queue_.append(header.data(), header.size());
+            client_to_server.AppendToString(&write_queue_);
+            Flush();
+        }
+
+        /// @brief Запросы, накопленные за время предыдущей записи, уходят одной записью
+        void Flush() {
+            if (writing_ || write_queue_.empty()) {
+                return;
+            }
+            writing_ = true;
+            write_buffer_.swap(write_queue_);
+            write_queue_.clear();
+            net::async_write(stream_, net::buffer(write_buffer_),
+                beast::bind_front_handler(&BinaryLoadConnection::OnWrite, shared_from_this()));
+        }
+
+        void OnWrite(beast::error_code ec, std::size_t) {
+            writing_ = false;
+            if (ec) {
+                ++errors_;
+                std::cerr << "write: "sv << ec.message() << std::endl;
+                return;
+            }
+            Flush();
+        }
+
+        void Read() {
+            stream_.async_read_some(buffer_.prepare(READ_BUFFER_SIZE),
+                beast::bind_front_handler(&BinaryLoadConnection::OnRead, shared_from_this()));
+        }
+
+        void OnRead(beast::error_code ec, std::size_t bytes_read) {
+            buffer_.commit(bytes_read);
+            if (ec) {
+                if (!closed_) {
+                    ++errors_;
+                    std::cerr << "read: "sv << ec.message() << std::endl;
+                }
+                return;
+            }
+            while (buffer_.size() >= FRAME_HEADER_SIZE) {
+                const auto* data = static_cast<const char*>(buffer_.data().data());
+                const FrameHeader header = DecodeFrameHeader(data);
+                if (buffer_.size() < FRAME_HEADER_SIZE + header.size) {
+                    break;
+                }
+                buffer_.consume(FRAME_HEADER_SIZE + header.size);
+                const auto it = pending_.find(header.request_id);
+                if (it == pending_.end()) {
+                    ++errors_;
+                    std::cerr << "unexpected response id "sv << header.request_id << std::endl;
+                    continue;
+                }
+                const auto latency = Clock::now() - it->second.intended;
+                latency_.Record(std::chrono::duration_cast<std::chrono::nanoseconds>(latency).count());
+                ++requests_;
+                if (header.status != FRAME_STATUS_OK) {
+                    ++errors_;
+                }
+                response_bytes_ += header.size;
+                const size_t slot = it->second.slot;
+                pending_.erase(it);
+                Next(slot);
+            }
+            if (closed_) {
+                return;
+            }
+            Read();
+        }
+
+        void Close() {
+            closed_ = true;
+            beast::error_code ec;
+            stream_.socket().shutdown(tcp::socket::shutdown_both, ec);
+        }
+
+    private:
+        beast::tcp_stream stream_;
+        std::vector<std::unique_ptr<net::steady_timer>> timers_;
+        beast::flat_buffer buffer_;
+        std::string write_queue_;
+        std::string write_buffer_;
+        bool writing_{false};
+        bool closed_{false};
+        Schedule& schedule_;
+        std::mt19937_64 random_;
+        uint64_t next_id_{0};
+        std::unordered_map<uint64_t, Pending> pending_;
+        size_t idle_slots_{0};
+
+        LatencyHistogram latency_;
+        uint64_t requests_{0};
+        uint64_t errors_{0};
+        uint64_t response_bytes_{0};
+    };
+
+    template <typename Connection>
+    void StartConnections(net::io_context& ioc, Schedule& schedule, std::vector<std::shared_ptr<Connection>>& connections) {
+        std::random_device random_device;
+        for (unsigned i = 0; i < std::max(1u, schedule.options.connections); ++i) {
+            connections.push_back(std::make_shared<Connection>(ioc, schedule,
+                (static_cast<uint64_t>(random_device()) << 32) | random_device()));
+            connections.back()->Start();
+        }
+    }
+
+    template <typename Connection>
+    void CollectReport(const std::vector<std::shared_ptr<Connection>>& connections, LoadReport& report) {
+        for (const auto& connection : connections) {
+            report.requests += connection->Requests();
+            report.errors += connection->Errors();
+            report.response_bytes += connection->ResponseBytes();
+            report.latency.Merge(connection->Latency());
+        }
+    }
+}
+
+LoadReport RunLoad(const LoadOptions& options) {
+    const unsigned threads = std::max(1u, options.threads);
+    net::io_context ioc(static_cast<int>(threads));
+
+    tcp::resolver resolver(ioc);
+    // начало расписания отсчитывается после построения выборки ключей, перед первыми соединениями
+    Schedule schedule{options, resolver.resolve(options.host, options.port), KeySampler(options.key_space, options.zipf), {}};
+
+    std::vector<std::shared_ptr<LoadConnection>> connections;
+    std::vector<std::shared_ptr<BinaryLoadConnection>> binary_connections;
+    schedule.start = Clock::now();
+    if (options.binary) {
+        StartConnections(ioc, schedule, binary_connections);
+    } else {
+        StartConnections(ioc, schedule, connections);
+    }
+
+    {
+        std::vector<std::jthread> workers;
+        for (unsigned i = 1; i < threads; ++i) {
+            workers.emplace_back([&ioc] {
+                ioc.run();
+            });
+        }
+        ioc.run();
+    }
+
+    LoadReport report;
+    report.seconds = std::chrono::duration<double>(Clock::now() - schedule.start).count();
+    CollectReport(connections, report);
+    CollectReport(binary_connections, report);
+    return report;
+}
+
+void PrintReport(const LoadOptions& options, const LoadReport& report) {
+    const double throughput = report.seconds > 0 ? static_cast<double>(report.requests) / report.seconds : 0.0;
+    const double bytes_per_second = report.seconds > 0 ? static_cast<double>(report.response_bytes) / report.seconds : 0.0;
+    const auto us = [](uint64_t nanoseconds) {
+        return static_cast<double>(nanoseconds) / 1000.0;
+    };
+
+    std::cout << "Mode: "sv << (options.rate > 0 ? "open loop"sv : "closed loop"sv)
+        << ", protocol "sv << (options.binary ? "binary"sv : "http"sv)
+        << ", connections "sv << options.connections
+        << ", in flight "sv << (options.binary ? options.in_flight : 1u)
+        << ", hashes per request "sv << options.hashes_per_request << '\n'
+        << "Requests: "sv << report.requests << ", errors "sv << report.errors
+        << ", time "sv << report.seconds << " s\n"sv
+        << "Throughput: "sv << throughput << " req/s, "sv << bytes_per_second / (1024 * 1024) << " MiB/s\n"sv
+        << "Latency us: p50 "sv << us(report.latency.Percentile(0.5))
+        << ", p90 "sv << us(report.latency.Percentile(0.9))
+        << ", p99 "sv << us(report.latency.Percentile(0.99))
+        << ", p999 "sv << us(report.latency.Percentile(0.999))
+        << ", max "sv << us(report.latency.Max())
+        << ", mean "sv << report.latency.Mean() / 1000.0 << std::endl;
+
+    if (options.json_path.empty()) {
+        return;
+    }
+    boost::property_tree::ptree tree;
+    tree.put("mode", options.rate > 0 ? "open"s : "closed"s);
+    tree.put("protocol", options.binary ? "binary"s : "http"s);
+    tree.put("connections", options.connections);
+    tree.put("in_flight", options.binary ? options.in_flight : 1u);
+    tree.put("rate", options.rate);
+    tree.put("hashes_per_request", options.hashes_per_request);
+    tree.put("key_space", options.key_space);
+    tree.put("zipf", options.zipf);
+    tree.put("requests", report.requests);
+    tree.put("errors", report.errors);
+    tree.put("seconds", report.seconds);
+    tree.put("throughput_rps", throughput);
+    tree.put("bytes_per_second", bytes_per_second);
+    tree.put("latency_us.p50", us(report.latency.Percentile(0.5)));
+    tree.put("latency_us.p90", us(report.latency.Percentile(0.9)));
+    tree.put("latency_us.p99", us(report.latency.Percentile(0.99)));
+    tree.put("latency_us.p999", us(report.latency.Percentile(0.999)));
+    tree.put("latency_us.max", us(report.latency.Max()));
+    tree.put("latency_us.mean", report.latency.Mean() / 1000.0);
+    try {
+        boost::property_tree::json_parser::write_json(options.json_path, tree);
+    } catch (const std::exception& e) {
+        std::cerr << "Failed to write report: "sv << e.what() << std::endl;
+    }
+}
@@ -0,0 +1,54 @@
+#pragma once
+#include <cstdint>
+#include <string>
+
+#include "latency_histogram.h"
+
+/// @brief Параметры нагрузки
+struct LoadOptions {
+    std::string host{"127.0.0.1"};
+    std::string port{"8080"};
+    std::string target{"/"};
+    // одновременные keep-alive соединения
+    unsigned connections{16};
+    // двоичный протокол с кадрами вместо HTTP; порт — порт двоичного протокола сервера
+    bool binary{false};
+    // запросов, ожидающих ответа, на соединение; больше одного — только для двоичного протокола
+    unsigned in_flight{1};
+    // потоки io_context
+    unsigned threads{1};
+    // всего запросов; 0 — ограничение только по времени
+    uint64_t requests{0};
+    // длительность теста в секундах; 0 — ограничение только по числу запросов
+    double duration{10.0};
+    // запросов в секунду по всем соединениям; 0 — замкнутый цикл: новый запрос сразу после ответа
+    double rate{0.0};
+    // токенов в запросе
+    unsigned hashes_per_request{20};
+    // число различных токенов, из которых выбираются токены запросов
+    uint64_t key_space{100000};
+    // показатель распределения Ципфа; 0 — равномерное распределение
+    double zipf{0.0};
+    // файл для отчёта в JSON, пустой — только вывод на экран
+    std::string json_path;
+};
+
+/// @brief Итоги нагрузки
+struct LoadReport {
+    uint64_t requests{0};
+    uint64_t errors{0};
+    uint64_t response_bytes{0};
+    double seconds{0.0};
+    // задержки в наносекундах; в открытом цикле — от запланированного момента отправки
+    LatencyHistogram latency;
+};
+
+/// @brief Нагрузка на сервер по заданным параметрам.
+/// В открытом цикле запросы планируются с постоянным шагом 1 / rate, и задержка
+/// отсчитывается от запланированного момента, а не от фактической отправки:
+/// так учитывается время, которое запрос ждал свободного соединения
+/// (поправка на coordinated omission).
+LoadReport RunLoad(const LoadOptions& options);
+
+/// @brief Вывод итогов на экран и, если задан options.json_path, в файл JSON
+void PrintReport(const LoadOptions& options, const LoadReport& report);
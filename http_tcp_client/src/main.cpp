@@ -9,20 +9,27 @@
 #include <boost/beast/http.hpp>
 #include <boost/beast/version.hpp>
 #include <boost/asio/strand.hpp>
-#include <boost/property_tree/ptree.hpp>
-#include <boost/property_tree/json_parser.hpp>
 #include <boost/lexical_cast.hpp>
+#include <boost/program_options.hpp>
+#include <chrono>
 #include <cstdlib>
+#include <cstring>
+#include <fstream>
 #include <functional>
 #include <iostream>
 #include <memory>
+#include <optional>
 #include <string>
 #include <random>
 #include <string_view>
+#include <vector>
 
 #include <google/protobuf/io/zero_copy_stream_impl_lite.h>
 #include <exchange.pb.h>
 
+#include "block_client.h"
+#include "load_generator.h"
+
 namespace beast = boost::beast;         // from <boost/beast.hpp>
 namespace http = beast::http;           // from <boost/beast/http.hpp>
 namespace net = boost::asio;            // from <boost/asio.hpp>
@@ -60,7 +67,7 @@ class session : public std::enable_shared_from_this<session>
     beast::tcp_stream stream_;
     beast::flat_buffer buffer_; // (Must persist between reads)
     http::request<http::string_body> req_;
-    http::response<http::string_body> res_;
+    http::response_parser<http::string_body> parser_;
 
 public:
     // Objects are constructed with a strand to
@@ -70,6 +77,8 @@ public:
         : resolver_(net::make_strand(ioc))
         , stream_(net::make_strand(ioc))
     {
+        // Ответ может содержать десятки блоков до 1 МБ, стандартного лимита в 8 МБ не хватает
+        parser_.body_limit(boost::none);
     }
 
     // Start the asynchronous operation
@@ -78,7 +87,6 @@ public:
             char const* host,
             char const* port,
             char const* target,
-            char const* body,
             int version)
     {
         // Set up an HTTP POST request message
@@ -175,7 +183,7 @@ public:
             return fail(ec, "write");
 
         // Receive the HTTP response
-        http::async_read(stream_, buffer_, res_,
+        http::async_read(stream_, buffer_, parser_,
             beast::bind_front_handler(
                 &session::on_read,
                 shared_from_this()));
@@ -192,9 +200,10 @@ public:
             return fail(ec, "read");
 
         // Write the message to standard out
+        const auto& res = parser_.get();
         Exchange::ServerToClient server_to_client;
         try {
-            if(server_to_client.ParseFromArray( res_.body().data(), res_.body().size())){
+            if(server_to_client.ParseFromArray( res.body().data(), res.body().size())){
                 std::cout << "Parse server response Ok, blocks count "sv << server_to_client.hash_and_block_size() << std::endl;
             }else{
                 std::cout << "Parse server response error"sv << std::endl;
@@ -215,25 +224,200 @@ public:
     }
 };
 
-std::string create_body()
+/// @brief Разбор параметров режима нагрузки
+/// @return параметры или std::nullopt, если нагрузку запускать не нужно
+std::optional<LoadOptions> ParseLoadOptions(int argc, char** argv)
 {
-    boost::property_tree::ptree tree;
-    tree.put("foo", "bar");
-    std::basic_stringstream<char> jsonStream;
-    boost::property_tree::json_parser::write_json(jsonStream, tree, false);
-    return jsonStream.str();
+    namespace po = boost::program_options;
+
+    LoadOptions options;
+    po::options_description desc{"Load generator options"s};
+    desc.add_options()
+        ("help,h", "produce help message")
+        ("load", "run the load generator instead of a single request")
+        ("host", po::value(&options.host)->value_name("host"s), "server host, 127.0.0.1 by default")
+        ("port", po::value(&options.port)->value_name("port"s), "server port, 8080 by default")
+        ("target", po::value(&options.target)->value_name("target"s), "request target, / by default")
+        ("connections,c", po::value(&options.connections)->value_name("count"s), "concurrent keep-alive connections, 16 by default")
+        ("binary", po::bool_switch(&options.binary), "use the length-prefixed binary protocol; --port is the server binary port")
+        ("in-flight", po::value(&options.in_flight)->value_name("count"s), "outstanding binary requests per connection, 1 by default")
+        ("threads,t", po::value(&options.threads)->value_name("count"s), "io threads, 1 by default")
+        ("requests,n", po::value(&options.requests)->value_name("count"s), "total requests, unlimited by default")
+        ("duration,d", po::value(&options.duration)->value_name("seconds"s), "test duration, 10 s by default, 0 for no limit")
+        ("rate,r", po::value(&options.rate)->value_name("rps"s), "open loop with a fixed request rate over all connections; closed loop by default")
+        ("hashes", po::value(&options.hashes_per_request)->value_name("count"s), "hashes per request, 20 by default")
+        ("keys", po::value(&options.key_space)->value_name("count"s), "number of distinct hashes, 100000 by default")
+        ("zipf", po::value(&options.zipf)->value_name("s"s), "Zipf exponent of hash popularity, uniform by default")
+        ("json", po::value(&options.json_path)->value_name("file"s), "write the report as JSON");
+
+    po::positional_options_description positional;
+    positional.add("host", 1).add("port", 1).add("target", 1);
+
+    po::variables_map vm;
+    try {
+        po::store(po::command_line_parser(argc, argv).options(desc).positional(positional).run(), vm);
+        po::notify(vm);
+    } catch (const po::error& e) {
+        std::cerr << e.what() << std::endl << desc;
+        return std::nullopt;
+    }
+    if (vm.contains("help"s)) {
+        std::cout << desc;
+        return std::nullopt;
+    }
+    if (options.in_flight > 1 && !options.binary) {
+        std::cerr << "--in-flight needs --binary: HTTP connections send one request at a time"sv << std::endl;
+        return std::nullopt;
+    }
+    if (options.requests == 0 && options.duration <= 0) {
+        std::cerr << "Either --requests or --duration must be set"sv << std::endl;
+        return std::nullopt;
+    }
+    return options;
+}
+
+/// @brief Параметры режима выборки блоков через локальный кэш
+struct FetchOptions {
+    std::string host{"127.0.0.1"};
+    std::string port{"8080"};
+    std::string target{"/"};
+    // файл с токенами по одному в строке; без него — случайные токены
+    std::string hashes_path;
+    unsigned hashes{20};
+    // сколько раз повторить выборку тех же токенов
+    unsigned rounds{2};
+    uint64_t cache_mb{256};
+    std::string spill_dir;
+    uint64_t spill_mb{1024};
+};
+
+/// @brief Разбор параметров режима выборки
+/// @return параметры или std::nullopt, если выборку запускать не нужно
+std::optional<FetchOptions> ParseFetchOptions(int argc, char** argv)
+{
+    namespace po = boost::program_options;
+
+    FetchOptions options;
+    po::options_description desc{"Fetch options"s};
+    desc.add_options()
+        ("help,h", "produce help message")
+        ("fetch", "fetch blocks through the local block cache instead of a single request")
+        ("host", po::value(&options.host)->value_name("host"s), "server host, 127.0.0.1 by default")
+        ("port", po::value(&options.port)->value_name("port"s), "server port, 8080 by default")
+        ("target", po::value(&options.target)->value_name("target"s), "request target, / by default")
+        ("hashes-file", po::value(&options.hashes_path)->value_name("file"s), "hashes to fetch, one per line")
+        ("hashes", po::value(&options.hashes)->value_name("count"s), "random hashes to fetch without --hashes-file, 20 by default")
+        ("rounds", po::value(&options.rounds)->value_name("count"s), "times to fetch the same hashes, 2 by default")
+        ("cache-mb", po::value(&options.cache_mb)->value_name("MB"s), "in-memory cache budget, 256 MB by default")
+        ("spill-dir", po::value(&options.spill_dir)->value_name("dir"s), "directory for blocks evicted from memory, kept between runs")
+        ("spill-mb", po::value(&options.spill_mb)->value_name("MB"s), "on-disk cache budget, 1024 MB by default");
+
+    po::positional_options_description positional;
+    positional.add("host", 1).add("port", 1).add("target", 1);
+
+    po::variables_map vm;
+    try {
+        po::store(po::command_line_parser(argc, argv).options(desc).positional(positional).run(), vm);
+        po::notify(vm);
+    } catch (const po::error& e) {
+        std::cerr << e.what() << std::endl << desc;
+        return std::nullopt;
+    }
+    if (vm.contains("help"s)) {
+        std::cout << desc;
+        return std::nullopt;
+    }
+    return options;
+}
+
+/// @brief Повторные выборки одних и тех же токенов: со второй блоки берутся из кэша
+bool RunFetch(const FetchOptions& options)
+{
+    std::vector<std::string> hashes;
+    if (options.hashes_path.empty()) {
+        for (unsigned i = 0; i < options.hashes; ++i) {
+            hashes.push_back(RandomString(128));
+        }
+    } else {
+        std::ifstream in(options.hashes_path);
+        if (!in) {
+            std::cerr << "Can't open "sv << options.hashes_path << std::endl;
+            return false;
+        }
+        for (std::string line; std::getline(in, line);) {
+            if (!line.empty()) {
+                hashes.push_back(std::move(line));
+            }
+        }
+    }
+
+    ClientBlockCache cache({options.cache_mb << 20, options.spill_dir, options.spill_mb << 20});
+    BlockClient client(options.host, options.port, options.target, cache);
+    try {
+        for (unsigned round = 0; round < options.rounds; ++round) {
+            const uint64_t requested = client.Stats().hashes_requested;
+            const auto start = std::chrono::steady_clock::now();
+            const auto blocks = client.Fetch(hashes);
+            const auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start);
+
+            size_t found = 0;
+            uint64_t bytes = 0;
+            for (const auto& block : blocks) {
+                found += block ? 1 : 0;
+                bytes += block.bytes.size();
+            }
+            std::cout << "Round "sv << round + 1 << ": "sv << found << "/"sv << blocks.size() << " blocks, "sv
+                << bytes << " bytes, "sv << client.Stats().hashes_requested - requested << " requested from server, "sv
+                << elapsed.count() << " ms"sv << std::endl;
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "fetch: "sv << e.what() << std::endl;
+        return false;
+    }
+
+    const auto stats = cache.Stats();
+    std::cout << "Cache: hit rate "sv << stats.HitRate() << ", hits "sv << stats.hits << " (spill "sv << stats.spill_hits
+        << "), misses "sv << stats.misses << ", evictions "sv << stats.evictions
+        << ", memory "sv << stats.memory_blocks << " blocks / "sv << stats.memory_bytes << " bytes"sv
+        << ", spill "sv << stats.spill_blocks << " blocks / "sv << stats.spill_bytes << " bytes"sv << std::endl;
+    return true;
 }
 
 int main(int argc, char** argv)
 {
+    if (argc > 1 && !std::strcmp("--fetch", argv[1]))
+    {
+        const auto options = ParseFetchOptions(argc, argv);
+        if (!options) {
+            return EXIT_FAILURE;
+        }
+        return RunFetch(*options) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    if (argc > 1 && !std::strcmp("--load", argv[1]))
+    {
+        const auto options = ParseLoadOptions(argc, argv);
+        if (!options) {
+            return EXIT_FAILURE;
+        }
+        const auto report = RunLoad(*options);
+        PrintReport(*options, report);
+        return report.errors == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
     // Check command line arguments.
     if (argc != 4 && argc != 5)
     {
         std::cerr <<
             "Usage: http-client-async <host> <port> <target> [<HTTP version: 1.0 or 1.1(default)>]\n" <<
+            "       http-client-async --load [<host> <port> <target>] [load options, see --load --help]\n" <<
+            "       http-client-async --fetch [<host> <port> <target>] [fetch options, see --fetch --help]\n" <<
             "Example:\n" <<
             "    http-client-async www.example.com 80 /\n" <<
-            "    http-client-async www.example.com 80 / 1.0\n";
+            "    http-client-async www.example.com 80 / 1.0\n" <<
+            "    http-client-async --load 127.0.0.1 8080 / -c 32 -d 30 --zipf 0.99 --json report.json\n" <<
+            "    http-client-async --load 127.0.0.1 8081 --binary --in-flight 16 -c 4 -d 30\n" <<
+            "    http-client-async --fetch 127.0.0.1 8080 / --hashes-file hashes.txt --spill-dir cache\n";
         return EXIT_FAILURE;
     }
     auto const host = argv[1];
@@ -245,7 +429,7 @@ int main(int argc, char** argv)
     net::io_context ioc;
 
     // Launch the asynchronous operation
-    std::make_shared<session>(ioc)->run(host, port, target, create_body().c_str(), version);
+    std::make_shared<session>(ioc)->run(host, port, target, version);
 
     // Run the I/O service. The call will return when
     // the get operation is complete.
@@ -0,0 +1,1068 @@
+// Микробенчмарки горячих участков сервера.
+// Результаты в JSON для сравнения сборок:
+//     server_bench --benchmark_format=json --benchmark_out=result.json
+
+#include <benchmark/benchmark.h>
+
+#include <boost/asio/connect.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/asio/read.hpp>
+#include <boost/asio/read_until.hpp>
+#include <boost/asio/write.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <future>
+#include <latch>
+#include <random>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "allocation_counter.h"
+#include "binary_server.h"
+#include "block_cache.h"
+#include "block_generator.h"
+#include "block_id.h"
+#include "block_snapshot.h"
+#include "block_store.h"
+#include "client_to_server_view.h"
+#include "compute_pool.h"
+#include "coro_session.h"
+#include "deflated_block.h"
+#include "flat_index.h"
+#include "http_server.h"
+#include "mapped_block_store.h"
+#include "metrics.h"
+#include "random_generator.h"
+#include "request_handler.h"
+#include "server_to_client_body.h"
+#include "syscall_counter.h"
+
+#include <exchange.pb.h>
+
+namespace {
+	namespace beast = boost::beast;
+	namespace http = beast::http;
+	using namespace std::literals;
+
+	/// @brief Набор различных токенов длины MAX_HASH_SIZE
+	std::vector<std::string> MakeHashes(size_t count) {
+		std::vector<std::string> hashes;
+		hashes.reserve(count);
+		for (size_t i = 0; i < count; ++i) {
+			hashes.push_back(RandomString(storage::MAX_HASH_SIZE));
+		}
+		return hashes;
+	}
+
+	/// @brief Сериализованный ClientToServer с заданными токенами
+	std::string MakeClientToServer(const std::vector<std::string>& hashes) {
+		Exchange::ClientToServer client_to_server;
+		for (const auto& hash : hashes) {
+			client_to_server.add_hashes(hash);
+		}
+		return client_to_server.SerializeAsString();
+	}
+
+	/// @brief Источник блоков одного размера без генерации: один общий блок на все токены.
+	/// Позволяет мерить накладные расходы кэша и сборки ответа отдельно от генерации.
+	class FixedBlockSource : public storage::BlockSource {
+	public:
+		explicit FixedBlockSource(size_t block_size) :
+			block_(storage::MakeBlockData(std::string(block_size, 'x'))) {
+		}
+
+		storage::BlockRecord GetBlock(std::string_view) override {
+			return {0, block_.size(), block_};
+		}
+
+	private:
+		storage::BlockData block_;
+	};
+
+	/// @brief Номера токенов по закону Ципфа с показателем s
+	std::vector<size_t> ZipfTrace(size_t key_space, double s, size_t length) {
+		std::vector<double> cdf(key_space);
+		double sum = 0.0;
+		for (size_t k = 0; k < key_space; ++k) {
+			sum += 1.0 / std::pow(static_cast<double>(k + 1), s);
+			cdf[k] = sum;
+		}
+		std::mt19937_64 random(42);
+		std::uniform_real_distribution<double> uniform(0.0, sum);
+		std::vector<size_t> trace(length);
+		for (auto& key : trace) {
+			key = std::min<size_t>(std::lower_bound(cdf.begin(), cdf.end(), uniform(random)) - cdf.begin(), key_space - 1);
+		}
+		return trace;
+	}
+
+	// --- генерация ---
+
+	void BM_RandomString(benchmark::State& state) {
+		const auto length = static_cast<size_t>(state.range(0));
+		for (auto _ : state) {
+			benchmark::DoNotOptimize(RandomString(length));
+		}
+		state.SetBytesProcessed(state.iterations() * length);
+	}
+	BENCHMARK(BM_RandomString)->RangeMultiplier(8)->Range(128, 1 << 20);
+
+	void BM_FillAlphabet(benchmark::State& state) {
+		const auto length = static_cast<size_t>(state.range(0));
+		std::string buffer(length, '\0');
+		generator::WyRand random(1);
+		for (auto _ : state) {
+			generator::FillAlphabet(buffer.data(), length, random);
+			benchmark::ClobberMemory();
+		}
+		state.SetBytesProcessed(state.iterations() * length);
+		state.SetLabel(std::string(generator::ActiveKernel()));
+	}
+	BENCHMARK(BM_FillAlphabet)->RangeMultiplier(8)->Range(128, 1 << 20);
+
+	// --- хранилище блоков ---
+
+	void BM_GetBlockNumber(benchmark::State& state) {
+		storage::BlockStore store;
+		const auto hashes = MakeHashes(static_cast<size_t>(state.range(0)));
+		for (const auto& hash : hashes) {
+			store.GetBlockNumber(hash);
+		}
+		size_t i = 0;
+		for (auto _ : state) {
+			benchmark::DoNotOptimize(store.GetBlockNumber(hashes[i++ % hashes.size()]));
+		}
+	}
+	BENCHMARK(BM_GetBlockNumber)->Arg(1 << 10)->Arg(1 << 16)->Arg(1 << 20);
+
+	void BM_GetBlockSize(benchmark::State& state) {
+		storage::BlockStore store;
+		const auto hashes = MakeHashes(static_cast<size_t>(state.range(0)));
+		for (const auto& hash : hashes) {
+			store.GetBlockSize(hash);
+		}
+		size_t i = 0;
+		for (auto _ : state) {
+			benchmark::DoNotOptimize(store.GetBlockSize(hashes[i++ % hashes.size()]));
+		}
+	}
+	BENCHMARK(BM_GetBlockSize)->Arg(1 << 10)->Arg(1 << 16)->Arg(1 << 20);
+
+	void BM_GetBlockNumberContended(benchmark::State& state) {
+		static storage::BlockStore store;
+		static const auto hashes = MakeHashes(1 << 16);
+		size_t i = static_cast<size_t>(state.thread_index()) * 7919;
+		for (auto _ : state) {
+			benchmark::DoNotOptimize(store.GetBlockNumber(hashes[i++ % hashes.size()]));
+		}
+	}
+	BENCHMARK(BM_GetBlockNumberContended)->ThreadRange(1, 8)->UseRealTime();
+
+	void BM_GetBlockData(benchmark::State& state) {
+		storage::BlockStore store(state.range(0) ? storage::BlockOrigin::FROM_HASH : storage::BlockOrigin::RANDOM);
+		const auto hashes = MakeHashes(64);
+		std::string buffer(storage::MAX_BLOCK_SIZE, '\0');
+		size_t i = 0;
+		uint64_t bytes = 0;
+		for (auto _ : state) {
+			bytes += store.GetBlockData(hashes[i++ % hashes.size()], buffer.data(), buffer.size());
+			benchmark::ClobberMemory();
+		}
+		state.SetBytesProcessed(bytes);
+		state.SetLabel(state.range(0) ? "from_hash"s : "random"s);
+	}
+	BENCHMARK(BM_GetBlockData)->Arg(0)->Arg(1);
+
+	// --- индекс токенов ---
+
+	void BM_FlatIndexFind(benchmark::State& state) {
+		const auto hashes = MakeHashes(static_cast<size_t>(state.range(0)));
+		storage::FlatIndex<storage::BlockId, uint64_t> index;
+		std::vector<storage::BlockId> ids;
+		for (size_t i = 0; i < hashes.size(); ++i) {
+			ids.push_back(*storage::BlockId::FromHash(hashes[i]));
+			index.TryEmplace(ids.back(), i);
+		}
+		size_t i = 0;
+		for (auto _ : state) {
+			benchmark::DoNotOptimize(index.Find(ids[i++ % ids.size()]));
+		}
+		state.counters["bytes_per_key"] = static_cast<double>(index.MemoryUsage()) / static_cast<double>(index.Size());
+	}
+	BENCHMARK(BM_FlatIndexFind)->Arg(1 << 10)->Arg(1 << 16)->Arg(1 << 20);
+
+	void BM_UnorderedMapFind(benchmark::State& state) {
+		const auto hashes = MakeHashes(static_cast<size_t>(state.range(0)));
+		std::unordered_map<std::string, uint64_t> index;
+		for (size_t i = 0; i < hashes.size(); ++i) {
+			index.emplace(hashes[i], i);
+		}
+		size_t i = 0;
+		for (auto _ : state) {
+			benchmark::DoNotOptimize(index.find(hashes[i++ % hashes.size()]));
+		}
+	}
+	BENCHMARK(BM_UnorderedMapFind)->Arg(1 << 10)->Arg(1 << 16)->Arg(1 << 20);
+
+	// --- кэш блоков ---
+
+	/// @brief Повтор трассы обращений по закону Ципфа через BlockCache.
+	/// Аргументы: объём кэша в процентах от всех блоков, показатель Ципфа * 100.
+	void BM_BlockCacheZipf(benchmark::State& state) {
+		constexpr size_t KEY_SPACE{1 << 16};
+		constexpr size_t BLOCK_SIZE{4096};
+		FixedBlockSource upstream(BLOCK_SIZE);
+		// стоимость записи в кэше: блок, токен и служебные данные
+		const uint64_t capacity = KEY_SPACE * (BLOCK_SIZE + storage::MAX_HASH_SIZE + 128) * state.range(0) / 100;
+		storage::BlockCache cache(upstream, capacity);
+		const auto hashes = MakeHashes(KEY_SPACE);
+		const auto trace = ZipfTrace(KEY_SPACE, static_cast<double>(state.range(1)) / 100.0, 1 << 20);
+		size_t i = 0;
+		for (auto _ : state) {
+			benchmark::DoNotOptimize(cache.GetBlock(hashes[trace[i++ % trace.size()]]));
+		}
+		const auto stats = cache.Stats();
+		state.counters["hit_ratio"] = static_cast<double>(stats.hits) / static_cast<double>(stats.hits + stats.misses);
+	}
+	BENCHMARK(BM_BlockCacheZipf)->ArgsProduct({{1, 10, 50}, {60, 99, 120}});
+
+	/// @brief Источник, генерирующий блок по токену, со счётчиком обращений
+	class CountingBlockSource : public storage::BlockSource {
+	public:
+		storage::BlockRecord GetBlock(std::string_view hash) override {
+			calls_.fetch_add(1, std::memory_order_relaxed);
+			return store_.GetBlock(hash);
+		}
+
+		uint64_t Calls() const {
+			return calls_.load(std::memory_order_relaxed);
+		}
+
+	private:
+		storage::BlockStore store_{storage::BlockOrigin::FROM_HASH};
+		std::atomic<uint64_t> calls_{0};
+	};
+
+	/// @brief N одновременных одинаковых запросов к блоку, которого нет в кэше:
+	/// блок должен материализоваться ровно один раз, остальные запросы ждут его без блокировки.
+	/// Аргумент: число запросов. Счётчики на итерацию: materializations и coalesced.
+	void BM_SingleFlight(benchmark::State& state) {
+		const auto requests = static_cast<size_t>(state.range(0));
+		CountingBlockSource upstream;
+		storage::BlockCache cache(upstream, 1ull << 30);
+		const auto hashes = MakeHashes(1 << 16);
+		size_t next_hash = 0;
+		for (auto _ : state) {
+			auto client_to_server = std::make_shared<http_server::ClientToServerView>();
+			client_to_server->Parse(MakeClientToServer({hashes[next_hash++ % hashes.size()]}));
+			const uint64_t calls = upstream.Calls();
+
+			std::latch start(static_cast<std::ptrdiff_t>(requests));
+			std::latch done(static_cast<std::ptrdiff_t>(requests));
+			std::atomic<size_t> failed{0};
+			std::vector<std::thread> threads;
+			threads.reserve(requests);
+			for (size_t i = 0; i < requests; ++i) {
+				threads.emplace_back([&] {
+					start.arrive_and_wait();
+					http_server::GetServerResponseAsync(cache, client_to_server, http_server::ContentEncoding::IDENTITY, nullptr,
+						[&](std::optional<http_server::ServerToClientBody::value_type>&& result) {
+							if (!result || result->Size() == 0) {
+								failed.fetch_add(1, std::memory_order_relaxed);
+							}
+							done.count_down();
+						});
+				});
+			}
+			done.wait();
+			for (auto& thread : threads) {
+				thread.join();
+			}
+			if (failed != 0 || upstream.Calls() - calls != 1) {
+				state.SkipWithError("block materialized more than once or response failed");
+				break;
+			}
+		}
+		const auto stats = cache.Stats();
+		state.counters["materializations"] = benchmark::Counter(static_cast<double>(stats.materializations), benchmark::Counter::kAvgIterations);
+		state.counters["coalesced"] = benchmark::Counter(static_cast<double>(stats.coalesced), benchmark::Counter::kAvgIterations);
+	}
+	BENCHMARK(BM_SingleFlight)->Arg(8)->Arg(64)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+	// --- хранилище на диске ---
+
+	/// @brief Поиск блока и чтение его байтов: хранилище на диске через отображение в память
+	/// против блоков в памяти. Аргументы: число блоков по 4 КБ; источник: 0 — MappedBlockStore
+	/// (page cache прогрет), 1 — тёплый BlockCache, 2 — std::unordered_map токенов и блоков.
+	void BM_MappedBlockStore(benchmark::State& state) {
+		constexpr size_t BLOCK_SIZE{4096};
+		const auto count = static_cast<size_t>(state.range(0));
+		const auto hashes = MakeHashes(count);
+		const std::string block(BLOCK_SIZE, 'x');
+
+		const auto directory = std::filesystem::temp_directory_path() / "server_bench_mapped";
+		std::filesystem::remove_all(directory);
+		std::optional<storage::MappedBlockStore> mapped;
+		FixedBlockSource upstream(BLOCK_SIZE);
+		std::optional<storage::BlockCache> cache;
+		std::unordered_map<std::string, storage::BlockData> map;
+		storage::BlockSource* source = nullptr;
+		switch (state.range(1)) {
+		case 0: {
+			{
+				storage::BlockSegmentWriter writer(directory);
+				for (size_t i = 0; i < count; ++i) {
+					writer.Append(hashes[i], static_cast<uint32_t>(i), block);
+				}
+			}
+			storage::MappedBlockStore::BuildIndex(directory);
+			source = &mapped.emplace(directory);
+			state.SetLabel("mapped"s);
+			break;
+		}
+		case 1:
+			source = &cache.emplace(upstream, 1ull << 30);
+			state.SetLabel("block_cache"s);
+			break;
+		default:
+			for (const auto& hash : hashes) {
+				map.emplace(hash, storage::MakeBlockData(block));
+			}
+			state.SetLabel("unordered_map"s);
+			break;
+		}
+
+		const auto lookup = [&](const std::string& hash) {
+			if (source) {
+				return source->GetBlock(hash).data;
+			}
+			return map.find(hash)->second;
+		};
+		// прогрев: page cache для отображения, записи для кэша
+		for (const auto& hash : hashes) {
+			lookup(hash);
+		}
+		std::mt19937_64 random(1);
+		uint64_t checksum = 0;
+		for (auto _ : state) {
+			const auto data = lookup(hashes[random() % count]);
+			checksum += static_cast<unsigned char>(data.bytes[data.size() / 2]);
+		}
+		benchmark::DoNotOptimize(checksum);
+		state.SetBytesProcessed(state.iterations() * BLOCK_SIZE);
+		mapped.reset();
+		std::filesystem::remove_all(directory);
+	}
+	BENCHMARK(BM_MappedBlockStore)->ArgNames({"blocks", "source"})->ArgsProduct({{1 << 10, 1 << 16}, {0, 1, 2}});
+
+	// --- снимок хранилища ---
+
+	/// @brief Снимок хранилища в памяти объёмом state.range(0) ГБ и тёплый перезапуск из него.
+	/// Время итерации — открытие снимка (отображение и загрузка индекса) с холодным page cache,
+	/// то есть время до начала обслуживания. Счётчики: snapshot_GBps — запись снимка,
+	/// restore_GBps — чтение всех блоков через отображение после открытия.
+	void BM_SnapshotRestore(benchmark::State& state) {
+		const uint64_t target_bytes = static_cast<uint64_t>(state.range(0)) << 30;
+		const auto directory = std::filesystem::temp_directory_path() / "server_bench_snapshot";
+		std::filesystem::remove_all(directory);
+
+		storage::BlockStore store(storage::BlockOrigin::RANDOM);
+		storage::BlockCache cache(store, 64ull << 20);
+		std::vector<std::string> hashes;
+		for (uint64_t bytes = 0; bytes < target_bytes;) {
+			hashes.push_back(RandomString(storage::MAX_HASH_SIZE));
+			bytes += store.GetBlockSize(hashes.back());
+		}
+		const auto write_start = std::chrono::steady_clock::now();
+		const auto stats = storage::BlockSnapshot(directory, store, cache).Write();
+		const std::chrono::duration<double> write_time = std::chrono::steady_clock::now() - write_start;
+
+		// снимок вытесняется из page cache перед каждым перезапуском
+		const auto drop_cache = [&directory] {
+			for (const auto name : {storage::SEGMENT_FILE_NAME, storage::INDEX_FILE_NAME}) {
+				const int fd = ::open((directory / name).c_str(), O_RDONLY);
+				::posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+				::close(fd);
+			}
+		};
+		double read_seconds = 0;
+		uint64_t read_bytes = 0;
+		for (auto _ : state) {
+			drop_cache();
+			const auto open_start = std::chrono::steady_clock::now();
+			storage::MappedBlockStore restored(directory);
+			benchmark::DoNotOptimize(restored.Find(hashes.front()));
+			const auto opened = std::chrono::steady_clock::now();
+			state.SetIterationTime(std::chrono::duration<double>(opened - open_start).count());
+
+			uint64_t checksum = 0;
+			for (const auto& hash : hashes) {
+				const auto record = restored.Find(hash);
+				if (!record) {
+					state.SkipWithError("block is missing from the snapshot");
+					break;
+				}
+				for (size_t offset = 0; offset < record->data.size(); offset += 4096) {
+					checksum += static_cast<unsigned char>(record->data.bytes[offset]);
+				}
+				read_bytes += record->data.size();
+			}
+			benchmark::DoNotOptimize(checksum);
+			read_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - opened).count();
+		}
+		state.counters["blocks"] = static_cast<double>(stats.total_blocks);
+		state.counters["snapshot_GBps"] = static_cast<double>(stats.bytes) / 1e9 / write_time.count();
+		state.counters["restore_GBps"] = static_cast<double>(read_bytes) / 1e9 / read_seconds;
+		std::filesystem::remove_all(directory);
+	}
+	BENCHMARK(BM_SnapshotRestore)->Arg(1)->Arg(10)->Iterations(3)->UseManualTime()->Unit(benchmark::kMillisecond);
+
+	// --- разбор запроса ---
+
+	void BM_ClientToServerParseFromArray(benchmark::State& state) {
+		const auto body = MakeClientToServer(MakeHashes(static_cast<size_t>(state.range(0))));
+		for (auto _ : state) {
+			Exchange::ClientToServer client_to_server;
+			benchmark::DoNotOptimize(client_to_server.ParseFromArray(body.data(), static_cast<int>(body.size())));
+		}
+		state.SetBytesProcessed(state.iterations() * body.size());
+	}
+	BENCHMARK(BM_ClientToServerParseFromArray)->RangeMultiplier(8)->Range(1, 512);
+
+	void BM_ClientToServerViewParse(benchmark::State& state) {
+		const auto body = MakeClientToServer(MakeHashes(static_cast<size_t>(state.range(0))));
+		for (auto _ : state) {
+			http_server::ClientToServerView client_to_server;
+			benchmark::DoNotOptimize(client_to_server.Parse(std::string(body)));
+		}
+		state.SetBytesProcessed(state.iterations() * body.size());
+	}
+	BENCHMARK(BM_ClientToServerViewParse)->RangeMultiplier(8)->Range(1, 512);
+
+	// --- сборка ответа ---
+
+	/// @brief Сериализация ServerToClient средствами protobuf: копирование каждого блока.
+	/// Аргументы: число токенов, размер блока.
+	void BM_ServerToClientSerializeProtobuf(benchmark::State& state) {
+		const auto hashes = MakeHashes(static_cast<size_t>(state.range(0)));
+		const std::string block(static_cast<size_t>(state.range(1)), 'x');
+		for (auto _ : state) {
+			Exchange::ServerToClient server_to_client;
+			for (const auto& hash : hashes) {
+				auto* hash_and_block = server_to_client.add_hash_and_block();
+				hash_and_block->set_hash(hash);
+				hash_and_block->set_block(block);
+			}
+			benchmark::DoNotOptimize(server_to_client.SerializeAsString());
+		}
+		state.SetBytesProcessed(state.iterations() * hashes.size() * block.size());
+	}
+	BENCHMARK(BM_ServerToClientSerializeProtobuf)->ArgsProduct({{1, 16, 128}, {1 << 10, 1 << 16, 1 << 20}});
+
+	/// @brief Сборка тела ServerToClientBody и его буферов для writev: блоки не копируются
+	void BM_ServerToClientBody(benchmark::State& state) {
+		const auto hashes = MakeHashes(static_cast<size_t>(state.range(0)));
+		const auto block = storage::MakeBlockData(std::string(static_cast<size_t>(state.range(1)), 'x'));
+		for (auto _ : state) {
+			http_server::ServerToClientBody::value_type body;
+			body.Reserve(hashes.size(), storage::MAX_HASH_SIZE);
+			for (const auto& hash : hashes) {
+				body.Add(hash, block);
+			}
+			http::response<http_server::ServerToClientBody> response;
+			http_server::ServerToClientBody::writer writer(response.base(), body);
+			beast::error_code ec;
+			writer.init(ec);
+			benchmark::DoNotOptimize(writer.get(ec));
+		}
+		state.SetBytesProcessed(state.iterations() * hashes.size() * block.size());
+	}
+	BENCHMARK(BM_ServerToClientBody)->ArgsProduct({{1, 16, 128}, {1 << 10, 1 << 16, 1 << 20}});
+
+	/// @brief Сборка ответа из блоков кэша: с заголовками записей HashAndBlock,
+	/// закодированными заранее (cached:1), и с кодированием заголовков в каждом запросе (cached:0).
+	/// До замера ответ сверяется побайтно с сериализацией Exchange::ServerToClient средствами protobuf.
+	/// Аргументы: число токенов, размер блока, готовые заголовки.
+	void BM_ServerToClientFragments(benchmark::State& state) {
+		FixedBlockSource upstream(static_cast<size_t>(state.range(1)));
+		storage::BlockCache cache(upstream, 1ull << 30);
+		const auto hashes = MakeHashes(static_cast<size_t>(state.range(0)));
+		std::vector<storage::BlockData> blocks;
+		for (const auto& hash : hashes) {
+			blocks.push_back(cache.GetBlock(hash).data);
+			if (state.range(2) == 0) {
+				blocks.back().wire_head = {};
+			}
+		}
+		const auto build = [&] {
+			http_server::ServerToClientBody::value_type body;
+			body.Reserve(hashes.size(), storage::MAX_HASH_SIZE);
+			for (size_t i = 0; i < hashes.size(); ++i) {
+				body.Add(hashes[i], blocks[i]);
+			}
+			return body;
+		};
+
+		Exchange::ServerToClient expected;
+		for (size_t i = 0; i < hashes.size(); ++i) {
+			auto* hash_and_block = expected.add_hash_and_block();
+			hash_and_block->set_hash(hashes[i]);
+			hash_and_block->set_block(std::string(blocks[i].bytes));
+		}
+		if (build().Serialize() != expected.SerializeAsString()) {
+			return state.SkipWithError("response differs from protobuf serialization");
+		}
+
+		for (auto _ : state) {
+			const auto body = build();
+			http::response<http_server::ServerToClientBody> response;
+			http_server::ServerToClientBody::writer writer(response.base(), body);
+			beast::error_code ec;
+			writer.init(ec);
+			benchmark::DoNotOptimize(writer.get(ec));
+		}
+		state.SetItemsProcessed(state.iterations() * hashes.size());
+		state.SetBytesProcessed(state.iterations() * build().Size());
+	}
+	BENCHMARK(BM_ServerToClientFragments)
+		->ArgNames({"hashes", "block", "cached"})
+		->ArgsProduct({{16, 128, 512}, {1 << 10, 1 << 16}, {0, 1}});
+
+	/// @brief Ответ на запрос из тёплого кэша: разбор запроса и сборка тела.
+	/// Счётчик allocs — выделения памяти на запрос.
+	void BM_GetServerResponse(benchmark::State& state) {
+		FixedBlockSource upstream(1 << 16);
+		storage::BlockCache cache(upstream, 1ull << 30);
+		const auto body = MakeClientToServer(MakeHashes(static_cast<size_t>(state.range(0))));
+		uint64_t allocations = 0;
+		for (auto _ : state) {
+			const uint64_t before = http_server::ThreadAllocationCount();
+			http_server::ClientToServerView client_to_server;
+			client_to_server.Parse(std::string(body));
+			http_server::ServerToClientBody::value_type server_to_client;
+			http_server::GetServerResponse(cache, client_to_server, server_to_client);
+			benchmark::DoNotOptimize(server_to_client.Size());
+			allocations += http_server::ThreadAllocationCount() - before;
+		}
+		state.counters["allocs"] = benchmark::Counter(static_cast<double>(allocations), benchmark::Counter::kAvgIterations);
+	}
+	BENCHMARK(BM_GetServerResponse)->RangeMultiplier(8)->Range(1, 512);
+
+	/// @brief Задержка сборки ответа с генерацией блоков без кэша: последовательно
+	/// и в пуле вычислений. Аргументы: число токенов, потоки пула (0 — последовательно).
+	void BM_GetServerResponseGenerated(benchmark::State& state) {
+		storage::BlockStore store(storage::BlockOrigin::FROM_HASH);
+		const auto hashes = MakeHashes(static_cast<size_t>(state.range(0)));
+		std::optional<http_server::ComputePool> pool;
+		if (state.range(1) > 0) {
+			pool.emplace(static_cast<unsigned>(state.range(1)));
+		}
+		const auto body = MakeClientToServer(hashes);
+		for (auto _ : state) {
+			auto client_to_server = std::make_shared<http_server::ClientToServerView>();
+			client_to_server->Parse(std::string(body));
+			if (!pool) {
+				http_server::ServerToClientBody::value_type server_to_client;
+				http_server::GetServerResponse(store, *client_to_server, server_to_client);
+				benchmark::DoNotOptimize(server_to_client.Size());
+				continue;
+			}
+			std::promise<uint64_t> done;
+			http_server::GetServerResponseParallel(*pool, store, client_to_server, http_server::ContentEncoding::IDENTITY,
+				[&done](std::optional<http_server::ServerToClientBody::value_type>&& result) {
+					done.set_value(result ? result->Size() : 0);
+				});
+			benchmark::DoNotOptimize(done.get_future().get());
+		}
+	}
+	BENCHMARK(BM_GetServerResponseGenerated)
+		->ArgsProduct({{8, 64, 256}, {0, 2, 4, 8}})
+		->Unit(benchmark::kMillisecond)
+		->UseRealTime();
+
+	// --- метрики ---
+
+	/// @brief Увеличение счётчика. Потоки пишут каждый в свою копию,
+	/// поэтому время на вызов не должно расти с числом потоков.
+	void BM_MetricsAdd(benchmark::State& state) {
+		for (auto _ : state) {
+			metrics::Add(metrics::Counter::BYTES_WRITTEN, 128);
+		}
+		state.SetItemsProcessed(state.iterations());
+	}
+	BENCHMARK(BM_MetricsAdd)->ThreadRange(1, 4);
+
+	/// @brief Замер этапа: два чтения часов и запись в гистограмму потока
+	void BM_MetricsObserve(benchmark::State& state) {
+		for (auto _ : state) {
+			metrics::ScopedTimer timer(metrics::Stage::PARSE);
+		}
+		state.SetItemsProcessed(state.iterations());
+	}
+	BENCHMARK(BM_MetricsObserve)->ThreadRange(1, 4);
+
+	/// @brief Все вызовы метрик одного HTTP-запроса на пути Session и HandleRequest:
+	/// пять замеров этапов (read, parse, blocks, serialize, write) и шесть счётчиков.
+	/// Накладные расходы — это время против BM_GetServerResponse того же прогона.
+	void BM_RequestMetrics(benchmark::State& state) {
+		const auto stage = [](metrics::Stage stage) {
+			metrics::ScopedTimer timer(stage);
+		};
+		for (auto _ : state) {
+			stage(metrics::Stage::READ);
+			metrics::Add(metrics::Counter::BYTES_READ, 2048);
+			metrics::Add(metrics::Counter::REQUESTS);
+			stage(metrics::Stage::PARSE);
+			metrics::Add(metrics::Counter::HASHES, 16);
+			stage(metrics::Stage::BLOCKS);
+			stage(metrics::Stage::SERIALIZE);
+			metrics::Add(metrics::Counter::ALLOCATIONS, 12);
+			stage(metrics::Stage::WRITE);
+			metrics::Add(metrics::Counter::BYTES_WRITTEN, 65536);
+			metrics::Add(metrics::Counter::RESPONSES);
+		}
+		state.SetItemsProcessed(state.iterations());
+	}
+	BENCHMARK(BM_RequestMetrics);
+
+	/// @brief Сведение метрик всех потоков в текст Prometheus: цена запроса /metrics
+	void BM_MetricsRender(benchmark::State& state) {
+		for (auto _ : state) {
+			benchmark::DoNotOptimize(metrics::RenderPrometheus());
+		}
+	}
+	BENCHMARK(BM_MetricsRender);
+
+	// --- сжатие ---
+
+	/// @brief Однократное сжатие блока из алфавита токенов: степень сжатия
+	/// и процессорное время на гигабайт исходных данных. Аргументы: размер блока, уровень zlib.
+	void BM_DeflateBlock(benchmark::State& state) {
+		const auto size = static_cast<size_t>(state.range(0));
+		std::string block(size, '\0');
+		generator::WyRand random(7);
+		generator::FillAlphabet(block.data(), size, random);
+		uint64_t deflated_size = 0;
+		for (auto _ : state) {
+			const auto deflated = storage::DeflateBlock(block, static_cast<int>(state.range(1)));
+			deflated_size = deflated->bytes.size();
+		}
+		state.SetBytesProcessed(state.iterations() * size);
+		state.counters["ratio"] = static_cast<double>(size) / static_cast<double>(deflated_size);
+		state.counters["cpu_s_per_GB"] = benchmark::Counter(static_cast<double>(state.iterations() * size) / 1e9,
+			benchmark::Counter::kIsRate | benchmark::Counter::kInvert);
+	}
+	BENCHMARK(BM_DeflateBlock)->ArgsProduct({{1 << 12, 1 << 16, 1 << 20}, {1, 6, 9}});
+
+	/// @brief Сжатый gzip ответ из тёплого кэша: заголовки записей несжатыми блоками deflate,
+	/// блоки — их сжатыми формами из кэша. Аргумент: число токенов.
+	void BM_GzipResponseCached(benchmark::State& state) {
+		storage::BlockStore store(storage::BlockOrigin::FROM_HASH);
+		storage::BlockCache cache(store, 1ull << 30);
+		http_server::ClientToServerView client_to_server;
+		client_to_server.Parse(MakeClientToServer(MakeHashes(static_cast<size_t>(state.range(0)))));
+		uint64_t raw_size = 0;
+		{
+			http_server::ServerToClientBody::value_type raw;
+			http_server::GetServerResponse(cache, client_to_server, raw);
+			raw_size = raw.Size();
+			// сжатые формы блоков вычисляются до замера
+			http_server::ServerToClientBody::value_type warm(http_server::ContentEncoding::GZIP);
+			http_server::GetServerResponse(cache, client_to_server, warm);
+		}
+		uint64_t gzip_size = 0;
+		for (auto _ : state) {
+			http_server::ServerToClientBody::value_type server_to_client(http_server::ContentEncoding::GZIP);
+			http_server::GetServerResponse(cache, client_to_server, server_to_client);
+			gzip_size = server_to_client.Size();
+		}
+		state.SetBytesProcessed(state.iterations() * raw_size);
+		state.counters["ratio"] = static_cast<double>(raw_size) / static_cast<double>(gzip_size);
+		state.counters["cpu_s_per_GB"] = benchmark::Counter(static_cast<double>(state.iterations() * raw_size) / 1e9,
+			benchmark::Counter::kIsRate | benchmark::Counter::kInvert);
+	}
+	BENCHMARK(BM_GzipResponseCached)->RangeMultiplier(8)->Range(1, 64);
+
+	/// @brief Для сравнения: сжатие всего сериализованного ответа на каждый запрос
+	void BM_GzipResponseRecompress(benchmark::State& state) {
+		storage::BlockStore store(storage::BlockOrigin::FROM_HASH);
+		storage::BlockCache cache(store, 1ull << 30);
+		http_server::ClientToServerView client_to_server;
+		client_to_server.Parse(MakeClientToServer(MakeHashes(static_cast<size_t>(state.range(0)))));
+		uint64_t raw_size = 0;
+		uint64_t gzip_size = 0;
+		for (auto _ : state) {
+			http_server::ServerToClientBody::value_type raw;
+			http_server::GetServerResponse(cache, client_to_server, raw);
+			const std::string serialized = raw.Serialize();
+			raw_size = serialized.size();
+			gzip_size = storage::DeflateBlock(serialized)->bytes.size();
+		}
+		state.SetBytesProcessed(state.iterations() * raw_size);
+		state.counters["ratio"] = static_cast<double>(raw_size) / static_cast<double>(gzip_size);
+		state.counters["cpu_s_per_GB"] = benchmark::Counter(static_cast<double>(state.iterations() * raw_size) / 1e9,
+			benchmark::Counter::kIsRate | benchmark::Counter::kInvert);
+	}
+	BENCHMARK(BM_GzipResponseRecompress)->RangeMultiplier(8)->Range(1, 64)->Unit(benchmark::kMillisecond);
+
+	void BM_MakeStringResponse(benchmark::State& state) {
+		const std::string body(static_cast<size_t>(state.range(0)), 'x');
+		for (auto _ : state) {
+			benchmark::DoNotOptimize(http_server::MakeStringResponse(http::status::ok, body, 11, true, http::verb::get));
+		}
+	}
+	BENCHMARK(BM_MakeStringResponse)->RangeMultiplier(16)->Range(16, 1 << 16);
+
+	// --- конвейерная обработка запросов ---
+
+	/// @brief Число выделений памяти в потоке, обслуживающем io_context
+	uint64_t ContextAllocationCount(boost::asio::io_context& ioc) {
+		std::promise<uint64_t> count;
+		boost::asio::post(ioc, [&count] {
+			count.set_value(http_server::ThreadAllocationCount());
+		});
+		return count.get_future().get();
+	}
+
+	/// @brief Число системных вызовов ввода-вывода в потоке, обслуживающем io_context
+	uint64_t ContextSyscallCount(boost::asio::io_context& ioc) {
+		std::promise<uint64_t> count;
+		boost::asio::post(ioc, [&count] {
+			count.set_value(bench::ThreadSyscallCount());
+		});
+		return count.get_future().get();
+	}
+
+	/// @brief Запросов в секунду на одном соединении при глубине конвейера state.range(0):
+	/// клиент отправляет пачку запросов одной записью и читает все ответы.
+	/// Сервер отвечает коротким текстом, чтобы мерить сессию, а не хранилище.
+	/// state.range(1): 0 — Session на обработчиках, 1 — CoroSession на сопрограммах.
+	/// Счётчики allocs и syscalls — выделения памяти и системные вызовы в потоке сервера на запрос.
+	void BM_Pipelining(benchmark::State& state) {
+		constexpr unsigned short PORT{18080};
+		namespace net = boost::asio;
+		using tcp = net::ip::tcp;
+
+		net::io_context server_ioc(1);
+		const auto handler = [](auto&& req, auto&& send) {
+			send(http_server::MakeStringResponse(http::status::ok, "ok"sv, req.version(), req.keep_alive(), req.method()));
+		};
+		const tcp::endpoint endpoint{net::ip::make_address("127.0.0.1"), PORT};
+		if (state.range(1) == 0) {
+			http_server::ServerHttp(server_ioc, endpoint, handler);
+		} else {
+			http_server::ServerHttp<http_server::CoroSession>(server_ioc, endpoint, handler);
+		}
+		std::jthread server_thread([&server_ioc] {
+			server_ioc.run();
+		});
+
+		net::io_context client_ioc;
+		tcp::socket socket(client_ioc);
+		net::connect(socket, std::vector{tcp::endpoint{net::ip::make_address("127.0.0.1"), PORT}});
+
+		const auto depth = static_cast<size_t>(state.range(0));
+		std::string batch;
+		for (size_t i = 0; i < depth; ++i) {
+			batch += "GET / HTTP/1.1\r\nHost: bench\r\nContent-Length: 0\r\n\r\n"s;
+		}
+		// ответ фиксированной длины: заголовки и тело "ok"
+		constexpr std::string_view RESPONSE_END = "\r\n\r\nok"sv;
+		std::string buffer;
+		// первая пачка до замера: соединение принято, буферы сессии выделены
+		const auto exchange = [&] {
+			net::write(socket, net::buffer(batch));
+			size_t received = 0;
+			while (received < depth) {
+				const size_t size = net::read_until(socket, net::dynamic_buffer(buffer), RESPONSE_END);
+				buffer.erase(0, size);
+				++received;
+			}
+		};
+		exchange();
+		const uint64_t allocations = ContextAllocationCount(server_ioc);
+		const uint64_t syscalls = ContextSyscallCount(server_ioc);
+		for (auto _ : state) {
+			exchange();
+		}
+		state.SetItemsProcessed(state.iterations() * depth);
+		state.counters["allocs"] = static_cast<double>(ContextAllocationCount(server_ioc) - allocations)
+			/ static_cast<double>(state.iterations() * depth);
+		state.counters["syscalls"] = static_cast<double>(ContextSyscallCount(server_ioc) - syscalls)
+			/ static_cast<double>(state.iterations() * depth);
+
+		socket.close();
+		server_ioc.stop();
+	}
+	BENCHMARK(BM_Pipelining)->ArgNames({"depth", "coro"})->ArgsProduct({{1, 8, 32}, {0, 1}})->UseRealTime();
+
+	/// @brief Ввод-вывод сессий через epoll и через io_uring: state.range(0) соединений,
+	/// клиент отправляет по запросу в каждое и читает все ответы, так что сервер
+	/// обслуживает соединения одновременно. state.range(1): 0 — Session на epoll,
+	/// 1 — UringSession. Счётчик syscalls — системные вызовы в потоке сервера на запрос.
+	void BM_SessionIo(benchmark::State& state) {
+		constexpr unsigned short PORT{18082};
+		namespace net = boost::asio;
+		using tcp = net::ip::tcp;
+
+		net::io_context server_ioc(1);
+		const auto handler = [](auto&& req, auto&& send) {
+			send(http_server::MakeStringResponse(http::status::ok, "ok"sv, req.version(), req.keep_alive(), req.method()));
+		};
+		const tcp::endpoint endpoint{net::ip::make_address("127.0.0.1"), PORT};
+		if (state.range(1) == 0) {
+			http_server::ServerHttp(server_ioc, endpoint, handler);
+		} else {
+#ifdef SERVER_HAS_IO_URING
+			try {
+				net::make_service<http_server::UringService>(server_ioc);
+			} catch (const std::exception& e) {
+				return state.SkipWithError(e.what());
+			}
+			http_server::ServerHttp<http_server::UringSession>(server_ioc, endpoint, handler);
+#else
+			return state.SkipWithError("built without io_uring");
+#endif
+		}
+		std::jthread server_thread([&server_ioc] {
+			server_ioc.run();
+		});
+
+		net::io_context client_ioc;
+		std::vector<tcp::socket> sockets;
+		const auto connections = static_cast<size_t>(state.range(0));
+		for (size_t i = 0; i < connections; ++i) {
+			sockets.emplace_back(client_ioc);
+			net::connect(sockets.back(), std::vector{endpoint});
+			sockets.back().set_option(tcp::no_delay(true));
+		}
+
+		const auto request = "GET / HTTP/1.1\r\nHost: bench\r\nContent-Length: 0\r\n\r\n"s;
+		constexpr std::string_view RESPONSE_END = "\r\n\r\nok"sv;
+		std::string buffer;
+		const auto exchange = [&] {
+			for (auto& socket : sockets) {
+				net::write(socket, net::buffer(request));
+			}
+			for (auto& socket : sockets) {
+				buffer.clear();
+				net::read_until(socket, net::dynamic_buffer(buffer), RESPONSE_END);
+			}
+		};
+		exchange();
+		const uint64_t syscalls = ContextSyscallCount(server_ioc);
+		for (auto _ : state) {
+			exchange();
+		}
+		state.SetItemsProcessed(state.iterations() * connections);
+		state.counters["syscalls"] = static_cast<double>(ContextSyscallCount(server_ioc) - syscalls)
+			/ static_cast<double>(state.iterations() * connections);
+
+		for (auto& socket : sockets) {
+			socket.close();
+		}
+		server_ioc.stop();
+	}
+	BENCHMARK(BM_SessionIo)->ArgNames({"connections", "uring"})->ArgsProduct({{1, 16, 128}, {0, 1}})->UseRealTime();
+
+	/// @brief Сервер для BM_ThreadPerCore: общий io_context на все потоки или
+	/// по io_context и слушателю SO_REUSEPORT на поток, как --thread-per-core в main
+	class ModelServer {
+	public:
+		ModelServer(const boost::asio::ip::tcp::endpoint& endpoint, unsigned threads, bool per_core) {
+			const auto handler = [](auto&& req, auto&& send) {
+				send(http_server::MakeStringResponse(http::status::ok, "ok"sv, req.version(), req.keep_alive(), req.method()));
+			};
+			if (per_core) {
+				for (unsigned i = 0; i < threads; ++i) {
+					contexts_.push_back(std::make_unique<boost::asio::io_context>(1));
+					http_server::ServerHttp(*contexts_.back(), endpoint, handler,
+						http_server::ListenerOptions{.reuse_port = true, .session_strands = false});
+				}
+				for (auto& context : contexts_) {
+					threads_.emplace_back([&context] {
+						context->run();
+					});
+				}
+				return;
+			}
+			contexts_.push_back(std::make_unique<boost::asio::io_context>(static_cast<int>(threads)));
+			http_server::ServerHttp(*contexts_.back(), endpoint, handler);
+			for (unsigned i = 0; i < threads; ++i) {
+				threads_.emplace_back([this] {
+					contexts_.front()->run();
+				});
+			}
+		}
+
+		~ModelServer() {
+			for (auto& context : contexts_) {
+				context->stop();
+			}
+			threads_.clear();
+		}
+
+	private:
+		std::vector<std::unique_ptr<boost::asio::io_context>> contexts_;
+		std::vector<std::jthread> threads_;
+	};
+
+	/// @brief Новые соединения в секунду и задержка соединения (connect, запрос, ответ, закрытие)
+	/// при общем io_context и при io_context на поток. state.range(0) — потоки сервера,
+	/// state.range(1): 0 — общий io_context со strand на сессию, 1 — thread-per-core.
+	/// Клиентские потоки бенчмарка открывают по соединению на итерацию.
+	/// Счётчики: p50_us и p99_us — перцентили задержки соединения в микросекундах.
+	void BM_ThreadPerCore(benchmark::State& state) {
+		constexpr unsigned short PORT{18084};
+		namespace net = boost::asio;
+		using tcp = net::ip::tcp;
+		const tcp::endpoint endpoint{net::ip::make_address("127.0.0.1"), PORT};
+
+		static std::unique_ptr<ModelServer> server;
+		if (state.thread_index() == 0) {
+			server = std::make_unique<ModelServer>(endpoint, static_cast<unsigned>(state.range(0)), state.range(1) != 0);
+		}
+
+		net::io_context client_ioc;
+		const auto request = "GET / HTTP/1.1\r\nHost: bench\r\nConnection: close\r\nContent-Length: 0\r\n\r\n"s;
+		std::string response;
+		std::vector<double> latencies;
+		for (auto _ : state) {
+			const auto started = std::chrono::steady_clock::now();
+			tcp::socket socket(client_ioc);
+			net::connect(socket, std::vector{endpoint});
+			net::write(socket, net::buffer(request));
+			response.clear();
+			boost::system::error_code ec;
+			// сервер закрывает соединение после ответа: TIME_WAIT остаётся на его стороне
+			net::read(socket, net::dynamic_buffer(response), ec);
+			latencies.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - started).count());
+		}
+		state.SetItemsProcessed(state.iterations());
+		if (!latencies.empty()) {
+			const auto percentile = [&latencies](double p) {
+				const auto nth = latencies.begin() + static_cast<ptrdiff_t>(p * static_cast<double>(latencies.size() - 1));
+				std::nth_element(latencies.begin(), nth, latencies.end());
+				return *nth;
+			};
+			// перцентили потоков клиента усредняются
+			state.counters["p50_us"] = benchmark::Counter(percentile(0.50), benchmark::Counter::kAvgThreads);
+			state.counters["p99_us"] = benchmark::Counter(percentile(0.99), benchmark::Counter::kAvgThreads);
+		}
+
+		if (state.thread_index() == 0) {
+			server.reset();
+		}
+	}
+	BENCHMARK(BM_ThreadPerCore)->ArgNames({"threads", "per_core"})->ArgsProduct({{1, 2, 4}, {0, 1}})
+		->Threads(4)->UseRealTime();
+
+	/// @brief То же для двоичного протокола: state.range(0) запросов с разными номерами
+	/// одной записью, сервер отвечает пустым ServerToClient — кадром из одного заголовка.
+	void BM_BinaryMultiplexing(benchmark::State& state) {
+		constexpr unsigned short PORT{18081};
+		namespace net = boost::asio;
+		using tcp = net::ip::tcp;
+
+		net::io_context server_ioc(1);
+		http_server::ServerBinary(server_ioc, {net::ip::make_address("127.0.0.1"), PORT},
+			[](http_server::BinaryRequest&& req, auto&& send) {
+				send(http_server::BinaryResponse{req.id, http_server::FrameStatus::OK, {}, {}});
+			});
+		std::jthread server_thread([&server_ioc] {
+			server_ioc.run();
+		});
+
+		net::io_context client_ioc;
+		tcp::socket socket(client_ioc);
+		net::connect(socket, std::vector{tcp::endpoint{net::ip::make_address("127.0.0.1"), PORT}});
+		socket.set_option(tcp::no_delay(true));
+
+		const auto depth = static_cast<size_t>(state.range(0));
+		std::string batch;
+		for (size_t i = 0; i < depth; ++i) {
+			const auto header = http_server::EncodeFrameHeader({0, http_server::FrameStatus::OK, i});
+			batch.append(header.data(), header.size());
+		}
+		std::string responses(depth * http_server::FRAME_HEADER_SIZE, '\0');
+		for (auto _ : state) {
+			net::write(socket, net::buffer(batch));
+			net::read(socket, net::buffer(responses));
+		}
+		state.SetItemsProcessed(state.iterations() * depth);
+
+		socket.close();
+		server_ioc.stop();
+	}
+	BENCHMARK(BM_BinaryMultiplexing)->Arg(1)->Arg(8)->Arg(32)->UseRealTime();
+
+	/// @brief Чтение заголовочного среза каждого блока против целых блоков через сервер
+	/// на loopback: задержка запроса от записи до прочитанного ответа и байты тела ответа.
+	/// Аргумент: длина среза, 0 — блоки целиком. Блоки по 1 МБ из тёплого кэша, 16 токенов на запрос.
+	void BM_PartialRead(benchmark::State& state) {
+		constexpr unsigned short PORT{18083};
+		namespace net = boost::asio;
+		using tcp = net::ip::tcp;
+
+		FixedBlockSource upstream(storage::MAX_BLOCK_SIZE);
+		storage::BlockCache cache(upstream, 1ull << 30);
+		const http_server::ParallelOptions parallel;
+		net::io_context server_ioc(1);
+		const tcp::endpoint endpoint{net::ip::make_address("127.0.0.1"), PORT};
+		http_server::ServerHttp(server_ioc, endpoint, [&cache, &parallel](auto&& req, auto&& send) {
+			http_server::HandleRequest(cache, parallel, nullptr, std::forward<decltype(req)>(req), std::forward<decltype(send)>(send));
+		});
+		std::jthread server_thread([&server_ioc] {
+			server_ioc.run();
+		});
+
+		net::io_context client_ioc;
+		tcp::socket socket(client_ioc);
+		net::connect(socket, std::vector{endpoint});
+		socket.set_option(tcp::no_delay(true));
+
+		Exchange::ClientToServer client_to_server;
+		for (const auto& hash : MakeHashes(16)) {
+			client_to_server.add_hashes(hash);
+			if (state.range(0) > 0) {
+				client_to_server.add_ranges()->set_length(static_cast<uint64_t>(state.range(0)));
+			}
+		}
+		http::request<http::string_body> request{http::verb::get, "/", 11};
+		request.set(http::field::host, "bench"sv);
+		request.body() = client_to_server.SerializeAsString();
+		request.prepare_payload();
+
+		beast::flat_buffer buffer;
+		uint64_t wire_bytes = 0;
+		const auto exchange = [&] {
+			http::write(socket, request);
+			http::response_parser<http::string_body> parser;
+			parser.body_limit(boost::none);
+			http::read(socket, buffer, parser);
+			wire_bytes = parser.get().body().size();
+		};
+		// первый запрос до замера: блоки в кэше, соединение принято
+		exchange();
+		for (auto _ : state) {
+			exchange();
+		}
+		state.SetBytesProcessed(state.iterations() * wire_bytes);
+		state.counters["wire_bytes"] = static_cast<double>(wire_bytes);
+
+		socket.close();
+		server_ioc.stop();
+	}
+	BENCHMARK(BM_PartialRead)->Arg(0)->Arg(512)->Arg(4 << 10)->Arg(64 << 10)->UseRealTime()->Unit(benchmark::kMicrosecond);
+}
+
+BENCHMARK_MAIN();
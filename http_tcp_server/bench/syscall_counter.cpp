@@ -0,0 +1,103 @@
+#include "syscall_counter.h"
+
+#include <cstdarg>
+
+#include <dlfcn.h>
+#include <sys/epoll.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+// Перехват обёрток libc над системными вызовами, которыми пользуются Asio и io_uring.
+// Определения в исполняемом файле находятся раньше libc, настоящая функция берётся
+// через dlsym(RTLD_NEXT). Как и в allocation_counter, счётчик локален для потока.
+
+namespace {
+	thread_local uint64_t syscall_count = 0;
+
+	template <typename Function>
+	Function* Next(const char* name) {
+		return reinterpret_cast<Function*>(::dlsym(RTLD_NEXT, name));
+	}
+}
+
+namespace bench {
+	uint64_t ThreadSyscallCount() {
+		return syscall_count;
+	}
+}  // namespace bench
+
+#define SYSCALL_COUNTER_FORWARD(name, ...) \
+	++syscall_count; \
+	static auto* next = Next<decltype(name)>(#name); \
+	return next(__VA_ARGS__)
+
+extern "C" {
+	ssize_t read(int fd, void* buffer, size_t size) {
+		SYSCALL_COUNTER_FORWARD(read, fd, buffer, size);
+	}
+
+	ssize_t __read_chk(int fd, void* buffer, size_t size, size_t buffer_size) {
+		SYSCALL_COUNTER_FORWARD(__read_chk, fd, buffer, size, buffer_size);
+	}
+
+	ssize_t write(int fd, const void* buffer, size_t size) {
+		SYSCALL_COUNTER_FORWARD(write, fd, buffer, size);
+	}
+
+	ssize_t readv(int fd, const iovec* iov, int count) {
+		SYSCALL_COUNTER_FORWARD(readv, fd, iov, count);
+	}
+
+	ssize_t writev(int fd, const iovec* iov, int count) {
+		SYSCALL_COUNTER_FORWARD(writev, fd, iov, count);
+	}
+
+	ssize_t recv(int fd, void* buffer, size_t size, int flags) {
+		SYSCALL_COUNTER_FORWARD(recv, fd, buffer, size, flags);
+	}
+
+	ssize_t send(int fd, const void* buffer, size_t size, int flags) {
+		SYSCALL_COUNTER_FORWARD(send, fd, buffer, size, flags);
+	}
+
+	ssize_t recvmsg(int fd, msghdr* message, int flags) {
+		SYSCALL_COUNTER_FORWARD(recvmsg, fd, message, flags);
+	}
+
+	ssize_t sendmsg(int fd, const msghdr* message, int flags) {
+		SYSCALL_COUNTER_FORWARD(sendmsg, fd, message, flags);
+	}
+
+	ssize_t sendfile(int out_fd, int in_fd, off_t* offset, size_t count) noexcept {
+		SYSCALL_COUNTER_FORWARD(sendfile, out_fd, in_fd, offset, count);
+	}
+
+	int epoll_wait(int fd, epoll_event* events, int max_events, int timeout) {
+		SYSCALL_COUNTER_FORWARD(epoll_wait, fd, events, max_events, timeout);
+	}
+
+	int epoll_ctl(int fd, int op, int target, epoll_event* event) noexcept {
+		SYSCALL_COUNTER_FORWARD(epoll_ctl, fd, op, target, event);
+	}
+
+	int timerfd_settime(int fd, int flags, const itimerspec* value, itimerspec* old_value) noexcept {
+		SYSCALL_COUNTER_FORWARD(timerfd_settime, fd, flags, value, old_value);
+	}
+
+	long syscall(long number, ...) noexcept {
+		// У системного вызова не больше шести аргументов в регистрах, лишние не используются
+		va_list args;
+		va_start(args, number);
+		long a[6];
+		for (auto& arg : a) {
+			arg = va_arg(args, long);
+		}
+		va_end(args);
+		++syscall_count;
+		static auto* next = Next<long(long, ...)>("syscall");
+		return next(number, a[0], a[1], a[2], a[3], a[4], a[5]);
+	}
+}
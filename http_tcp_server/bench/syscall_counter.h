@@ -0,0 +1,11 @@
+#pragma once
+#include <cstdint>
+
+namespace bench {
+
+    /// @brief Число системных вызовов ввода-вывода в текущем потоке с его запуска:
+    /// чтение и запись сокетов и eventfd, epoll, таймеры, sendfile и syscall (io_uring_enter).
+    /// Считаются вызовы через libc, перехваченные в этом исполняемом файле.
+    uint64_t ThreadSyscallCount();
+
+} // namespace bench
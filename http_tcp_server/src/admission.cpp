@@ -0,0 +1,145 @@
+#include "admission.h"
+#include "metrics.h"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <string_view>
+#include <utility>
+
+namespace http_server {
+	namespace {
+		using namespace std::literals;
+
+		// сколько адресов шард держит, прежде чем выбросить вёдра простаивающих клиентов
+		constexpr size_t MAX_CLIENTS_PER_SHARD{4096};
+
+		constexpr double NANOSECONDS_PER_SECOND{1e9};
+	}
+
+	InflightBytes::InflightBytes(AdmissionController& controller, uint64_t bytes) :
+		controller_(&controller),
+		bytes_(bytes) {
+		controller_->inflight_bytes_.fetch_add(bytes_, std::memory_order_relaxed);
+	}
+
+	InflightBytes::InflightBytes(InflightBytes&& other) noexcept :
+		controller_(std::exchange(other.controller_, nullptr)),
+		bytes_(std::exchange(other.bytes_, 0)) {
+	}
+
+	InflightBytes& InflightBytes::operator=(InflightBytes&& other) noexcept {
+		if (this != &other) {
+			Release();
+			controller_ = std::exchange(other.controller_, nullptr);
+			bytes_ = std::exchange(other.bytes_, 0);
+		}
+		return *this;
+	}
+
+	InflightBytes::~InflightBytes() {
+		Release();
+	}
+
+	void InflightBytes::Release() {
+		if (controller_) {
+			controller_->inflight_bytes_.fetch_sub(bytes_, std::memory_order_relaxed);
+			controller_ = nullptr;
+		}
+	}
+
+	AdmissionController::AdmissionController(AdmissionOptions options) :
+		options_(options) {
+		constexpr auto body = "Server overloaded"sv;
+		overloaded_http_response_ = "HTTP/1.1 503 Service Unavailable\r\nRetry-After: "s
+			+ std::to_string(options_.retry_after_seconds)
+			+ "\r\nContent-Type: text/html\r\nContent-Length: "s + std::to_string(body.size())
+			+ "\r\nConnection: close\r\n\r\n"s + std::string(body);
+	}
+
+	bool AdmissionController::TryOpenSession() {
+		const uint32_t sessions = sessions_.fetch_add(1, std::memory_order_relaxed);
+		if (options_.max_sessions != 0 && sessions >= options_.max_sessions) {
+			sessions_.fetch_sub(1, std::memory_order_relaxed);
+			metrics::Add(metrics::Counter::SHED_CONNECTIONS);
+			return false;
+		}
+		return true;
+	}
+
+	void AdmissionController::CloseSession() {
+		sessions_.fetch_sub(1, std::memory_order_relaxed);
+	}
+
+	std::optional<Rejection> AdmissionController::AdmitRequest(const boost::asio::ip::address& client) {
+		if (options_.max_inflight_bytes != 0 && Inflight() >= options_.max_inflight_bytes) {
+			metrics::Add(metrics::Counter::SHED_INFLIGHT);
+			return Rejection{options_.retry_after_seconds};
+		}
+		if (options_.client_rate > 0) {
+			if (auto rejection = TakeClientToken(client)) {
+				metrics::Add(metrics::Counter::SHED_CLIENT_RATE);
+				return rejection;
+			}
+		}
+		return std::nullopt;
+	}
+
+	std::optional<Rejection> AdmissionController::TakeClientToken(const boost::asio::ip::address& client) {
+		const double capacity = std::max(1.0, options_.client_burst);
+		const uint64_t now = metrics::Now();
+		auto& shard = shards_[AddressHash{}(client) % SHARD_COUNT];
+
+		std::lock_guard lock(shard.mutex);
+		if (shard.buckets.size() >= MAX_CLIENTS_PER_SHARD) {
+			// ведро, которое успело бы наполниться, ничем не отличается от нового
+			const auto refill = static_cast<uint64_t>(capacity / options_.client_rate * NANOSECONDS_PER_SECOND);
+			std::erase_if(shard.buckets, [now, refill](const auto& item) {
+				return now - item.second.updated >= refill;
+			});
+		}
+		auto [it, inserted] = shard.buckets.try_emplace(client, Bucket{capacity, now});
+		auto& bucket = it->second;
+		if (!inserted) {
+			const double elapsed = static_cast<double>(now - bucket.updated) / NANOSECONDS_PER_SECOND;
+			bucket.tokens = std::min(capacity, bucket.tokens + elapsed * options_.client_rate);
+			bucket.updated = now;
+		}
+		if (bucket.tokens >= 1.0) {
+			bucket.tokens -= 1.0;
+			return std::nullopt;
+		}
+		// через сколько секунд в ведре появится токен
+		const double wait = (1.0 - bucket.tokens) / options_.client_rate;
+		return Rejection{std::max(1u, static_cast<uint32_t>(std::ceil(wait)))};
+	}
+
+	size_t AdmissionController::AddressHash::operator()(const boost::asio::ip::address& address) const {
+		if (address.is_v4()) {
+			return std::hash<uint32_t>{}(address.to_v4().to_uint());
+		}
+		const auto bytes = address.to_v6().to_bytes();
+		return std::hash<std::string_view>{}(std::string_view(reinterpret_cast<const char*>(bytes.data()), bytes.size()));
+	}
+
+	bool AdmissionController::TooManyHashes(int count) const {
+		if (options_.max_hashes != 0 && count > options_.max_hashes) {
+			metrics::Add(metrics::Counter::OVERSIZE_REQUESTS);
+			return true;
+		}
+		return false;
+	}
+
+	bool AdmissionController::TooManyRanges(size_t per_hash, size_t total) const {
+		if ((options_.max_ranges_per_hash != 0 && per_hash > options_.max_ranges_per_hash)
+			|| (options_.max_ranges != 0 && total > options_.max_ranges)) {
+			metrics::Add(metrics::Counter::OVERSIZE_REQUESTS);
+			return true;
+		}
+		return false;
+	}
+
+	InflightBytes AdmissionController::Hold(uint64_t bytes) {
+		return InflightBytes(*this, bytes);
+	}
+}  // namespace http_server
@@ -0,0 +1,141 @@
+#pragma once
+#include <boost/asio/ip/address.hpp>
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+
+namespace http_server {
+
+    /// @brief Лимиты контроля допуска, 0 — без ограничения
+    struct AdmissionOptions {
+        // одновременных сессий на сервере
+        uint32_t max_sessions{0};
+        // байт тел ответов, собранных в памяти и ещё не отправленных
+        uint64_t max_inflight_bytes{0};
+        // токенов в одном запросе
+        int max_hashes{0};
+        // частей блока на один токен
+        uint32_t max_ranges_per_hash{0};
+        // частей блоков во всём запросе
+        uint32_t max_ranges{0};
+        // средний темп запросов с одного IP-адреса в секунду
+        double client_rate{0};
+        // сколько запросов подряд клиент может сделать сверх среднего темпа
+        double client_burst{1};
+        // через сколько секунд клиенту предлагается повторить запрос, отклонённый из-за нагрузки
+        uint32_t retry_after_seconds{1};
+    };
+
+    /// @brief Отказ в обработке запроса из-за нагрузки
+    struct Rejection {
+        uint32_t retry_after_seconds;
+    };
+
+    class AdmissionController;
+
+    /// @brief Учёт байтов ответа, собранного в памяти: байты числятся в полёте,
+    /// пока объект жив, то есть пока тело ответа не отправлено и не разрушено
+    class InflightBytes {
+    public:
+        InflightBytes() = default;
+        InflightBytes(AdmissionController& controller, uint64_t bytes);
+
+        InflightBytes(InflightBytes&& other) noexcept;
+        InflightBytes& operator=(InflightBytes&& other) noexcept;
+
+        ~InflightBytes();
+
+    private:
+        void Release();
+
+        AdmissionController* controller_{nullptr};
+        uint64_t bytes_{0};
+    };
+
+    /// @brief Контроль допуска на весь сервер: ограничивает число сессий, байты ответов в полёте,
+    /// размер запроса и темп запросов с одного IP-адреса. Проверки делаются до работы с блоками,
+    /// поэтому отказ стоит дёшево. Каждому адресу — своё ведро токенов, поэтому тяжёлый клиент
+    /// исчерпывает только свою долю. Отказы считаются в метриках.
+    /// Методы потокобезопасны.
+    class AdmissionController {
+    public:
+        explicit AdmissionController(AdmissionOptions options);
+
+        AdmissionController(const AdmissionController&) = delete;
+        AdmissionController& operator=(const AdmissionController&) = delete;
+
+        /// @return true, если сессия допущена; по её завершении вызывается CloseSession
+        bool TryOpenSession();
+
+        void CloseSession();
+
+        /// @brief Допуск очередного запроса клиента: ведро токенов адреса и байты в полёте
+        /// @return std::nullopt, если запрос можно обрабатывать
+        std::optional<Rejection> AdmitRequest(const boost::asio::ip::address& client);
+
+        /// @brief Превышает ли число токенов лимит запроса; превышение считается в метриках
+        bool TooManyHashes(int count) const;
+
+        /// @brief Превышает ли число запрошенных частей блоков лимиты на токен или на запрос;
+        /// превышение считается в метриках вместе с запросами сверх лимита токенов
+        /// @param per_hash наибольшее число частей у одного токена
+        /// @param total частей во всём запросе
+        bool TooManyRanges(size_t per_hash, size_t total) const;
+
+        /// @brief Учёт байтов собранного тела ответа до его разрушения
+        InflightBytes Hold(uint64_t bytes);
+
+        uint32_t Sessions() const {
+            return sessions_.load(std::memory_order_relaxed);
+        }
+
+        uint64_t Inflight() const {
+            return inflight_bytes_.load(std::memory_order_relaxed);
+        }
+
+        /// @brief Готовый HTTP-ответ 503 с Retry-After для соединений сверх лимита сессий
+        const std::string& OverloadedHttpResponse() const {
+            return overloaded_http_response_;
+        }
+
+        const AdmissionOptions& Options() const {
+            return options_;
+        }
+
+    private:
+        friend class InflightBytes;
+
+        struct Bucket {
+            double tokens;
+            uint64_t updated;
+        };
+
+        // В Boost 1.74 нет std::hash для адресов
+        struct AddressHash {
+            size_t operator()(const boost::asio::ip::address& address) const;
+        };
+
+        // Вёдра разложены по шардам с отдельными мьютексами, чтобы потоки io_context
+        // не сталкивались на одном мьютексе
+        struct alignas(64) Shard {
+            std::mutex mutex;
+            std::unordered_map<boost::asio::ip::address, Bucket, AddressHash> buckets;
+        };
+
+        static constexpr size_t SHARD_COUNT{16};
+
+        std::optional<Rejection> TakeClientToken(const boost::asio::ip::address& client);
+
+        AdmissionOptions options_;
+        std::string overloaded_http_response_;
+        std::atomic<uint32_t> sessions_{0};
+        std::atomic<uint64_t> inflight_bytes_{0};
+        std::array<Shard, SHARD_COUNT> shards_;
+    };
+
+} // namespace http_server
@@ -0,0 +1,136 @@
+#include "allocation_counter.h"
+
+#include <cstdlib>
+#include <new>
+
+// Замена глобальных operator new/delete, которая считает выделения памяти.
+// Счётчик локален для потока и инициализируется константой, поэтому
+// не требует ни атомарных операций, ни динамической инициализации.
+
+namespace {
+	thread_local uint64_t allocation_count = 0;
+
+	void* Allocate(std::size_t size) {
+		++allocation_count;
+		if (void* ptr = std::malloc(size ? size : 1)) {
+			return ptr;
+		}
+		throw std::bad_alloc();
+	}
+
+	void* AllocateAligned(std::size_t size, std::align_val_t alignment) {
+		++allocation_count;
+		const auto align = static_cast<std::size_t>(alignment);
+		// aligned_alloc требует размер, кратный выравниванию
+		size = (size + align - 1) / align * align;
+		if (void* ptr = std::aligned_alloc(align, size ? size : align)) {
+			return ptr;
+		}
+		throw std::bad_alloc();
+	}
+}
+
+namespace http_server {
+	uint64_t ThreadAllocationCount() {
+		return allocation_count;
+	}
+}  // namespace http_server
+
+void* operator new(std::size_t size) {
+	return Allocate(size);
+}
+
+void* operator new[](std::size_t size) {
+	return Allocate(size);
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment) {
+	return AllocateAligned(size, alignment);
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment) {
+	return AllocateAligned(size, alignment);
+}
+
+// nothrow-формы заменяются вместе с остальными: иначе их память выделяет
+// стандартная библиотека (или санитайзер), а освобождает заменённый operator delete
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+	try {
+		return Allocate(size);
+	} catch (const std::bad_alloc&) {
+		return nullptr;
+	}
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+	try {
+		return Allocate(size);
+	} catch (const std::bad_alloc&) {
+		return nullptr;
+	}
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+	try {
+		return AllocateAligned(size, alignment);
+	} catch (const std::bad_alloc&) {
+		return nullptr;
+	}
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+	try {
+		return AllocateAligned(size, alignment);
+	} catch (const std::bad_alloc&) {
+		return nullptr;
+	}
+}
+
+void operator delete(void* ptr) noexcept {
+	std::free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept {
+	std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept {
+	std::free(ptr);
+}
+
+void operator delete[](void* ptr, std::size_t) noexcept {
+	std::free(ptr);
+}
+
+void operator delete(void* ptr, std::align_val_t) noexcept {
+	std::free(ptr);
+}
+
+void operator delete[](void* ptr, std::align_val_t) noexcept {
+	std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t, std::align_val_t) noexcept {
+	std::free(ptr);
+}
+
+void operator delete[](void* ptr, std::size_t, std::align_val_t) noexcept {
+	std::free(ptr);
+}
+
+void operator delete(void* ptr, const std::nothrow_t&) noexcept {
+	std::free(ptr);
+}
+
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept {
+	std::free(ptr);
+}
+
+void operator delete(void* ptr, std::align_val_t, const std::nothrow_t&) noexcept {
+	std::free(ptr);
+}
+
+void operator delete[](void* ptr, std::align_val_t, const std::nothrow_t&) noexcept {
+	std::free(ptr);
+}
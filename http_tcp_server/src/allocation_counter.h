@@ -0,0 +1,10 @@
+#pragma once
+#include <cstdint>
+
+namespace http_server {
+
+    /// @brief Число выделений памяти через operator new в текущем потоке с его запуска.
+    /// Разность значений до и после обработки запроса — число выделений на запрос.
+    uint64_t ThreadAllocationCount();
+
+} // namespace http_server
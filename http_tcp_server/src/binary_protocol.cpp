@@ -0,0 +1,37 @@
+#include "binary_protocol.h"
+
+namespace http_server {
+	namespace {
+		template <typename T>
+		void StoreLe(char* out, T value) {
+			for (size_t i = 0; i < sizeof(T); ++i) {
+				out[i] = static_cast<char>(value >> (8 * i));
+			}
+		}
+
+		template <typename T>
+		T LoadLe(const char* in) {
+			T value = 0;
+			for (size_t i = 0; i < sizeof(T); ++i) {
+				value |= static_cast<T>(static_cast<unsigned char>(in[i])) << (8 * i);
+			}
+			return value;
+		}
+	}
+
+	FrameHeaderBytes EncodeFrameHeader(const FrameHeader& header) {
+		FrameHeaderBytes bytes;
+		StoreLe(bytes.data(), header.size);
+		StoreLe(bytes.data() + 4, static_cast<uint32_t>(header.status));
+		StoreLe(bytes.data() + 8, header.request_id);
+		return bytes;
+	}
+
+	FrameHeader DecodeFrameHeader(const char* bytes) {
+		FrameHeader header;
+		header.size = LoadLe<uint32_t>(bytes);
+		header.status = static_cast<FrameStatus>(LoadLe<uint32_t>(bytes + 4));
+		header.request_id = LoadLe<uint64_t>(bytes + 8);
+		return header;
+	}
+}  // namespace http_server
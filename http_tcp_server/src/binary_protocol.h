@@ -0,0 +1,80 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include "server_to_client_body.h"
+
+// Двоичный протокол для обмена между сервисами: те же сообщения ClientToServer
+// и ServerToClient, что и в HTTP, но в кадрах с длиной вместо HTTP-заголовков.
+//
+// Кадр: заголовок из 16 байт в little endian и данные
+//   0  uint32  размер данных
+//   4  uint32  статус, FrameStatus; в запросах 0
+//   8  uint64  номер запроса, выбирается клиентом и возвращается в ответе
+//   16 данные: ClientToServer в запросе, ServerToClient или текст ошибки в ответе
+//
+// По одному соединению идёт много запросов сразу, ответы приходят по мере готовности,
+// не обязательно в порядке запросов: клиент сопоставляет их по номеру.
+namespace http_server {
+
+    constexpr size_t FRAME_HEADER_SIZE{16};
+    // наибольший размер данных в кадре запроса, как лимит тела HTTP-запроса
+    constexpr uint32_t MAX_REQUEST_FRAME_SIZE{1024 * 1024};
+    // наибольший размер данных в кадре ответа: длина в заголовке 32-битная
+    constexpr uint64_t MAX_RESPONSE_FRAME_SIZE{UINT32_MAX};
+
+    /// @brief Статус ответа в кадре
+    enum class FrameStatus : uint32_t {
+        OK = 0,
+        // запрос не разобран, в данных текст ошибки
+        BAD_REQUEST = 1,
+        // блоки получить не удалось, в данных текст ошибки
+        INTERNAL_ERROR = 2,
+        // сервер перегружен, запрос не обрабатывался; в данных текст с предлагаемой паузой
+        OVERLOADED = 3,
+        // в запросе больше токенов или частей блоков, чем допускает сервер,
+        // или ответ не помещается в кадр (больше MAX_RESPONSE_FRAME_SIZE)
+        TOO_LARGE = 4
+    };
+
+    /// @brief Заголовок кадра
+    struct FrameHeader {
+        uint32_t size{0};
+        FrameStatus status{FrameStatus::OK};
+        uint64_t request_id{0};
+    };
+
+    using FrameHeaderBytes = std::array<char, FRAME_HEADER_SIZE>;
+
+    FrameHeaderBytes EncodeFrameHeader(const FrameHeader& header);
+
+    /// @param bytes не меньше FRAME_HEADER_SIZE байт
+    FrameHeader DecodeFrameHeader(const char* bytes);
+
+    /// @brief Запрос двоичного протокола
+    struct BinaryRequest {
+        uint64_t id{0};
+        // сериализованный ClientToServer
+        std::string body;
+    };
+
+    /// @brief Ответ двоичного протокола: ServerToClient или текст ошибки
+    struct BinaryResponse {
+        uint64_t id{0};
+        FrameStatus status{FrameStatus::OK};
+        ServerToClientBody::value_type body;
+        std::string error;
+
+        static BinaryResponse Error(uint64_t id, FrameStatus status, std::string_view text) {
+            BinaryResponse response;
+            response.id = id;
+            response.status = status;
+            response.error = text;
+            return response;
+        }
+    };
+
+} // namespace http_server
@@ -0,0 +1,177 @@
+#include "binary_server.h"
+#include "logging.h"
+#include "metrics.h"
+
+namespace http_server {
+	namespace {
+		// наименьший объём чтения из сокета: в буфер попадает сразу много небольших кадров
+		constexpr size_t MIN_READ_SIZE{64 * 1024};
+
+		// Ответ в очереди отправки: байты заголовка кадра и тело, на которые ссылаются буферы
+		struct OutgoingFrame {
+			FrameHeaderBytes header;
+			BinaryResponse response;
+		};
+	}
+
+	BinarySessionBase::BinarySessionBase(tcp::socket&& socket, std::chrono::steady_clock::duration io_timeout) :
+		stream_(std::move(socket)),
+		io_timeout_(io_timeout) {}
+
+	void BinarySessionBase::Run() {
+		net::dispatch(stream_.get_executor(), beast::bind_front_handler(&BinarySessionBase::Read, GetSharedThis()));
+	}
+
+	void BinarySessionBase::Read() {
+		using namespace std::literals;
+
+		if (reading_) {
+			return;
+		}
+		// Разбираем все целые кадры, уже лежащие в буфере
+		size_t need = FRAME_HEADER_SIZE;
+		while (!read_done_ && in_flight_ < MAX_IN_FLIGHT_REQUESTS && buffer_.size() >= FRAME_HEADER_SIZE) {
+			const char* data = static_cast<const char*>(buffer_.data().data());
+			const FrameHeader header = DecodeFrameHeader(data);
+			if (header.size > MAX_REQUEST_FRAME_SIZE) {
+				static logging::Site site{logging::Level::WARNING, "Binary frame of {} bytes exceeds the limit"sv, 10};
+				logging::Log(site, header.size);
+				metrics::Add(metrics::Counter::READ_ERRORS);
+				read_done_ = true;
+				break;
+			}
+			need = FRAME_HEADER_SIZE + header.size;
+			if (buffer_.size() < need) {
+				break;
+			}
+			BinaryRequest request{header.request_id, std::string(data + FRAME_HEADER_SIZE, header.size)};
+			buffer_.consume(need);
+			need = FRAME_HEADER_SIZE;
+
+			metrics::Add(metrics::Counter::REQUESTS);
+			++in_flight_;
+			HandleRequest(std::move(request));
+		}
+
+		if (read_done_) {
+			if (in_flight_ == 0 && !writing_) {
+				Close();
+			}
+			return;
+		}
+		if (in_flight_ >= MAX_IN_FLIGHT_REQUESTS) {
+			// чтение продолжится, когда уйдут ответы
+			return;
+		}
+
+		stream_.expires_after(io_timeout_);
+		reading_ = true;
+		stream_.async_read_some(buffer_.prepare(std::max(need - buffer_.size(), MIN_READ_SIZE)),
+			beast::bind_front_handler(&BinarySessionBase::OnRead, GetSharedThis()));
+	}
+
+	void BinarySessionBase::OnRead(beast::error_code ec, std::size_t bytes_read) {
+		using namespace std::literals;
+
+		reading_ = false;
+		buffer_.commit(bytes_read);
+		metrics::Add(metrics::Counter::BYTES_READ, bytes_read);
+
+		if (ec) {
+			read_done_ = true;
+			if (ec != net::error::eof) {
+				metrics::Add(metrics::Counter::READ_ERRORS);
+				ReportError(ec, "binary read"sv);
+			}
+			// соединение закрываем, когда будут отправлены ответы на уже прочитанные запросы
+			if (in_flight_ == 0 && !writing_) {
+				Close();
+			}
+			return;
+		}
+		Read();
+	}
+
+	void BinarySessionBase::Write(BinaryResponse&& response) {
+		using namespace std::literals;
+
+		if (response.status == FrameStatus::OK && response.body.Size() > MAX_RESPONSE_FRAME_SIZE) {
+			// усечённая длина в заголовке рассинхронизировала бы поток кадров: клиент получает отказ
+			static logging::Site site{logging::Level::WARNING, "Binary response of {} bytes does not fit in a frame"sv, 10};
+			logging::Log(site, response.body.Size());
+			response = BinaryResponse::Error(response.id, FrameStatus::TOO_LARGE, "Response too large"sv);
+		}
+		auto frame = std::make_shared<OutgoingFrame>();
+		frame->response = std::move(response);
+		{
+			metrics::ScopedTimer timer(metrics::Stage::SERIALIZE);
+			const auto& body = frame->response;
+			const bool ok = body.status == FrameStatus::OK;
+			frame->header = EncodeFrameHeader({
+				static_cast<uint32_t>(ok ? body.body.Size() : body.error.size()), body.status, body.id});
+			queued_buffers_.emplace_back(frame->header.data(), frame->header.size());
+			if (ok) {
+				body.body.AppendBuffers(queued_buffers_);
+			} else {
+				queued_buffers_.emplace_back(body.error.data(), body.error.size());
+			}
+		}
+		queued_owners_.push_back(std::move(frame));
+		++queued_responses_;
+		Flush();
+	}
+
+	void BinarySessionBase::Flush() {
+		if (writing_ || queued_responses_ == 0) {
+			return;
+		}
+		// Все накопленные ответы уходят одной записью
+		write_buffers_.swap(queued_buffers_);
+		write_owners_.swap(queued_owners_);
+		write_responses_ = queued_responses_;
+		queued_buffers_.clear();
+		queued_owners_.clear();
+		queued_responses_ = 0;
+
+		stream_.expires_after(io_timeout_);
+
+		writing_ = true;
+		write_started_ = metrics::Now();
+		net::async_write(stream_, write_buffers_,
+			beast::bind_front_handler(&BinarySessionBase::OnWrite, GetSharedThis()));
+	}
+
+	void BinarySessionBase::OnWrite(beast::error_code ec, std::size_t bytes_written) {
+		using namespace std::literals;
+
+		writing_ = false;
+		write_owners_.clear();
+
+		metrics::Observe(metrics::Stage::WRITE, metrics::Now() - write_started_);
+		metrics::Add(metrics::Counter::BYTES_WRITTEN, bytes_written);
+
+		if (ec) {
+			read_done_ = true;
+			metrics::Add(metrics::Counter::WRITE_ERRORS);
+			return ReportError(ec, "binary write"sv);
+		}
+
+		metrics::Add(metrics::Counter::RESPONSES, write_responses_);
+		in_flight_ -= write_responses_;
+		write_responses_ = 0;
+
+		if (read_done_ && in_flight_ == 0) {
+			return Close();
+		}
+		// чтение могло остановиться на пределе одновременных запросов
+		if (!read_done_) {
+			Read();
+		}
+		Flush();
+	}
+
+	void BinarySessionBase::Close() {
+		beast::error_code ec;
+		stream_.socket().shutdown(tcp::socket::shutdown_send, ec);
+	}
+}  // namespace http_server
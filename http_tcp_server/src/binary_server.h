@@ -0,0 +1,118 @@
+#pragma once
+#include "sdk.h"
+#define BOOST_BEAST_USE_STD_STRING_VIEW
+
+#include <boost/asio/dispatch.hpp>
+#include <boost/beast/core.hpp>
+
+#include <chrono>
+#include <memory>
+#include <vector>
+
+#include "binary_protocol.h"
+#include "http_server.h"
+
+namespace http_server {
+
+    /// @brief Сессия двоичного протокола. Запросы читаются, не дожидаясь ответов на предыдущие,
+    /// ответы уходят по мере готовности: готовые к моменту записи ответы — одним writev.
+    class BinarySessionBase {
+    public:
+        BinarySessionBase() = delete;
+
+        BinarySessionBase& operator=(const BinarySessionBase&) = delete;
+
+        void Run();
+
+        // сколько запросов соединения может обрабатываться одновременно, прежде чем сессия перестанет читать новые
+        static constexpr size_t MAX_IN_FLIGHT_REQUESTS{128};
+
+    protected:
+        /// @param io_timeout срок каждого чтения и каждой записи
+        BinarySessionBase(tcp::socket&& socket, std::chrono::steady_clock::duration io_timeout);
+
+        ~BinarySessionBase() = default;
+
+        /// @brief Исполнитель сессии (strand), в котором должен вызываться Write
+        beast::tcp_stream::executor_type GetExecutor() {
+            return stream_.get_executor();
+        }
+
+        /// @brief Постановка ответа в очередь отправки
+        void Write(BinaryResponse&& response);
+
+    private:
+        /// @brief Разбор кадров, уже лежащих в буфере, и чтение следующих
+        void Read();
+
+        void OnRead(beast::error_code ec, std::size_t bytes_read);
+
+        /// @brief Отправка накопленных ответов, если запись сейчас не идёт
+        void Flush();
+
+        void OnWrite(beast::error_code ec, std::size_t bytes_written);
+
+        void Close();
+
+        virtual std::shared_ptr<BinarySessionBase> GetSharedThis() = 0;
+        virtual void HandleRequest(BinaryRequest&& request) = 0;
+
+    private:
+        beast::tcp_stream stream_;
+        beast::flat_buffer buffer_;
+        std::chrono::steady_clock::duration io_timeout_;
+        bool reading_{false};
+        // новых запросов не будет: клиент закрыл соединение или прислал неверный кадр
+        bool read_done_{false};
+        // запросы, ответы на которые ещё не отправлены
+        size_t in_flight_{0};
+
+        // ответы, ожидающие записи, и буферы с владельцами текущей записи
+        std::vector<net::const_buffer> queued_buffers_;
+        std::vector<std::shared_ptr<const void>> queued_owners_;
+        size_t queued_responses_{0};
+        std::vector<net::const_buffer> write_buffers_;
+        std::vector<std::shared_ptr<const void>> write_owners_;
+        size_t write_responses_{0};
+        bool writing_{false};
+        uint64_t write_started_{0};
+    };
+
+    /// @brief Сессия двоичного протокола с обработчиком запросов
+    /// @tparam RequestHandler функция (BinaryRequest&&, send), send принимает BinaryResponse
+    template <typename RequestHandler>
+    class BinarySession : public BinarySessionBase, public std::enable_shared_from_this<BinarySession<RequestHandler>> {
+    public:
+        template <typename Handler>
+        BinarySession(tcp::socket&& socket, Handler&& request_handler, std::chrono::steady_clock::duration io_timeout) :
+            BinarySessionBase(std::move(socket), io_timeout),
+            request_handler_(std::forward<Handler>(request_handler))
+        {}
+    private:
+
+        void HandleRequest(BinaryRequest&& request) override {
+            // ответ может прийти из потока пула вычислений, запись выполняется в strand сессии
+            request_handler_(std::move(request), [self = this->shared_from_this()](BinaryResponse&& response){
+                net::dispatch(self->GetExecutor(),
+                    [self, response = std::move(response)]() mutable {
+                        self->Write(std::move(response));
+                    });
+            });
+        }
+
+        std::shared_ptr<BinarySessionBase> GetSharedThis() override {
+            return this->shared_from_this();
+        }
+    private:
+        RequestHandler request_handler_;
+    };
+
+    /// @brief Запуск слушателя двоичного протокола
+    template <typename RequestHandler>
+    void ServerBinary(net::io_context& ioc, const tcp::endpoint& endpoint, RequestHandler&& handler, ListenerOptions options = {}) {
+        using MyListener = Listener<std::decay_t<RequestHandler>, BinarySession>;
+
+        std::make_shared<MyListener>(ioc, endpoint, std::forward<RequestHandler>(handler), options)->Run();
+    }
+
+} // namespace http_server
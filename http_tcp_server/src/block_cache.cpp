@@ -0,0 +1,348 @@
+#include "block_cache.h"
+#include "hash_and_block.h"
+
+#include <algorithm>
+#include <bit>
+#include <mutex>
+
+namespace storage {
+	namespace {
+		// доля малой очереди в бюджете шарда, в процентах
+		constexpr uint64_t SMALL_QUEUE_PERCENT{10};
+		// шард должен вмещать несколько блоков максимального размера
+		constexpr uint64_t MIN_SHARD_CAPACITY{8 * MAX_BLOCK_SIZE};
+		constexpr size_t MAX_SHARD_COUNT{64};
+		// частота обращений насыщается на этом значении
+		constexpr uint8_t MAX_FREQ{3};
+		// накладные расходы на запись кэша помимо блока и токена
+		constexpr uint64_t ENTRY_OVERHEAD{128};
+
+		/// @brief Владелец блока из кэша: память блока от источника
+		/// и закодированный один раз заголовок его записи HashAndBlock
+		struct EncodedBlock {
+			std::shared_ptr<const void> block_owner;
+			std::string wire_head;
+		};
+
+		/// @brief Блок с готовым заголовком записи HashAndBlock для токена hash
+		BlockData AttachWireHead(BlockData data, std::string_view hash) {
+			if (!data) {
+				return data;
+			}
+			auto encoded = std::make_shared<EncodedBlock>(EncodedBlock{std::move(data.owner), MakeHashAndBlockHead(hash, data.size())});
+			data.wire_head = encoded->wire_head;
+			data.owner = std::move(encoded);
+			return data;
+		}
+	}
+
+	BlockCache::BlockCache(BlockSource& upstream, uint64_t capacity_bytes) :
+		upstream_(upstream),
+		capacity_bytes_(capacity_bytes),
+		shards_(std::bit_floor(std::clamp<uint64_t>(capacity_bytes / MIN_SHARD_CAPACITY, 1, MAX_SHARD_COUNT))),
+		shard_mask_(shards_.size() - 1),
+		shard_capacity_(capacity_bytes / shards_.size()),
+		small_capacity_(shard_capacity_ * SMALL_QUEUE_PERCENT / 100) {}
+
+	BlockCache::Shard& BlockCache::ShardFor(size_t key_hash) {
+		return shards_[key_hash & shard_mask_];
+	}
+
+	std::optional<BlockRecord> BlockCache::Hit(Shard& shard, std::string_view hash) {
+		std::shared_lock lock(shard.mutex);
+		auto it = shard.entries.find(hash);
+		if (it == shard.entries.end()) {
+			return std::nullopt;
+		}
+		const Entry& entry = *it->second;
+		// Гонка двух попаданий может потерять инкремент, для оценки частоты это не важно
+		const auto freq = entry.freq.load(std::memory_order_relaxed);
+		if (freq < MAX_FREQ) {
+			entry.freq.store(freq + 1, std::memory_order_relaxed);
+		}
+		shard.hits.fetch_add(1, std::memory_order_relaxed);
+		return entry.record;
+	}
+
+	BlockLookup BlockCache::Materialize(Shard& shard, std::string_view hash) {
+		shard.misses.fetch_add(1, std::memory_order_relaxed);
+		auto flight = std::make_shared<BlockFlight>();
+		{
+			std::unique_lock lock(shard.mutex);
+			if (auto it = shard.entries.find(hash); it != shard.entries.end()) {
+				// другой поток успел положить блок в кэш
+				return {it->second->record, nullptr};
+			}
+			if (auto it = shard.flights.find(hash); it != shard.flights.end()) {
+				++shard.coalesced;
+				return {{}, it->second};
+			}
+			shard.flights.emplace(hash, flight);
+			++shard.materializations;
+		}
+
+		// Блок запрашивается вне блокировки, чтобы не задерживать попадания в шард
+		BlockRecord record;
+		try {
+			record = upstream_.GetBlock(hash);
+		} catch (...) {
+			{
+				std::unique_lock lock(shard.mutex);
+				shard.flights.erase(shard.flights.find(hash));
+			}
+			flight->Fail(std::current_exception());
+			throw;
+		}
+
+		// заголовок записи ответа кодируется один раз на блок, а не в каждом запросе
+		record.data = AttachWireHead(std::move(record.data), hash);
+		const uint64_t cost = record.data.size() + record.data.wire_head.size() + hash.size() + ENTRY_OVERHEAD;
+		{
+			std::unique_lock lock(shard.mutex);
+			if (cost <= shard_capacity_) {
+				Insert(shard, hash, record, cost);
+			}
+			shard.flights.erase(shard.flights.find(hash));
+		}
+		flight->Complete(record);
+		return {std::move(record), nullptr};
+	}
+
+	BlockRecord BlockCache::GetBlock(std::string_view hash) {
+		auto& shard = ShardFor(TransparentHash{}(hash));
+		if (auto record = Hit(shard, hash)) {
+			return *std::move(record);
+		}
+		auto found = Materialize(shard, hash);
+		if (found.flight) {
+			return found.flight->Wait();
+		}
+		return std::move(found.record);
+	}
+
+	BlockLookup BlockCache::LookupBlock(std::string_view hash) {
+		auto& shard = ShardFor(TransparentHash{}(hash));
+		if (auto record = Hit(shard, hash)) {
+			return {*std::move(record), nullptr};
+		}
+		return Materialize(shard, hash);
+	}
+
+	DeflatedBlockPtr BlockCache::GetDeflatedBlock(std::string_view hash) {
+		auto found = LookupDeflatedBlock(hash);
+		if (found.flight) {
+			return found.flight->Wait();
+		}
+		return std::move(found.deflated);
+	}
+
+	DeflatedLookup BlockCache::LookupDeflatedBlock(std::string_view hash) {
+		auto& shard = ShardFor(TransparentHash{}(hash));
+		{
+			std::shared_lock lock(shard.mutex);
+			if (auto it = shard.entries.find(hash); it != shard.entries.end() && it->second->deflated) {
+				const Entry& entry = *it->second;
+				const auto freq = entry.freq.load(std::memory_order_relaxed);
+				if (freq < MAX_FREQ) {
+					entry.freq.store(freq + 1, std::memory_order_relaxed);
+				}
+				shard.hits.fetch_add(1, std::memory_order_relaxed);
+				return {entry.deflated, nullptr};
+			}
+		}
+		return Deflate(shard, hash);
+	}
+
+	DeflatedLookup BlockCache::Deflate(Shard& shard, std::string_view hash) {
+		auto flight = std::make_shared<DeflateFlight>();
+		{
+			std::unique_lock lock(shard.mutex);
+			if (auto it = shard.entries.find(hash); it != shard.entries.end() && it->second->deflated) {
+				// другой поток успел сжать блок
+				return {it->second->deflated, nullptr};
+			}
+			if (auto it = shard.deflating.find(hash); it != shard.deflating.end()) {
+				++shard.coalesced;
+				return {nullptr, it->second};
+			}
+			shard.deflating.emplace(hash, flight);
+			++shard.deflations;
+		}
+
+		// Исходный блок попадает в кэш как обычно, сжатие идёт вне блокировки
+		DeflatedBlockPtr deflated;
+		try {
+			deflated = DeflateBlock(GetBlock(hash).data.bytes);
+		} catch (...) {
+			{
+				std::unique_lock lock(shard.mutex);
+				shard.deflating.erase(shard.deflating.find(hash));
+			}
+			flight->Fail(std::current_exception());
+			throw;
+		}
+
+		{
+			std::unique_lock lock(shard.mutex);
+			AttachDeflated(shard, hash, deflated);
+			shard.deflating.erase(shard.deflating.find(hash));
+		}
+		flight->Complete(deflated);
+		return {std::move(deflated), nullptr};
+	}
+
+	void BlockCache::AttachDeflated(Shard& shard, std::string_view hash, const DeflatedBlockPtr& deflated) {
+		auto it = shard.entries.find(hash);
+		if (it == shard.entries.end()) {
+			// блок не поместился в кэш или уже вытеснен
+			return;
+		}
+		Entry& entry = *it->second;
+		const uint64_t cost = deflated->bytes.size();
+		if (entry.cost + cost > shard_capacity_) {
+			return;
+		}
+		// запись уходит из очередей на время освобождения места, чтобы не вытеснить её саму
+		Queue& queue = entry.in_main ? shard.main : shard.small;
+		Queue detached;
+		detached.splice(detached.begin(), queue, it->second);
+		(entry.in_main ? shard.main_bytes : shard.small_bytes) -= entry.cost;
+		MakeRoom(shard, entry.cost + cost);
+		entry.deflated = deflated;
+		entry.cost += cost;
+		(entry.in_main ? shard.main_bytes : shard.small_bytes) += entry.cost;
+		queue.splice(queue.begin(), detached);
+		++shard.deflated_blocks;
+		shard.deflated_bytes += cost;
+	}
+
+	void BlockCache::MakeRoom(Shard& shard, uint64_t cost) {
+		while (shard.small_bytes + shard.main_bytes + cost > shard_capacity_
+			&& !(shard.small.empty() && shard.main.empty())) {
+			if (!shard.small.empty() && (shard.small_bytes >= small_capacity_ || shard.main.empty())) {
+				EvictSmall(shard);
+			} else {
+				EvictMain(shard);
+			}
+		}
+	}
+
+	void BlockCache::Insert(Shard& shard, std::string_view hash, const BlockRecord& record, uint64_t cost) {
+		MakeRoom(shard, cost);
+
+		// Токен недавно вытеснялся из малой очереди: блок востребован, сразу в основную
+		bool in_main = false;
+		if (auto ghost = shard.ghost_index.find(hash); ghost != shard.ghost_index.end()) {
+			auto ghost_it = ghost->second;
+			shard.ghost_index.erase(ghost);
+			shard.ghost.erase(ghost_it);
+			in_main = true;
+		}
+
+		Queue& queue = in_main ? shard.main : shard.small;
+		Entry& entry = queue.emplace_front();
+		entry.hash = hash;
+		entry.record = record;
+		entry.cost = cost;
+		entry.in_main = in_main;
+		(in_main ? shard.main_bytes : shard.small_bytes) += cost;
+		shard.entries.emplace(entry.hash, queue.begin());
+		++shard.insertions;
+	}
+
+	void BlockCache::EvictSmall(Shard& shard) {
+		while (!shard.small.empty()) {
+			auto tail = std::prev(shard.small.end());
+			if (tail->freq.load(std::memory_order_relaxed) > 1) {
+				// к блоку обращались повторно — переводим в основную очередь
+				tail->freq.store(0, std::memory_order_relaxed);
+				tail->in_main = true;
+				shard.small_bytes -= tail->cost;
+				shard.main_bytes += tail->cost;
+				shard.main.splice(shard.main.begin(), shard.small, tail);
+				continue;
+			}
+			AddGhost(shard, tail->hash);
+			Remove(shard, shard.small, tail);
+			return;
+		}
+	}
+
+	void BlockCache::EvictMain(Shard& shard) {
+		while (!shard.main.empty()) {
+			auto tail = std::prev(shard.main.end());
+			const auto freq = tail->freq.load(std::memory_order_relaxed);
+			if (freq > 0) {
+				// второй шанс: возвращаем в голову очереди с уменьшенной частотой
+				tail->freq.store(freq - 1, std::memory_order_relaxed);
+				shard.main.splice(shard.main.begin(), shard.main, tail);
+				continue;
+			}
+			Remove(shard, shard.main, tail);
+			return;
+		}
+	}
+
+	void BlockCache::Remove(Shard& shard, Queue& queue, Queue::iterator it) {
+		(it->in_main ? shard.main_bytes : shard.small_bytes) -= it->cost;
+		if (it->deflated) {
+			--shard.deflated_blocks;
+			shard.deflated_bytes -= it->deflated->bytes.size();
+		}
+		++shard.evictions;
+		shard.evicted_bytes += it->cost;
+		shard.entries.erase(std::string_view{it->hash});
+		queue.erase(it);
+	}
+
+	void BlockCache::AddGhost(Shard& shard, std::string hash) {
+		// Призрак помнит не больше токенов, чем сейчас блоков в шарде
+		const size_t ghost_capacity = std::max<size_t>(shard.entries.size(), 16);
+		while (shard.ghost.size() >= ghost_capacity) {
+			shard.ghost_index.erase(std::string_view{shard.ghost.back()});
+			shard.ghost.pop_back();
+		}
+		shard.ghost.push_front(std::move(hash));
+		shard.ghost_index.emplace(shard.ghost.front(), shard.ghost.begin());
+	}
+
+	void BlockCache::ForEachBlock(const std::function<void(std::string_view hash, const BlockRecord& record)>& fn) const {
+		std::vector<std::pair<std::string, BlockRecord>> blocks;
+		for (const auto& shard : shards_) {
+			blocks.clear();
+			{
+				// копируются только токены и ссылки на блоки
+				std::shared_lock lock(shard.mutex);
+				blocks.reserve(shard.entries.size());
+				for (const Queue* queue : {&shard.small, &shard.main}) {
+					for (const Entry& entry : *queue) {
+						blocks.emplace_back(entry.hash, entry.record);
+					}
+				}
+			}
+			for (const auto& [hash, record] : blocks) {
+				fn(hash, record);
+			}
+		}
+	}
+
+	BlockCacheStats BlockCache::Stats() const {
+		BlockCacheStats stats;
+		for (const auto& shard : shards_) {
+			std::shared_lock lock(shard.mutex);
+			stats.hits += shard.hits.load(std::memory_order_relaxed);
+			stats.misses += shard.misses.load(std::memory_order_relaxed);
+			stats.coalesced += shard.coalesced;
+			stats.materializations += shard.materializations;
+			stats.insertions += shard.insertions;
+			stats.evictions += shard.evictions;
+			stats.evicted_bytes += shard.evicted_bytes;
+			stats.bytes += shard.small_bytes + shard.main_bytes;
+			stats.blocks += shard.entries.size();
+			stats.deflated_blocks += shard.deflated_blocks;
+			stats.deflated_bytes += shard.deflated_bytes;
+			stats.deflations += shard.deflations;
+		}
+		return stats;
+	}
+}  // namespace storage
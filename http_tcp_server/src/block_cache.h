@@ -0,0 +1,162 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "block_store.h"
+
+namespace storage {
+
+    /// @brief Счётчики кэша блоков
+    struct BlockCacheStats {
+        uint64_t hits{0};
+        uint64_t misses{0};
+        // промахи, дождавшиеся чужой материализации или чужого сжатия того же блока
+        uint64_t coalesced{0};
+        // обращения к источнику за блоком
+        uint64_t materializations{0};
+        uint64_t insertions{0};
+        uint64_t evictions{0};
+        uint64_t evicted_bytes{0};
+        // занятый кэшем объём и число блоков в нём
+        uint64_t bytes{0};
+        uint64_t blocks{0};
+        // сжатые формы блоков, их объём входит в bytes
+        uint64_t deflated_blocks{0};
+        uint64_t deflated_bytes{0};
+        // сжатия блоков при промахах по сжатой форме
+        uint64_t deflations{0};
+    };
+
+    /// @brief Кэш готовых блоков с ограничением по памяти перед другим источником блоков.
+    /// Вытеснение по алгоритму S3-FIFO: новые блоки попадают в малую очередь (10% объёма),
+    /// во вторую, основную, переходят только блоки, к которым обращались повторно,
+    /// а очередь-призрак помнит токены недавно вытесненных блоков.
+    /// Однократный проход по множеству уникальных токенов не вымывает из кэша
+    /// часто запрашиваемые блоки. Попадание берёт только разделяемую блокировку шарда.
+    /// Вместе с блоком хранится готовый заголовок его записи HashAndBlock (BlockData::wire_head).
+    /// Одновременные промахи по одному токену обращаются к источнику один раз:
+    /// первый материализует блок, остальные ждут его готовности. Так же однократно
+    /// сжимается блок при одновременных запросах его сжатой формы.
+    class BlockCache : public BlockSource {
+    public:
+        /// @param upstream источник блоков при промахе
+        /// @param capacity_bytes бюджет памяти кэша в байтах
+        BlockCache(BlockSource& upstream, uint64_t capacity_bytes);
+
+        BlockCache(const BlockCache&) = delete;
+        BlockCache& operator=(const BlockCache&) = delete;
+
+        BlockRecord GetBlock(std::string_view hash) override;
+
+        /// @brief Промах, пока блок материализует другой запрос,
+        /// возвращает материализацию вместо блокирующего ожидания
+        BlockLookup LookupBlock(std::string_view hash) override;
+
+        /// @brief Сжатая форма блока вычисляется один раз и хранится в записи кэша
+        /// вместе с исходным блоком, её размер входит в стоимость записи
+        DeflatedBlockPtr GetDeflatedBlock(std::string_view hash) override;
+
+        /// @brief Промах, пока блок сжимает другой запрос,
+        /// возвращает его сжатие вместо блокирующего ожидания
+        DeflatedLookup LookupDeflatedBlock(std::string_view hash) override;
+
+        /// @brief Обход блоков, лежащих в кэше. Записи шарда копируются
+        /// под разделяемой блокировкой, функция вызывается уже без неё.
+        void ForEachBlock(const std::function<void(std::string_view hash, const BlockRecord& record)>& fn) const;
+
+        /// @brief Счётчики, сведённые по всем шардам
+        BlockCacheStats Stats() const;
+
+        uint64_t Capacity() const {
+            return capacity_bytes_;
+        }
+
+    private:
+        struct TransparentHash {
+            using is_transparent = void;
+            size_t operator()(std::string_view hash) const noexcept {
+                return std::hash<std::string_view>{}(hash);
+            }
+        };
+
+        struct Entry {
+            std::string hash;
+            BlockRecord record;
+            // сжатая форма блока, появляется при первом запросе со сжатием
+            DeflatedBlockPtr deflated;
+            uint64_t cost;
+            // число обращений после вставки, насыщается на 3
+            mutable std::atomic<uint8_t> freq{0};
+            bool in_main{false};
+        };
+
+        using Queue = std::list<Entry>;
+
+        struct alignas(64) Shard {
+            mutable std::shared_mutex mutex;
+            // ключи указывают на Entry::hash, узлы списков не перемещаются в памяти
+            std::unordered_map<std::string_view, Queue::iterator, TransparentHash, std::equal_to<>> entries;
+            // голова очереди — новые записи, хвост — кандидаты на вытеснение
+            Queue small;
+            Queue main;
+            uint64_t small_bytes{0};
+            uint64_t main_bytes{0};
+            // очередь-призрак: только токены
+            std::list<std::string> ghost;
+            std::unordered_map<std::string_view, std::list<std::string>::iterator, TransparentHash, std::equal_to<>> ghost_index;
+            // блоки, которые сейчас запрашиваются у источника
+            std::unordered_map<std::string, std::shared_ptr<BlockFlight>, TransparentHash, std::equal_to<>> flights;
+            // блоки, которые сейчас сжимаются
+            std::unordered_map<std::string, std::shared_ptr<DeflateFlight>, TransparentHash, std::equal_to<>> deflating;
+
+            std::atomic<uint64_t> hits{0};
+            std::atomic<uint64_t> misses{0};
+            uint64_t coalesced{0};
+            uint64_t materializations{0};
+            uint64_t insertions{0};
+            uint64_t evictions{0};
+            uint64_t evicted_bytes{0};
+            uint64_t deflated_blocks{0};
+            uint64_t deflated_bytes{0};
+            uint64_t deflations{0};
+        };
+
+        Shard& ShardFor(size_t key_hash);
+
+        // попадание под разделяемой блокировкой
+        std::optional<BlockRecord> Hit(Shard& shard, std::string_view hash);
+        // промах: блок запрашивает у источника первый из одновременных промахов
+        BlockLookup Materialize(Shard& shard, std::string_view hash);
+        // промах по сжатой форме: блок сжимает первый из одновременных промахов
+        DeflatedLookup Deflate(Shard& shard, std::string_view hash);
+        // сжатая форма кладётся в запись блока, если запись ещё в кэше
+        void AttachDeflated(Shard& shard, std::string_view hash, const DeflatedBlockPtr& deflated);
+
+        // вызываются под исключительной блокировкой шарда
+        void Insert(Shard& shard, std::string_view hash, const BlockRecord& record, uint64_t cost);
+        void MakeRoom(Shard& shard, uint64_t cost);
+        void EvictSmall(Shard& shard);
+        void EvictMain(Shard& shard);
+        void Remove(Shard& shard, Queue& queue, Queue::iterator it);
+        void AddGhost(Shard& shard, std::string hash);
+
+    private:
+        BlockSource& upstream_;
+        uint64_t capacity_bytes_;
+        std::vector<Shard> shards_;
+        size_t shard_mask_;
+        // бюджеты одного шарда
+        uint64_t shard_capacity_;
+        uint64_t small_capacity_;
+    };
+
+} // namespace storage
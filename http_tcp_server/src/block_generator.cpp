@@ -0,0 +1,152 @@
+#include "block_generator.h"
+
+#include <cstring>
+#include <random>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BLOCK_GENERATOR_X86
+#endif
+
+namespace generator {
+	namespace {
+		constexpr uint32_t ALPHABET_SIZE{61};
+
+		/// @brief Символ алфавита по номеру [0, 61): '0'-'9', 'A'-'Z', 'a'-'w', 'y', 'z'
+		char AlphabetChar(uint8_t index) {
+			return static_cast<char>('0' + index
+				+ (index > 9 ? 7 : 0)
+				+ (index > 35 ? 6 : 0)
+				+ (index > 58 ? 1 : 0));
+		}
+
+		/// @brief Символ по 16 случайным битам: номер (bits * 61) >> 16
+		char BitsToChar(uint16_t bits) {
+			return AlphabetChar(static_cast<uint8_t>((bits * ALPHABET_SIZE) >> 16));
+		}
+
+		/// @brief Скалярное ядро: по 4 символа на случайное число, лишние биты последнего числа отбрасываются
+		void FillScalar(char* buffer, size_t length, WyRand& random) {
+			while (length > 0) {
+				uint64_t word = random.Next();
+				const size_t count = length < 4 ? length : 4;
+				for (size_t i = 0; i < count; ++i) {
+					*buffer++ = BitsToChar(static_cast<uint16_t>(word));
+					word >>= 16;
+				}
+				length -= count;
+			}
+		}
+
+#ifdef BLOCK_GENERATOR_X86
+		// Номер символа (bits * 61) >> 16 — старшая половина беззнакового 16-битного произведения
+		// (mulhi_epu16), затем номер переводится в символ сравнениями: к '0' + index добавляются
+		// 7 после '9', ещё 6 после 'Z' и 1 после 'w', чтобы пропустить 'x'.
+
+		__attribute__((target("sse2")))
+		__m128i IndexToCharSse2(__m128i index) {
+			__m128i chars = _mm_add_epi8(index, _mm_set1_epi8('0'));
+			chars = _mm_add_epi8(chars, _mm_and_si128(_mm_cmpgt_epi8(index, _mm_set1_epi8(9)), _mm_set1_epi8(7)));
+			chars = _mm_add_epi8(chars, _mm_and_si128(_mm_cmpgt_epi8(index, _mm_set1_epi8(35)), _mm_set1_epi8(6)));
+			chars = _mm_add_epi8(chars, _mm_and_si128(_mm_cmpgt_epi8(index, _mm_set1_epi8(58)), _mm_set1_epi8(1)));
+			return chars;
+		}
+
+		__attribute__((target("sse2")))
+		void FillSse2(char* buffer, size_t length, WyRand& random) {
+			const __m128i multiplier = _mm_set1_epi16(ALPHABET_SIZE);
+			for (; length >= 16; length -= 16, buffer += 16) {
+				uint64_t words[4] = {random.Next(), random.Next(), random.Next(), random.Next()};
+				__m128i low;
+				__m128i high;
+				std::memcpy(&low, words, sizeof(low));
+				std::memcpy(&high, words + 2, sizeof(high));
+				const __m128i index = _mm_packus_epi16(_mm_mulhi_epu16(low, multiplier), _mm_mulhi_epu16(high, multiplier));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(buffer), IndexToCharSse2(index));
+			}
+			FillScalar(buffer, length, random);
+		}
+
+		__attribute__((target("avx2")))
+		void FillAvx2(char* buffer, size_t length, WyRand& random) {
+			const __m256i multiplier = _mm256_set1_epi16(ALPHABET_SIZE);
+			for (; length >= 32; length -= 32, buffer += 32) {
+				uint64_t words[8];
+				for (auto& word : words) {
+					word = random.Next();
+				}
+				__m256i low;
+				__m256i high;
+				std::memcpy(&low, words, sizeof(low));
+				std::memcpy(&high, words + 4, sizeof(high));
+				// pack в AVX2 работает внутри 128-битных половин: перестановка 64-битных четвертей
+				// возвращает номерам порядок случайных чисел
+				const __m256i packed = _mm256_packus_epi16(_mm256_mulhi_epu16(low, multiplier), _mm256_mulhi_epu16(high, multiplier));
+				const __m256i index = _mm256_permute4x64_epi64(packed, 0xD8);
+				__m256i chars = _mm256_add_epi8(index, _mm256_set1_epi8('0'));
+				chars = _mm256_add_epi8(chars, _mm256_and_si256(_mm256_cmpgt_epi8(index, _mm256_set1_epi8(9)), _mm256_set1_epi8(7)));
+				chars = _mm256_add_epi8(chars, _mm256_and_si256(_mm256_cmpgt_epi8(index, _mm256_set1_epi8(35)), _mm256_set1_epi8(6)));
+				chars = _mm256_add_epi8(chars, _mm256_and_si256(_mm256_cmpgt_epi8(index, _mm256_set1_epi8(58)), _mm256_set1_epi8(1)));
+				_mm256_storeu_si256(reinterpret_cast<__m256i*>(buffer), chars);
+			}
+			FillScalar(buffer, length, random);
+		}
+#endif
+
+		using FillFunction = void (*)(char*, size_t, WyRand&);
+
+		struct Kernel {
+			FillFunction fill;
+			std::string_view name;
+		};
+
+		Kernel SelectKernel() {
+#ifdef BLOCK_GENERATOR_X86
+			__builtin_cpu_init();
+			if (__builtin_cpu_supports("avx2")) {
+				return {FillAvx2, "avx2"};
+			}
+			if (__builtin_cpu_supports("sse2")) {
+				return {FillSse2, "sse2"};
+			}
+#endif
+			return {FillScalar, "scalar"};
+		}
+
+		const Kernel& ActiveKernelImpl() {
+			static const Kernel kernel = SelectKernel();
+			return kernel;
+		}
+	}
+
+	WyRand& ThreadRandom() {
+		thread_local WyRand random{[] {
+			std::random_device random_device;
+			return (static_cast<uint64_t>(random_device()) << 32) | random_device();
+		}()};
+		return random;
+	}
+
+	void FillAlphabet(char* buffer, size_t length, WyRand& random) {
+		ActiveKernelImpl().fill(buffer, length, random);
+	}
+
+	uint64_t SeedFromHash(std::string_view hash) {
+		// FNV-1a с финальным перемешиванием из splitmix64
+		uint64_t value = 14695981039346656037ull;
+		for (unsigned char c : hash) {
+			value ^= c;
+			value *= 1099511628211ull;
+		}
+		value ^= value >> 30;
+		value *= 0xbf58476d1ce4e5b9ull;
+		value ^= value >> 27;
+		value *= 0x94d049bb133111ebull;
+		value ^= value >> 31;
+		return value;
+	}
+
+	std::string_view ActiveKernel() {
+		return ActiveKernelImpl().name;
+	}
+}  // namespace generator
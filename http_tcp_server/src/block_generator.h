@@ -0,0 +1,52 @@
+#pragma once
+#include <cstdint>
+#include <string_view>
+
+namespace generator {
+
+    /// @brief Быстрый некриптографический генератор wyrand: одно умножение 64x64->128 на число.
+    /// Состояние — одно 64-битное слово, поэтому генератор дёшево держать в каждом потоке
+    /// и заводить заново от seed для детерминированной генерации.
+    class WyRand {
+    public:
+        explicit WyRand(uint64_t seed) :
+            state_(seed) {
+        }
+
+        uint64_t Next() {
+            state_ += 0xa0761d6478bd642full;
+            const __uint128_t product = static_cast<__uint128_t>(state_) * (state_ ^ 0xe7037ed1a0b428dbull);
+            return static_cast<uint64_t>(product >> 64) ^ static_cast<uint64_t>(product);
+        }
+
+        /// @brief Равномерное число в [0, range) без деления (метод Лемира)
+        uint32_t Below(uint32_t range) {
+            return static_cast<uint32_t>(((Next() >> 32) * range) >> 32);
+        }
+
+    private:
+        uint64_t state_;
+    };
+
+    /// @brief Генератор текущего потока, один раз инициализируется из std::random_device
+    WyRand& ThreadRandom();
+
+    /// @brief Заполняет буфер символами алфавита блоков (61 символ: цифры, A-Z, a-z без x).
+    /// Каждые 16 случайных бит b отображаются в символ с номером (b * 61) >> 16:
+    /// на символ приходится 1074 или 1075 из 65536 значений, так что перекос частот
+    /// не больше 0.1% (отображение байта (b * 61) >> 8 давало 4 или 5 прообразов, до 25%).
+    /// Используются векторные ядра AVX2 или SSE2, если процессор их поддерживает;
+    /// все ядра расходуют генератор одинаково и дают побайтно одинаковый результат.
+    /// @param buffer буфер
+    /// @param length число символов
+    /// @param random генератор
+    void FillAlphabet(char* buffer, size_t length, WyRand& random);
+
+    /// @brief Начальное значение генератора, выведенное из токена.
+    /// Позволяет заново получить тот же блок по одному токену, ничего не храня.
+    uint64_t SeedFromHash(std::string_view hash);
+
+    /// @brief Имя выбранного ядра заполнения: "avx2", "sse2" или "scalar"
+    std::string_view ActiveKernel();
+
+} // namespace generator
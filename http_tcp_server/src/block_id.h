@@ -0,0 +1,73 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <string_view>
+
+namespace storage {
+
+    // максимальный размер токена
+    inline constexpr size_t MAX_HASH_SIZE{128};
+
+    /// @brief Хэш последовательности байт: по 16 байт за шаг, перемешивание
+    /// умножением 64x64->128 (как в wyhash). Для 128-байтного токена — 8 умножений.
+    inline uint64_t HashBytes(const void* data, size_t size, uint64_t seed = 0) {
+        constexpr uint64_t K0 = 0xa0761d6478bd642full;
+        constexpr uint64_t K1 = 0xe7037ed1a0b428dbull;
+        const auto mix = [](uint64_t a, uint64_t b) {
+            const __uint128_t product = static_cast<__uint128_t>(a) * b;
+            return static_cast<uint64_t>(product >> 64) ^ static_cast<uint64_t>(product);
+        };
+        const auto* bytes = static_cast<const unsigned char*>(data);
+        uint64_t hash = seed ^ K0 ^ size;
+        for (; size >= 16; size -= 16, bytes += 16) {
+            uint64_t a, b;
+            std::memcpy(&a, bytes, 8);
+            std::memcpy(&b, bytes + 8, 8);
+            hash = mix(a ^ K1 ^ hash, b ^ K0);
+        }
+        if (size > 0) {
+            uint64_t tail[2] = {0, 0};
+            std::memcpy(tail, bytes, size);
+            hash = mix(tail[0] ^ K1 ^ hash, tail[1] ^ K0);
+        }
+        return mix(hash ^ K1, hash ^ K0);
+    }
+
+    /// @brief Идентификатор блока фиксированной длины MAX_HASH_SIZE.
+    /// Занимает ровно две кэш-линии и выровнен по ним.
+    class alignas(64) BlockId {
+    public:
+        BlockId() = default;
+
+        /// @brief Идентификатор из токена
+        /// @return std::nullopt, если длина токена не MAX_HASH_SIZE
+        static std::optional<BlockId> FromHash(std::string_view hash) {
+            if (hash.size() != MAX_HASH_SIZE) {
+                return std::nullopt;
+            }
+            BlockId id;
+            std::memcpy(id.bytes_.data(), hash.data(), MAX_HASH_SIZE);
+            return id;
+        }
+
+        std::string_view View() const {
+            return {bytes_.data(), bytes_.size()};
+        }
+
+        uint64_t Hash() const {
+            return HashBytes(bytes_.data(), bytes_.size());
+        }
+
+        bool operator==(const BlockId& other) const {
+            return std::memcmp(bytes_.data(), other.bytes_.data(), MAX_HASH_SIZE) == 0;
+        }
+
+    private:
+        std::array<char, MAX_HASH_SIZE> bytes_;
+    };
+
+    static_assert(sizeof(BlockId) == MAX_HASH_SIZE);
+
+} // namespace storage
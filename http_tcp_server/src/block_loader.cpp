@@ -0,0 +1,104 @@
+// Загрузчик блоков в хранилище на диске.
+// Дописывает в сегмент каталога сгенерированные блоки и перестраивает индекс,
+// токены новых блоков выводятся по одному на строку.
+
+#include <boost/program_options.hpp>
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <optional>
+#include <string>
+
+#include "block_store.h"
+#include "mapped_block_store.h"
+#include "random_generator.h"
+
+namespace {
+	using namespace std::literals;
+
+	// Параметры командной строки
+	struct Args {
+		std::string directory;
+		uint64_t count{0};
+		uint32_t max_block_size{storage::MAX_BLOCK_SIZE};
+		// файл, в который дописываются токены новых блоков
+		std::string hashes_file;
+	};
+
+	std::optional<Args> ParseCommandLine(int argc, const char* const argv[]) {
+		namespace po = boost::program_options;
+
+		po::options_description desc{"Usage: block_loader <dir> <count> [options]"s};
+		Args args;
+		desc.add_options()
+			("help,h", "produce help message")
+			("dir", po::value(&args.directory)->required(), "block store directory")
+			("count", po::value(&args.count)->required(), "number of blocks to append")
+			("max-block-size", po::value(&args.max_block_size)->value_name("bytes"s), "maximum block size")
+			("hashes", po::value(&args.hashes_file)->value_name("file"s), "append hashes of new blocks to file instead of stdout");
+
+		po::positional_options_description positional;
+		positional.add("dir", 1).add("count", 1);
+
+		po::variables_map vm;
+		try {
+			po::store(po::command_line_parser(argc, argv).options(desc).positional(positional).run(), vm);
+			if (vm.contains("help"s)) {
+				std::cout << desc;
+				return std::nullopt;
+			}
+			po::notify(vm);
+		} catch (const po::error& e) {
+			std::cerr << e.what() << std::endl << desc;
+			return std::nullopt;
+		}
+		if (args.max_block_size == 0 || args.max_block_size > storage::MAX_BLOCK_SIZE) {
+			std::cerr << "max-block-size must be in [1, "sv << storage::MAX_BLOCK_SIZE << "]"sv << std::endl;
+			return std::nullopt;
+		}
+		return args;
+	}
+}
+
+int main(int argc, const char* argv[]) {
+	const auto args = ParseCommandLine(argc, argv);
+	if (!args) {
+		return EXIT_FAILURE;
+	}
+
+	try {
+		std::ofstream hashes_file;
+		if (!args->hashes_file.empty()) {
+			hashes_file.open(args->hashes_file, std::ios::app);
+			if (!hashes_file) {
+				std::cerr << "Failed to open "sv << args->hashes_file << std::endl;
+				return EXIT_FAILURE;
+			}
+		}
+		std::ostream& hashes = args->hashes_file.empty() ? std::cout : hashes_file;
+
+		const auto start = std::chrono::steady_clock::now();
+		uint64_t bytes = 0;
+		{
+			storage::BlockSegmentWriter writer(args->directory);
+			for (uint64_t i = 0; i < args->count; ++i) {
+				const auto hash = RandomString(storage::MAX_HASH_SIZE);
+				const auto block = RandomString(RandomNumber(1, args->max_block_size));
+				writer.Append(hash, RandomUnsignedInt32Number(), block);
+				bytes += block.size();
+				hashes << hash << '\n';
+			}
+		}
+		storage::MappedBlockStore::BuildIndex(args->directory);
+
+		const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+		const storage::MappedBlockStore store(args->directory);
+		std::cerr << "Appended "sv << args->count << " blocks, "sv << bytes << " bytes in "sv << elapsed.count()
+			<< " s, store has "sv << store.Size() << " blocks"sv << std::endl;
+	} catch (const std::exception& e) {
+		std::cerr << "block_loader: "sv << e.what() << std::endl;
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,65 @@
+#include "block_snapshot.h"
+
+#include <utility>
+
+namespace storage {
+	BlockSnapshot::BlockSnapshot(std::filesystem::path directory, BlockStore& store, const BlockCache& cache,
+		const MappedBlockStore* restored) :
+		directory_(std::move(directory)),
+		store_(store),
+		cache_(cache),
+		restored_(restored) {
+		// Хвост сегмента за проиндексированной частью — недописанный снимок, например после падения:
+		// новые записи после него индекс бы уже не нашёл
+		const auto segment_path = directory_ / SEGMENT_FILE_NAME;
+		if (restored_ && std::filesystem::file_size(segment_path) > restored_->IndexedSegmentSize()) {
+			std::filesystem::resize_file(segment_path, restored_->IndexedSegmentSize());
+		}
+	}
+
+	void BlockSnapshot::CreateStore(const std::filesystem::path& directory) {
+		if (std::filesystem::exists(directory / SEGMENT_FILE_NAME)) {
+			return;
+		}
+		{
+			BlockSegmentWriter writer(directory);
+		}
+		MappedBlockStore::BuildIndex(directory);
+	}
+
+	SnapshotStats BlockSnapshot::Write() {
+		std::lock_guard lock(mutex_);
+		SnapshotStats stats;
+		{
+			BlockSegmentWriter writer(directory_);
+			const auto append = [&](std::string_view hash, uint32_t block_num, std::string_view block) {
+				writer.Append(hash, block_num, block);
+				written_.emplace(hash);
+				++stats.blocks;
+				stats.bytes += block.size();
+			};
+			const auto on_disk = [this](std::string_view hash) {
+				return written_.contains(std::string(hash)) || (restored_ && restored_->Find(hash));
+			};
+
+			// готовые блоки из кэша пишутся как есть
+			cache_.ForEachBlock([&](std::string_view hash, const BlockRecord& record) {
+				if (!on_disk(hash)) {
+					append(hash, record.block_num, record.data.bytes);
+				}
+			});
+			// остальные токены хранилища: блок генерируется заново по номеру
+			store_.ForEachRecord([&](std::string_view hash, uint32_t, size_t) {
+				if (!on_disk(hash)) {
+					const auto record = store_.GetBlock(hash);
+					append(hash, record.block_num, record.data.bytes);
+				}
+			});
+		}
+		if (stats.blocks > 0) {
+			MappedBlockStore::BuildIndex(directory_);
+		}
+		stats.total_blocks = MappedBlockStore::IndexedBlockCount(directory_);
+		return stats;
+	}
+}  // namespace storage
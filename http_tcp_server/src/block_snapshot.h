@@ -0,0 +1,61 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+
+#include "block_cache.h"
+#include "block_store.h"
+#include "mapped_block_store.h"
+
+namespace storage {
+
+    /// @brief Итог записи снимка
+    struct SnapshotStats {
+        // блоки и байты блоков, дописанные в сегмент этим снимком
+        uint64_t blocks{0};
+        uint64_t bytes{0};
+        // блоков в индексе после записи
+        uint64_t total_blocks{0};
+    };
+
+    /// @brief Снимок блоков, сгенерированных в памяти, в каталоге хранилища на диске.
+    /// Формат снимка — формат MappedBlockStore с версией в сигнатурах файлов: новые записи
+    /// дописываются в сегмент, а индекс строится во временном файле и атомарно подменяет старый.
+    /// Поэтому снимок пишется без остановки сервера, а после перезапуска каталог открывается
+    /// отображением в память, и время до начала обслуживания определяется загрузкой индекса.
+    /// В снимок попадают блоки из кэша и токены, известные хранилищу в памяти;
+    /// каждый токен пишется в сегмент один раз.
+    class BlockSnapshot {
+    public:
+        /// @param directory каталог хранилища
+        /// @param store хранилище в памяти: номера и содержимое блоков, которых нет в кэше
+        /// @param cache кэш готовых блоков
+        /// @param restored хранилище, открытое из этого каталога при запуске, его блоки уже на диске
+        BlockSnapshot(std::filesystem::path directory, BlockStore& store, const BlockCache& cache,
+            const MappedBlockStore* restored = nullptr);
+
+        BlockSnapshot(const BlockSnapshot&) = delete;
+        BlockSnapshot& operator=(const BlockSnapshot&) = delete;
+
+        /// @brief Дописывает в сегмент блоки, которых ещё нет на диске, и перестраивает индекс.
+        /// Блокировки шардов хранилища и кэша берутся только на копирование их записей.
+        /// Одновременные вызовы выполняются по очереди.
+        SnapshotStats Write();
+
+        /// @brief Создаёт в каталоге пустое хранилище, если его там ещё нет
+        static void CreateStore(const std::filesystem::path& directory);
+
+    private:
+        std::filesystem::path directory_;
+        BlockStore& store_;
+        const BlockCache& cache_;
+        const MappedBlockStore* restored_;
+
+        std::mutex mutex_;
+        // токены, дописанные в сегмент после запуска
+        std::unordered_set<std::string> written_;
+    };
+
+} // namespace storage
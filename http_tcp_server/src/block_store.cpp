@@ -0,0 +1,126 @@
+#include "block_store.h"
+#include "block_generator.h"
+#include "random_generator.h"
+
+#include <algorithm>
+#include <bit>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+namespace storage {
+	BlockData MakeBlockData(std::string block) {
+		auto owner = std::make_shared<const std::string>(std::move(block));
+		BlockData data;
+		data.bytes = *owner;
+		data.owner = std::move(owner);
+		return data;
+	}
+
+	BlockStore::BlockStore(BlockOrigin origin, size_t shard_count) :
+		origin_(origin),
+		shards_(std::bit_ceil(std::max<size_t>(1, shard_count))),
+		shard_mask_(shards_.size() - 1) {}
+
+	size_t BlockStore::DefaultShardCount() {
+		return 4 * std::max(1u, std::thread::hardware_concurrency());
+	}
+
+	BlockStore::Shard& BlockStore::ShardFor(uint64_t key_hash) {
+		// старшие биты: младшие использует индекс внутри шарда
+		return shards_[(key_hash >> 48) & shard_mask_];
+	}
+
+	BlockStore::BlockInfo BlockStore::GetBlockInfo(std::string_view hash) {
+		if (origin_ == BlockOrigin::FROM_HASH) {
+			generator::WyRand random(generator::SeedFromHash(hash));
+			const uint32_t block_num = static_cast<uint32_t>(random.Next() >> 32);
+			const uint32_t block_size = 1 + random.Below(MAX_BLOCK_SIZE);
+			return {block_num, block_size, random.Next()};
+		}
+
+		const auto id = BlockId::FromHash(hash);
+		if (!id) {
+			throw std::invalid_argument("invalid hash size");
+		}
+		const uint64_t key_hash = id->Hash();
+		auto& shard = ShardFor(key_hash);
+		{
+			std::shared_lock lock(shard.mutex);
+			if (const auto* info = shard.records.Find(*id, key_hash)) {
+				return {info->block_num, info->block_size, info->block_num};
+			}
+		}
+
+		const StoredInfo new_info{RandomUnsignedInt32Number(), RandomNumber(1, MAX_BLOCK_SIZE)};
+
+		std::unique_lock lock(shard.mutex);
+		// Если другой поток успел создать запись раньше, отдаём его вариант
+		const auto [info, inserted] = shard.records.TryEmplace(*id, key_hash, new_info);
+		return {info->block_num, info->block_size, info->block_num};
+	}
+
+	BlockRecord BlockStore::GetBlock(std::string_view hash) {
+		const auto info = GetBlockInfo(hash);
+
+		BlockRecord record;
+		record.block_num = info.block_num;
+		record.block_size = info.block_size;
+		std::string block(info.block_size, '\0');
+		FillRandomString(block.data(), block.size(), info.seed);
+		record.data = MakeBlockData(std::move(block));
+		return record;
+	}
+
+	uint32_t BlockStore::GetBlockNumber(std::string_view hash) {
+		return GetBlockInfo(hash).block_num;
+	}
+
+	size_t BlockStore::GetBlockSize(std::string_view hash) {
+		return GetBlockInfo(hash).block_size;
+	}
+
+	size_t BlockStore::GetBlockData(std::string_view hash, char* buffer, size_t buffer_size) {
+		const auto info = GetBlockInfo(hash);
+		if (buffer_size < info.block_size) {
+			return 0;
+		}
+		FillRandomString(buffer, info.block_size, info.seed);
+		return info.block_size;
+	}
+
+	void BlockStore::ForEachRecord(const std::function<void(std::string_view hash, uint32_t block_num, size_t block_size)>& fn) const {
+		std::vector<std::pair<BlockId, StoredInfo>> records;
+		for (const auto& shard : shards_) {
+			records.clear();
+			{
+				std::shared_lock lock(shard.mutex);
+				records.reserve(shard.records.Size());
+				shard.records.ForEach([&records](const BlockId& id, const StoredInfo& info) {
+					records.emplace_back(id, info);
+				});
+			}
+			for (const auto& [id, info] : records) {
+				fn(id.View(), info.block_num, info.block_size);
+			}
+		}
+	}
+
+	size_t BlockStore::Size() const {
+		size_t size = 0;
+		for (const auto& shard : shards_) {
+			std::shared_lock lock(shard.mutex);
+			size += shard.records.Size();
+		}
+		return size;
+	}
+
+	size_t BlockStore::MemoryUsage() const {
+		size_t bytes = 0;
+		for (const auto& shard : shards_) {
+			std::shared_lock lock(shard.mutex);
+			bytes += shard.records.MemoryUsage();
+		}
+		return bytes;
+	}
+}  // namespace storage
@@ -0,0 +1,287 @@
+#pragma once
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "block_id.h"
+#include "deflated_block.h"
+#include "flat_index.h"
+
+namespace storage {
+
+    // максимальный размер блока данных на сервере
+    inline constexpr size_t MAX_BLOCK_SIZE{1000000};
+
+    /// @brief Расположение блока в файле, позволяет отдать его через sendfile
+    struct FileRange {
+        int fd{-1};
+        uint64_t offset{0};
+    };
+
+    /// @brief Неизменяемый блок данных, разделяемый между хранилищем и ответами.
+    /// bytes указывает в память, которую удерживает owner.
+    struct BlockData {
+        std::string_view bytes;
+        std::shared_ptr<const void> owner;
+        // для блоков из файла: где лежат байты блока
+        FileRange file;
+        // готовый заголовок записи HashAndBlock этого блока (MakeHashAndBlockHead),
+        // лежит в памяти owner; пуст, если источник его не хранит, и у частей блока
+        std::string_view wire_head;
+
+        const char* data() const {
+            return bytes.data();
+        }
+
+        size_t size() const {
+            return bytes.size();
+        }
+
+        explicit operator bool() const {
+            return owner != nullptr;
+        }
+
+        /// @brief Часть блока без копирования: тот же владелец, смещение в файле сдвигается.
+        /// Диапазон обрезается по границе блока.
+        /// @param offset смещение от начала блока
+        /// @param length длина части
+        BlockData Slice(uint64_t offset, uint64_t length) const {
+            BlockData slice;
+            offset = std::min<uint64_t>(offset, bytes.size());
+            slice.bytes = bytes.substr(offset, std::min<uint64_t>(length, bytes.size() - offset));
+            slice.owner = owner;
+            if (file.fd >= 0) {
+                slice.file = {file.fd, file.offset + offset};
+            }
+            return slice;
+        }
+    };
+
+    /// @brief Блок данных, владеющий строкой в куче
+    BlockData MakeBlockData(std::string block);
+
+    /// @brief Запись хранилища: всё, что известно о блоке по его токену
+    struct BlockRecord {
+        // номер блока данных
+        uint32_t block_num{0};
+        // размер блока данных
+        size_t block_size{0};
+        // блок данных
+        BlockData data;
+    };
+
+    /// @brief Результат, который ждут несколько запросов. Первый промах по токену
+    /// создаёт ожидание и сам получает результат, остальные подписываются на готовность
+    /// и получают тот же разделяемый результат.
+    template <typename T>
+    class Flight {
+    public:
+        /// @brief Подписка на готовность результата.
+        /// Функция вызывается в потоке, завершившем ожидание, и не должна блокироваться.
+        /// @return false, если результат уже готов: тогда функция не вызывается
+        bool OnReady(std::function<void()> callback) {
+            std::lock_guard lock(mutex_);
+            if (ready_) {
+                return false;
+            }
+            waiters_.push_back(std::move(callback));
+            return true;
+        }
+
+        /// @brief Блокирующее ожидание результата, пробрасывает ошибку его получения
+        T Wait() {
+            std::unique_lock lock(mutex_);
+            ready_cv_.wait(lock, [this] { return ready_; });
+            if (error_) {
+                std::rethrow_exception(error_);
+            }
+            return value_;
+        }
+
+        void Complete(T value) {
+            std::unique_lock lock(mutex_);
+            value_ = std::move(value);
+            Finish(std::move(lock));
+        }
+
+        void Fail(std::exception_ptr error) {
+            std::unique_lock lock(mutex_);
+            error_ = std::move(error);
+            Finish(std::move(lock));
+        }
+
+    private:
+        void Finish(std::unique_lock<std::mutex> lock) {
+            ready_ = true;
+            auto waiters = std::move(waiters_);
+            lock.unlock();
+            ready_cv_.notify_all();
+            // подписчики вызываются без блокировки: они могут снова обратиться к ожиданию
+            for (auto& waiter : waiters) {
+                waiter();
+            }
+        }
+
+    private:
+        std::mutex mutex_;
+        std::condition_variable ready_cv_;
+        bool ready_{false};
+        T value_{};
+        std::exception_ptr error_;
+        std::vector<std::function<void()>> waiters_;
+    };
+
+    /// @brief Материализация блока: одновременные промахи по токену запрашивают его у источника один раз
+    using BlockFlight = Flight<BlockRecord>;
+
+    /// @brief Сжатие блока: одновременные запросы сжатой формы сжимают блок один раз
+    using DeflateFlight = Flight<DeflatedBlockPtr>;
+
+    /// @brief Результат поиска блока без ожидания: либо готовая запись,
+    /// либо материализация, на готовность которой можно подписаться
+    struct BlockLookup {
+        BlockRecord record;
+        std::shared_ptr<BlockFlight> flight;
+    };
+
+    /// @brief Результат поиска сжатой формы блока без ожидания: либо готовая форма,
+    /// либо сжатие, на готовность которого можно подписаться
+    struct DeflatedLookup {
+        DeflatedBlockPtr deflated;
+        std::shared_ptr<DeflateFlight> flight;
+    };
+
+    /// @brief Источник блоков данных по токену
+    class BlockSource {
+    public:
+        virtual ~BlockSource() = default;
+
+        /// @brief Запись о блоке по токену
+        /// @param hash токен
+        /// @return запись о блоке
+        virtual BlockRecord GetBlock(std::string_view hash) = 0;
+
+        /// @brief Запись о блоке без ожидания чужой материализации.
+        /// Источники без общих материализаций отдают блок сразу.
+        /// @param hash токен
+        virtual BlockLookup LookupBlock(std::string_view hash) {
+            return {GetBlock(hash), nullptr};
+        }
+
+        /// @brief Блок по токену, сжатый отдельным сегментом deflate.
+        /// Здесь блок сжимается при каждом вызове, кэши хранят сжатую форму рядом с исходной.
+        /// @param hash токен
+        virtual DeflatedBlockPtr GetDeflatedBlock(std::string_view hash) {
+            return DeflateBlock(GetBlock(hash).data.bytes);
+        }
+
+        /// @brief Сжатая форма блока без ожидания чужого сжатия.
+        /// Источники без общих сжатий сжимают блок сразу.
+        /// @param hash токен
+        virtual DeflatedLookup LookupDeflatedBlock(std::string_view hash) {
+            return {GetDeflatedBlock(hash), nullptr};
+        }
+    };
+
+    /// @brief Откуда берутся номер, размер и содержимое блока нового токена
+    enum class BlockOrigin {
+        // случайные номер и размер, запоминаются в хранилище
+        RANDOM,
+        // выводятся из самого токена, хранилищу ничего запоминать не нужно
+        FROM_HASH
+    };
+
+    /// @brief Потокобезопасное хранилище блоков данных.
+    /// Записи разнесены по шардам, у каждого шарда свой std::shared_mutex,
+    /// поэтому запросы к разным токенам не конкурируют за одну блокировку,
+    /// а повторные обращения к одному токену берут только разделяемую блокировку.
+    /// Хранятся только номер и размер блока: сам блок детерминированно
+    /// генерируется по номеру при каждом обращении, поэтому память хранилища
+    /// не зависит от размера блоков. Готовые блоки держит BlockCache.
+    /// В режиме BlockOrigin::FROM_HASH всё выводится из токена и шарды не используются.
+    class BlockStore : public BlockSource {
+    public:
+        /// @param origin откуда берутся блоки новых токенов
+        /// @param shard_count число шардов, округляется вверх до степени двойки
+        explicit BlockStore(BlockOrigin origin = BlockOrigin::RANDOM, size_t shard_count = DefaultShardCount());
+
+        BlockStore(const BlockStore&) = delete;
+        BlockStore& operator=(const BlockStore&) = delete;
+
+        /// @brief Запись о блоке по токену, блок генерируется заново.
+        /// При первом обращении к токену ему назначаются номер и размер блока.
+        /// @param hash токен
+        /// @return запись о блоке
+        BlockRecord GetBlock(std::string_view hash) override;
+
+        /// @brief Номер блока данных по токену
+        /// @param hash токен
+        /// @return номер блока данных
+        uint32_t GetBlockNumber(std::string_view hash);
+
+        /// @brief Размер блока данных по токену
+        /// @param hash токен
+        /// @return размер блока данных
+        size_t GetBlockSize(std::string_view hash);
+
+        /// @brief Имитация обращение к БД
+        /// @param hash токен
+        /// @param buffer буфер
+        /// @param buffer_size размер буфера
+        /// @return размер записанного в буфер блока данных
+        size_t GetBlockData(std::string_view hash, char* buffer, size_t buffer_size);
+
+        /// @brief Обход известных хранилищу токенов. Записи шарда копируются
+        /// под разделяемой блокировкой, функция вызывается уже без неё.
+        /// В режиме BlockOrigin::FROM_HASH хранилище ничего не помнит, и обход пуст.
+        /// @param fn вызывается с токеном, номером и размером блока
+        void ForEachRecord(const std::function<void(std::string_view hash, uint32_t block_num, size_t block_size)>& fn) const;
+
+        /// @brief Число известных хранилищу токенов
+        size_t Size() const;
+
+        /// @brief Память под индекс токенов в байтах
+        size_t MemoryUsage() const;
+
+        /// @brief Число шардов по умолчанию: несколько на каждое ядро
+        static size_t DefaultShardCount();
+
+    private:
+        // номер и размер блока, начальное значение генератора его содержимого
+        struct BlockInfo {
+            uint32_t block_num;
+            uint32_t block_size;
+            uint64_t seed;
+        };
+
+        // то, что хранится в индексе: генератор блока заводится от его номера
+        struct StoredInfo {
+            uint32_t block_num;
+            uint32_t block_size;
+        };
+
+        // шард выровнен по кэш-линии, чтобы мьютексы соседних шардов не делили её
+        struct alignas(64) Shard {
+            mutable std::shared_mutex mutex;
+            FlatIndex<BlockId, StoredInfo> records;
+        };
+
+        Shard& ShardFor(uint64_t key_hash);
+
+        BlockInfo GetBlockInfo(std::string_view hash);
+
+    private:
+        BlockOrigin origin_;
+        std::vector<Shard> shards_;
+        size_t shard_mask_;
+    };
+
+} // namespace storage
@@ -0,0 +1,112 @@
+#include "client_to_server_view.h"
+
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/wire_format_lite.h>
+
+#include <algorithm>
+
+namespace http_server {
+	namespace {
+		namespace pb = google::protobuf;
+
+		using WireFormat = pb::internal::WireFormatLite;
+
+		// тег поля hashes = 1 с wire type length-delimited
+		constexpr uint32_t HASHES_TAG = WireFormat::MakeTag(1, WireFormat::WIRETYPE_LENGTH_DELIMITED);
+		// ClientToServer.ranges = 2 и BlockRange.ranges = 3
+		constexpr uint32_t RANGES_TAG = WireFormat::MakeTag(2, WireFormat::WIRETYPE_LENGTH_DELIMITED);
+		constexpr uint32_t NESTED_RANGES_TAG = WireFormat::MakeTag(3, WireFormat::WIRETYPE_LENGTH_DELIMITED);
+		// offset = 1 и length = 2 в BlockRange и ByteRange
+		constexpr uint32_t OFFSET_TAG = WireFormat::MakeTag(1, WireFormat::WIRETYPE_VARINT);
+		constexpr uint32_t LENGTH_TAG = WireFormat::MakeTag(2, WireFormat::WIRETYPE_VARINT);
+
+		/// @brief Разбор полей offset и length сообщения ByteRange или BlockRange,
+		/// вложенные диапазоны BlockRange передаются в nested
+		template <typename Nested>
+		bool ParseRangeFields(pb::io::CodedInputStream& input, ByteRange& range, Nested&& nested) {
+			while (const uint32_t tag = input.ReadTag()) {
+				if (tag == OFFSET_TAG) {
+					if (!input.ReadVarint64(&range.offset)) {
+						return false;
+					}
+				} else if (tag == LENGTH_TAG) {
+					if (!input.ReadVarint64(&range.length)) {
+						return false;
+					}
+				} else if (tag == NESTED_RANGES_TAG) {
+					if (!nested(input)) {
+						return false;
+					}
+				} else if (!WireFormat::SkipField(&input, tag)) {
+					return false;
+				}
+			}
+			return input.ConsumedEntireMessage();
+		}
+	}
+
+	bool ClientToServerView::ParseBlockRange(const char* data, uint32_t size) {
+		pb::io::CodedInputStream input(reinterpret_cast<const uint8_t*>(data), static_cast<int>(size));
+		const auto begin = static_cast<uint32_t>(ranges_.size());
+		ByteRange single;
+		const bool parsed = ParseRangeFields(input, single, [this](pb::io::CodedInputStream& input) {
+			uint32_t length = 0;
+			if (!input.ReadVarint32(&length)) {
+				return false;
+			}
+			const auto limit = input.PushLimit(static_cast<int>(length));
+			ByteRange range;
+			const bool parsed = ParseRangeFields(input, range, [](pb::io::CodedInputStream&) {
+				// в ByteRange поле 3 не определено
+				return false;
+			});
+			input.PopLimit(limit);
+			ranges_.push_back(range);
+			return parsed;
+		});
+		if (!parsed) {
+			return false;
+		}
+		// без вложенных диапазонов часть задают offset и length, без них — блок целиком
+		if (ranges_.size() == begin && (single.offset != 0 || single.length != ByteRange::TO_END)) {
+			ranges_.push_back(single);
+		}
+		range_spans_.emplace_back(begin, static_cast<uint32_t>(ranges_.size()));
+		max_ranges_per_hash_ = std::max<size_t>(max_ranges_per_hash_, ranges_.size() - begin);
+		return true;
+	}
+
+	bool ClientToServerView::Parse(std::string&& body) {
+		body_ = std::move(body);
+		hashes_.clear();
+		ranges_.clear();
+		range_spans_.clear();
+		max_ranges_per_hash_ = 0;
+
+		pb::io::CodedInputStream input(reinterpret_cast<const uint8_t*>(body_.data()), static_cast<int>(body_.size()));
+		while (const uint32_t tag = input.ReadTag()) {
+			if (tag != HASHES_TAG && tag != RANGES_TAG) {
+				if (!WireFormat::SkipField(&input, tag)) {
+					return false;
+				}
+				continue;
+			}
+			uint32_t length = 0;
+			if (!input.ReadVarint32(&length)) {
+				return false;
+			}
+			// текущее место в буфере: весь буфер передан потоку одним куском
+			const char* data = body_.data() + input.CurrentPosition();
+			if (!input.Skip(static_cast<int>(length))) {
+				return false;
+			}
+			if (tag == HASHES_TAG) {
+				hashes_.emplace_back(data, length);
+			} else if (!ParseBlockRange(data, length)) {
+				return false;
+			}
+		}
+		// ReadTag возвращает 0 и в конце сообщения, и при ошибке
+		return input.ConsumedEntireMessage();
+	}
+}  // namespace http_server
@@ -0,0 +1,81 @@
+#pragma once
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace http_server {
+
+    /// @brief Диапазон байт блока из запроса
+    struct ByteRange {
+        // длина «до конца блока»
+        static constexpr uint64_t TO_END{UINT64_MAX};
+
+        uint64_t offset{0};
+        uint64_t length{TO_END};
+    };
+
+    /// @brief Сообщение Exchange::ClientToServer, разобранное без копирования токенов:
+    /// токены — представления, указывающие в тело запроса, которым владеет объект.
+    /// В отличие от Exchange::ClientToServer не выделяет по строке на токен,
+    /// а диапазоны частей блоков всех токенов хранит в одном массиве.
+    /// Объект не копируется и не перемещается, чтобы представления оставались валидными.
+    class ClientToServerView {
+    public:
+        ClientToServerView() = default;
+
+        ClientToServerView(const ClientToServerView&) = delete;
+        ClientToServerView& operator=(const ClientToServerView&) = delete;
+
+        /// @brief Разбор сериализованного сообщения, неизвестные поля пропускаются
+        /// @param body тело запроса, объект забирает его себе
+        /// @return false, если сообщение повреждено
+        bool Parse(std::string&& body);
+
+        std::span<const std::string_view> Hashes() const {
+            return hashes_;
+        }
+
+        int HashCount() const {
+            return static_cast<int>(hashes_.size());
+        }
+
+        /// @brief Части блока токена Hashes()[i]; пустой список — блок целиком
+        std::span<const ByteRange> Ranges(size_t i) const {
+            if (i >= range_spans_.size()) {
+                return {};
+            }
+            const auto [begin, end] = range_spans_[i];
+            return std::span<const ByteRange>(ranges_).subspan(begin, end - begin);
+        }
+
+        /// @brief Запрошена ли хотя бы одна часть блока
+        bool HasRanges() const {
+            return !ranges_.empty();
+        }
+
+        /// @brief Число частей блоков во всём запросе
+        size_t RangeCount() const {
+            return ranges_.size();
+        }
+
+        /// @brief Наибольшее число частей, запрошенных у одного токена
+        size_t MaxRangesPerHash() const {
+            return max_ranges_per_hash_;
+        }
+
+    private:
+        bool ParseBlockRange(const char* data, uint32_t size);
+
+    private:
+        std::string body_;
+        std::vector<std::string_view> hashes_;
+        // диапазоны всех сообщений BlockRange подряд и границы каждого сообщения в них
+        std::vector<ByteRange> ranges_;
+        std::vector<std::pair<uint32_t, uint32_t>> range_spans_;
+        size_t max_ranges_per_hash_{0};
+    };
+
+} // namespace http_server
@@ -0,0 +1,118 @@
+#include "compute_pool.h"
+
+#include <algorithm>
+
+namespace http_server {
+	namespace {
+		// пул и номер очереди текущего потока, если поток принадлежит пулу
+		thread_local const ComputePool* current_pool = nullptr;
+		thread_local unsigned current_index = 0;
+	}
+
+	ComputePool::ComputePool(unsigned thread_count) {
+		thread_count = std::max(1u, thread_count);
+		workers_.reserve(thread_count);
+		for (unsigned i = 0; i < thread_count; ++i) {
+			workers_.push_back(std::make_unique<Worker>());
+		}
+		threads_.reserve(thread_count);
+		for (unsigned i = 0; i < thread_count; ++i) {
+			threads_.emplace_back([this, i] {
+				Run(i);
+			});
+		}
+	}
+
+	ComputePool::~ComputePool() {
+		{
+			std::lock_guard lock(idle_mutex_);
+			stop_ = true;
+		}
+		idle_cv_.notify_all();
+		threads_.clear();
+	}
+
+	void ComputePool::Submit(Task task) {
+		const unsigned index = current_pool == this
+			? current_index
+			: next_worker_.fetch_add(1, std::memory_order_relaxed) % workers_.size();
+		{
+			std::lock_guard lock(workers_[index]->mutex);
+			workers_[index]->tasks.push_back(std::move(task));
+		}
+		queued_.fetch_add(1, std::memory_order_release);
+		{
+			// под мьютексом, чтобы не потерять пробуждение потока, который как раз засыпает
+			std::lock_guard lock(idle_mutex_);
+		}
+		idle_cv_.notify_one();
+	}
+
+	void ComputePool::ForEach(size_t count, std::function<void(size_t)> fn, Task done) {
+		if (count == 0) {
+			return done();
+		}
+		struct State {
+			std::function<void(size_t)> fn;
+			Task done;
+			std::atomic<size_t> remaining;
+		};
+		auto state = std::make_shared<State>(std::move(fn), std::move(done), count);
+		for (size_t i = 0; i < count; ++i) {
+			Submit([state, i] {
+				state->fn(i);
+				// acq_rel: последний поток видит результаты всех остальных задач
+				if (state->remaining.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+					state->done();
+				}
+			});
+		}
+	}
+
+	void ComputePool::Run(unsigned index) {
+		current_pool = this;
+		current_index = index;
+		Task task;
+		while (true) {
+			if (TryPop(index, task) || TrySteal(index, task)) {
+				queued_.fetch_sub(1, std::memory_order_relaxed);
+				task();
+				task = nullptr;
+				continue;
+			}
+			std::unique_lock lock(idle_mutex_);
+			idle_cv_.wait(lock, [this] {
+				return stop_ || queued_.load(std::memory_order_acquire) > 0;
+			});
+			if (stop_) {
+				return;
+			}
+		}
+	}
+
+	bool ComputePool::TryPop(unsigned index, Task& task) {
+		Worker& worker = *workers_[index];
+		std::lock_guard lock(worker.mutex);
+		if (worker.tasks.empty()) {
+			return false;
+		}
+		// свои задачи — с конца: их данные ещё в кэше этого ядра
+		task = std::move(worker.tasks.back());
+		worker.tasks.pop_back();
+		return true;
+	}
+
+	bool ComputePool::TrySteal(unsigned index, Task& task) {
+		for (size_t offset = 1; offset < workers_.size(); ++offset) {
+			Worker& victim = *workers_[(index + offset) % workers_.size()];
+			std::unique_lock lock(victim.mutex, std::try_to_lock);
+			if (!lock.owns_lock() || victim.tasks.empty()) {
+				continue;
+			}
+			task = std::move(victim.tasks.front());
+			victim.tasks.pop_front();
+			return true;
+		}
+		return false;
+	}
+}  // namespace http_server
@@ -0,0 +1,66 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace http_server {
+
+    /// @brief Пул потоков для вычислений, отдельный от потоков io_context.
+    /// У каждого потока своя очередь задач: поток берёт задачи с конца своей очереди,
+    /// а закончив их, забирает задачи с начала очередей других потоков (work stealing).
+    /// Задачи, поставленные из потока пула, попадают в его собственную очередь.
+    class ComputePool {
+    public:
+        using Task = std::function<void()>;
+
+        /// @param thread_count число потоков, не меньше одного
+        explicit ComputePool(unsigned thread_count);
+
+        ComputePool(const ComputePool&) = delete;
+        ComputePool& operator=(const ComputePool&) = delete;
+
+        /// @brief Останавливает потоки, задачи в очередях не выполняются
+        ~ComputePool();
+
+        void Submit(Task task);
+
+        /// @brief Выполняет fn(i) для всех i из [0, count), по задаче на индекс.
+        /// done вызывается один раз после всех fn в потоке, завершившем последнюю задачу.
+        /// Исключения из fn не перехватываются, fn должна обрабатывать их сама.
+        void ForEach(size_t count, std::function<void(size_t)> fn, Task done);
+
+        unsigned ThreadCount() const {
+            return static_cast<unsigned>(workers_.size());
+        }
+
+    private:
+        struct alignas(64) Worker {
+            std::mutex mutex;
+            std::deque<Task> tasks;
+        };
+
+        void Run(unsigned index);
+
+        bool TryPop(unsigned index, Task& task);
+
+        bool TrySteal(unsigned index, Task& task);
+
+    private:
+        std::vector<std::unique_ptr<Worker>> workers_;
+        // число задач во всех очередях, по нему засыпают свободные потоки
+        std::atomic<size_t> queued_{0};
+        std::mutex idle_mutex_;
+        std::condition_variable idle_cv_;
+        bool stop_{false};
+        // очередь для задач, поставленных не из потоков пула
+        std::atomic<unsigned> next_worker_{0};
+        std::vector<std::jthread> threads_;
+    };
+
+} // namespace http_server
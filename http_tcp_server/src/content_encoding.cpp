@@ -0,0 +1,185 @@
+#include "content_encoding.h"
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+
+#include <zlib.h>
+
+namespace http_server {
+	namespace {
+		using namespace std::literals;
+
+		// заголовок gzip: сигнатура, метод deflate, без флагов, mtime 0, ОС не указана
+		constexpr std::string_view GZIP_HEADER{"\x1f\x8b\x08\x00\x00\x00\x00\x00\x00\xff", 10};
+		// заголовок zlib: окно 32 КБ, уровень по умолчанию, (CMF * 256 + FLG) % 31 == 0
+		constexpr std::string_view ZLIB_HEADER{"\x78\x9c", 2};
+		// пустой последний блок deflate с фиксированными кодами: BFINAL=1, BTYPE=01, код конца блока
+		constexpr std::string_view FINAL_BLOCK{"\x03\x00", 2};
+		// наибольшая длина stored блока и размер его заголовка: BFINAL/BTYPE, LEN, NLEN
+		constexpr size_t MAX_STORED{65535};
+		constexpr size_t STORED_HEADER_SIZE{5};
+
+		std::string_view Trim(std::string_view value) {
+			while (!value.empty() && (value.front() == ' ' || value.front() == '\t')) {
+				value.remove_prefix(1);
+			}
+			while (!value.empty() && (value.back() == ' ' || value.back() == '\t')) {
+				value.remove_suffix(1);
+			}
+			return value;
+		}
+
+		bool EqualsNoCase(std::string_view a, std::string_view b) {
+			return std::equal(a.begin(), a.end(), b.begin(), b.end(), [](char x, char y) {
+				return std::tolower(static_cast<unsigned char>(x)) == std::tolower(static_cast<unsigned char>(y));
+			});
+		}
+
+		/// @brief Вес q из параметров кодирования в тысячных, по умолчанию 1000
+		int ParseQuality(std::string_view params) {
+			while (!params.empty()) {
+				const size_t end = std::min(params.find(';'), params.size());
+				const std::string_view param = Trim(params.substr(0, end));
+				params.remove_prefix(std::min(end + 1, params.size()));
+				if (param.size() < 2 || std::tolower(static_cast<unsigned char>(param[0])) != 'q' || param[1] != '=') {
+					continue;
+				}
+				// q = 0 | 1 | 0.ddd
+				const std::string_view value = param.substr(2);
+				int whole = 0;
+				auto [ptr, ec] = std::from_chars(value.data(), value.data() + value.size(), whole);
+				if (ec != std::errc{}) {
+					return 0;
+				}
+				int quality = whole * 1000;
+				if (ptr != value.data() + value.size() && *ptr == '.') {
+					int scale = 100;
+					for (++ptr; ptr != value.data() + value.size() && std::isdigit(static_cast<unsigned char>(*ptr)) && scale > 0; ++ptr, scale /= 10) {
+						quality += (*ptr - '0') * scale;
+					}
+				}
+				return std::clamp(quality, 0, 1000);
+			}
+			return 1000;
+		}
+
+		void AppendUint32Le(std::string& out, uint32_t value) {
+			for (int i = 0; i < 4; ++i) {
+				out.push_back(static_cast<char>(value >> (8 * i)));
+			}
+		}
+
+		void AppendUint32Be(std::string& out, uint32_t value) {
+			for (int i = 3; i >= 0; --i) {
+				out.push_back(static_cast<char>(value >> (8 * i)));
+			}
+		}
+	}
+
+	ContentEncoding NegotiateEncoding(std::string_view accept_encoding) {
+		int gzip = -1;
+		int deflate = -1;
+		int any = -1;
+		while (!accept_encoding.empty()) {
+			const size_t end = std::min(accept_encoding.find(','), accept_encoding.size());
+			const std::string_view item = accept_encoding.substr(0, end);
+			accept_encoding.remove_prefix(std::min(end + 1, accept_encoding.size()));
+
+			const size_t params = std::min(item.find(';'), item.size());
+			const std::string_view coding = Trim(item.substr(0, params));
+			const int quality = ParseQuality(item.substr(params));
+			if (EqualsNoCase(coding, "gzip"sv) || EqualsNoCase(coding, "x-gzip"sv)) {
+				gzip = quality;
+			} else if (EqualsNoCase(coding, "deflate"sv)) {
+				deflate = quality;
+			} else if (coding == "*"sv) {
+				any = quality;
+			}
+		}
+		// * относится к кодированиям, не названным явно
+		if (gzip < 0) {
+			gzip = any;
+		}
+		if (deflate < 0) {
+			deflate = any;
+		}
+		if (gzip > 0 && gzip >= deflate) {
+			return ContentEncoding::GZIP;
+		}
+		if (deflate > 0) {
+			return ContentEncoding::DEFLATE;
+		}
+		return ContentEncoding::IDENTITY;
+	}
+
+	std::string_view EncodingName(ContentEncoding encoding) {
+		switch (encoding) {
+		case ContentEncoding::GZIP:
+			return "gzip"sv;
+		case ContentEncoding::DEFLATE:
+			return "deflate"sv;
+		case ContentEncoding::IDENTITY:
+			break;
+		}
+		return "identity"sv;
+	}
+
+	DeflateFramer::DeflateFramer(ContentEncoding encoding) :
+		encoding_(encoding),
+		checksum_(encoding == ContentEncoding::DEFLATE ? 1 : 0) {}
+
+	void DeflateFramer::AppendHeader(std::string& out) const {
+		out += encoding_ == ContentEncoding::DEFLATE ? ZLIB_HEADER : GZIP_HEADER;
+	}
+
+	void DeflateFramer::AppendStored(std::string& out, std::string_view bytes) {
+		const auto* data = reinterpret_cast<const Bytef*>(bytes.data());
+		checksum_ = static_cast<uint32_t>(encoding_ == ContentEncoding::DEFLATE
+			? adler32(checksum_, data, static_cast<uInt>(bytes.size()))
+			: crc32(checksum_, data, static_cast<uInt>(bytes.size())));
+		raw_size_ += bytes.size();
+
+		// предыдущая часть выровнена по байту, поэтому заголовок stored блока — целый байт
+		do {
+			const size_t size = std::min(bytes.size(), MAX_STORED);
+			out.push_back('\0');
+			out.push_back(static_cast<char>(size));
+			out.push_back(static_cast<char>(size >> 8));
+			out.push_back(static_cast<char>(~size));
+			out.push_back(static_cast<char>(~size >> 8));
+			out.append(bytes.substr(0, size));
+			bytes.remove_prefix(size);
+		} while (!bytes.empty());
+	}
+
+	void DeflateFramer::AddSegment(const storage::DeflatedBlock& block) {
+		checksum_ = static_cast<uint32_t>(encoding_ == ContentEncoding::DEFLATE
+			? adler32_combine(checksum_, block.adler32, static_cast<z_off_t>(block.raw_size))
+			: crc32_combine(checksum_, block.crc32, static_cast<z_off_t>(block.raw_size)));
+		raw_size_ += block.raw_size;
+	}
+
+	void DeflateFramer::AppendTrailer(std::string& out) const {
+		out += FINAL_BLOCK;
+		if (encoding_ == ContentEncoding::DEFLATE) {
+			AppendUint32Be(out, checksum_);
+		} else {
+			// ISIZE — размер исходных данных по модулю 2^32
+			AppendUint32Le(out, checksum_);
+			AppendUint32Le(out, static_cast<uint32_t>(raw_size_));
+		}
+	}
+
+	size_t DeflateFramer::HeaderSize(ContentEncoding encoding) {
+		return encoding == ContentEncoding::DEFLATE ? ZLIB_HEADER.size() : GZIP_HEADER.size();
+	}
+
+	size_t DeflateFramer::StoredSize(size_t bytes_size) {
+		return bytes_size + STORED_HEADER_SIZE * std::max<size_t>(1, (bytes_size + MAX_STORED - 1) / MAX_STORED);
+	}
+
+	size_t DeflateFramer::TrailerSize(ContentEncoding encoding) {
+		return FINAL_BLOCK.size() + (encoding == ContentEncoding::DEFLATE ? 4 : 8);
+	}
+}  // namespace http_server
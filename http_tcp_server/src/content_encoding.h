@@ -0,0 +1,58 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include "deflated_block.h"
+
+namespace http_server {
+
+    /// @brief Кодирование тела ответа
+    enum class ContentEncoding {
+        IDENTITY,
+        // поток deflate в обёртке gzip (RFC 1952)
+        GZIP,
+        // поток deflate в обёртке zlib (RFC 1950), так его понимает HTTP
+        DEFLATE
+    };
+
+    /// @brief Выбор кодирования по заголовку Accept-Encoding с учётом весов q.
+    /// При равных весах предпочитается gzip.
+    /// @param accept_encoding значение заголовка, пустое — без сжатия
+    ContentEncoding NegotiateEncoding(std::string_view accept_encoding);
+
+    /// @brief Значение заголовка Content-Encoding
+    std::string_view EncodingName(ContentEncoding encoding);
+
+    /// @brief Сборка сжатого потока gzip или zlib из частей без пересжатия:
+    /// небольшие части добавляются несжатыми (stored) блоками deflate,
+    /// крупные — готовыми сегментами DeflatedBlock. Контрольная сумма потока
+    /// сводится из сумм частей через crc32_combine / adler32_combine.
+    class DeflateFramer {
+    public:
+        explicit DeflateFramer(ContentEncoding encoding);
+
+        /// @brief Дописывает заголовок gzip или zlib
+        void AppendHeader(std::string& out) const;
+
+        /// @brief Дописывает байты несжатыми блоками deflate
+        void AppendStored(std::string& out, std::string_view bytes);
+
+        /// @brief Учитывает сегмент, байты которого передаются отдельно
+        void AddSegment(const storage::DeflatedBlock& block);
+
+        /// @brief Дописывает пустой последний блок deflate и трейлер с контрольной суммой
+        void AppendTrailer(std::string& out) const;
+
+        /// @brief Размер заголовка, блоков stored для bytes_size байт и трейлера
+        static size_t HeaderSize(ContentEncoding encoding);
+        static size_t StoredSize(size_t bytes_size);
+        static size_t TrailerSize(ContentEncoding encoding);
+
+    private:
+        ContentEncoding encoding_;
+        uint32_t checksum_;
+        uint64_t raw_size_{0};
+    };
+
+} // namespace http_server
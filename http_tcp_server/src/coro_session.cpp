@@ -0,0 +1,369 @@
+#include "coro_session.h"
+#include "logging.h"
+#include "metrics.h"
+
+#include <boost/asio/co_spawn.hpp>
+#include <boost/asio/execution/context.hpp>
+#include <boost/asio/detached.hpp>
+#include <boost/asio/redirect_error.hpp>
+#include <boost/asio/use_awaitable.hpp>
+#include <boost/asio/write.hpp>
+
+#include <span>
+
+#include <sys/sendfile.h>
+
+namespace http_server {
+	namespace {
+		using namespace std::literals;
+
+		/// @brief Маркер завершения операций сессии: ошибка — в ec, состояние операции — из кэша потока
+		auto Await(beast::error_code& ec) {
+			return Recycling(net::redirect_error(net::use_awaitable_t<CoroSessionBase::Executor>{}, ec));
+		}
+
+		/// @brief Перенос принятого сокета на strand сессии.
+		/// Слушатель отдаёт сокет с исполнителем any_io_executor, сессии нужен strand конкретного типа.
+		net::basic_stream_socket<tcp, CoroSessionBase::Executor> AdoptSocket(tcp::socket&& socket) {
+			auto& ioc = static_cast<net::io_context&>(net::query(socket.get_executor(), net::execution::context));
+			net::basic_stream_socket<tcp, CoroSessionBase::Executor> adopted(net::make_strand(ioc));
+			beast::error_code ec;
+			const auto endpoint = socket.local_endpoint(ec);
+			if (!ec) {
+				const auto handle = socket.release(ec);
+				if (!ec) {
+					adopted.assign(endpoint.protocol(), handle, ec);
+				}
+			}
+			if (ec) {
+				// сокет без соединения: первое же чтение завершится ошибкой, и сессия закончится
+				ReportError(ec, "adopt socket"sv);
+			}
+			return adopted;
+		}
+	}
+
+	CoroSessionBase::CoroSessionBase(tcp::socket&& socket, std::chrono::steady_clock::duration io_timeout) :
+		stream_(AdoptSocket(std::move(socket))),
+		io_timeout_(io_timeout),
+		read_wake_(stream_.get_executor(), Timer::time_point::max()),
+		write_wake_(stream_.get_executor(), Timer::time_point::max()),
+		chunk_wake_(stream_.get_executor(), Timer::time_point::max()),
+		idle_timer_(stream_.get_executor()) {}
+
+	void CoroSessionBase::Run() {
+		net::dispatch(stream_.get_executor(), [self = GetSharedThis()] {
+			net::co_spawn(self->GetExecutor(), ReadLoop(self), net::detached);
+			net::co_spawn(self->GetExecutor(), WriteLoop(self), net::detached);
+		});
+	}
+
+	void CoroSessionBase::PushSlot() {
+		auto& slot = slots_[next_seq_ % MAX_PIPELINED_REQUESTS];
+		if (!slot) {
+			slot = std::make_unique<Outgoing>();
+		}
+		++next_seq_;
+	}
+
+	void CoroSessionBase::PopSlot() {
+		auto& outgoing = Slot(first_seq_);
+		outgoing.ready = false;
+		outgoing.close = false;
+		outgoing.buffers.clear();
+		outgoing.payload = std::monostate{};
+		++first_seq_;
+	}
+
+	void CoroSessionBase::MarkReady(Outgoing& outgoing) {
+		outgoing.ready = true;
+		if (&outgoing == &Slot(first_seq_)) {
+			write_wake_.cancel();
+		}
+	}
+
+	void CoroSessionBase::Write(uint64_t seq, StreamResponse&& response) {
+		auto& outgoing = Slot(seq);
+		// без chunked ответ без длины пришлось бы завершать закрытием соединения
+		response.header.chunked(true);
+		outgoing.close = response.header.need_eof();
+		outgoing.payload = std::move(response);
+		MarkReady(outgoing);
+	}
+
+	void CoroSessionBase::Write(uint64_t seq, SendfileResponse&& response) {
+		auto& outgoing = Slot(seq);
+		outgoing.close = response.header.need_eof();
+		outgoing.payload = std::move(response);
+		MarkReady(outgoing);
+	}
+
+	CoroSessionBase::Awaitable<void> CoroSessionBase::ReadLoop(std::shared_ptr<CoroSessionBase> self) {
+		beast::error_code ec;
+		for (;;) {
+			// очередь ответов заполнена: ждём, пока писатель её разгрузит
+			while (!self->read_done_ && self->PendingCount() >= MAX_PIPELINED_REQUESTS) {
+				co_await self->read_wake_.async_wait(Await(ec));
+			}
+			if (self->read_done_) {
+				break;
+			}
+
+			self->request_ = {};
+			// ответы ещё пишутся: срок чтению поставит писатель, когда отправит их все
+			self->read_unbounded_ = self->PendingCount() > 0;
+			if (self->read_unbounded_) {
+				self->stream_.expires_never();
+			} else {
+				self->stream_.expires_after(self->io_timeout_);
+			}
+			const uint64_t read_started = metrics::Now();
+			const size_t bytes_read = co_await http::async_read(self->stream_, self->buffer_, self->request_, Await(ec));
+			self->read_unbounded_ = false;
+			if (self->idle_armed_) {
+				self->idle_armed_ = false;
+				self->idle_timer_.cancel();
+			}
+			metrics::Observe(metrics::Stage::READ, metrics::Now() - read_started);
+			metrics::Add(metrics::Counter::BYTES_READ, bytes_read);
+
+			if (ec == http::error::end_of_stream) {
+				break;
+			}
+			if (ec) {
+				if (!self->read_done_) {
+					metrics::Add(metrics::Counter::READ_ERRORS);
+					ReportError(ec, "read"sv);
+				}
+				break;
+			}
+
+			metrics::Add(metrics::Counter::REQUESTS);
+			const bool keep_alive = self->request_.keep_alive();
+			const uint64_t seq = self->next_seq_;
+			self->PushSlot();
+			self->HandleRequest(std::move(self->request_), seq);
+			if (!keep_alive) {
+				// после запроса с Connection: close новых запросов не читаем
+				break;
+			}
+		}
+		// соединение закроет писатель, когда отправит ответы на уже прочитанные запросы
+		self->read_done_ = true;
+		self->write_wake_.cancel();
+	}
+
+	CoroSessionBase::Awaitable<void> CoroSessionBase::WriteLoop(std::shared_ptr<CoroSessionBase> self) {
+		beast::error_code ec;
+		for (;;) {
+			while (self->PendingCount() == 0 ? !self->read_done_ : !self->Slot(self->first_seq_).ready) {
+				co_await self->write_wake_.async_wait(Await(ec));
+			}
+			if (self->PendingCount() == 0) {
+				// читатель закончил, и все ответы отправлены
+				self->Close();
+				break;
+			}
+
+			const uint64_t write_started = metrics::Now();
+			bool close = false;
+			size_t bytes_written = 0;
+			size_t responses = 1;
+			auto& front = self->Slot(self->first_seq_);
+			if (auto* stream = std::get_if<StreamResponse>(&front.payload)) {
+				close = front.close;
+				ec = co_await self->WriteStream(*stream);
+				self->PopSlot();
+			} else if (auto* sendfile = std::get_if<SendfileResponse>(&front.payload)) {
+				close = front.close;
+				ec = co_await self->WriteSendfile(*sendfile);
+				self->PopSlot();
+			} else {
+				// Все готовые подряд ответы уходят одной записью
+				auto& buffers = self->write_buffers_;
+				buffers.clear();
+				size_t count = 0;
+				for (uint64_t seq = self->first_seq_; !close && seq != self->next_seq_; ++seq, ++count) {
+					const auto& outgoing = self->Slot(seq);
+					if (!outgoing.ready || std::holds_alternative<StreamResponse>(outgoing.payload)
+						|| std::holds_alternative<SendfileResponse>(outgoing.payload)) {
+						break;
+					}
+					buffers.insert(buffers.end(), outgoing.buffers.begin(), outgoing.buffers.end());
+					close = outgoing.close;
+				}
+				self->stream_.expires_after(self->io_timeout_);
+				// операция копирует последовательность буферов, span копируется без выделения памяти
+				bytes_written = co_await net::async_write(self->stream_, std::span<const net::const_buffer>(buffers), Await(ec));
+				// ответы живут в очереди до конца записи: буферы ссылаются на них
+				for (size_t i = 0; i < count; ++i) {
+					self->PopSlot();
+				}
+				responses = count;
+			}
+
+			metrics::Observe(metrics::Stage::WRITE, metrics::Now() - write_started);
+			metrics::Add(metrics::Counter::BYTES_WRITTEN, bytes_written);
+			// читатель мог остановиться на заполненной очереди
+			self->read_wake_.cancel();
+
+			if (ec) {
+				self->read_done_ = true;
+				metrics::Add(metrics::Counter::WRITE_ERRORS);
+				ReportError(ec, "write"sv);
+				// прерываем чтение, чтобы читатель завершился и отпустил сессию
+				self->stream_.cancel();
+				break;
+			}
+			metrics::Add(metrics::Counter::RESPONSES, responses);
+			if (close) {
+				self->read_done_ = true;
+				self->Close();
+				break;
+			}
+			self->ArmIdleTimeout();
+		}
+	}
+
+	void CoroSessionBase::ArmIdleTimeout() {
+		if (!read_unbounded_ || idle_armed_ || PendingCount() > 0) {
+			return;
+		}
+		idle_armed_ = true;
+		idle_timer_.expires_after(io_timeout_);
+		idle_timer_.async_wait([self = GetSharedThis()](beast::error_code ec) {
+			// срабатывание, уже поставленное в очередь к моменту отмены, отличаем по флагу
+			if (ec || !self->idle_armed_) {
+				return;
+			}
+			self->idle_armed_ = false;
+			// как и по истечении срока потока: чтение завершится, и сессия закончится
+			self->stream_.socket().shutdown(tcp::socket::shutdown_both, ec);
+		});
+	}
+
+	CoroSessionBase::Awaitable<beast::error_code> CoroSessionBase::WriteStream(StreamResponse& response) {
+		beast::error_code ec;
+		http::response_serializer<http::empty_body> serializer{response.header};
+
+		stream_.expires_after(io_timeout_);
+		const size_t header_bytes = co_await http::async_write_header(stream_, serializer, Await(ec));
+		metrics::Add(metrics::Counter::BYTES_WRITTEN, header_bytes);
+
+		std::vector<net::const_buffer> buffers;
+		while (!ec) {
+			// Пустая часть в chunked encoding означает конец тела, поэтому такие части пропускаем
+			buffers.clear();
+			// блок очередной части готовит другой запрос: сопрограмма спит до его готовности
+			const auto resume = [self = GetSharedThis()] {
+				net::dispatch(self->GetExecutor(), [self] {
+					self->chunk_wake_.cancel();
+				});
+			};
+			bool has_chunk = false;
+			bool failed = false;
+			try {
+				while (response.source->Wait(resume)) {
+					co_await chunk_wake_.async_wait(Await(ec));
+					ec = {};
+				}
+				while (response.source->Next(buffers)) {
+					if (net::buffer_size(buffers) > 0) {
+						has_chunk = true;
+						break;
+					}
+					buffers.clear();
+				}
+			} catch (const std::exception& e) {
+				ReportSourceError(e.what());
+				failed = true;
+			}
+			if (failed) {
+				// Ответ обрывается без завершающей части: WriteLoop по ошибке прекращает сессию,
+				// и клиент видит закрытое соединение посреди тела, а не ждёт до таймаута
+				beast::error_code shutdown_ec;
+				stream_.socket().shutdown(tcp::socket::shutdown_both, shutdown_ec);
+				co_return beast::errc::make_error_code(beast::errc::io_error);
+			}
+
+			stream_.expires_after(io_timeout_);
+			if (!has_chunk) {
+				const size_t bytes = co_await net::async_write(stream_, http::make_chunk_last(), Await(ec));
+				metrics::Add(metrics::Counter::BYTES_WRITTEN, bytes);
+				break;
+			}
+			const size_t bytes = co_await net::async_write(stream_, http::make_chunk(buffers), Await(ec));
+			metrics::Add(metrics::Counter::BYTES_WRITTEN, bytes);
+		}
+		co_return ec;
+	}
+
+	CoroSessionBase::Awaitable<beast::error_code> CoroSessionBase::WriteSendfile(SendfileResponse& response) {
+		beast::error_code ec;
+		http::response_serializer<http::empty_body> serializer{response.header};
+
+		stream_.expires_after(io_timeout_);
+		const size_t header_bytes = co_await http::async_write_header(stream_, serializer, Await(ec));
+		metrics::Add(metrics::Counter::BYTES_WRITTEN, header_bytes);
+
+		auto& socket = stream_.socket();
+		std::vector<net::const_buffer> buffers;
+		size_t part = 0;
+		while (!ec && part < response.parts.size()) {
+			if (response.parts[part].fd < 0) {
+				// Подряд идущие части из памяти отправляются одной операцией записи
+				buffers.clear();
+				while (part < response.parts.size() && response.parts[part].fd < 0) {
+					buffers.push_back(response.parts[part++].buffer);
+				}
+				stream_.expires_after(io_timeout_);
+				const size_t bytes = co_await net::async_write(stream_, std::span<const net::const_buffer>(buffers), Await(ec));
+				metrics::Add(metrics::Counter::BYTES_WRITTEN, bytes);
+				continue;
+			}
+
+			socket.native_non_blocking(true, ec);
+			const auto& file_part = response.parts[part];
+			const uint64_t size = file_part.buffer.size();
+			uint64_t sent_total = 0;
+			while (!ec && sent_total < size) {
+				off_t offset = static_cast<off_t>(file_part.offset + sent_total);
+				const auto sent = ::sendfile(socket.native_handle(), file_part.fd, &offset, size - sent_total);
+				if (sent > 0) {
+					sent_total += static_cast<uint64_t>(sent);
+					metrics::Add(metrics::Counter::BYTES_WRITTEN, static_cast<uint64_t>(sent));
+				} else if (sent < 0 && errno == EINTR) {
+					continue;
+				} else if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+					// Буфер сокета заполнен, ждём, пока он освободится. Ожидание на самом сокете
+					// не видит таймаута потока, поэтому его ограничивает отдельный таймер
+					Timer deadline(GetExecutor(), io_timeout_);
+					deadline.async_wait([self = GetSharedThis()](beast::error_code timer_ec) {
+						if (!timer_ec) {
+							self->stream_.socket().cancel(timer_ec);
+						}
+					});
+					co_await socket.async_wait(tcp::socket::wait_write, Await(ec));
+					deadline.cancel();
+					if (ec == net::error::operation_aborted && deadline.expiry() <= Timer::clock_type::now()) {
+						ec = beast::error::timeout;
+					}
+				} else {
+					// sendfile вернул 0 до конца части: файл короче, чем ожидалось
+					ec = sent < 0 ? beast::error_code(errno, sys::system_category()) : beast::error_code(net::error::eof);
+				}
+			}
+			++part;
+		}
+		co_return ec;
+	}
+
+	void CoroSessionBase::Close() {
+		if (idle_armed_) {
+			idle_armed_ = false;
+			idle_timer_.cancel();
+		}
+		beast::error_code ec;
+		stream_.socket().shutdown(tcp::socket::shutdown_send, ec);
+	}
+}  // namespace http_server
@@ -0,0 +1,204 @@
+#pragma once
+#include "sdk.h"
+#define BOOST_BEAST_USE_STD_STRING_VIEW
+
+// awaitable.hpp из Boost 1.74 использует std::exchange, не подключая <utility>
+#include <utility>
+#include <boost/asio/awaitable.hpp>
+#include <boost/asio/dispatch.hpp>
+#include <boost/asio/basic_waitable_timer.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/strand.hpp>
+#include <boost/beast/core.hpp>
+#include <boost/beast/http.hpp>
+
+#include <array>
+#include <chrono>
+#include <memory>
+#include <type_traits>
+#include <variant>
+#include <vector>
+
+#include "http_server.h"
+#include "recycling_allocator.h"
+#include "server_to_client_body.h"
+
+namespace http_server {
+
+    /// @brief Сессия на сопрограммах C++20 с тем же поведением, что у Session: конвейер запросов,
+    /// ответы в порядке запросов, готовые подряд ответы — одной записью, потоковые ответы и sendfile.
+    /// Чтение и запись — две сопрограммы, живущие всё время соединения, поэтому их кадры
+    /// выделяются один раз на соединение, а не на каждую операцию. Сопрограммы будят друг друга
+    /// отменой ожидания таймера. Ответ строится прямо в ячейке очереди отправки без shared_ptr на ответ,
+    /// ячейки переиспользуются.
+    /// Исполнитель — strand конкретного типа, а не any_io_executor: стирание типа strand
+    /// выделяет память при каждом завершении операции. Состояния операций выделяются
+    /// через RecyclingAllocator, кадры сопрограмм Asio берёт из своего кэша потока.
+    class CoroSessionBase {
+    protected:
+        using HttpRequest = http::request<http::string_body>;
+    public:
+        using Executor = net::strand<net::io_context::executor_type>;
+
+        CoroSessionBase() = delete;
+
+        CoroSessionBase& operator=(const CoroSessionBase&) = delete;
+
+        void Run();
+
+        // сколько запросов может ждать ответа, прежде чем сессия перестанет читать новые
+        static constexpr size_t MAX_PIPELINED_REQUESTS{32};
+
+    protected:
+        /// @param io_timeout срок чтения запроса и каждой записи
+        CoroSessionBase(tcp::socket&& socket, std::chrono::steady_clock::duration io_timeout);
+
+        ~CoroSessionBase() = default;
+
+        /// @brief Исполнитель сессии (strand), в котором должны вызываться все методы Write
+        Executor GetExecutor() {
+            return stream_.get_executor();
+        }
+
+        /// @brief Постановка ответа на запрос с номером seq в очередь отправки.
+        /// Строковые ответы и ответы ServerToClient хранятся в очереди без выделения памяти,
+        /// ответы с другими телами — в куче.
+        template<typename Body, typename Fields>
+        void Write(uint64_t seq, http::response<Body, Fields>&& response) {
+            using Gathered = GatheredResponse<Body, Fields>;
+            auto& outgoing = Slot(seq);
+            outgoing.close = response.need_eof();
+            beast::error_code ec;
+            {
+                metrics::ScopedTimer timer(metrics::Stage::SERIALIZE);
+                if constexpr (std::is_same_v<Gathered, GatheredString> || std::is_same_v<Gathered, GatheredServerToClient>) {
+                    outgoing.payload.template emplace<Gathered>(std::move(response)).Prepare(outgoing.buffers, ec);
+                } else {
+                    auto gathered = std::make_shared<Gathered>(std::move(response));
+                    gathered->Prepare(outgoing.buffers, ec);
+                    outgoing.payload = std::shared_ptr<const void>(std::move(gathered));
+                }
+            }
+            if (ec) {
+                ReportError(ec, "serialize");
+                outgoing.buffers.clear();
+                outgoing.close = true;
+            }
+            MarkReady(outgoing);
+        }
+
+        /// @brief Потоковый ответ: очередная часть запрашивается у источника после записи предыдущей
+        void Write(uint64_t seq, StreamResponse&& response);
+
+        /// @brief Ответ, файловые части которого передаются через sendfile
+        void Write(uint64_t seq, SendfileResponse&& response);
+
+    private:
+        using GatheredString = GatheredResponse<http::string_body, http::fields>;
+        using GatheredServerToClient = GatheredResponse<ServerToClientBody, http::fields>;
+        using Stream = beast::basic_stream<tcp, Executor>;
+        using Timer = net::basic_waitable_timer<std::chrono::steady_clock, net::wait_traits<std::chrono::steady_clock>, Executor>;
+        template <typename T>
+        using Awaitable = net::awaitable<T, Executor>;
+
+        // Ответ в очереди отправки. Ячейки не перемещаются, поэтому буферы
+        // могут ссылаться на ответ, лежащий в самой ячейке.
+        struct Outgoing {
+            bool ready{false};
+            // закрыть соединение после отправки
+            bool close{false};
+            std::vector<net::const_buffer> buffers;
+            std::variant<std::monostate, GatheredString, GatheredServerToClient, std::shared_ptr<const void>,
+                StreamResponse, SendfileResponse> payload;
+        };
+
+        // Ячейка ответа на запрос seq в кольце из MAX_PIPELINED_REQUESTS ячеек,
+        // ячейки создаются при первом использовании и потом переиспользуются
+        Outgoing& Slot(uint64_t seq) {
+            return *slots_[seq % MAX_PIPELINED_REQUESTS];
+        }
+
+        size_t PendingCount() const {
+            return static_cast<size_t>(next_seq_ - first_seq_);
+        }
+
+        // Новая ячейка в конце очереди
+        void PushSlot();
+
+        // Освобождение ячейки в начале очереди с сохранением ёмкости её буферов
+        void PopSlot();
+
+        void MarkReady(Outgoing& outgoing);
+
+        static Awaitable<void> ReadLoop(std::shared_ptr<CoroSessionBase> self);
+        static Awaitable<void> WriteLoop(std::shared_ptr<CoroSessionBase> self);
+
+        // Потоковые ответы и ответы с sendfile пишутся во вложенных сопрограммах,
+        // их кадры Asio берёт из кэша потока
+        Awaitable<beast::error_code> WriteStream(StreamResponse& response);
+        Awaitable<beast::error_code> WriteSendfile(SendfileResponse& response);
+
+        void Close();
+
+        /// @brief Срок простоя для чтения, начатого без срока, когда писатель отправил все ответы
+        void ArmIdleTimeout();
+
+        virtual std::shared_ptr<CoroSessionBase> GetSharedThis() = 0;
+        virtual void HandleRequest(HttpRequest&& request, uint64_t seq) = 0;
+
+    private:
+        Stream stream_;
+        beast::flat_buffer buffer_;
+        HttpRequest request_;
+        std::chrono::steady_clock::duration io_timeout_;
+
+        // ответы на прочитанные запросы с номерами [first_seq_, next_seq_)
+        std::array<std::unique_ptr<Outgoing>, MAX_PIPELINED_REQUESTS> slots_;
+        uint64_t first_seq_{0};
+        uint64_t next_seq_{0};
+        // новых запросов не будет: клиент закрыл соединение, попросил закрыть его или запись не удалась
+        bool read_done_{false};
+        // будят читателя, остановленного заполненной очередью, и писателя, ждущего готового ответа
+        Timer read_wake_;
+        Timer write_wake_;
+        // будит потоковый ответ, ждущий блок очередной части
+        Timer chunk_wake_;
+        // Чтение, начатое при неотправленных ответах, идёт без срока: срок начатого чтения
+        // не сдвигается и закрыл бы сокет посреди долгой записи. Срок простоя отсчитывает idle_timer_.
+        bool read_unbounded_{false};
+        bool idle_armed_{false};
+        Timer idle_timer_;
+        std::vector<net::const_buffer> write_buffers_;
+    };
+
+    /// @brief Сессия на сопрограммах с обработчиком запросов, контракт обработчика тот же, что у Session
+    /// @tparam RequestHandler
+    template <typename RequestHandler>
+    class CoroSession : public CoroSessionBase, public std::enable_shared_from_this<CoroSession<RequestHandler>> {
+    public:
+        template <typename Handler>
+        CoroSession(tcp::socket&& socket, Handler&& request_handler, std::chrono::steady_clock::duration io_timeout) :
+            CoroSessionBase(std::move(socket), io_timeout),
+            request_handler_(std::forward<Handler>(request_handler))
+        {}
+    private:
+
+        void HandleRequest(HttpRequest&& request, uint64_t seq) override {
+            // ответ из другого потока, например из пула вычислений, записывается в strand сессии;
+            // из strand сессии dispatch вызывает функцию сразу, без выделения памяти
+            request_handler_(std::move(request), [self = this->shared_from_this(), seq](auto&& response){
+                net::dispatch(self->GetExecutor(),
+                    [self, seq, response = std::forward<decltype(response)>(response)]() mutable {
+                        self->Write(seq, std::move(response));
+                    });
+            });
+        }
+
+        std::shared_ptr<CoroSessionBase> GetSharedThis() override {
+            return this->shared_from_this();
+        }
+    private:
+        RequestHandler request_handler_;
+    };
+
+} // namespace http_server
@@ -0,0 +1,83 @@
+#include "deflated_block.h"
+
+#include <stdexcept>
+#include <vector>
+
+#include <zlib.h>
+
+namespace storage {
+	namespace {
+		/// @brief Поток deflate, переиспользуемый потоком между блоками:
+		/// deflateInit выделяет сотни килобайт, deflateReset — нет
+		class ThreadDeflater {
+		public:
+			ThreadDeflater() = default;
+
+			ThreadDeflater(const ThreadDeflater&) = delete;
+			ThreadDeflater& operator=(const ThreadDeflater&) = delete;
+
+			~ThreadDeflater() {
+				if (level_ >= 0) {
+					deflateEnd(&stream_);
+				}
+			}
+
+			z_stream& Start(int level) {
+				if (level_ != level) {
+					if (level_ >= 0) {
+						deflateEnd(&stream_);
+						level_ = -1;
+					}
+					stream_ = {};
+					// отрицательный windowBits — сырой deflate без заголовка zlib
+					if (deflateInit2(&stream_, level, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+						throw std::runtime_error("deflateInit2 failed");
+					}
+					level_ = level;
+				} else {
+					deflateReset(&stream_);
+				}
+				return stream_;
+			}
+
+		private:
+			z_stream stream_{};
+			int level_{-1};
+		};
+	}
+
+	DeflatedBlockPtr DeflateBlock(std::string_view block, int level) {
+		thread_local ThreadDeflater deflater;
+		z_stream& stream = deflater.Start(level);
+
+		auto result = std::make_shared<DeflatedBlock>();
+		result->raw_size = block.size();
+		result->crc32 = static_cast<uint32_t>(crc32(0, reinterpret_cast<const Bytef*>(block.data()), static_cast<uInt>(block.size())));
+		result->adler32 = static_cast<uint32_t>(adler32(1, reinterpret_cast<const Bytef*>(block.data()), static_cast<uInt>(block.size())));
+
+		// сжатие идёт в буфер потока, а в блок копируется ровно сжатый размер:
+		// лишняя ёмкость не остаётся в долгоживущей записи кэша
+		// deflateBound рассчитан на Z_FINISH, маркер Z_SYNC_FLUSH добавляет ещё несколько байт
+		thread_local std::vector<Bytef> scratch;
+		scratch.resize(deflateBound(&stream, static_cast<uLong>(block.size())) + 16);
+		stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(block.data()));
+		stream.avail_in = static_cast<uInt>(block.size());
+		size_t written = 0;
+		while (true) {
+			stream.next_out = scratch.data() + written;
+			stream.avail_out = static_cast<uInt>(scratch.size() - written);
+			if (deflate(&stream, Z_SYNC_FLUSH) == Z_STREAM_ERROR) {
+				throw std::runtime_error("deflate failed");
+			}
+			written = scratch.size() - stream.avail_out;
+			// выход заполнен не полностью — весь вход сжат и сброшен
+			if (stream.avail_out != 0) {
+				break;
+			}
+			scratch.resize(scratch.size() * 2);
+		}
+		result->bytes.reserve(written);
+		result->bytes.append(reinterpret_cast<const char*>(scratch.data()), written);
+		return result;
+	}
+}  // namespace storage
@@ -0,0 +1,32 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+
+namespace storage {
+
+    // уровень сжатия блоков: сжатая форма вычисляется один раз на блок,
+    // поэтому выбрано плотное сжатие, а не самое быстрое
+    inline constexpr int DEFLATE_LEVEL{6};
+
+    /// @brief Блок, сжатый deflate самостоятельным сегментом: сжатие начато заново
+    /// и не ссылается на предыдущие данные, последний блок deflate не помечен BFINAL,
+    /// а сегмент завершён Z_SYNC_FLUSH и выровнен по байту. Такие сегменты склеиваются
+    /// друг с другом и с несжатыми (stored) блоками deflate в один поток без пересжатия.
+    struct DeflatedBlock {
+        std::string bytes;
+        // контрольные суммы исходного блока для трейлеров gzip и zlib
+        uint32_t crc32{0};
+        uint32_t adler32{1};
+        uint64_t raw_size{0};
+    };
+
+    using DeflatedBlockPtr = std::shared_ptr<const DeflatedBlock>;
+
+    /// @brief Сжимает блок отдельным сегментом deflate
+    /// @param block исходный блок
+    /// @param level уровень сжатия zlib
+    DeflatedBlockPtr DeflateBlock(std::string_view block, int level = DEFLATE_LEVEL);
+
+} // namespace storage
@@ -0,0 +1,159 @@
+#pragma once
+#include <bit>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace storage {
+
+    /// @brief Хэш-таблица с открытой адресацией в духе Swiss tables.
+    /// Ячейки объединены в группы по 16; на каждую ячейку приходится управляющий байт:
+    /// EMPTY или младшие 7 бит хэша ключа. Поиск сравнивает байт с управляющими байтами
+    /// всей группы одной SSE2-инструкцией, и ключ читается только при совпадении байта.
+    /// Ключи и значения лежат в отдельных массивах без узлов и указателей,
+    /// каждый ключ хранится один раз. Удаление не поддерживается.
+    /// @tparam Key ключ с методом Hash() и operator==
+    /// @tparam Value значение
+    template <typename Key, typename Value>
+    class FlatIndex {
+    public:
+        FlatIndex() = default;
+
+        /// @brief Поиск значения по ключу
+        /// @param key ключ
+        /// @param hash key.Hash()
+        /// @return указатель на значение или nullptr
+        const Value* Find(const Key& key, uint64_t hash) const {
+            if (size_ == 0) {
+                return nullptr;
+            }
+            const int8_t tag = Tag(hash);
+            size_t group = GroupIndex(hash);
+            for (size_t step = 1;; ++step) {
+                const size_t base = group * GROUP_SIZE;
+                for (uint32_t match = MatchTag(base, tag); match != 0; match &= match - 1) {
+                    const size_t slot = base + std::countr_zero(match);
+                    if (keys_[slot] == key) {
+                        return &values_[slot];
+                    }
+                }
+                if (MatchTag(base, EMPTY) != 0) {
+                    return nullptr;
+                }
+                group = (group + step) & group_mask_;
+            }
+        }
+
+        const Value* Find(const Key& key) const {
+            return Find(key, key.Hash());
+        }
+
+        /// @brief Вставляет значение, если ключа ещё нет
+        /// @return указатель на значение в таблице и признак вставки
+        std::pair<const Value*, bool> TryEmplace(const Key& key, uint64_t hash, const Value& value) {
+            if (const Value* existing = Find(key, hash)) {
+                return {existing, false};
+            }
+            if (growth_left_ == 0) {
+                Rehash(ctrl_.empty() ? GROUP_SIZE : ctrl_.size() * 2);
+            }
+            const size_t slot = InsertNew(key, hash, value);
+            return {&values_[slot], true};
+        }
+
+        std::pair<const Value*, bool> TryEmplace(const Key& key, const Value& value) {
+            return TryEmplace(key, key.Hash(), value);
+        }
+
+        /// @brief Обход всех пар ключ-значение в порядке ячеек
+        template <typename Fn>
+        void ForEach(Fn&& fn) const {
+            for (size_t slot = 0; slot < ctrl_.size(); ++slot) {
+                if (ctrl_[slot] != EMPTY) {
+                    fn(keys_[slot], values_[slot]);
+                }
+            }
+        }
+
+        size_t Size() const {
+            return size_;
+        }
+
+        /// @brief Объём памяти под ячейки таблицы в байтах
+        size_t MemoryUsage() const {
+            return ctrl_.size() * (1 + sizeof(Key) + sizeof(Value));
+        }
+
+    private:
+        static constexpr size_t GROUP_SIZE{16};
+        static constexpr int8_t EMPTY{-128};
+
+        static int8_t Tag(uint64_t hash) {
+            return static_cast<int8_t>(hash & 0x7F);
+        }
+
+        size_t GroupIndex(uint64_t hash) const {
+            return (hash >> 7) & group_mask_;
+        }
+
+        /// @brief Битовая маска ячеек группы, управляющий байт которых равен tag
+        uint32_t MatchTag(size_t base, int8_t tag) const {
+#if defined(__SSE2__)
+            const __m128i ctrl = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ctrl_.data() + base));
+            return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8(tag))));
+#else
+            uint32_t match = 0;
+            for (size_t i = 0; i < GROUP_SIZE; ++i) {
+                match |= static_cast<uint32_t>(ctrl_[base + i] == tag) << i;
+            }
+            return match;
+#endif
+        }
+
+        size_t InsertNew(const Key& key, uint64_t hash, const Value& value) {
+            size_t group = GroupIndex(hash);
+            for (size_t step = 1;; ++step) {
+                const size_t base = group * GROUP_SIZE;
+                if (const uint32_t empty = MatchTag(base, EMPTY); empty != 0) {
+                    const size_t slot = base + std::countr_zero(empty);
+                    ctrl_[slot] = Tag(hash);
+                    keys_[slot] = key;
+                    values_[slot] = value;
+                    ++size_;
+                    --growth_left_;
+                    return slot;
+                }
+                group = (group + step) & group_mask_;
+            }
+        }
+
+        void Rehash(size_t capacity) {
+            std::vector<int8_t> old_ctrl = std::exchange(ctrl_, std::vector<int8_t>(capacity, EMPTY));
+            std::vector<Key> old_keys = std::exchange(keys_, std::vector<Key>(capacity));
+            std::vector<Value> old_values = std::exchange(values_, std::vector<Value>(capacity));
+            group_mask_ = capacity / GROUP_SIZE - 1;
+            size_ = 0;
+            // заполнение не больше 7/8, чтобы пробы оставались короткими
+            growth_left_ = capacity - capacity / 8;
+            for (size_t slot = 0; slot < old_ctrl.size(); ++slot) {
+                if (old_ctrl[slot] != EMPTY) {
+                    InsertNew(old_keys[slot], old_keys[slot].Hash(), old_values[slot]);
+                }
+            }
+        }
+
+    private:
+        std::vector<int8_t> ctrl_;
+        // BlockId выровнен по кэш-линии, поэтому ключи в массиве не пересекают лишних линий
+        std::vector<Key> keys_;
+        std::vector<Value> values_;
+        size_t group_mask_{0};
+        size_t size_{0};
+        size_t growth_left_{0};
+    };
+
+} // namespace storage
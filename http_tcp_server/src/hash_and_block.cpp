@@ -0,0 +1,69 @@
+#include "hash_and_block.h"
+
+namespace storage {
+	namespace {
+		// Теги полей в формате protobuf: (номер поля << 3) | wire type 2 (length-delimited)
+		constexpr char HASH_AND_BLOCK_TAG = (1 << 3) | 2;
+		constexpr char HASH_TAG = (1 << 3) | 2;
+		constexpr char BLOCK_TAG = (2 << 3) | 2;
+		// offset = 3 и total_size = 4 с wire type varint
+		constexpr char OFFSET_TAG = (3 << 3) | 0;
+		constexpr char TOTAL_SIZE_TAG = (4 << 3) | 0;
+
+		/// @brief Размер числа в кодировке varint
+		size_t VarintSize(uint64_t value) {
+			size_t size = 1;
+			while (value >= 0x80) {
+				value >>= 7;
+				++size;
+			}
+			return size;
+		}
+
+		/// @brief Дописывает число в кодировке varint
+		void AppendVarint(std::string& out, uint64_t value) {
+			while (value >= 0x80) {
+				out.push_back(static_cast<char>(value | 0x80));
+				value >>= 7;
+			}
+			out.push_back(static_cast<char>(value));
+		}
+	}
+
+	size_t HashAndBlockHeadSize(size_t hash_size, size_t block_size) {
+		const uint64_t inner_size = 1 + VarintSize(hash_size) + hash_size
+			+ 1 + VarintSize(block_size) + block_size;
+		return 1 + VarintSize(inner_size) + 1 + VarintSize(hash_size) + hash_size
+			+ 1 + VarintSize(block_size);
+	}
+
+	void AppendHashAndBlockHead(std::string& out, std::string_view hash, size_t block_size, std::optional<ServedRange> range) {
+		uint64_t inner_size = 1 + VarintSize(hash.size()) + hash.size()
+			+ 1 + VarintSize(block_size) + block_size;
+		if (range) {
+			inner_size += 1 + VarintSize(range->offset) + 1 + VarintSize(range->total_size);
+		}
+
+		out.push_back(HASH_AND_BLOCK_TAG);
+		AppendVarint(out, inner_size);
+		out.push_back(HASH_TAG);
+		AppendVarint(out, hash.size());
+		out.append(hash);
+		out.push_back(BLOCK_TAG);
+		AppendVarint(out, block_size);
+	}
+
+	void AppendServedRange(std::string& out, const ServedRange& range) {
+		out.push_back(OFFSET_TAG);
+		AppendVarint(out, range.offset);
+		out.push_back(TOTAL_SIZE_TAG);
+		AppendVarint(out, range.total_size);
+	}
+
+	std::string MakeHashAndBlockHead(std::string_view hash, size_t block_size) {
+		std::string head;
+		head.reserve(HashAndBlockHeadSize(hash.size(), block_size));
+		AppendHashAndBlockHead(head, hash, block_size);
+		return head;
+	}
+}  // namespace storage
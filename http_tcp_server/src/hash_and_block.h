@@ -0,0 +1,35 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace storage {
+
+    /// @brief Какая часть блока отдана в записи HashAndBlock
+    struct ServedRange {
+        uint64_t offset;
+        uint64_t total_size;
+    };
+
+    /// @brief Заголовок записи HashAndBlock в сообщении ServerToClient:
+    /// тег и длина записи, тег и длина токена, токен, тег и длина блока.
+    /// Вслед за ним в сериализованном сообщении идут байты блока.
+    /// @param hash токен
+    /// @param block_size размер блока данных
+    std::string MakeHashAndBlockHead(std::string_view hash, size_t block_size);
+
+    /// @brief Дописывает заголовок записи HashAndBlock в конец out.
+    /// Для части блока длина записи учитывает поля offset и total_size, но сами поля
+    /// идут после байтов части, в порядке номеров, как их пишет protobuf: их дописывает AppendServedRange.
+    void AppendHashAndBlockHead(std::string& out, std::string_view hash, size_t block_size,
+        std::optional<ServedRange> range = std::nullopt);
+
+    /// @brief Дописывает поля offset и total_size записи HashAndBlock с частью блока в конец out
+    void AppendServedRange(std::string& out, const ServedRange& range);
+
+    /// @brief Размер заголовка записи HashAndBlock в байтах
+    size_t HashAndBlockHeadSize(size_t hash_size, size_t block_size);
+
+} // namespace storage
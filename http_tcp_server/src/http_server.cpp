@@ -1,62 +1,419 @@
 #include "http_server.h"
+#include "logging.h"
+#include "metrics.h"
 #include <boost/asio/dispatch.hpp>
-#include <iostream>
+#include <boost/asio/steady_timer.hpp>
+
+#include <sys/sendfile.h>
 
 namespace http_server {
 	void ReportError(beast::error_code ec, std::string_view what) {
-		std::cerr << what << ": " << ec.message() << std::endl;
+		using namespace std::literals;
+		// обрывы соединений клиентами повторяются сериями, поэтому частота ограничена
+		static logging::Site site{logging::Level::WARNING, "{}: {}"sv, 10};
+		logging::Log(site, what, ec);
+	}
+
+	void ReportSourceError(std::string_view what) {
+		using namespace std::literals;
+		static logging::Site site{logging::Level::ERROR, "stream response aborted: {}"sv, 10};
+		logging::Log(site, what);
 	}
 
-	SessionBase::SessionBase(tcp::socket&& socket) :
-		stream_(std::move(socket)) {};
+	template <typename Stream>
+	SessionBase<Stream>::SessionBase(tcp::socket&& socket, std::chrono::steady_clock::duration io_timeout) :
+		stream_(std::move(socket)),
+		buffer_(MakeReadBuffer(stream_)),
+		io_timeout_(io_timeout),
+		idle_timer_(stream_.get_executor()) {}
 
-	void SessionBase::Run() {
+	template <typename Stream>
+	void SessionBase<Stream>::Run() {
 		net::dispatch(stream_.get_executor(), beast::bind_front_handler(&SessionBase::Read, GetSharedThis()));
 	}
 
-	void SessionBase::Read() {
-		using namespace std::literals;
-
+	template <typename Stream>
+	void SessionBase<Stream>::Read() {
 		request_ = {};
 
-		stream_.expires_after(30s);
+		// Ответы ещё пишутся: срок чтению поставит ArmIdleTimeout, когда очередь опустеет
+		read_unbounded_ = !pending_.empty() || writing_;
+		if (read_unbounded_) {
+			stream_.expires_never();
+		} else {
+			stream_.expires_after(io_timeout_);
+		}
 
+		read_started_ = metrics::Now();
 
 		http::async_read(stream_, buffer_, request_,
 		
 		beast::bind_front_handler(&SessionBase::OnRead, GetSharedThis()));
 	}
 
-	void SessionBase::OnRead(beast::error_code ec, [[maybe_unused]] std::size_t bytes_read) {
+	template <typename Stream>
+	void SessionBase<Stream>::OnRead(beast::error_code ec, [[maybe_unused]] std::size_t bytes_read) {
 		using namespace std::literals;
 
+		metrics::Observe(metrics::Stage::READ, metrics::Now() - read_started_);
+		metrics::Add(metrics::Counter::BYTES_READ, bytes_read);
+
+		read_unbounded_ = false;
+		if (idle_armed_) {
+			idle_armed_ = false;
+			idle_timer_.cancel();
+		}
+
 		if (ec == http::error::end_of_stream) {
-			return Close();
+			read_done_ = true;
+			// соединение закрываем, когда будут отправлены ответы на уже прочитанные запросы
+			if (pending_.empty() && !writing_) {
+				Close();
+			}
+			return;
 		}
 
 		if (ec) {
+			read_done_ = true;
+			metrics::Add(metrics::Counter::READ_ERRORS);
 			return ReportError(ec, "read"sv);
 		}
 
-		HandleRequest(std::move(request_));
+		metrics::Add(metrics::Counter::REQUESTS);
+		const bool keep_alive = request_.keep_alive();
+		const uint64_t seq = first_seq_ + pending_.size();
+		pending_.emplace_back();
+		HandleRequest(std::move(request_), seq);
+
+		if (!keep_alive) {
+			// после запроса с Connection: close новых запросов не читаем
+			read_done_ = true;
+			return;
+		}
+		// Следующий запрос разбирается сразу, не дожидаясь отправки ответа:
+		// конвейерные запросы клиента, уже лежащие в buffer_, читаются без обращения к сокету
+		if (pending_.size() < MAX_PIPELINED_REQUESTS) {
+			Read();
+		} else {
+			read_paused_ = true;
+		}
+	}
+
+	template <typename Stream>
+	void SessionBase<Stream>::Enqueue(uint64_t seq, Outgoing&& outgoing) {
+		auto& slot = pending_.at(seq - first_seq_);
+		slot = std::move(outgoing);
+		slot.ready = true;
+		Flush();
+	}
+
+	template <typename Stream>
+	void SessionBase<Stream>::Flush() {
+		if (writing_ || pending_.empty() || !pending_.front().ready) {
+			return;
+		}
+
+		if (pending_.front().start) {
+			// потоковый ответ или ответ с sendfile пишется отдельно
+			auto start = std::move(pending_.front().start);
+			pending_.pop_front();
+			++first_seq_;
+			writing_ = true;
+			write_started_ = metrics::Now();
+			return start();
+		}
+
+		// Все готовые подряд ответы уходят одной записью
+		write_buffers_.clear();
+		write_owners_.clear();
+		bool close = false;
+		while (!close && !pending_.empty() && pending_.front().ready && !pending_.front().start) {
+			auto& outgoing = pending_.front();
+			write_buffers_.insert(write_buffers_.end(), outgoing.buffers.begin(), outgoing.buffers.end());
+			write_owners_.push_back(std::move(outgoing.owner));
+			close = outgoing.close;
+			pending_.pop_front();
+			++first_seq_;
+		}
+
+		stream_.expires_after(io_timeout_);
+
+		writing_ = true;
+		write_started_ = metrics::Now();
+		net::async_write(stream_, write_buffers_,
+			[self = GetSharedThis(), close](beast::error_code ec, std::size_t bytes_written) {
+				self->OnWrite(close, ec, bytes_written);
+			});
 	}
 
-	void SessionBase::OnWrite(bool close, beast::error_code ec, [[maybe_unused]] std::size_t bytes_written) {
+	template <typename Stream>
+	void SessionBase<Stream>::OnWrite(bool close, beast::error_code ec, [[maybe_unused]] std::size_t bytes_written) {
 		using namespace std::literals;
-		
+
+		writing_ = false;
+		write_owners_.clear();
+
+		metrics::Observe(metrics::Stage::WRITE, metrics::Now() - write_started_);
+		metrics::Add(metrics::Counter::BYTES_WRITTEN, bytes_written);
+
 		if (ec) {
+			read_done_ = true;
+			metrics::Add(metrics::Counter::WRITE_ERRORS);
 			return ReportError(ec, "write"sv);
 		}
+
+		metrics::Add(metrics::Counter::RESPONSES);
 		
 		if (close) {
+			read_done_ = true;
 			return Close();
 		}
 
-		Read();
+		if (read_paused_ && !read_done_ && pending_.size() < MAX_PIPELINED_REQUESTS) {
+			read_paused_ = false;
+			Read();
+		}
+
+		if (pending_.empty() && read_done_) {
+			return Close();
+		}
+
+		Flush();
+		ArmIdleTimeout();
+	}
+
+	template <typename Stream>
+	void SessionBase<Stream>::ArmIdleTimeout() {
+		if (!read_unbounded_ || idle_armed_ || writing_ || !pending_.empty()) {
+			return;
+		}
+		idle_armed_ = true;
+		idle_timer_.expires_after(io_timeout_);
+		idle_timer_.async_wait([self = GetSharedThis()](beast::error_code ec) {
+			// срабатывание, уже поставленное в очередь к моменту отмены, отличаем по флагу
+			if (ec || !self->idle_armed_) {
+				return;
+			}
+			self->idle_armed_ = false;
+			// как и по истечении срока потока: чтение завершится, и сессия закончится
+			self->stream_.socket().shutdown(tcp::socket::shutdown_both, ec);
+		});
+	}
+
+	// Состояние отправки потокового ответа
+	template <typename Stream>
+	struct SessionBase<Stream>::StreamState {
+		http::response<http::empty_body> response;
+		http::response_serializer<http::empty_body> serializer{response};
+		std::shared_ptr<ChunkSource> source;
+		std::vector<net::const_buffer> buffers;
+	};
+
+	template <typename Stream>
+	void SessionBase<Stream>::Write(uint64_t seq, StreamResponse&& response) {
+		auto state = std::make_shared<StreamState>();
+		state->response = std::move(response.header);
+		state->response.chunked(true);
+		state->source = std::move(response.source);
+
+		Outgoing outgoing;
+		outgoing.start = [this, state] {
+			stream_.expires_after(io_timeout_);
+
+			http::async_write_header(stream_, state->serializer,
+				[self = GetSharedThis(), state](beast::error_code ec, std::size_t bytes_written) {
+					if (ec) {
+						return self->OnWrite(true, ec, bytes_written);
+					}
+					metrics::Add(metrics::Counter::BYTES_WRITTEN, bytes_written);
+					self->WriteNextChunk(std::move(state));
+				});
+		};
+		Enqueue(seq, std::move(outgoing));
+	}
+
+	template <typename Stream>
+	void SessionBase<Stream>::WriteNextChunk(std::shared_ptr<StreamState> state) {
+		stream_.expires_after(io_timeout_);
+
+		bool has_chunk = false;
+		try {
+			// Блок очередной части готовит другой запрос: поток не ждёт, запись продолжится по готовности
+			const bool waiting = state->source->Wait([self = GetSharedThis(), state] {
+				net::dispatch(self->stream_.get_executor(), [self, state] {
+					self->WriteNextChunk(state);
+				});
+			});
+			if (waiting) {
+				return;
+			}
+
+			// Пустая часть в chunked encoding означает конец тела, поэтому такие части пропускаем
+			state->buffers.clear();
+			while (state->source->Next(state->buffers)) {
+				if (net::buffer_size(state->buffers) > 0) {
+					has_chunk = true;
+					break;
+				}
+				state->buffers.clear();
+			}
+		} catch (const std::exception& e) {
+			// Заголовок и часть тела уже отправлены: ответ обрывается без завершающей части,
+			// а соединение закрывается, чтобы клиент увидел неполный ответ, а не ждал до таймаута
+			ReportSourceError(e.what());
+			beast::error_code ec;
+			stream_.socket().shutdown(tcp::socket::shutdown_both, ec);
+			return OnWrite(true, beast::errc::make_error_code(beast::errc::io_error), 0);
+		}
+
+		if (!has_chunk) {
+			net::async_write(stream_, http::make_chunk_last(),
+				[self = GetSharedThis(), state](beast::error_code ec, std::size_t bytes_written) {
+					self->OnWrite(state->response.need_eof(), ec, bytes_written);
+				});
+			return;
+		}
+
+		net::async_write(stream_, http::make_chunk(state->buffers),
+			[self = GetSharedThis(), state](beast::error_code ec, std::size_t bytes_written) {
+				if (ec) {
+					return self->OnWrite(true, ec, bytes_written);
+				}
+				metrics::Add(metrics::Counter::BYTES_WRITTEN, bytes_written);
+				self->WriteNextChunk(std::move(state));
+			});
+	}
+
+	// Состояние отправки ответа с файловыми частями
+	template <typename Stream>
+	struct SessionBase<Stream>::SendfileState {
+		http::response<http::empty_body> response;
+		http::response_serializer<http::empty_body> serializer{response};
+		std::vector<BodyPart> parts;
+		std::shared_ptr<const void> owner;
+		// текущая часть и сколько байт файловой части уже отправлено
+		size_t part{0};
+		uint64_t part_sent{0};
+		std::vector<net::const_buffer> buffers;
+	};
+
+	template <typename Stream>
+	void SessionBase<Stream>::Write(uint64_t seq, SendfileResponse&& response) {
+		auto state = std::make_shared<SendfileState>();
+		state->response = std::move(response.header);
+		state->parts = std::move(response.parts);
+		state->owner = std::move(response.owner);
+
+		Outgoing outgoing;
+		outgoing.start = [this, state] {
+			stream_.expires_after(io_timeout_);
+
+			http::async_write_header(stream_, state->serializer,
+				[self = GetSharedThis(), state](beast::error_code ec, std::size_t bytes_written) {
+					if (ec) {
+						return self->OnWrite(true, ec, bytes_written);
+					}
+					metrics::Add(metrics::Counter::BYTES_WRITTEN, bytes_written);
+					self->WriteNextParts(std::move(state));
+				});
+		};
+		Enqueue(seq, std::move(outgoing));
+	}
+
+	template <typename Stream>
+	void SessionBase<Stream>::WriteNextParts(std::shared_ptr<SendfileState> state) {
+		if (state->part == state->parts.size()) {
+			return OnWrite(state->response.need_eof(), {}, 0);
+		}
+		if (state->parts[state->part].fd >= 0) {
+			state->part_sent = 0;
+			return SendFilePart(std::move(state));
+		}
+
+		// Подряд идущие части из памяти отправляются одной операцией записи
+		state->buffers.clear();
+		while (state->part < state->parts.size() && state->parts[state->part].fd < 0) {
+			state->buffers.push_back(state->parts[state->part++].buffer);
+		}
+
+		stream_.expires_after(io_timeout_);
+
+		net::async_write(stream_, state->buffers,
+			[self = GetSharedThis(), state](beast::error_code ec, std::size_t bytes_written) {
+				if (ec) {
+					return self->OnWrite(true, ec, bytes_written);
+				}
+				metrics::Add(metrics::Counter::BYTES_WRITTEN, bytes_written);
+				self->WriteNextParts(std::move(state));
+			});
 	}
 
-	void SessionBase::Close() {
+	template <typename Stream>
+	void SessionBase<Stream>::SendFilePart(std::shared_ptr<SendfileState> state) {
+		auto& socket = stream_.socket();
+		const auto& part = state->parts[state->part];
+		const uint64_t size = part.buffer.size();
+
+		beast::error_code ec;
+		socket.native_non_blocking(true, ec);
+		if (ec) {
+			return OnWrite(true, ec, 0);
+		}
+
+		while (state->part_sent < size) {
+			off_t offset = static_cast<off_t>(part.offset + state->part_sent);
+			const auto sent = ::sendfile(socket.native_handle(), part.fd, &offset, size - state->part_sent);
+			if (sent > 0) {
+				state->part_sent += static_cast<uint64_t>(sent);
+				metrics::Add(metrics::Counter::BYTES_WRITTEN, static_cast<uint64_t>(sent));
+				continue;
+			}
+			if (sent < 0 && errno == EINTR) {
+				continue;
+			}
+			if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+				// Буфер сокета заполнен, ждём, пока он освободится. Ожидание на самом сокете
+				// не видит таймаута потока, поэтому его ограничивает отдельный таймер
+				auto deadline = std::make_shared<net::steady_timer>(socket.get_executor(), io_timeout_);
+				deadline->async_wait([self = GetSharedThis()](beast::error_code ec) {
+					if (!ec) {
+						self->stream_.socket().cancel(ec);
+					}
+				});
+				socket.async_wait(tcp::socket::wait_write,
+					[self = GetSharedThis(), state, deadline](beast::error_code ec) {
+						deadline->cancel();
+						if (ec == net::error::operation_aborted && deadline->expiry() <= net::steady_timer::clock_type::now()) {
+							ec = beast::error::timeout;
+						}
+						if (ec) {
+							return self->OnWrite(true, ec, 0);
+						}
+						self->SendFilePart(std::move(state));
+					});
+				return;
+			}
+			// sendfile вернул 0 до конца части: файл короче, чем ожидалось
+			ec = sent < 0 ? beast::error_code(errno, sys::system_category()) : beast::error_code(net::error::eof);
+			return OnWrite(true, ec, 0);
+		}
+
+		++state->part;
+		WriteNextParts(std::move(state));
+	}
+
+	template <typename Stream>
+	void SessionBase<Stream>::Close() {
+		if (idle_armed_) {
+			idle_armed_ = false;
+			idle_timer_.cancel();
+		}
 		beast::error_code ec;
 		stream_.socket().shutdown(tcp::socket::shutdown_send, ec);
 	}
+
+	template class SessionBase<beast::tcp_stream>;
+#ifdef SERVER_HAS_IO_URING
+	template class SessionBase<UringStream>;
+#endif
 }  // namespace http_server
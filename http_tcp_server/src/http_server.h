@@ -2,11 +2,25 @@
 #include "sdk.h"
 #define BOOST_BEAST_USE_STD_STRING_VIEW
 
+#include "metrics.h"
+#ifdef SERVER_HAS_IO_URING
+#include "uring_stream.h"
+#endif
+
+#include <boost/asio/dispatch.hpp>
 #include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/steady_timer.hpp>
 #include <boost/asio/strand.hpp>
 #include <boost/beast/core.hpp>
 #include <boost/beast/http.hpp>
 
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <vector>
+
 namespace http_server {
 
     namespace net = boost::asio;
@@ -17,6 +31,108 @@ namespace http_server {
 
     void ReportError(beast::error_code ec, std::string_view what);
 
+    /// @brief Запись в лог ошибки источника частей потокового ответа,
+    /// после которой ответ обрывается
+    void ReportSourceError(std::string_view what);
+
+    /// @brief Источник частей потокового ответа
+    class ChunkSource {
+    public:
+        virtual ~ChunkSource() = default;
+
+        /// @brief Готовит очередную часть ответа. Вызывается только после того,
+        /// как предыдущая часть ушла в сокет. Исключение из Next или Wait обрывает
+        /// ответ: сессия закрывает соединение, не отправляя завершающую часть.
+        /// @param buffers буферы части, должны оставаться валидными до следующего вызова
+        /// @return false, если частей больше нет
+        virtual bool Next(std::vector<net::const_buffer>& buffers) = 0;
+
+        /// @brief Ожидание данных очередной части без блокировки потока. Вызывается перед Next.
+        /// @param resume вызывается из любого потока, когда часть можно готовить
+        /// @return true, если Next надо вызвать только после resume
+        virtual bool Wait([[maybe_unused]] std::function<void()> resume) {
+            return false;
+        }
+    };
+
+    /// @brief Часть тела ответа: буфер в памяти или, если fd >= 0,
+    /// диапазон файла [offset, offset + buffer.size()), отправляемый через sendfile
+    struct BodyPart {
+        net::const_buffer buffer;
+        int fd{-1};
+        uint64_t offset{0};
+    };
+
+    /// @brief Ответ с телом из частей, файловые части уходят в сокет через sendfile
+    /// без копирования в пространство пользователя
+    struct SendfileResponse {
+        // заголовок ответа, content_length должен быть выставлен
+        http::response<http::empty_body> header;
+        std::vector<BodyPart> parts;
+        // удерживает память и файлы, на которые ссылаются части
+        std::shared_ptr<const void> owner;
+    };
+
+    /// @brief Потоковый ответ: заголовок и источник частей тела,
+    /// которые отправляются в chunked transfer encoding
+    struct StreamResponse {
+        http::response<http::empty_body> header;
+        std::shared_ptr<ChunkSource> source;
+    };
+
+    /// @brief Ответ, подготовленный к записи вместе с соседними ответами одним writev:
+    /// байты заголовка и буферы тела. Подходит для тел, чьи буферы живут вместе
+    /// с самим сообщением (string_body, ServerToClientBody).
+    template <typename Body, typename Fields>
+    struct GatheredResponse {
+        explicit GatheredResponse(http::response<Body, Fields>&& res) :
+            response(std::move(res)) {
+        }
+
+        /// @brief Дописывает буферы заголовка и тела ответа
+        void Prepare(std::vector<net::const_buffer>& buffers, beast::error_code& ec) {
+            header.emplace(response.base(), response.version(), response.result_int());
+            // последовательность буферов заголовка — временный объект: range-for продлевает
+            // жизнь только внешнему адаптеру, поэтому она сохраняется в переменной
+            const auto header_buffers = header->get();
+            for (const auto& buffer : beast::buffers_range_ref(header_buffers)) {
+                buffers.push_back(buffer);
+            }
+            body.emplace(response.base(), response.body());
+            body->init(ec);
+            while (!ec) {
+                auto part = body->get(ec);
+                if (ec || !part) {
+                    break;
+                }
+                for (const auto& buffer : beast::buffers_range_ref(part->first)) {
+                    buffers.push_back(buffer);
+                }
+                if (!part->second) {
+                    break;
+                }
+            }
+        }
+
+        http::response<Body, Fields> response;
+        std::optional<typename Fields::writer> header;
+        std::optional<typename Body::writer> body;
+    };
+
+    /// @brief Буфер чтения запросов сессии: поток может выдать свой, например
+    /// в памяти, зарегистрированной в io_uring, иначе обычный flat_buffer
+    template <typename Stream>
+    auto MakeReadBuffer(Stream& stream) {
+        if constexpr (requires { stream.MakeReadBuffer(); }) {
+            return stream.MakeReadBuffer();
+        } else {
+            return beast::flat_buffer{};
+        }
+    }
+
+    /// @brief Сессия HTTP поверх потока Stream: beast::tcp_stream на реакторе Asio
+    /// или UringStream на io_uring
+    template <typename Stream>
     class SessionBase {
     protected:
         using HttpRequest = http::request<http::string_body>;
@@ -27,72 +143,181 @@ namespace http_server {
 
         void Run();
 
+        // сколько запросов может ждать ответа, прежде чем сессия перестанет читать новые
+        static constexpr size_t MAX_PIPELINED_REQUESTS{32};
+
     protected:
-        explicit SessionBase(tcp::socket&& socket);
+        /// @param io_timeout срок чтения запроса на простаивающем соединении и срок каждой записи
+        SessionBase(tcp::socket&& socket, std::chrono::steady_clock::duration io_timeout);
 
         ~SessionBase() = default;
 
+        /// @brief Исполнитель сессии (strand), в котором должны вызываться все методы Write
+        typename Stream::executor_type GetExecutor() {
+            return stream_.get_executor();
+        }
+
+        /// @brief Постановка ответа на запрос с номером seq в очередь отправки.
+        /// Ответы уходят в порядке запросов, готовые подряд ответы — одной записью.
         template<typename Body, typename Fields>
-        void Write(http::response<Body, Fields>&& response) {
-            auto self_response = std::make_shared<http::response<Body, Fields>>(std::move(response));
+        void Write(uint64_t seq, http::response<Body, Fields>&& response) {
+            auto gathered = std::make_shared<GatheredResponse<Body, Fields>>(std::move(response));
+
+            Outgoing outgoing;
+            outgoing.close = gathered->response.need_eof();
+            beast::error_code ec;
+            {
+                metrics::ScopedTimer timer(metrics::Stage::SERIALIZE);
+                gathered->Prepare(outgoing.buffers, ec);
+            }
+            if (ec) {
+                ReportError(ec, "serialize");
+                outgoing.buffers.clear();
+                outgoing.close = true;
+            }
+            outgoing.owner = std::move(gathered);
+            Enqueue(seq, std::move(outgoing));
+        }
 
-            auto self = GetSharedThis();
+        /// @brief Отправка потокового ответа: очередная часть запрашивается
+        /// у источника только после записи предыдущей в сокет
+        void Write(uint64_t seq, StreamResponse&& response);
 
-            http::async_write(stream_, *self_response,
-                [self_response, self](beast::error_code ec, std::size_t bytes_written) {
-                    self->OnWrite(self_response->need_eof(), ec, bytes_written);
-                });
-        }
+        /// @brief Отправка ответа, файловые части которого передаются через sendfile
+        void Write(uint64_t seq, SendfileResponse&& response);
 
     private:
+        // Ответ в очереди отправки
+        struct Outgoing {
+            bool ready{false};
+            // закрыть соединение после отправки
+            bool close{false};
+            // буферы ответа, который можно отправить вместе с соседними
+            std::vector<net::const_buffer> buffers;
+            std::shared_ptr<const void> owner;
+            // запуск отдельной записи для потоковых ответов и ответов с sendfile,
+            // по завершении вызывает OnWrite
+            std::function<void()> start;
+        };
+
         /// @brief Асинхронное чтение запроса. Может быть вызван несколько раз.
         void Read();
 
         void OnRead(beast::error_code ec, [[maybe_unused]] std::size_t bytes_read);
 
+        void Enqueue(uint64_t seq, Outgoing&& outgoing);
+
+        /// @brief Отправка готовых ответов из головы очереди, если запись сейчас не идёт
+        void Flush();
+
         void OnWrite(bool close, beast::error_code ec, [[maybe_unused]] std::size_t bytes_written);
 
         void Close();
 
+        /// @brief Срок простоя для чтения, начатого без срока, когда очередь ответов опустела
+        void ArmIdleTimeout();
+
+        struct StreamState;
+
+        void WriteNextChunk(std::shared_ptr<StreamState> state);
+
+        struct SendfileState;
+
+        void WriteNextParts(std::shared_ptr<SendfileState> state);
+
+        void SendFilePart(std::shared_ptr<SendfileState> state);
+
         virtual std::shared_ptr<SessionBase> GetSharedThis() = 0;
-        virtual void HandleRequest(HttpRequest&& request) = 0;
+        virtual void HandleRequest(HttpRequest&& request, uint64_t seq) = 0;
     private:
-        // tcp_stream содержит внутри себя сокет и добавляет поддержку таймаутов
-        beast::tcp_stream stream_;
-        beast::flat_buffer buffer_;
+        // поток содержит внутри себя сокет и добавляет поддержку таймаутов
+        Stream stream_;
+        decltype(MakeReadBuffer(stream_)) buffer_;
         HttpRequest request_;
+        std::chrono::steady_clock::duration io_timeout_;
+        // Чтение следующего запроса, начатое при непустой очереди ответов, идёт без срока:
+        // срок начатого чтения не сдвигается, и его истечение закрыло бы сокет посреди долгой записи.
+        // Когда очередь пустеет, срок простоя отсчитывает idle_timer_.
+        bool read_unbounded_{false};
+        bool idle_armed_{false};
+        net::steady_timer idle_timer_;
+
+        // ответы на прочитанные запросы, по порядку номеров начиная с first_seq_
+        std::deque<Outgoing> pending_;
+        uint64_t first_seq_{0};
+        bool writing_{false};
+        // чтение остановлено: очередь ответов заполнена
+        bool read_paused_{false};
+        // новых запросов не будет: клиент закрыл соединение или попросил закрыть его
+        bool read_done_{false};
+        // буферы и владельцы ответов текущей общей записи
+        std::vector<net::const_buffer> write_buffers_;
+        std::vector<std::shared_ptr<const void>> write_owners_;
+        // начало текущих чтения и записи для метрик, нс
+        uint64_t read_started_{0};
+        uint64_t write_started_{0};
     };
 
 
+    extern template class SessionBase<beast::tcp_stream>;
+#ifdef SERVER_HAS_IO_URING
+    extern template class SessionBase<UringStream>;
+#endif
+
     /// @brief Этот класс будет отвечать за сеанс асинхронного обмена данными с клиентом. 
     /// @tparam RequestHandler
-    template <typename RequestHandler>
-    class Session : public SessionBase, public std::enable_shared_from_this<Session<RequestHandler>> {
+    /// @tparam Stream поток сокета сессии
+    template <typename RequestHandler, typename Stream = beast::tcp_stream>
+    class Session : public SessionBase<Stream>, public std::enable_shared_from_this<Session<RequestHandler, Stream>> {
+        using typename SessionBase<Stream>::HttpRequest;
     public:
         template <typename Handler>
-        Session(tcp::socket&& socket, Handler&& request_handler) :
-            SessionBase(std::move(socket)),
+        Session(tcp::socket&& socket, Handler&& request_handler, std::chrono::steady_clock::duration io_timeout) :
+            SessionBase<Stream>(std::move(socket), io_timeout),
             request_handler_(std::forward<Handler>(request_handler))
-        {};
+        {}
     private:
 
-        void HandleRequest(HttpRequest&& request) override {
-            request_handler_(std::move(request), [self = this->shared_from_this()](auto&& response){
-                self->Write(std::move(response));
+        void HandleRequest(HttpRequest&& request, uint64_t seq) override {
+            // обработчик может отправить ответ из другого потока, например из пула вычислений,
+            // поэтому запись всегда выполняется в strand сессии
+            request_handler_(std::move(request), [self = this->shared_from_this(), seq](auto&& response){
+                net::dispatch(self->GetExecutor(),
+                    [self, seq, response = std::forward<decltype(response)>(response)]() mutable {
+                        self->Write(seq, std::move(response));
+                    });
             });
         }
 
-        std::shared_ptr<SessionBase> GetSharedThis() override {
+        std::shared_ptr<SessionBase<Stream>> GetSharedThis() override {
             return this->shared_from_this();
         }
     private:
         RequestHandler request_handler_;
     };
 
+#ifdef SERVER_HAS_IO_URING
+    /// @brief Session, чтение и запись которой идут через io_uring. До запуска сервера
+    /// на io_context должна быть создана UringService, см. net::make_service
+    template <typename RequestHandler>
+    using UringSession = Session<RequestHandler, UringStream>;
+#endif
+
+    /// @brief Параметры приёма соединений
+    struct ListenerOptions {
+        // SO_REUSEPORT: несколько слушателей на одном порту, ядро распределяет между ними соединения
+        bool reuse_port{false};
+        // отдельный strand на каждую сессию; не нужен, если io_context обслуживает один поток
+        bool session_strands{true};
+        // срок чтения запроса на простаивающем соединении и срок каждой записи ответа
+        std::chrono::steady_clock::duration io_timeout{std::chrono::seconds{30}};
+    };
+
     /// @brief Слушатель асинхронно принимает входящие TCP-соединения. 
     /// @tparam RequestHandler тип функции-обработчика запросов
-    template <typename RequestHandler>
-    class Listener : public std::enable_shared_from_this<Listener<RequestHandler>> {
+    /// @tparam SessionType сессия, обслуживающая принятое соединение: HTTP или двоичный протокол
+    template <typename RequestHandler, template <typename> typename SessionType = Session>
+    class Listener : public std::enable_shared_from_this<Listener<RequestHandler, SessionType>> {
 
     private:
         // Ссылка на io_context, управляющий асинхронными операциями.
@@ -105,17 +330,26 @@ namespace http_server {
         // обработчик запросов
         RequestHandler request_handler_;
 
+        ListenerOptions options_;
+
+        using ReusePort = net::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>;
+
     public:
         template <typename Handler>
-        Listener(net::io_context& ioc, const tcp::endpoint& endpoint, Handler&& request_handler)
+        Listener(net::io_context& ioc, const tcp::endpoint& endpoint, Handler&& request_handler, ListenerOptions options = {})
             : ioc_(ioc),
-            acceptor_(net::make_strand(ioc)),
-            request_handler_(std::forward<Handler>(request_handler))
+            acceptor_(options.session_strands ? tcp::acceptor(net::make_strand(ioc)) : tcp::acceptor(ioc)),
+            request_handler_(std::forward<Handler>(request_handler)),
+            options_(options)
         {
             acceptor_.open(endpoint.protocol());
 
             acceptor_.set_option(net::socket_base::reuse_address(true));
 
+            if (options_.reuse_port) {
+                acceptor_.set_option(ReusePort(true));
+            }
+
             acceptor_.bind(endpoint);
 
             acceptor_.listen(net::socket_base::max_listen_connections);
@@ -127,6 +361,11 @@ namespace http_server {
 
     private:
         void DoAccept() {
+            if (!options_.session_strands) {
+                // сессия остаётся в единственном потоке своего io_context
+                return acceptor_.async_accept(ioc_,
+                    beast::bind_front_handler(&Listener::OnAccept, this->shared_from_this()));
+            }
             acceptor_.async_accept(
                 net::make_strand(ioc_),
 
@@ -142,6 +381,9 @@ namespace http_server {
                 return ReportError(ec, "accept"sv);
             }
 
+            // Ответы конвейера уходят пачками сразу, без ожидания ACK по алгоритму Нейгла
+            socket.set_option(tcp::no_delay(true), ec);
+
             // Асинхронно обрабатываем сессии
             AsyncRunSession(std::move(socket));
 
@@ -150,19 +392,30 @@ namespace http_server {
         }
 
         void AsyncRunSession(tcp::socket&& socket) {
-            std::make_shared<Session<RequestHandler>>(std::move(socket), request_handler_)->Run();
+            if constexpr (requires { request_handler_.Admit(socket); }) {
+                // обработчик с контролем допуска: своя копия на соединение или отказ
+                auto handler = request_handler_.Admit(socket);
+                if (!handler) {
+                    return request_handler_.Reject(std::move(socket));
+                }
+                std::make_shared<SessionType<RequestHandler>>(std::move(socket), std::move(*handler), options_.io_timeout)->Run();
+            } else {
+                std::make_shared<SessionType<RequestHandler>>(std::move(socket), request_handler_, options_.io_timeout)->Run();
+            }
         }
     };
 
     /// @brief Вспомогательная функция для запуска сервера
+    /// @tparam SessionType сессия HTTP: Session на обработчиках или CoroSession на сопрограммах
     /// @tparam RequestHandler
     /// @param ioc
     /// @param endpoint
     /// @param request_handler
-    template <typename RequestHandler>
-    void ServerHttp(net::io_context& ioc, const tcp::endpoint& endpoint, RequestHandler&& handler) {
-        using MyListener = Listener<std::decay_t<RequestHandler>>;
+    /// @param options параметры приёма соединений
+    template <template <typename> typename SessionType = Session, typename RequestHandler>
+    void ServerHttp(net::io_context& ioc, const tcp::endpoint& endpoint, RequestHandler&& handler, ListenerOptions options = {}) {
+        using MyListener = Listener<std::decay_t<RequestHandler>, SessionType>;
 
-        std::make_shared<MyListener>(ioc, endpoint, std::forward<RequestHandler>(handler))->Run();
+        std::make_shared<MyListener>(ioc, endpoint, std::forward<RequestHandler>(handler), options)->Run();
     }
 }; // namespace http_server
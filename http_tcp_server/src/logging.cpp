@@ -0,0 +1,330 @@
+#include "logging.h"
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <charconv>
+#include <chrono>
+#include <cstdio>
+#include <ctime>
+#include <memory>
+#include <vector>
+
+namespace logging {
+	namespace {
+		using namespace std::literals;
+
+		constexpr size_t MAX_ARGS{6};
+		// строковые аргументы записи вместе, длинные строки обрезаются
+		constexpr size_t TEXT_CAPACITY{96};
+		// записей в буфере потока, степень двойки
+		constexpr uint64_t RING_CAPACITY{1024};
+		constexpr auto DRAIN_PERIOD = 10ms;
+
+		constexpr std::array<std::string_view, 4> LEVEL_NAMES{"DEBUG"sv, "INFO"sv, "WARNING"sv, "ERROR"sv};
+
+		std::atomic<Level> min_level{Level::INFO};
+
+		// Аргумент в записи: строки хранятся в тексте записи
+		struct RecordArg {
+			Arg::Type type;
+			uint8_t text_offset;
+			uint8_t text_size;
+			int error_value;
+			union {
+				int64_t signed_value;
+				uint64_t unsigned_value;
+				double real;
+				const boost::system::error_category* category;
+			};
+		};
+
+		struct Record {
+			// системное время в наносекундах
+			uint64_t time;
+			const Site* site;
+			uint64_t suppressed;
+			uint8_t arg_count;
+			std::array<RecordArg, MAX_ARGS> args;
+			std::array<char, TEXT_CAPACITY> text;
+		};
+
+		/// @brief Кольцевой буфер одного писателя и одного читателя
+		class Ring {
+		public:
+			bool Push(const Record& record) {
+				const uint64_t head = head_.load(std::memory_order_relaxed);
+				if (head - tail_.load(std::memory_order_acquire) == RING_CAPACITY) {
+					dropped_.fetch_add(1, std::memory_order_relaxed);
+					return false;
+				}
+				records_[head & (RING_CAPACITY - 1)] = record;
+				head_.store(head + 1, std::memory_order_release);
+				return true;
+			}
+
+			template <typename Consumer>
+			void Drain(Consumer&& consumer) {
+				uint64_t tail = tail_.load(std::memory_order_relaxed);
+				const uint64_t head = head_.load(std::memory_order_acquire);
+				for (; tail != head; ++tail) {
+					consumer(records_[tail & (RING_CAPACITY - 1)]);
+				}
+				tail_.store(tail, std::memory_order_release);
+			}
+
+			uint64_t Dropped() const {
+				return dropped_.load(std::memory_order_relaxed);
+			}
+
+		private:
+			std::array<Record, RING_CAPACITY> records_;
+			alignas(64) std::atomic<uint64_t> head_{0};
+			alignas(64) std::atomic<uint64_t> tail_{0};
+			std::atomic<uint64_t> dropped_{0};
+		};
+
+		struct Registry {
+			std::mutex mutex;
+			// буферы не удаляются после завершения потоков: читатель может ещё читать из них
+			std::vector<std::unique_ptr<Ring>> rings;
+		};
+
+		Registry& GetRegistry() {
+			static Registry registry;
+			return registry;
+		}
+
+		Ring& LocalRing() {
+			thread_local Ring* local = [] {
+				auto& registry = GetRegistry();
+				std::lock_guard lock(registry.mutex);
+				return registry.rings.emplace_back(std::make_unique<Ring>()).get();
+			}();
+			return *local;
+		}
+
+		uint64_t SystemNow() {
+			return std::chrono::duration_cast<std::chrono::nanoseconds>(
+				std::chrono::system_clock::now().time_since_epoch()).count();
+		}
+
+		template <typename T>
+		void AppendNumber(std::string& out, T value) {
+			std::array<char, 32> buffer;
+			const auto result = std::to_chars(buffer.data(), buffer.data() + buffer.size(), value);
+			out.append(buffer.data(), result.ptr);
+		}
+
+		void AppendArg(std::string& out, const Record& record, const RecordArg& arg) {
+			switch (arg.type) {
+			case Arg::Type::SIGNED:
+				return AppendNumber(out, arg.signed_value);
+			case Arg::Type::UNSIGNED:
+				return AppendNumber(out, arg.unsigned_value);
+			case Arg::Type::REAL:
+				return AppendNumber(out, arg.real);
+			case Arg::Type::TEXT:
+				out.append(record.text.data() + arg.text_offset, arg.text_size);
+				return;
+			case Arg::Type::ERROR_CODE:
+				out += arg.category->message(arg.error_value);
+				return;
+			}
+		}
+
+		/// @brief Строка журнала: время UTC с микросекундами, уровень и сообщение
+		void Format(std::string& out, const Record& record) {
+			const auto seconds = static_cast<std::time_t>(record.time / 1'000'000'000);
+			std::tm time{};
+			gmtime_r(&seconds, &time);
+			std::array<char, 40> stamp;
+			const size_t size = std::strftime(stamp.data(), stamp.size(), "%Y-%m-%d %H:%M:%S", &time);
+			out.append(stamp.data(), size);
+			std::snprintf(stamp.data(), stamp.size(), ".%06u ", static_cast<unsigned>(record.time % 1'000'000'000 / 1000));
+			out += stamp.data();
+			out += LEVEL_NAMES[static_cast<size_t>(record.site->GetLevel())];
+			out += ' ';
+
+			// подстановка аргументов вместо {} по порядку
+			std::string_view format = record.site->Format();
+			size_t arg = 0;
+			for (size_t pos = format.find("{}"sv); pos != std::string_view::npos; pos = format.find("{}"sv)) {
+				out += format.substr(0, pos);
+				if (arg < record.arg_count) {
+					AppendArg(out, record, record.args[arg++]);
+				} else {
+					out += "{}"sv;
+				}
+				format.remove_prefix(pos + 2);
+			}
+			out += format;
+			if (record.suppressed > 0) {
+				out += " (suppressed "sv;
+				AppendNumber(out, record.suppressed);
+				out += " similar messages)"sv;
+			}
+			out += '\n';
+		}
+	}
+
+	std::optional<Level> ParseLevel(std::string_view name) {
+		for (size_t i = 0; i < LEVEL_NAMES.size(); ++i) {
+			const auto level_name = LEVEL_NAMES[i];
+			if (std::equal(name.begin(), name.end(), level_name.begin(), level_name.end(),
+				[](char a, char b) { return std::toupper(static_cast<unsigned char>(a)) == b; })) {
+				return static_cast<Level>(i);
+			}
+		}
+		return std::nullopt;
+	}
+
+	Level MinLevel() {
+		return min_level.load(std::memory_order_relaxed);
+	}
+
+	void SetMinLevel(Level level) {
+		min_level.store(level, std::memory_order_relaxed);
+	}
+
+	bool Site::Admit(uint64_t now, uint64_t& suppressed) {
+		suppressed = 0;
+		if (per_second_ == 0) {
+			return true;
+		}
+		// окно сбрасывает тот поток, который первым увидел новую секунду;
+		// в гонке на границе секунды может пройти на несколько сообщений больше
+		const uint64_t second = now / 1'000'000'000;
+		uint64_t window = window_.load(std::memory_order_relaxed);
+		if (window != second && window_.compare_exchange_strong(window, second, std::memory_order_relaxed)) {
+			count_.store(0, std::memory_order_relaxed);
+		}
+		if (count_.fetch_add(1, std::memory_order_relaxed) < per_second_) {
+			suppressed = suppressed_.exchange(0, std::memory_order_relaxed);
+			return true;
+		}
+		suppressed_.fetch_add(1, std::memory_order_relaxed);
+		return false;
+	}
+
+	void Write(Site& site, std::initializer_list<Arg> args) {
+		Record record;
+		record.time = SystemNow();
+		if (!site.Admit(record.time, record.suppressed)) {
+			return;
+		}
+		record.site = &site;
+		record.arg_count = 0;
+		size_t text_size = 0;
+		for (const Arg& arg : args) {
+			if (record.arg_count == MAX_ARGS) {
+				break;
+			}
+			RecordArg& out = record.args[record.arg_count++];
+			out.type = arg.GetType();
+			switch (arg.GetType()) {
+			case Arg::Type::SIGNED:
+				out.signed_value = arg.Signed();
+				break;
+			case Arg::Type::UNSIGNED:
+				out.unsigned_value = arg.Unsigned();
+				break;
+			case Arg::Type::REAL:
+				out.real = arg.Real();
+				break;
+			case Arg::Type::TEXT: {
+				const auto text = arg.Text().substr(0, TEXT_CAPACITY - text_size);
+				std::copy(text.begin(), text.end(), record.text.data() + text_size);
+				out.text_offset = static_cast<uint8_t>(text_size);
+				out.text_size = static_cast<uint8_t>(text.size());
+				text_size += text.size();
+				break;
+			}
+			case Arg::Type::ERROR_CODE:
+				out.error_value = arg.ErrorValue();
+				out.category = &arg.ErrorCategory();
+				break;
+			}
+		}
+		LocalRing().Push(record);
+	}
+
+	uint64_t DroppedRecords() {
+		auto& registry = GetRegistry();
+		std::lock_guard lock(registry.mutex);
+		uint64_t dropped = 0;
+		for (const auto& ring : registry.rings) {
+			dropped += ring->Dropped();
+		}
+		return dropped;
+	}
+
+	LogWriter::LogWriter(Level level) {
+		SetMinLevel(level);
+		thread_ = std::thread([this] {
+			Run();
+		});
+	}
+
+	LogWriter::~LogWriter() {
+		{
+			std::lock_guard lock(mutex_);
+			stop_ = true;
+		}
+		wake_.notify_one();
+		thread_.join();
+	}
+
+	void LogWriter::Run() {
+		std::vector<Record> batch;
+		std::string out;
+		std::string err;
+		uint64_t reported_dropped = 0;
+		for (bool stop = false; !stop;) {
+			{
+				// писатели не будят поток записи, чтобы не делать системных вызовов на пути запроса
+				std::unique_lock lock(mutex_);
+				wake_.wait_for(lock, DRAIN_PERIOD, [this] {
+					return stop_;
+				});
+				stop = stop_;
+			}
+
+			batch.clear();
+			{
+				auto& registry = GetRegistry();
+				std::lock_guard lock(registry.mutex);
+				for (const auto& ring : registry.rings) {
+					ring->Drain([&batch](const Record& record) {
+						batch.push_back(record);
+					});
+				}
+			}
+			// записи разных потоков в порядке времени
+			std::stable_sort(batch.begin(), batch.end(), [](const Record& a, const Record& b) {
+				return a.time < b.time;
+			});
+
+			out.clear();
+			err.clear();
+			for (const Record& record : batch) {
+				Format(record.site->GetLevel() >= Level::WARNING ? err : out, record);
+			}
+			const uint64_t dropped = DroppedRecords();
+			if (dropped != reported_dropped) {
+				err += "Log buffers overflowed, dropped "sv;
+				AppendNumber(err, dropped - reported_dropped);
+				err += " records\n"sv;
+				reported_dropped = dropped;
+			}
+
+			if (!out.empty()) {
+				std::fwrite(out.data(), 1, out.size(), stdout);
+				std::fflush(stdout);
+			}
+			if (!err.empty()) {
+				std::fwrite(err.data(), 1, err.size(), stderr);
+			}
+		}
+	}
+} // namespace logging
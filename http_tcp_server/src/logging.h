@@ -0,0 +1,196 @@
+#pragma once
+#include <boost/system/error_code.hpp>
+
+#include <atomic>
+#include <concepts>
+#include <condition_variable>
+#include <cstdint>
+#include <initializer_list>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+
+namespace logging {
+
+    enum class Level : uint8_t {
+        DEBUG,
+        INFO,
+        WARNING,
+        ERROR
+    };
+
+    /// @brief Уровень по имени: debug, info, warning или error
+    std::optional<Level> ParseLevel(std::string_view name);
+
+    /// @brief Минимальный уровень записываемых сообщений
+    Level MinLevel();
+    void SetMinLevel(Level level);
+
+    /// @brief Место вызова журнала: уровень, шаблон сообщения с подстановками {}
+    /// и ограничение частоты. Объявляется статическим: записи ссылаются на него,
+    /// а форматирование выполняется позже в потоке записи.
+    class Site {
+    public:
+        /// @param per_second сообщений в секунду, остальные только подсчитываются; 0 — без ограничения
+        constexpr Site(Level level, std::string_view format, uint32_t per_second = 0) :
+            level_(level),
+            format_(format),
+            per_second_(per_second) {
+        }
+
+        Site(const Site&) = delete;
+        Site& operator=(const Site&) = delete;
+
+        Level GetLevel() const {
+            return level_;
+        }
+
+        std::string_view Format() const {
+            return format_;
+        }
+
+        /// @brief Пропускает ли ограничение частоты сообщение в момент now
+        /// @param suppressed число подавленных сообщений с прошлого пропущенного
+        bool Admit(uint64_t now, uint64_t& suppressed);
+
+    private:
+        Level level_;
+        std::string_view format_;
+        uint32_t per_second_;
+        // секунда, в которой считаются сообщения, и их число
+        std::atomic<uint64_t> window_{0};
+        std::atomic<uint32_t> count_{0};
+        std::atomic<uint64_t> suppressed_{0};
+    };
+
+    /// @brief Аргумент сообщения. Числа и коды ошибок хранятся как есть и форматируются
+    /// в потоке записи, строки копируются в запись.
+    class Arg {
+    public:
+        enum class Type : uint8_t {
+            SIGNED,
+            UNSIGNED,
+            REAL,
+            TEXT,
+            ERROR_CODE
+        };
+
+        template <std::signed_integral T>
+        Arg(T value) :
+            type_(Type::SIGNED),
+            signed_(value) {
+        }
+
+        template <std::unsigned_integral T>
+        Arg(T value) :
+            type_(Type::UNSIGNED),
+            unsigned_(value) {
+        }
+
+        Arg(double value) :
+            type_(Type::REAL),
+            real_(value) {
+        }
+
+        Arg(std::string_view value) :
+            type_(Type::TEXT),
+            text_(value) {
+        }
+
+        Arg(const char* value) :
+            Arg(std::string_view(value)) {
+        }
+
+        Arg(const std::string& value) :
+            Arg(std::string_view(value)) {
+        }
+
+        // сообщение ошибки строится только при записи
+        Arg(const boost::system::error_code& ec) :
+            type_(Type::ERROR_CODE),
+            error_{ec.value(), &ec.category()} {
+        }
+
+        Type GetType() const {
+            return type_;
+        }
+
+        int64_t Signed() const {
+            return signed_;
+        }
+
+        uint64_t Unsigned() const {
+            return unsigned_;
+        }
+
+        double Real() const {
+            return real_;
+        }
+
+        std::string_view Text() const {
+            return text_;
+        }
+
+        int ErrorValue() const {
+            return error_.value;
+        }
+
+        const boost::system::error_category& ErrorCategory() const {
+            return *error_.category;
+        }
+
+    private:
+        struct ErrorCode {
+            int value;
+            const boost::system::error_category* category;
+        };
+
+        Type type_;
+        union {
+            int64_t signed_;
+            uint64_t unsigned_;
+            double real_;
+            std::string_view text_;
+            ErrorCode error_;
+        };
+    };
+
+    /// @brief Помещает запись в кольцевой буфер текущего потока без блокировок.
+    /// Если буфер полон, запись отбрасывается и учитывается в DroppedRecords.
+    void Write(Site& site, std::initializer_list<Arg> args);
+
+    /// @brief Сообщение уровня site, если он не ниже MinLevel()
+    template <typename... Args>
+    void Log(Site& site, const Args&... args) {
+        if (site.GetLevel() < MinLevel()) {
+            return;
+        }
+        Write(site, {Arg(args)...});
+    }
+
+    /// @brief Записи, отброшенные из-за переполнения буферов потоков
+    uint64_t DroppedRecords();
+
+    /// @brief Поток, который забирает записи из буферов всех потоков, форматирует их
+    /// и пишет пачками: DEBUG и INFO в stdout, WARNING и ERROR в stderr.
+    /// При разрушении дописывает оставшиеся записи.
+    class LogWriter {
+    public:
+        explicit LogWriter(Level min_level = Level::INFO);
+        ~LogWriter();
+
+        LogWriter(const LogWriter&) = delete;
+        LogWriter& operator=(const LogWriter&) = delete;
+
+    private:
+        void Run();
+
+    private:
+        std::mutex mutex_;
+        std::condition_variable wake_;
+        bool stop_{false};
+        std::thread thread_;
+    };
+} // namespace logging
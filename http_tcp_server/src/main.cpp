@@ -7,59 +7,32 @@
 
 #define BOOST_BEAST_USE_STD_STRING_VIEW
 #include <boost/asio/signal_set.hpp>
+#include <boost/program_options.hpp>
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <iostream>
+#include <memory>
 #include <mutex>
+#include <optional>
 #include <thread>
 #include <vector>
-#include <random>
-#include <list>
+#include <pthread.h>
+#include <sched.h>
 #include "sdk.h"
+#include "admission.h"
+#include "binary_server.h"
+#include "coro_session.h"
 #include "http_server.h"
-
-#include <google/protobuf/io/zero_copy_stream_impl_lite.h>
-#include <exchange.pb.h>
-
-/// @brief Генаратор рандомной строки заданной длины
-/// @param length длина строки
-/// @return рандомная строка
-std::string RandomString(size_t length){
-    const std::string characters = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwyz";
-
-    std::random_device random_device;
-    std::mt19937 generator(random_device());
-    std::uniform_int_distribution<> distribution(0, characters.size() - 1);
-
-    std::string random_string;
-
-    for(size_t i = 0; i < length; ++i){
-        random_string += characters[distribution(generator)];
-    }
-
-    return random_string;
-}
-
-/// @brief Генератор рандомного целого беззнакового числа
-/// @return рандомное целое беззнаковое число
-uint32_t RandomUnsignedInt32Number(){
-    std::random_device random_device;
-    std::mt19937 generator(random_device());
-    std::uniform_int_distribution<uint32_t> distribution;
-    return distribution(generator);
-}
-
-/// @brief Генератор рандомного беззнакового целого числа в заданном диапазоне
-/// @param min минимальное значение
-/// @param max максимальное число
-/// @return рандомное беззнаковое целое число
-uint32_t RandomNumber(uint32_t min, uint32_t max){
-    const std::string characters = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwyz";
-
-    std::random_device random_device;
-    std::mt19937 generator(random_device());
-    std::uniform_int_distribution<uint32_t> distribution(min, max);
-    return distribution(generator);
-}
+#include "block_store.h"
+#include "block_cache.h"
+#include "block_snapshot.h"
+#include "mapped_block_store.h"
+#include "compute_pool.h"
+#include "logging.h"
+#include "metrics.h"
+#include "request_handler.h"
 
 namespace {
 	namespace net = boost::asio;
@@ -67,194 +40,397 @@ namespace {
 	namespace sys = boost::system;
 	namespace http = boost::beast::http;
 
+	/// @brief Привязка текущего потока к ядру процессора
+	/// @param cpu номер ядра
+	void PinThread(unsigned cpu) {
+		cpu_set_t cpu_set;
+		CPU_ZERO(&cpu_set);
+		CPU_SET(cpu % std::max(1u, std::thread::hardware_concurrency()), &cpu_set);
+		if (const int error = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set); error != 0) {
+			static logging::Site site{logging::Level::WARNING, "Failed to pin thread to CPU {}: {}"sv};
+			logging::Log(site, cpu, sys::error_code(error, sys::system_category()));
+		}
+	}
+
 	/// @brief Запуск функции на заданном числе потоков
-	/// @tparam Fn тип функции
+	/// @tparam Fn тип функции, принимающей номер потока
 	/// @param n число потоков
-	/// @param n fn функция
+	/// @param fn функция
+	/// @param pin привязать поток с номером i к ядру i
 	template<typename Fn>
-	void RunWorkers(unsigned n, const Fn& fn) {
+	void RunWorkers(unsigned n, const Fn& fn, bool pin = false) {
 		n = std::max(1u, n);
+		const auto run = [&fn, pin](unsigned index) {
+			if (pin) {
+				PinThread(index);
+			}
+			fn(index);
+		};
 		std::vector<std::jthread> workers;
 		workers.reserve(n - 1);
 		// Запускаем n-1 рабочих потоков, выполняющих функцию fn
-		while (--n) {
-			workers.emplace_back(fn);
+		for (unsigned i = 1; i < n; ++i) {
+			workers.emplace_back(run, i);
 		}
-		fn();
+		run(0);
 	}
 
-	namespace beast = boost::beast;
-	namespace http = beast::http;
-	// Ответ, тело которого представлено в виде строки
-	using StringResponse = http::response<http::string_body>;
-	// Запрос, тело которого представлено в виде строки
-	using StringRequest = http::request<http::string_body>;
+	// Параметры командной строки
+	struct Args {
+		unsigned short port{8080};
+		// порт двоичного протокола, 0 — только HTTP
+		unsigned short binary_port{0};
+		// каталог хранилища блоков на диске, пустой — блоки только в памяти
+		std::string store_directory;
+		// период записи снимка блоков в каталог хранилища в секундах, 0 — без снимков
+		uint32_t snapshot_interval{0};
+		// бюджет кэша готовых блоков в мегабайтах
+		uint64_t cache_size_mb{512};
+		// бюджет сжатых форм блоков из --store в мегабайтах
+		uint64_t store_deflate_cache_mb{storage::MappedBlockStore::DEFAULT_DEFLATED_CAPACITY >> 20};
+		// выводить блоки из токенов вместо хранения случайных номеров и размеров
+		bool deterministic_blocks{false};
+		// потоки пула вычислений, 0 — без пула
+		unsigned compute_threads{std::thread::hardware_concurrency()};
+		// число токенов, начиная с которого запрос обрабатывается в пуле
+		int parallel_threshold{64};
+		// свой io_context и свой слушатель SO_REUSEPORT на каждое ядро
+		bool thread_per_core{false};
+		// привязка потоков io_context к ядрам
+		bool pin_threads{false};
+		// HTTP-сессии на сопрограммах вместо цепочек обработчиков
+		bool coroutine_sessions{false};
+		// чтение и запись HTTP-сессий через io_uring вместо реактора epoll
+		bool io_uring{false};
+		// буферы чтения, зарегистрированные в io_uring, на каждый io_context
+		size_t uring_buffers{256};
+		// контроль допуска
+		uint32_t max_sessions{10000};
+		uint64_t max_inflight_mb{1024};
+		int max_hashes{4096};
+		uint32_t max_ranges_per_hash{64};
+		uint32_t max_ranges{4096};
+		double client_rate{0};
+		double client_burst{1};
+		uint32_t retry_after{1};
+		// минимальный уровень сообщений журнала
+		logging::Level log_level{logging::Level::INFO};
+	};
 
-	// Чтобы использовать литералы ""s и ""sv стандартной библиотеки, применим std::literals.
-	using namespace std::literals;
+	/// @brief Разбор параметров командной строки
+	/// @return параметры или std::nullopt, если сервер запускать не нужно
+	std::optional<Args> ParseCommandLine(int argc, const char* const argv[]) {
+		namespace po = boost::program_options;
+
+		po::options_description desc{"Allowed options"s};
+		Args args;
+		std::string log_level;
+		std::string session{"callback"s};
+		std::string io{"epoll"s};
+		desc.add_options()
+			("help,h", "produce help message")
+			("port,p", po::value(&args.port)->value_name("port"s), "listening port, 8080 by default")
+			("binary-port", po::value(&args.binary_port)->value_name("port"s), "also serve the length-prefixed binary protocol on this port, disabled by default")
+			("store,s", po::value(&args.store_directory)->value_name("dir"s), "directory with on-disk block store built by block_loader")
+			("snapshot-interval", po::value(&args.snapshot_interval)->value_name("seconds"s), "write a snapshot of generated blocks into the --store directory every N seconds and on SIGINT/SIGTERM, the directory is created if missing, disabled by default")
+			("cache-size", po::value(&args.cache_size_mb)->value_name("MB"s), "memory budget of generated blocks cache, 512 MB by default")
+			("store-deflate-cache", po::value(&args.store_deflate_cache_mb)->value_name("MB"s), "memory budget of compressed forms of --store blocks, 256 MB by default")
+			("deterministic-blocks", po::bool_switch(&args.deterministic_blocks), "derive block number, size and data from the hash instead of storing them")
+			("compute-threads", po::value(&args.compute_threads)->value_name("count"s), "threads fetching blocks of large requests in parallel, number of cores by default, 0 disables the pool")
+			("parallel-threshold", po::value(&args.parallel_threshold)->value_name("hashes"s), "hash count from which a request is split across the compute pool, 64 by default")
+			("thread-per-core", po::bool_switch(&args.thread_per_core), "run an io_context and an SO_REUSEPORT listener per core instead of one shared io_context")
+			("pin-threads", po::bool_switch(&args.pin_threads), "pin io threads to cores")
+			("session", po::value(&session)->value_name("engine"s), "HTTP session engine: callback (default) or coroutine")
+			("io", po::value(&io)->value_name("backend"s), "HTTP session I/O of the callback engine: epoll (default) or uring, uring falls back to epoll where unsupported")
+			("uring-buffers", po::value(&args.uring_buffers)->value_name("count"s), "16 KB read buffers registered with io_uring per io_context, 256 by default, 0 disables them")
+			("max-sessions", po::value(&args.max_sessions)->value_name("count"s), "concurrent sessions, further connections get 503, 10000 by default, 0 is unlimited")
+			("max-inflight-mb", po::value(&args.max_inflight_mb)->value_name("MB"s), "response bodies built in memory and not yet sent, requests above it get 503, 1024 MB by default, 0 is unlimited")
+			("max-hashes", po::value(&args.max_hashes)->value_name("hashes"s), "hashes per request, larger requests get 413, 4096 by default, 0 is unlimited")
+			("max-ranges-per-hash", po::value(&args.max_ranges_per_hash)->value_name("ranges"s), "byte ranges requested for one hash, larger requests get 413, 64 by default, 0 is unlimited")
+			("max-ranges", po::value(&args.max_ranges)->value_name("ranges"s), "byte ranges per request, larger requests get 413, 4096 by default, 0 is unlimited")
+			("client-rate", po::value(&args.client_rate)->value_name("rps"s), "requests per second per client IP, excess requests get 503, unlimited by default")
+			("client-burst", po::value(&args.client_burst)->value_name("requests"s), "requests a client IP may send at once above its rate, 1 by default")
+			("retry-after", po::value(&args.retry_after)->value_name("seconds"s), "Retry-After of 503 responses on overload, 1 by default")
+			("log-level", po::value(&log_level)->value_name("level"s), "debug, info, warning or error, info by default");
+
+		po::variables_map vm;
+		try {
+			po::store(po::parse_command_line(argc, argv, desc), vm);
+			po::notify(vm);
+		} catch (const po::error& e) {
+			std::cerr << e.what() << std::endl << desc;
+			return std::nullopt;
+		}
 
-	// Структура ContentType задаёт область видимости для констант, задающей значения HTTP-заголовка Content-Type
-	struct ContentType {
-		ContentType() = delete;
-		constexpr static std::string_view TEXT_HTML = "text/html"sv;
-		// При необходимости внутрь ContentType можно добавить и другие типы контента
-	};
+		if (vm.contains("help"s)) {
+			std::cout << desc;
+			return std::nullopt;
+		}
+		if (session != "callback"sv && session != "coroutine"sv) {
+			std::cerr << "Unknown session engine "sv << session << std::endl << desc;
+			return std::nullopt;
+		}
+		args.coroutine_sessions = session == "coroutine"sv;
+		if (io != "epoll"sv && io != "uring"sv) {
+			std::cerr << "Unknown I/O backend "sv << io << std::endl << desc;
+			return std::nullopt;
+		}
+		args.io_uring = io == "uring"sv;
+		if (args.io_uring && args.coroutine_sessions) {
+			std::cerr << "io_uring backend serves callback sessions only"sv << std::endl << desc;
+			return std::nullopt;
+		}
+		if (args.snapshot_interval > 0 && args.store_directory.empty()) {
+			std::cerr << "--snapshot-interval needs a --store directory"sv << std::endl << desc;
+			return std::nullopt;
+		}
+		if (!log_level.empty()) {
+			const auto level = logging::ParseLevel(log_level);
+			if (!level) {
+				std::cerr << "Unknown log level "sv << log_level << std::endl << desc;
+				return std::nullopt;
+			}
+			args.log_level = *level;
+		}
+		return args;
+	}
 
-	/// @brief Создаёт StringResponse с заданными параметрами
-	/// @param status http статус ответа
-	/// @param body тело ответа
-	/// @param http_version 1.1 или 1.0
-	/// @param keep_alive
-	/// @param method метод запроса
-	/// @param content_type тип тела ответа
-	/// @return строковый http ответ
-	StringResponse MakeStringResponse(http::status status, std::string_view body, unsigned http_version,
-		bool keep_alive,
-		http::verb method,
-		std::string_view content_type = ContentType::TEXT_HTML) {
-		StringResponse response(status, http_version);
-		response.set(http::field::content_type, content_type);
-		if (method != http::verb::head) {
-			response.body() = body;
+	/// @brief Запись снимка блоков с отчётом в журнал
+	void WriteSnapshot(storage::BlockSnapshot& snapshot) {
+		const auto start = std::chrono::steady_clock::now();
+		try {
+			const auto stats = snapshot.Write();
+			const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+			static logging::Site site{logging::Level::INFO, "Snapshot: appended {} blocks, {} bytes in {} s, {} blocks on disk"sv};
+			logging::Log(site, stats.blocks, stats.bytes, elapsed.count(), stats.total_blocks);
+		} catch (const std::exception& e) {
+			static logging::Site site{logging::Level::ERROR, "Snapshot failed: {}"sv};
+			logging::Log(site, e.what());
 		}
-		response.content_length(body.size());
-		response.keep_alive(keep_alive);
-		return response;
 	}
 
-	// хэш-таблица соответствия токена в запросе и номера блока данных на сервере
-    std::unordered_map<std::string_view, size_t> hash_to_block_num;
-	
-	// хэш-таблица соответствия номера блоку токену
-    std::unordered_map<size_t, std::string> block_num_to_hash;
-	
-	// хэш-таблица соответствия токена размеру блока
-    std::unordered_map<std::string, size_t> hash_to_block_size;
-	
-	// хэш-таблица соответствия номера блока блоку данных
-    std::unordered_map<size_t, std::string> block_num_to_block;
-	
-	// хранилище токенов
-    std::list<std::string> hashes;
-	
-	// максимальный размер токена
-    const size_t MAX_HASH_SIZE{128};
-	
-	// максимальный размер блока данных на сервере
-    const size_t MAX_BLOCK_SIZE{1000000};
-
-	/// @brief Номер блока данных по токену
-	/// @param hash токен
-	/// @param номер блока данных
-    size_t GetBlockNumber(const std::string& hash){
-        if(hash_to_block_num.find(hash) == hash_to_block_num.end()){
-            hashes.emplace_back(hash);
-            auto block_num{RandomUnsignedInt32Number()};
-            hash_to_block_num[hashes.back()] = block_num;
-            block_num_to_hash[block_num] = hash;
-        }
-        return hash_to_block_num[hash];
-    }
-
-	/// @brief Размер блока данных по токену
-	/// @param hash токен
-	/// @param размер блока данных
-    size_t GetBlockSize(const std::string& hash){
-        if(hash_to_block_size.find(hash) == hash_to_block_size.end()){
-            hashes.emplace_back(hash);
-            hash_to_block_size[hashes.back()] = RandomNumber(1, MAX_BLOCK_SIZE);
-        }
-        return hash_to_block_size[hash];
-    }
-
-	/// @brief Имитация обращение к БД
-	/// @param block_num
-	/// @param buffer буфер
-	/// @param buffer_size размер буфера
-	/// @return размер записанного в буфер блока данных
-    int GetBlockData(size_t block_num, char* buffer, size_t buffer_size){
-        if(block_num_to_block.find(block_num) == block_num_to_block.end()){
-            block_num_to_block[block_num] = RandomString(GetBlockSize(block_num_to_hash[block_num]));
-        }
-        const auto& block = block_num_to_block.at(block_num);
-        if(buffer_size < block.size()){
-            return 0;
-        }
-        std::memcpy(buffer, block.data(), block.size());
-        return block.size();
-    }
-
-	/// @brief Формировщик ответа сервера
-	/// @brief client_to_server распаршенный запрос клиента
-	/// @brief server_to_client ответ
-    void GetServerResponse(const Exchange::ClientToServer& client_to_server, Exchange::ServerToClient& server_to_client){
-        for(int i = 0; i < client_to_server.hashes_size(); ++i){
-            std::string hash{client_to_server.hashes().at(i)};
-            if(hash.size() != MAX_HASH_SIZE){
-                continue;
-            }
-            Exchange::HashAndBlock hash_and_block;
-            auto block_num = GetBlockNumber(hash);
-            static std::string block(MAX_BLOCK_SIZE, '1');
-            auto block_size = GetBlockData(block_num, block.data(), block.size());
-            hash_and_block.set_hash(std::move(hash));
-            hash_and_block.set_block(block.data(), block_size);
-            server_to_client.mutable_hash_and_block()->Add(std::move(hash_and_block));
-        }
-    }
-
-	/// @brief Обработка запроса на сервер
-	/// @param req запрос на сервер 
-	/// @return строковый Http ответ на запрос
-	StringResponse HandleRequest(StringRequest&& req) {
-		const auto text_response = [&req](http::status status, std::string_view text) {
-			if (req.method() == http::verb::get || req.method() == http::verb::head) {
-				return MakeStringResponse(status, text, req.version(), req.keep_alive(), req.method());
-			}
-			return MakeStringResponse(http::status::method_not_allowed, "Invalid method", req.version(), req.keep_alive(), req.method());
-		};
+	/// @brief Периодическая запись снимка до запроса остановки
+	void RunSnapshots(storage::BlockSnapshot& snapshot, std::chrono::seconds interval, std::stop_token stop) {
+		std::mutex mutex;
+		std::condition_variable_any wake;
+		std::unique_lock lock(mutex);
+		// ожидание прерывается запросом остановки
+		while (!wake.wait_for(lock, stop, interval, [&stop] { return stop.stop_requested(); })) {
+			WriteSnapshot(snapshot);
+		}
+	}
 
-        Exchange::ClientToServer client_to_server;
-        Exchange::ServerToClient server_to_client;
-        try {
-            if(client_to_server.ParseFromArray( req.body().data(), req.body().size())){
-                std::cout << "Parse Ok, hash count "sv << client_to_server.hashes_size() << std::endl;
-                GetServerResponse(client_to_server, server_to_client);
-            }else{
-                std::cout << "Parse error"sv << std::endl;
-                return text_response(http::status::bad_request, "Parse error"sv);
-            }
-        }
-        catch (...) {
-            std::cout << "Parse error by exception"sv << std::endl;
-            return text_response(http::status::bad_request, "Parse error by exception"sv);
-        }
-
-        size_t size_output = server_to_client.ByteSizeLong();
-        char *msg = new char[size_output];
-        server_to_client.SerializeToArray(msg, size_output);
-
-        return text_response(http::status::ok, {msg, size_output});
-	};
+	/// @brief Запуск кольца io_uring на контексте ioc
+	/// @return false, если io_uring недоступен и сессии остаются на epoll
+	bool StartUring(net::io_context& ioc, const Args& args) {
+#ifdef SERVER_HAS_IO_URING
+		try {
+			net::make_service<http_server::UringService>(ioc, http_server::UringOptions{.buffers = args.uring_buffers});
+			return true;
+		} catch (const std::exception& e) {
+			static logging::Site site{logging::Level::WARNING, "io_uring is unavailable, falling back to epoll: {}"sv};
+			logging::Log(site, e.what());
+			return false;
+		}
+#else
+		static logging::Site site{logging::Level::WARNING, "Server is built without io_uring, falling back to epoll"sv};
+		logging::Log(site);
+		return false;
+#endif
+	}
 }
 
-int main() {
+int main(int argc, const char* argv[]) {
 	using namespace std::literals;
 	namespace net = boost::asio;
 
+	const auto args = ParseCommandLine(argc, argv);
+	if (!args) {
+		return EXIT_FAILURE;
+	}
+
+	// журнал пишется отдельным потоком, рабочие потоки только кладут записи в свои буферы
+	logging::LogWriter log_writer(args->log_level);
+
 	const unsigned int num_threads = std::thread::hardware_concurrency();
 
+	// хранилище блоков данных, общее для всех рабочих потоков
+	storage::BlockStore memory_store(args->deterministic_blocks ? storage::BlockOrigin::FROM_HASH : storage::BlockOrigin::RANDOM);
+	// сгенерированные блоки держит кэш с ограниченным бюджетом памяти
+	storage::BlockCache cache(memory_store, args->cache_size_mb * 1024 * 1024);
+	std::unique_ptr<storage::MappedBlockStore> mapped_store;
+	storage::BlockSource* store = &cache;
+	std::unique_ptr<storage::BlockSnapshot> snapshot;
+	if (!args->store_directory.empty()) {
+		const auto start = std::chrono::steady_clock::now();
+		try {
+			if (args->snapshot_interval > 0) {
+				storage::BlockSnapshot::CreateStore(args->store_directory);
+			}
+			// блоки, которых нет на диске, по-прежнему генерируются в памяти;
+			// сегмент и индекс отображаются в память, блоки не копируются
+			mapped_store = std::make_unique<storage::MappedBlockStore>(args->store_directory, &cache,
+				args->store_deflate_cache_mb * 1024 * 1024);
+			if (args->snapshot_interval > 0) {
+				snapshot = std::make_unique<storage::BlockSnapshot>(args->store_directory, memory_store, cache, mapped_store.get());
+			}
+		} catch (const std::exception& e) {
+			static logging::Site site{logging::Level::ERROR, "Failed to open block store: {}"sv};
+			logging::Log(site, e.what());
+			return EXIT_FAILURE;
+		}
+		const std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+		static logging::Site site{logging::Level::INFO, "Block store {}, blocks {}, opened in {} ms"sv};
+		logging::Log(site, args->store_directory, mapped_store->Size(), elapsed.count());
+		store = mapped_store.get();
+	}
+	// снимки пишутся в фоне, обработка запросов при этом не останавливается
+	std::jthread snapshot_thread;
+	if (snapshot) {
+		snapshot_thread = std::jthread([&snapshot, interval = std::chrono::seconds(args->snapshot_interval)](std::stop_token stop) {
+			RunSnapshots(*snapshot, interval, stop);
+		});
+	}
+	// со снимками сервер останавливается по сигналу, чтобы записать последний снимок
+	const auto stop_on_signal = [&snapshot](std::vector<net::io_context*> contexts) {
+		if (!snapshot) {
+			return;
+		}
+		auto signals = std::make_shared<net::signal_set>(*contexts.front(), SIGINT, SIGTERM);
+		signals->async_wait([signals, contexts](const sys::error_code& ec, int) {
+			if (!ec) {
+				for (auto* context : contexts) {
+					context->stop();
+				}
+			}
+		});
+	};
+	const auto final_snapshot = [&snapshot, &snapshot_thread] {
+		if (snapshot) {
+			snapshot_thread.request_stop();
+			snapshot_thread.join();
+			WriteSnapshot(*snapshot);
+		}
+	};
+
+	metrics::RegisterCallback("block_store_blocks"s, "Blocks known to the in-memory store"s, metrics::MetricType::GAUGE,
+		[&memory_store] { return static_cast<double>(memory_store.Size()); });
+	metrics::RegisterCallback("block_store_memory_bytes"s, "Memory used by the in-memory store index"s, metrics::MetricType::GAUGE,
+		[&memory_store] { return static_cast<double>(memory_store.MemoryUsage()); });
+	metrics::RegisterCallback("block_cache_hits_total"s, "Block cache hits"s, metrics::MetricType::COUNTER,
+		[&cache] { return static_cast<double>(cache.Stats().hits); });
+	metrics::RegisterCallback("block_cache_misses_total"s, "Block cache misses"s, metrics::MetricType::COUNTER,
+		[&cache] { return static_cast<double>(cache.Stats().misses); });
+	metrics::RegisterCallback("block_cache_coalesced_total"s, "Block cache misses that waited for another request's materialization"s,
+		metrics::MetricType::COUNTER, [&cache] { return static_cast<double>(cache.Stats().coalesced); });
+	metrics::RegisterCallback("block_cache_materializations_total"s, "Blocks fetched from the block source on a cache miss"s,
+		metrics::MetricType::COUNTER, [&cache] { return static_cast<double>(cache.Stats().materializations); });
+	metrics::RegisterCallback("block_cache_evictions_total"s, "Blocks evicted from the cache"s, metrics::MetricType::COUNTER,
+		[&cache] { return static_cast<double>(cache.Stats().evictions); });
+	metrics::RegisterCallback("block_cache_bytes"s, "Bytes held by the block cache"s, metrics::MetricType::GAUGE,
+		[&cache] { return static_cast<double>(cache.Stats().bytes); });
+	metrics::RegisterCallback("block_cache_deflations_total"s, "Blocks compressed on a miss of their compressed form"s,
+		metrics::MetricType::COUNTER, [&cache] { return static_cast<double>(cache.Stats().deflations); });
+	metrics::RegisterCallback("block_cache_deflated_bytes"s, "Bytes of compressed block forms held by the block cache"s, metrics::MetricType::GAUGE,
+		[&cache] { return static_cast<double>(cache.Stats().deflated_bytes); });
+	if (mapped_store) {
+		metrics::RegisterCallback("mapped_store_deflated_bytes"s, "Bytes of compressed forms of on-disk blocks held in memory"s, metrics::MetricType::GAUGE,
+			[&mapped_store] { return static_cast<double>(mapped_store->DeflatedBytes()); });
+		metrics::RegisterCallback("mapped_store_deflated_evictions_total"s, "Compressed forms of on-disk blocks evicted over the budget"s,
+			metrics::MetricType::COUNTER, [&mapped_store] { return static_cast<double>(mapped_store->DeflatedEvictions()); });
+	}
+
+	// пул вычислений отдельно от потоков io_context
+	std::unique_ptr<http_server::ComputePool> compute_pool;
+	http_server::ParallelOptions parallel;
+	if (args->compute_threads > 0) {
+		compute_pool = std::make_unique<http_server::ComputePool>(args->compute_threads);
+		parallel.pool = compute_pool.get();
+		parallel.threshold = args->parallel_threshold;
+	}
+
+	// ограничения на весь сервер, проверяются до работы с блоками
+	http_server::AdmissionController admission({
+		.max_sessions = args->max_sessions,
+		.max_inflight_bytes = args->max_inflight_mb * 1024 * 1024,
+		.max_hashes = args->max_hashes,
+		.max_ranges_per_hash = args->max_ranges_per_hash,
+		.max_ranges = args->max_ranges,
+		.client_rate = args->client_rate,
+		.client_burst = args->client_burst,
+		.retry_after_seconds = args->retry_after});
+	metrics::RegisterCallback("admission_sessions"s, "Open sessions counted against the session limit"s, metrics::MetricType::GAUGE,
+		[&admission] { return static_cast<double>(admission.Sessions()); });
+	metrics::RegisterCallback("admission_inflight_bytes"s, "Bytes of response bodies built in memory and not yet sent"s, metrics::MetricType::GAUGE,
+		[&admission] { return static_cast<double>(admission.Inflight()); });
+
+	metrics::RegisterCallback("log_records_dropped_total"s, "Log records dropped on full thread buffers"s, metrics::MetricType::COUNTER,
+		[] { return static_cast<double>(logging::DroppedRecords()); });
+
+	static logging::Site started{logging::Level::INFO, "Server has started..."sv};
+
+	const http_server::AdmittedHandler handler(admission, [store, parallel, &admission](auto&& req, auto&& sender) {
+		http_server::HandleRequest(*store, parallel, &admission, std::forward<decltype(req)>(req), std::forward<decltype(sender)>(sender));
+	}, admission.OverloadedHttpResponse());
+	const http_server::AdmittedHandler binary_handler(admission, [store, parallel, &admission](http_server::BinaryRequest&& req, auto&& sender) {
+		http_server::HandleBinaryRequest(*store, parallel, &admission, std::move(req), std::forward<decltype(sender)>(sender));
+	});
+	const net::ip::tcp::endpoint endpoint{net::ip::make_address("0.0.0.0"), args->port};
+	const net::ip::tcp::endpoint binary_endpoint{net::ip::make_address("0.0.0.0"), args->binary_port};
+
+	// HTTP-сервер на контексте ioc с выбранными движком сессий и вводом-выводом
+	const auto serve_http = [&args, &handler, &endpoint](net::io_context& ioc, http_server::ListenerOptions options) {
+		if (args->coroutine_sessions) {
+			return http_server::ServerHttp<http_server::CoroSession>(ioc, endpoint, handler, options);
+		}
+		if (args->io_uring && StartUring(ioc, *args)) {
+#ifdef SERVER_HAS_IO_URING
+			return http_server::ServerHttp<http_server::UringSession>(ioc, endpoint, handler, options);
+#endif
+		}
+		http_server::ServerHttp(ioc, endpoint, handler, options);
+	};
+
+	if (args->thread_per_core) {
+		// Потоки ничего не делят: у каждого свой io_context и свой слушатель на общем порту,
+		// сессия живёт в потоке, принявшем соединение, поэтому strand ей не нужен
+		std::vector<std::unique_ptr<net::io_context>> contexts;
+		for (unsigned i = 0; i < std::max(1u, num_threads); ++i) {
+			contexts.push_back(std::make_unique<net::io_context>(1));
+			serve_http(*contexts.back(), http_server::ListenerOptions{.reuse_port = true, .session_strands = false});
+			if (args->binary_port != 0) {
+				http_server::ServerBinary(*contexts.back(), binary_endpoint, binary_handler,
+					http_server::ListenerOptions{.reuse_port = true, .session_strands = false});
+			}
+		}
+
+		std::vector<net::io_context*> context_ptrs;
+		for (const auto& context : contexts) {
+			context_ptrs.push_back(context.get());
+		}
+		stop_on_signal(std::move(context_ptrs));
+
+		logging::Log(started);
+
+		RunWorkers(num_threads, [&contexts](unsigned index) {
+			contexts[index]->run();
+			}, args->pin_threads);
+		final_snapshot();
+		return EXIT_SUCCESS;
+	}
+
 	net::io_context ioc(num_threads);
 
-	const auto address = net::ip::make_address("0.0.0.0");
-    constexpr int port = 8080;
-	http_server::ServerHttp(ioc, { address, port }, [](auto&& req, auto&& sender) {
-		sender(HandleRequest(std::forward<decltype(req)>(req)));
-		});
+	serve_http(ioc, {});
+	if (args->binary_port != 0) {
+		http_server::ServerBinary(ioc, binary_endpoint, binary_handler);
+	}
+	stop_on_signal({&ioc});
 
-	std::cout << "Server has started..."sv << std::endl;
+	logging::Log(started);
 
-	RunWorkers(num_threads, [&ioc] {
+	RunWorkers(num_threads, [&ioc](unsigned) {
 		ioc.run();
-		});
+		}, args->pin_threads);
+	final_snapshot();
 }
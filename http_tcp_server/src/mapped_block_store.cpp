@@ -0,0 +1,453 @@
+#include "mapped_block_store.h"
+
+#include <algorithm>
+#include <bit>
+#include <cerrno>
+#include <cstring>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace storage {
+	namespace {
+		using namespace std::literals;
+
+		constexpr std::string_view SEGMENT_MAGIC{"HTTSEG01"};
+		constexpr std::string_view INDEX_MAGIC{"HTTIDX01"};
+
+		// Заголовок файла сегмента
+		struct SegmentHeader {
+			char magic[8];
+			uint64_t reserved;
+		};
+
+		// Заголовок записи в сегменте, за ним следует блок
+		struct RecordHeader {
+			char hash[MAX_HASH_SIZE];
+			uint64_t block_size;
+			uint32_t block_num;
+			uint32_t reserved;
+		};
+
+		// Заголовок файла индекса, за ним следуют slot_count ячеек
+		struct IndexHeader {
+			char magic[8];
+			uint64_t entry_count;
+			uint64_t slot_count;
+			// размер сегмента, по которому построен индекс
+			uint64_t segment_size;
+		};
+
+		// Ячейка индекса. Пустая ячейка имеет size == 0: пустых блоков не бывает.
+		struct IndexSlot {
+			uint64_t fingerprint;
+			// смещение байтов блока в сегменте
+			uint64_t offset;
+			uint32_t size;
+			uint32_t block_num;
+		};
+
+		static_assert(sizeof(RecordHeader) == MAX_HASH_SIZE + 16);
+		static_assert(sizeof(IndexHeader) == 32);
+		static_assert(sizeof(IndexSlot) == 24);
+
+		/// @brief Отпечаток токена (FNV-1a), стабильный между запусками и сборками
+		uint64_t Fingerprint(std::string_view hash) {
+			uint64_t value = 14695981039346656037ull;
+			for (unsigned char c : hash) {
+				value ^= c;
+				value *= 1099511628211ull;
+			}
+			return value;
+		}
+
+		[[noreturn]] void ThrowSystemError(const std::string& what) {
+			throw std::system_error(errno, std::generic_category(), what);
+		}
+
+		void WriteAll(int fd, const void* data, size_t size, const std::string& what) {
+			const char* ptr = static_cast<const char*>(data);
+			while (size > 0) {
+				const auto written = ::write(fd, ptr, size);
+				if (written < 0) {
+					if (errno == EINTR) {
+						continue;
+					}
+					ThrowSystemError(what);
+				}
+				ptr += written;
+				size -= static_cast<size_t>(written);
+			}
+		}
+
+		void ReadAll(int fd, void* data, size_t size, uint64_t offset, const std::string& what) {
+			char* ptr = static_cast<char*>(data);
+			while (size > 0) {
+				const auto read = ::pread(fd, ptr, size, static_cast<off_t>(offset));
+				if (read < 0) {
+					if (errno == EINTR) {
+						continue;
+					}
+					ThrowSystemError(what);
+				}
+				if (read == 0) {
+					throw std::runtime_error(what + ": unexpected end of file"s);
+				}
+				ptr += read;
+				offset += static_cast<uint64_t>(read);
+				size -= static_cast<size_t>(read);
+			}
+		}
+
+		IndexSlot LoadSlot(const MappedFile& index, uint64_t slot) {
+			IndexSlot result;
+			std::memcpy(&result, index.Data() + sizeof(IndexHeader) + slot * sizeof(IndexSlot), sizeof(IndexSlot));
+			return result;
+		}
+
+		IndexHeader LoadIndexHeader(const MappedFile& index) {
+			IndexHeader header;
+			std::memcpy(&header, index.Data(), sizeof(header));
+			return header;
+		}
+	}
+
+	MappedFile::MappedFile(const std::filesystem::path& path) {
+		fd_ = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+		if (fd_ < 0) {
+			ThrowSystemError("open "s + path.string());
+		}
+		struct stat st;
+		if (::fstat(fd_, &st) != 0) {
+			::close(fd_);
+			ThrowSystemError("stat "s + path.string());
+		}
+		size_ = static_cast<uint64_t>(st.st_size);
+		if (size_ == 0) {
+			return;
+		}
+		void* data = ::mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd_, 0);
+		if (data == MAP_FAILED) {
+			::close(fd_);
+			ThrowSystemError("mmap "s + path.string());
+		}
+		data_ = static_cast<const char*>(data);
+	}
+
+	MappedFile::~MappedFile() {
+		if (data_) {
+			::munmap(const_cast<char*>(data_), size_);
+		}
+		::close(fd_);
+	}
+
+	MappedBlockStore::MappedBlockStore(const std::filesystem::path& directory, BlockSource* fallback,
+		uint64_t deflated_capacity_bytes) :
+		segment_(std::make_shared<MappedFile>(directory / SEGMENT_FILE_NAME)),
+		index_(std::make_shared<MappedFile>(directory / INDEX_FILE_NAME)),
+		fallback_(fallback),
+		deflated_capacity_(deflated_capacity_bytes) {
+		if (segment_->Size() < sizeof(SegmentHeader)
+			|| std::string_view(segment_->Data(), SEGMENT_MAGIC.size()) != SEGMENT_MAGIC) {
+			throw std::runtime_error("invalid block segment in "s + directory.string());
+		}
+		if (index_->Size() < sizeof(IndexHeader)
+			|| std::string_view(index_->Data(), INDEX_MAGIC.size()) != INDEX_MAGIC) {
+			throw std::runtime_error("invalid block index in "s + directory.string());
+		}
+		const auto header = LoadIndexHeader(*index_);
+		if (!std::has_single_bit(header.slot_count)
+			|| index_->Size() != sizeof(IndexHeader) + header.slot_count * sizeof(IndexSlot)
+			|| header.segment_size > segment_->Size()) {
+			throw std::runtime_error("block index does not match segment in "s + directory.string());
+		}
+		// обращения к блокам случайны, упреждающее чтение только засоряет page cache
+		::madvise(const_cast<char*>(segment_->Data()), segment_->Size(), MADV_RANDOM);
+		// индекс нужен целиком с первого запроса: читаем его заранее, не дожидаясь промахов страниц
+		::madvise(const_cast<char*>(index_->Data()), index_->Size(), MADV_WILLNEED);
+		deflated_ = std::make_unique<DeflatedSlot[]>(header.slot_count);
+	}
+
+	std::optional<BlockRecord> MappedBlockStore::Find(std::string_view hash) const {
+		if (auto found = Lookup(hash)) {
+			return std::move(found->second);
+		}
+		return std::nullopt;
+	}
+
+	std::optional<std::pair<uint64_t, BlockRecord>> MappedBlockStore::Lookup(std::string_view hash) const {
+		if (hash.size() != MAX_HASH_SIZE) {
+			return std::nullopt;
+		}
+		const auto header = LoadIndexHeader(*index_);
+		const uint64_t mask = header.slot_count - 1;
+		const uint64_t fingerprint = Fingerprint(hash);
+		for (uint64_t slot = fingerprint & mask;; slot = (slot + 1) & mask) {
+			const auto entry = LoadSlot(*index_, slot);
+			if (entry.size == 0) {
+				return std::nullopt;
+			}
+			if (entry.fingerprint != fingerprint) {
+				continue;
+			}
+			if (entry.offset < sizeof(SegmentHeader) + sizeof(RecordHeader)
+				|| entry.offset + entry.size > header.segment_size) {
+				continue;
+			}
+			const char* stored_hash = segment_->Data() + entry.offset - sizeof(RecordHeader);
+			if (std::string_view(stored_hash, MAX_HASH_SIZE) != hash) {
+				continue;
+			}
+			BlockRecord record;
+			record.block_num = entry.block_num;
+			record.block_size = entry.size;
+			record.data.bytes = std::string_view(segment_->Data() + entry.offset, entry.size);
+			record.data.owner = segment_;
+			record.data.file = {segment_->Descriptor(), entry.offset};
+			return std::pair{slot, std::move(record)};
+		}
+	}
+
+	BlockRecord MappedBlockStore::GetBlock(std::string_view hash) {
+		if (auto record = Find(hash)) {
+			return *std::move(record);
+		}
+		if (fallback_) {
+			return fallback_->GetBlock(hash);
+		}
+		throw std::out_of_range("block is not found");
+	}
+
+	BlockLookup MappedBlockStore::LookupBlock(std::string_view hash) {
+		if (auto record = Find(hash)) {
+			return {*std::move(record), nullptr};
+		}
+		if (fallback_) {
+			return fallback_->LookupBlock(hash);
+		}
+		throw std::out_of_range("block is not found");
+	}
+
+	DeflatedBlockPtr MappedBlockStore::GetDeflatedBlock(std::string_view hash) {
+		auto found = Lookup(hash);
+		if (!found) {
+			if (fallback_) {
+				return fallback_->GetDeflatedBlock(hash);
+			}
+			throw std::out_of_range("block is not found");
+		}
+		return Deflated(*found);
+	}
+
+	DeflatedLookup MappedBlockStore::LookupDeflatedBlock(std::string_view hash) {
+		auto found = Lookup(hash);
+		if (!found) {
+			if (fallback_) {
+				return fallback_->LookupDeflatedBlock(hash);
+			}
+			throw std::out_of_range("block is not found");
+		}
+		return {Deflated(*found), nullptr};
+	}
+
+	DeflatedBlockPtr MappedBlockStore::Deflated(const std::pair<uint64_t, BlockRecord>& found) {
+		auto& slot = deflated_[found.first];
+		if (auto deflated = slot.block.load(std::memory_order_acquire)) {
+			slot.referenced.store(true, std::memory_order_relaxed);
+			return deflated;
+		}
+		// два потока могут сжать блок одновременно, в ячейке остаётся первый результат
+		DeflatedBlockPtr deflated = DeflateBlock(found.second.data.bytes);
+		DeflatedBlockPtr expected;
+		if (!slot.block.compare_exchange_strong(expected, deflated, std::memory_order_acq_rel)) {
+			return expected;
+		}
+		AccountDeflated(found.first, deflated->bytes.size());
+		return deflated;
+	}
+
+	void MappedBlockStore::AccountDeflated(uint64_t slot, uint64_t bytes) {
+		std::lock_guard lock(clock_mutex_);
+		// ячейка попадает в обход только после записи формы и покидает его, когда форма снята,
+		// поэтому каждая заполненная ячейка учтена ровно один раз
+		clock_.push_back(slot);
+		uint64_t held = deflated_bytes_.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+		while (held > deflated_capacity_ && !clock_.empty()) {
+			const uint64_t victim = clock_.front();
+			clock_.pop_front();
+			auto& entry = deflated_[victim];
+			if (entry.referenced.exchange(false, std::memory_order_relaxed)) {
+				clock_.push_back(victim);
+				continue;
+			}
+			// запросы, уже получившие форму, держат её до конца отправки
+			const auto evicted = entry.block.exchange(nullptr, std::memory_order_acq_rel);
+			held = deflated_bytes_.fetch_sub(evicted->bytes.size(), std::memory_order_relaxed) - evicted->bytes.size();
+			deflated_evictions_.fetch_add(1, std::memory_order_relaxed);
+		}
+	}
+
+	uint64_t MappedBlockStore::Size() const {
+		return LoadIndexHeader(*index_).entry_count;
+	}
+
+	uint64_t MappedBlockStore::IndexedSegmentSize() const {
+		return LoadIndexHeader(*index_).segment_size;
+	}
+
+	void MappedBlockStore::BuildIndex(const std::filesystem::path& directory) {
+		const auto segment_path = directory / SEGMENT_FILE_NAME;
+		const int segment_fd = ::open(segment_path.c_str(), O_RDONLY | O_CLOEXEC);
+		if (segment_fd < 0) {
+			ThrowSystemError("open "s + segment_path.string());
+		}
+		struct stat st;
+		if (::fstat(segment_fd, &st) != 0) {
+			::close(segment_fd);
+			ThrowSystemError("stat "s + segment_path.string());
+		}
+		const uint64_t segment_size = static_cast<uint64_t>(st.st_size);
+
+		std::vector<IndexSlot> entries;
+		try {
+			SegmentHeader segment_header;
+			ReadAll(segment_fd, &segment_header, sizeof(segment_header), 0, segment_path.string());
+			if (std::string_view(segment_header.magic, SEGMENT_MAGIC.size()) != SEGMENT_MAGIC) {
+				throw std::runtime_error("invalid block segment "s + segment_path.string());
+			}
+			// Читаем только заголовки записей, сами блоки пропускаем.
+			// Недописанная последняя запись (например, после падения загрузчика) отбрасывается.
+			uint64_t offset = sizeof(SegmentHeader);
+			while (offset + sizeof(RecordHeader) <= segment_size) {
+				RecordHeader record;
+				ReadAll(segment_fd, &record, sizeof(record), offset, segment_path.string());
+				const uint64_t block_offset = offset + sizeof(RecordHeader);
+				if (record.block_size == 0 || record.block_size > MAX_BLOCK_SIZE
+					|| block_offset + record.block_size > segment_size) {
+					break;
+				}
+				entries.push_back({Fingerprint({record.hash, MAX_HASH_SIZE}), block_offset,
+					static_cast<uint32_t>(record.block_size), record.block_num});
+				offset = block_offset + record.block_size;
+			}
+		} catch (...) {
+			::close(segment_fd);
+			throw;
+		}
+
+		const uint64_t slot_count = std::bit_ceil(std::max<uint64_t>(16, entries.size() * 2));
+		std::vector<IndexSlot> slots(slot_count, IndexSlot{0, 0, 0, 0});
+		uint64_t entry_count = 0;
+		char stored_hash[MAX_HASH_SIZE];
+		char new_hash[MAX_HASH_SIZE];
+		for (const auto& entry : entries) {
+			for (uint64_t slot = entry.fingerprint & (slot_count - 1);; slot = (slot + 1) & (slot_count - 1)) {
+				auto& target = slots[slot];
+				if (target.size == 0) {
+					target = entry;
+					++entry_count;
+					break;
+				}
+				if (target.fingerprint != entry.fingerprint) {
+					continue;
+				}
+				// Совпадение отпечатков: сверяем токены, более поздняя запись того же токена заменяет раннюю
+				ReadAll(segment_fd, stored_hash, MAX_HASH_SIZE, target.offset - sizeof(RecordHeader), segment_path.string());
+				ReadAll(segment_fd, new_hash, MAX_HASH_SIZE, entry.offset - sizeof(RecordHeader), segment_path.string());
+				if (std::memcmp(stored_hash, new_hash, MAX_HASH_SIZE) == 0) {
+					target = entry;
+					break;
+				}
+			}
+		}
+		::close(segment_fd);
+
+		IndexHeader header{};
+		std::memcpy(header.magic, INDEX_MAGIC.data(), INDEX_MAGIC.size());
+		header.entry_count = entry_count;
+		header.slot_count = slot_count;
+		header.segment_size = segment_size;
+
+		// Индекс пишется во временный файл и атомарно подменяет старый
+		const auto index_path = directory / INDEX_FILE_NAME;
+		auto tmp_path = index_path;
+		tmp_path += ".tmp";
+		const int index_fd = ::open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+		if (index_fd < 0) {
+			ThrowSystemError("open "s + tmp_path.string());
+		}
+		try {
+			WriteAll(index_fd, &header, sizeof(header), tmp_path.string());
+			WriteAll(index_fd, slots.data(), slots.size() * sizeof(IndexSlot), tmp_path.string());
+			if (::fsync(index_fd) != 0) {
+				ThrowSystemError("fsync "s + tmp_path.string());
+			}
+		} catch (...) {
+			::close(index_fd);
+			throw;
+		}
+		::close(index_fd);
+		std::filesystem::rename(tmp_path, index_path);
+	}
+
+	uint64_t MappedBlockStore::IndexedBlockCount(const std::filesystem::path& directory) {
+		const auto index_path = directory / INDEX_FILE_NAME;
+		const int index_fd = ::open(index_path.c_str(), O_RDONLY | O_CLOEXEC);
+		if (index_fd < 0) {
+			ThrowSystemError("open "s + index_path.string());
+		}
+		IndexHeader header;
+		try {
+			ReadAll(index_fd, &header, sizeof(header), 0, index_path.string());
+		} catch (...) {
+			::close(index_fd);
+			throw;
+		}
+		::close(index_fd);
+		if (std::string_view(header.magic, INDEX_MAGIC.size()) != INDEX_MAGIC) {
+			throw std::runtime_error("invalid block index in "s + directory.string());
+		}
+		return header.entry_count;
+	}
+
+	BlockSegmentWriter::BlockSegmentWriter(const std::filesystem::path& directory) {
+		std::filesystem::create_directories(directory);
+		const auto path = directory / SEGMENT_FILE_NAME;
+		fd_ = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+		if (fd_ < 0) {
+			ThrowSystemError("open "s + path.string());
+		}
+		struct stat st;
+		if (::fstat(fd_, &st) != 0) {
+			::close(fd_);
+			ThrowSystemError("stat "s + path.string());
+		}
+		if (st.st_size == 0) {
+			SegmentHeader header{};
+			std::memcpy(header.magic, SEGMENT_MAGIC.data(), SEGMENT_MAGIC.size());
+			WriteAll(fd_, &header, sizeof(header), path.string());
+		}
+	}
+
+	BlockSegmentWriter::~BlockSegmentWriter() {
+		::fsync(fd_);
+		::close(fd_);
+	}
+
+	void BlockSegmentWriter::Append(std::string_view hash, uint32_t block_num, std::string_view block) {
+		if (hash.size() != MAX_HASH_SIZE || block.empty() || block.size() > MAX_BLOCK_SIZE) {
+			throw std::invalid_argument("invalid block for segment");
+		}
+		RecordHeader header{};
+		std::memcpy(header.hash, hash.data(), MAX_HASH_SIZE);
+		header.block_size = block.size();
+		header.block_num = block_num;
+		WriteAll(fd_, &header, sizeof(header), "append block"s);
+		WriteAll(fd_, block.data(), block.size(), "append block"s);
+	}
+}  // namespace storage
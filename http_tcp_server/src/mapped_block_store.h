@@ -0,0 +1,154 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string_view>
+#include <utility>
+
+#include "block_store.h"
+
+namespace storage {
+
+    /// @brief Файл, отображённый в память только для чтения
+    class MappedFile {
+    public:
+        explicit MappedFile(const std::filesystem::path& path);
+        ~MappedFile();
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        const char* Data() const {
+            return data_;
+        }
+
+        uint64_t Size() const {
+            return size_;
+        }
+
+        int Descriptor() const {
+            return fd_;
+        }
+
+    private:
+        int fd_{-1};
+        const char* data_{nullptr};
+        uint64_t size_{0};
+    };
+
+    /// @brief Хранилище блоков на диске.
+    /// Блоки лежат в append-only файле сегмента blocks.seg записями
+    /// [токен][размер блока u64][номер блока u32][резерв u32][блок],
+    /// а компактный индекс blocks.idx — открытая адресация по 64-битному отпечатку токена
+    /// с ячейками {отпечаток, смещение блока, размер, номер}.
+    /// Оба файла отображаются в память, блоки отдаются ссылками на отображение без копирования.
+    /// Токены, которых нет на диске, запрашиваются у fallback источника.
+    class MappedBlockStore : public BlockSource {
+    public:
+        // бюджет сжатых форм блоков с диска по умолчанию
+        static constexpr uint64_t DEFAULT_DEFLATED_CAPACITY{256ull << 20};
+
+        /// @param directory каталог с blocks.seg и blocks.idx
+        /// @param fallback источник блоков для токенов, которых нет на диске
+        /// @param deflated_capacity_bytes бюджет памяти сжатых форм блоков с диска
+        explicit MappedBlockStore(const std::filesystem::path& directory, BlockSource* fallback = nullptr,
+            uint64_t deflated_capacity_bytes = DEFAULT_DEFLATED_CAPACITY);
+
+        BlockRecord GetBlock(std::string_view hash) override;
+
+        BlockLookup LookupBlock(std::string_view hash) override;
+
+        /// @brief Сжатая форма блока с диска вычисляется при первом запросе и хранится
+        /// в ячейке рядом с ячейкой индекса. Сверх бюджета формы вытесняются по алгоритму
+        /// CLOCK: форма, к которой обращались после прошлого обхода, получает второй шанс.
+        DeflatedBlockPtr GetDeflatedBlock(std::string_view hash) override;
+
+        /// @brief Блоки с диска сжимаются сразу, промахи уходят к источнику блоков не с диска
+        DeflatedLookup LookupDeflatedBlock(std::string_view hash) override;
+
+        /// @brief Поиск блока только среди записанных на диск
+        std::optional<BlockRecord> Find(std::string_view hash) const;
+
+        /// @brief Число блоков в индексе
+        uint64_t Size() const;
+
+        /// @brief Размер сегмента, по которому построен индекс: записи дальше него индексу не известны
+        uint64_t IndexedSegmentSize() const;
+
+        /// @brief Байты сжатых форм блоков, которые сейчас хранятся в памяти
+        uint64_t DeflatedBytes() const {
+            return deflated_bytes_.load(std::memory_order_relaxed);
+        }
+
+        /// @brief Число сжатых форм, вытесненных сверх бюджета
+        uint64_t DeflatedEvictions() const {
+            return deflated_evictions_.load(std::memory_order_relaxed);
+        }
+
+        /// @brief Перестраивает индекс каталога по файлу сегмента
+        /// @param directory каталог с blocks.seg
+        static void BuildIndex(const std::filesystem::path& directory);
+
+        /// @brief Число блоков в индексе каталога: читается только заголовок, файлы не отображаются
+        /// @param directory каталог с построенным индексом
+        static uint64_t IndexedBlockCount(const std::filesystem::path& directory);
+
+    private:
+        /// @brief Ячейка индекса и запись о блоке
+        std::optional<std::pair<uint64_t, BlockRecord>> Lookup(std::string_view hash) const;
+        /// @brief Сжатая форма найденного на диске блока: из его ячейки или сжатая заново
+        DeflatedBlockPtr Deflated(const std::pair<uint64_t, BlockRecord>& found);
+
+        /// @brief Учитывает форму, записанную в ячейку slot, и вытесняет формы сверх бюджета
+        void AccountDeflated(uint64_t slot, uint64_t bytes);
+
+    private:
+        // сжатая форма блока и признак обращения к ней после прошлого обхода CLOCK
+        struct DeflatedSlot {
+            std::atomic<DeflatedBlockPtr> block;
+            std::atomic<bool> referenced{false};
+        };
+
+        std::shared_ptr<const MappedFile> segment_;
+        std::shared_ptr<const MappedFile> index_;
+        BlockSource* fallback_;
+        // сжатые формы блоков по номеру ячейки индекса
+        std::unique_ptr<DeflatedSlot[]> deflated_;
+        uint64_t deflated_capacity_;
+        std::atomic<uint64_t> deflated_bytes_{0};
+        std::atomic<uint64_t> deflated_evictions_{0};
+        // номера заполненных ячеек в порядке обхода CLOCK, меняются только под мьютексом
+        std::mutex clock_mutex_;
+        std::deque<uint64_t> clock_;
+    };
+
+    /// @brief Дописывает блоки в конец файла сегмента.
+    /// После записи нужно перестроить индекс MappedBlockStore::BuildIndex.
+    class BlockSegmentWriter {
+    public:
+        /// @param directory каталог хранилища, создаётся при необходимости
+        explicit BlockSegmentWriter(const std::filesystem::path& directory);
+        ~BlockSegmentWriter();
+
+        BlockSegmentWriter(const BlockSegmentWriter&) = delete;
+        BlockSegmentWriter& operator=(const BlockSegmentWriter&) = delete;
+
+        /// @brief Дописывает блок
+        /// @param hash токен длиной MAX_HASH_SIZE
+        /// @param block_num номер блока
+        /// @param block блок данных
+        void Append(std::string_view hash, uint32_t block_num, std::string_view block);
+
+    private:
+        int fd_{-1};
+    };
+
+    // имена файлов хранилища в каталоге
+    inline constexpr std::string_view SEGMENT_FILE_NAME{"blocks.seg"};
+    inline constexpr std::string_view INDEX_FILE_NAME{"blocks.idx"};
+
+} // namespace storage
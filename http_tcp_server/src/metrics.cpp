@@ -0,0 +1,180 @@
+#include "metrics.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string_view>
+#include <vector>
+
+namespace metrics {
+	namespace {
+		using namespace std::literals;
+
+		constexpr size_t STAGE_COUNT = static_cast<size_t>(Stage::COUNT);
+		constexpr size_t COUNTER_COUNT = static_cast<size_t>(Counter::COUNT);
+
+		// Корзины гистограммы по степеням двойки: корзина i содержит длительности
+		// меньше 2^(MIN_BUCKET_BITS + i) нс, первая — до ~1 мкс, последняя конечная — до ~17 с
+		constexpr int MIN_BUCKET_BITS{10};
+		constexpr size_t BUCKET_COUNT{25};
+
+		constexpr std::array<std::string_view, STAGE_COUNT> STAGE_NAMES{
+			"read"sv, "parse"sv, "blocks"sv, "serialize"sv, "write"sv
+		};
+
+		struct CounterInfo {
+			std::string_view name;
+			std::string_view help;
+		};
+
+		constexpr std::array<CounterInfo, COUNTER_COUNT> COUNTERS{{
+			{"http_server_requests_total"sv, "Requests read"sv},
+			{"http_server_responses_total"sv, "Write operations completed"sv},
+			{"http_server_hashes_total"sv, "Hashes in parsed requests"sv},
+			{"http_server_read_bytes_total"sv, "Bytes read from sockets"sv},
+			{"http_server_written_bytes_total"sv, "Bytes written to sockets"sv},
+			{"http_server_read_errors_total"sv, "Failed reads"sv},
+			{"http_server_write_errors_total"sv, "Failed writes"sv},
+			{"http_server_allocations_total"sv, "Heap allocations on io threads while handling requests"sv},
+			{"http_server_shed_connections_total"sv, "Connections refused over the session limit"sv},
+			{"http_server_shed_client_rate_total"sv, "Requests refused over the per-client rate"sv},
+			{"http_server_shed_inflight_total"sv, "Requests refused over the in-flight response bytes limit"sv},
+			{"http_server_oversize_requests_total"sv, "Requests refused for too many hashes"sv},
+			{"http_server_uring_submits_total"sv, "io_uring_enter calls submitting session I/O"sv},
+			{"http_server_uring_completions_total"sv, "Session I/O completions reaped from io_uring"sv},
+		}};
+
+		/// @brief Прибавление к значению, которое пишет только один поток:
+		/// обычные загрузка и запись вместо lock-префикса, читатели видят целые значения
+		void Increment(std::atomic<uint64_t>& value, uint64_t delta) {
+			value.store(value.load(std::memory_order_relaxed) + delta, std::memory_order_relaxed);
+		}
+
+		struct Histogram {
+			// последняя корзина — всё, что не попало в конечные
+			std::array<std::atomic<uint64_t>, BUCKET_COUNT + 1> buckets{};
+			std::atomic<uint64_t> sum{0};
+			std::atomic<uint64_t> count{0};
+		};
+
+		// Метрики одного потока, каждый поток пишет только в свою копию
+		struct alignas(64) ThreadMetrics {
+			std::array<std::atomic<uint64_t>, COUNTER_COUNT> counters{};
+			std::array<Histogram, STAGE_COUNT> histograms{};
+		};
+
+		struct Callback {
+			std::string name;
+			std::string help;
+			MetricType type;
+			std::function<double()> value;
+		};
+
+		struct Registry {
+			std::mutex mutex;
+			// копии метрик не удаляются после завершения потоков, чтобы счётчики не убывали
+			std::vector<std::unique_ptr<ThreadMetrics>> threads;
+			std::vector<Callback> callbacks;
+		};
+
+		Registry& GetRegistry() {
+			static Registry registry;
+			return registry;
+		}
+
+		ThreadMetrics& Local() {
+			thread_local ThreadMetrics* local = [] {
+				auto& registry = GetRegistry();
+				std::lock_guard lock(registry.mutex);
+				return registry.threads.emplace_back(std::make_unique<ThreadMetrics>()).get();
+			}();
+			return *local;
+		}
+
+		size_t BucketIndex(uint64_t nanoseconds) {
+			const int bits = std::bit_width(nanoseconds);
+			if (bits <= MIN_BUCKET_BITS) {
+				return 0;
+			}
+			return std::min<size_t>(bits - MIN_BUCKET_BITS, BUCKET_COUNT);
+		}
+	}
+
+	void Add(Counter counter, uint64_t value) {
+		Increment(Local().counters[static_cast<size_t>(counter)], value);
+	}
+
+	void Observe(Stage stage, uint64_t nanoseconds) {
+		auto& histogram = Local().histograms[static_cast<size_t>(stage)];
+		Increment(histogram.buckets[BucketIndex(nanoseconds)], 1);
+		Increment(histogram.sum, nanoseconds);
+		Increment(histogram.count, 1);
+	}
+
+	void RegisterCallback(std::string name, std::string help, MetricType type, std::function<double()> value) {
+		auto& registry = GetRegistry();
+		std::lock_guard lock(registry.mutex);
+		registry.callbacks.push_back({std::move(name), std::move(help), type, std::move(value)});
+	}
+
+	std::string RenderPrometheus() {
+		std::array<uint64_t, COUNTER_COUNT> counters{};
+		std::array<std::array<uint64_t, BUCKET_COUNT + 1>, STAGE_COUNT> buckets{};
+		std::array<uint64_t, STAGE_COUNT> sums{};
+		std::array<uint64_t, STAGE_COUNT> counts{};
+
+		std::ostringstream out;
+		out.precision(9);
+		auto& registry = GetRegistry();
+		std::lock_guard lock(registry.mutex);
+		for (const auto& thread : registry.threads) {
+			for (size_t i = 0; i < COUNTER_COUNT; ++i) {
+				counters[i] += thread->counters[i].load(std::memory_order_relaxed);
+			}
+			for (size_t stage = 0; stage < STAGE_COUNT; ++stage) {
+				const auto& histogram = thread->histograms[stage];
+				for (size_t i = 0; i <= BUCKET_COUNT; ++i) {
+					buckets[stage][i] += histogram.buckets[i].load(std::memory_order_relaxed);
+				}
+				sums[stage] += histogram.sum.load(std::memory_order_relaxed);
+				counts[stage] += histogram.count.load(std::memory_order_relaxed);
+			}
+		}
+
+		for (size_t i = 0; i < COUNTER_COUNT; ++i) {
+			out << "# HELP "sv << COUNTERS[i].name << ' ' << COUNTERS[i].help << '\n'
+				<< "# TYPE "sv << COUNTERS[i].name << " counter\n"sv
+				<< COUNTERS[i].name << ' ' << counters[i] << '\n';
+		}
+
+		out << "# HELP http_server_stage_seconds Duration of request handling stages\n"sv
+			<< "# TYPE http_server_stage_seconds histogram\n"sv;
+		for (size_t stage = 0; stage < STAGE_COUNT; ++stage) {
+			// значения корзин в Prometheus накопительные
+			uint64_t cumulative = 0;
+			for (size_t i = 0; i < BUCKET_COUNT; ++i) {
+				cumulative += buckets[stage][i];
+				const double bound = static_cast<double>(uint64_t{1} << (MIN_BUCKET_BITS + i)) / 1e9;
+				out << "http_server_stage_seconds_bucket{stage=\""sv << STAGE_NAMES[stage]
+					<< "\",le=\""sv << bound << "\"} "sv << cumulative << '\n';
+			}
+			out << "http_server_stage_seconds_bucket{stage=\""sv << STAGE_NAMES[stage]
+				<< "\",le=\"+Inf\"} "sv << counts[stage] << '\n'
+				<< "http_server_stage_seconds_sum{stage=\""sv << STAGE_NAMES[stage] << "\"} "sv
+				<< static_cast<double>(sums[stage]) / 1e9 << '\n'
+				<< "http_server_stage_seconds_count{stage=\""sv << STAGE_NAMES[stage] << "\"} "sv
+				<< counts[stage] << '\n';
+		}
+
+		for (const auto& callback : registry.callbacks) {
+			out << "# HELP "sv << callback.name << ' ' << callback.help << '\n'
+				<< "# TYPE "sv << callback.name << (callback.type == MetricType::COUNTER ? " counter\n"sv : " gauge\n"sv)
+				<< callback.name << ' ' << callback.value() << '\n';
+		}
+		return out.str();
+	}
+}  // namespace metrics
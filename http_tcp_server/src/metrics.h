@@ -0,0 +1,95 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <string>
+
+namespace metrics {
+
+    /// @brief Этапы обработки запроса, для каждого ведётся гистограмма длительностей
+    enum class Stage {
+        // ожидание и чтение запроса из сокета, включая простой keep-alive соединения
+        READ,
+        // разбор ClientToServer
+        PARSE,
+        // поиск или генерация блоков
+        BLOCKS,
+        // подготовка буферов ответа
+        SERIALIZE,
+        // запись ответа в сокет
+        WRITE,
+        COUNT
+    };
+
+    /// @brief Счётчики сервера
+    enum class Counter {
+        REQUESTS,
+        RESPONSES,
+        HASHES,
+        BYTES_READ,
+        BYTES_WRITTEN,
+        READ_ERRORS,
+        WRITE_ERRORS,
+        // выделения памяти в потоке io_context при обработке запросов
+        ALLOCATIONS,
+        // отказы контроля допуска: соединения сверх лимита сессий,
+        // запросы сверх доли клиента, запросы при превышении байтов в полёте,
+        // запросы со слишком большим числом токенов
+        SHED_CONNECTIONS,
+        SHED_CLIENT_RATE,
+        SHED_INFLIGHT,
+        OVERSIZE_REQUESTS,
+        // вызовы io_uring_enter и завершения операций, разобранные из кольца
+        URING_SUBMITS,
+        URING_COMPLETIONS,
+        COUNT
+    };
+
+    /// @brief Монотонное время в наносекундах
+    inline uint64_t Now() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    /// @brief Увеличивает счётчик текущего потока, без блокировок и атомарных RMW
+    void Add(Counter counter, uint64_t value = 1);
+
+    /// @brief Добавляет длительность этапа в гистограмму текущего потока
+    void Observe(Stage stage, uint64_t nanoseconds);
+
+    /// @brief Замер длительности этапа от конструирования до разрушения
+    class ScopedTimer {
+    public:
+        explicit ScopedTimer(Stage stage) :
+            stage_(stage),
+            start_(Now()) {
+        }
+
+        ScopedTimer(const ScopedTimer&) = delete;
+        ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+        ~ScopedTimer() {
+            Observe(stage_, Now() - start_);
+        }
+
+    private:
+        Stage stage_;
+        uint64_t start_;
+    };
+
+    enum class MetricType {
+        COUNTER,
+        GAUGE
+    };
+
+    /// @brief Регистрирует метрику, значение которой вычисляется при каждом запросе /metrics
+    /// @param name имя метрики в формате Prometheus
+    /// @param help описание
+    /// @param type тип метрики
+    /// @param value функция, возвращающая текущее значение; вызывается из потоков io_context
+    void RegisterCallback(std::string name, std::string help, MetricType type, std::function<double()> value);
+
+    /// @brief Все метрики, сведённые по потокам, в текстовом формате Prometheus
+    std::string RenderPrometheus();
+
+} // namespace metrics
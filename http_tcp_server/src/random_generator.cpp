@@ -0,0 +1,25 @@
+#include "random_generator.h"
+#include "block_generator.h"
+
+std::string RandomString(size_t length){
+    std::string random_string(length, '\0');
+    generator::FillAlphabet(random_string.data(), length, generator::ThreadRandom());
+    return random_string;
+}
+
+void FillRandomString(char* buffer, size_t length, uint64_t seed){
+    generator::WyRand generator(seed);
+    generator::FillAlphabet(buffer, length, generator);
+}
+
+uint32_t RandomUnsignedInt32Number(){
+    return static_cast<uint32_t>(generator::ThreadRandom().Next() >> 32);
+}
+
+uint32_t RandomNumber(uint32_t min, uint32_t max){
+    const uint64_t range = static_cast<uint64_t>(max) - min + 1;
+    if (range > UINT32_MAX) {
+        return RandomUnsignedInt32Number();
+    }
+    return min + generator::ThreadRandom().Below(static_cast<uint32_t>(range));
+}
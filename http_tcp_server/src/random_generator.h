@@ -0,0 +1,26 @@
+#pragma once
+#include <cstdint>
+#include <string>
+
+/// @brief Генаратор рандомной строки заданной длины
+/// @param length длина строки
+/// @return рандомная строка
+std::string RandomString(size_t length);
+
+/// @brief Детерминированно заполняет буфер символами алфавита RandomString.
+/// Один и тот же seed всегда даёт одну и ту же последовательность,
+/// поэтому блок можно сгенерировать заново вместо хранения.
+/// @param buffer буфер
+/// @param length число символов
+/// @param seed начальное значение генератора
+void FillRandomString(char* buffer, size_t length, uint64_t seed);
+
+/// @brief Генератор рандомного целого беззнакового числа
+/// @return рандомное целое беззнаковое число
+uint32_t RandomUnsignedInt32Number();
+
+/// @brief Генератор рандомного беззнакового целого числа в заданном диапазоне
+/// @param min минимальное значение
+/// @param max максимальное число
+/// @return рандомное беззнаковое целое число
+uint32_t RandomNumber(uint32_t min, uint32_t max);
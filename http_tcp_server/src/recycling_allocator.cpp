@@ -0,0 +1,55 @@
+#include "recycling_allocator.h"
+
+#include <array>
+#include <new>
+
+namespace http_server {
+	namespace {
+		constexpr size_t SIZE_CLASS{64};
+		constexpr size_t SIZE_CLASSES{64};
+		// сколько освобождённых блоков одного класса поток держит про запас
+		constexpr size_t BLOCKS_PER_CLASS{4};
+
+		struct FreeBlocks {
+			std::array<std::array<void*, BLOCKS_PER_CLASS>, SIZE_CLASSES> blocks{};
+			std::array<size_t, SIZE_CLASSES> counts{};
+
+			~FreeBlocks() {
+				for (size_t size_class = 0; size_class < SIZE_CLASSES; ++size_class) {
+					for (size_t i = 0; i < counts[size_class]; ++i) {
+						::operator delete(blocks[size_class][i]);
+					}
+				}
+			}
+		};
+
+		thread_local FreeBlocks free_blocks;
+
+		size_t SizeClass(size_t size) {
+			return size == 0 ? 0 : (size - 1) / SIZE_CLASS;
+		}
+	}
+
+	void* AllocateRecycled(size_t size) {
+		const size_t size_class = SizeClass(size);
+		if (size_class >= SIZE_CLASSES) {
+			return ::operator new(size);
+		}
+		if (size_t& count = free_blocks.counts[size_class]; count > 0) {
+			return free_blocks.blocks[size_class][--count];
+		}
+		// блок выделяется с размером класса, чтобы подойти любому запросу этого класса
+		return ::operator new((size_class + 1) * SIZE_CLASS);
+	}
+
+	void DeallocateRecycled(void* pointer, size_t size) noexcept {
+		const size_t size_class = SizeClass(size);
+		if (size_class < SIZE_CLASSES) {
+			if (size_t& count = free_blocks.counts[size_class]; count < BLOCKS_PER_CLASS) {
+				free_blocks.blocks[size_class][count++] = pointer;
+				return;
+			}
+		}
+		::operator delete(pointer);
+	}
+}  // namespace http_server
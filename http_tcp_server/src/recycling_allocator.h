@@ -0,0 +1,107 @@
+#pragma once
+#include <boost/asio/associated_executor.hpp>
+#include <boost/asio/async_result.hpp>
+
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+
+namespace http_server {
+
+    /// @brief Блок памяти из кэша текущего потока. Блоки разбиты на классы по 64 байта,
+    /// в каждом классе поток хранит несколько освобождённых блоков; большие блоки не кэшируются.
+    void* AllocateRecycled(size_t size);
+
+    /// @brief Возврат блока в кэш текущего потока, size — тот же, что при выделении.
+    /// Блок можно освободить в другом потоке, тогда он попадёт в кэш этого потока.
+    void DeallocateRecycled(void* pointer, size_t size) noexcept;
+
+    /// @brief Аллокатор поверх кэша блоков потока. Состояния асинхронных операций живут
+    /// от запуска операции до её завершения, поэтому блоки постоянно переиспользуются
+    /// и operator new в установившемся режиме не вызывается.
+    template <typename T>
+    class RecyclingAllocator {
+    public:
+        using value_type = T;
+
+        RecyclingAllocator() noexcept = default;
+
+        template <typename U>
+        RecyclingAllocator(const RecyclingAllocator<U>&) noexcept {}
+
+        T* allocate(size_t n) {
+            return static_cast<T*>(AllocateRecycled(n * sizeof(T)));
+        }
+
+        void deallocate(T* pointer, size_t n) noexcept {
+            DeallocateRecycled(pointer, n * sizeof(T));
+        }
+
+        template <typename U>
+        bool operator==(const RecyclingAllocator<U>&) const noexcept {
+            return true;
+        }
+    };
+
+    /// @brief Обработчик завершения с RecyclingAllocator в качестве связанного аллокатора:
+    /// Asio и Beast выделяют через него память под состояния операций
+    template <typename Handler>
+    class RecyclingHandler {
+    public:
+        using allocator_type = RecyclingAllocator<void>;
+        using executor_type = boost::asio::associated_executor_t<Handler>;
+
+        explicit RecyclingHandler(Handler&& handler) :
+            handler_(std::move(handler)) {}
+
+        allocator_type get_allocator() const noexcept {
+            return {};
+        }
+
+        executor_type get_executor() const noexcept {
+            return boost::asio::get_associated_executor(handler_);
+        }
+
+        template <typename... Args>
+        void operator()(Args&&... args) {
+            std::move(handler_)(std::forward<Args>(args)...);
+        }
+
+    private:
+        Handler handler_;
+    };
+
+    /// @brief Маркер завершения, оборачивающий обработчик маркера token в RecyclingHandler
+    template <typename Token>
+    struct RecyclingToken {
+        Token token;
+    };
+
+    /// @brief Например, co_await socket.async_read_some(buffers, Recycling(net::use_awaitable))
+    template <typename Token>
+    RecyclingToken<std::decay_t<Token>> Recycling(Token&& token) {
+        return {std::forward<Token>(token)};
+    }
+
+} // namespace http_server
+
+namespace boost::asio {
+
+    template <typename Token, typename Signature>
+    class async_result<http_server::RecyclingToken<Token>, Signature> {
+    public:
+        using return_type = typename async_result<Token, Signature>::return_type;
+
+        template <typename Initiation, typename... Args>
+        static return_type initiate(Initiation initiation, http_server::RecyclingToken<Token> token, Args&&... args) {
+            return async_initiate<Token, Signature>(
+                [initiation = std::move(initiation)](auto&& handler, auto&&... init_args) mutable {
+                    using Handler = std::decay_t<decltype(handler)>;
+                    std::move(initiation)(http_server::RecyclingHandler<Handler>(std::move(handler)),
+                        std::forward<decltype(init_args)>(init_args)...);
+                },
+                token.token, std::forward<Args>(args)...);
+        }
+    };
+
+} // namespace boost::asio
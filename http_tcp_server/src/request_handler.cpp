@@ -0,0 +1,83 @@
+#include "request_handler.h"
+
+namespace http_server {
+	StringResponse MakeStringResponse(http::status status, std::string_view body, unsigned http_version,
+		bool keep_alive,
+		http::verb method,
+		std::string_view content_type) {
+		StringResponse response(status, http_version);
+		response.set(http::field::content_type, content_type);
+		if (method != http::verb::head) {
+			response.body() = body;
+		}
+		response.content_length(body.size());
+		response.keep_alive(keep_alive);
+		return response;
+	}
+
+    void GetServerResponse(storage::BlockSource& store, const ClientToServerView& client_to_server, ServerToClientBody::value_type& server_to_client){
+        server_to_client.Reserve(client_to_server.HashCount(), storage::MAX_HASH_SIZE);
+        const bool deflated = server_to_client.Encoding() != ContentEncoding::IDENTITY;
+        const auto hashes = client_to_server.Hashes();
+        for(size_t i = 0; i < hashes.size(); ++i){
+            const std::string_view hash = hashes[i];
+            if(hash.size() != storage::MAX_HASH_SIZE){
+                continue;
+            }
+            if(const auto ranges = client_to_server.Ranges(i); !ranges.empty()){
+                server_to_client.AddRanges(hash, store.GetBlock(hash).data, ranges);
+            }else if(deflated){
+                server_to_client.AddDeflated(hash, store.GetDeflatedBlock(hash));
+            }else{
+                server_to_client.Add(hash, store.GetBlock(hash).data);
+            }
+        }
+        server_to_client.Finish();
+    }
+
+	http::response<http::empty_body> MakeEmptyResponse(const StringRequest& req, ContentEncoding encoding) {
+		http::response<http::empty_body> response(http::status::ok, req.version());
+		response.set(http::field::content_type, ContentType::TEXT_HTML);
+		response.set(http::field::vary, "Accept-Encoding"sv);
+		if (encoding != ContentEncoding::IDENTITY) {
+			response.set(http::field::content_encoding, EncodingName(encoding));
+		}
+		response.keep_alive(req.keep_alive());
+		return response;
+	}
+
+	StringResponse MakeRejection(const StringRequest& req, const Rejection& rejection) {
+		auto response = MakeStringResponse(http::status::service_unavailable, "Server overloaded"sv, req.version(),
+			req.keep_alive(), req.method());
+		response.set(http::field::retry_after, std::to_string(rejection.retry_after_seconds));
+		return response;
+	}
+
+	BinaryResponse MakeRejection(const BinaryRequest& req, const Rejection& rejection) {
+		return BinaryResponse::Error(req.id, FrameStatus::OVERLOADED,
+			"Server overloaded, retry after "s + std::to_string(rejection.retry_after_seconds) + " s"s);
+	}
+
+	std::shared_ptr<const InflightBytes> ReserveInflight(AdmissionController* admission, const ClientToServerView& client_to_server) {
+		if (!admission) {
+			return nullptr;
+		}
+		return std::make_shared<const InflightBytes>(admission->Hold(client_to_server.HashCount() * storage::MAX_BLOCK_SIZE));
+	}
+
+	void HoldInflight(AdmissionController& admission, ServerToClientResponse& response) {
+		response.body().Hold(admission.Hold(response.body().InflightSize()));
+	}
+
+	void HoldInflight(AdmissionController& admission, BinaryResponse& response) {
+		response.body.Hold(admission.Hold(response.body.InflightSize()));
+	}
+
+	bool UseStreaming(const StringRequest& req, const ClientToServerView& client_to_server) {
+		// ответы на запросы частей блоков малы, их собирает в памяти обычный путь
+		return req.version() == 11
+			&& req.method() == http::verb::get
+			&& client_to_server.HashCount() >= STREAMING_HASH_COUNT
+			&& !client_to_server.HasRanges();
+	}
+}  // namespace http_server
@@ -0,0 +1,567 @@
+#pragma once
+#include "sdk.h"
+#define BOOST_BEAST_USE_STD_STRING_VIEW
+
+#include <boost/asio/write.hpp>
+#include <boost/beast/http.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "admission.h"
+#include "allocation_counter.h"
+#include "binary_protocol.h"
+#include "block_store.h"
+#include "client_to_server_view.h"
+#include "compute_pool.h"
+#include "http_server.h"
+#include "logging.h"
+#include "metrics.h"
+#include "server_to_client_body.h"
+
+// Обработка HTTP-запросов к серверу блоков: разбор ClientToServer,
+// сбор блоков из хранилища и выбор способа отправки ответа.
+namespace http_server {
+
+    // Ответ, тело которого представлено в виде строки
+    using StringResponse = http::response<http::string_body>;
+    // Запрос, тело которого представлено в виде строки
+    using StringRequest = http::request<http::string_body>;
+
+    // Чтобы использовать литералы ""s и ""sv стандартной библиотеки, применим std::literals.
+    using namespace std::literals;
+
+    // Структура ContentType задаёт область видимости для констант, задающей значения HTTP-заголовка Content-Type
+    struct ContentType {
+        ContentType() = delete;
+        constexpr static std::string_view TEXT_HTML = "text/html"sv;
+        constexpr static std::string_view TEXT_PROMETHEUS = "text/plain; version=0.0.4"sv;
+        // При необходимости внутрь ContentType можно добавить и другие типы контента
+    };
+
+    /// @brief Создаёт StringResponse с заданными параметрами
+    /// @param status http статус ответа
+    /// @param body тело ответа
+    /// @param http_version 1.1 или 1.0
+    /// @param keep_alive
+    /// @param method метод запроса
+    /// @param content_type тип тела ответа
+    /// @return строковый http ответ
+    StringResponse MakeStringResponse(http::status status, std::string_view body, unsigned http_version,
+        bool keep_alive,
+        http::verb method,
+        std::string_view content_type = ContentType::TEXT_HTML);
+
+    // Ответ, тело которого ссылается на блоки данных хранилища
+    using ServerToClientResponse = http::response<ServerToClientBody>;
+
+    /// @brief Формировщик ответа сервера. Если у тела задано сжатие,
+    /// в него кладутся сжатые формы блоков, и тело завершается трейлером.
+    /// @brief store хранилище блоков данных
+    /// @brief client_to_server распаршенный запрос клиента
+    /// @brief server_to_client тело ответа
+    void GetServerResponse(storage::BlockSource& store, const ClientToServerView& client_to_server, ServerToClientBody::value_type& server_to_client);
+
+    /// @brief Формировщик ответа сервера, который не блокирует поток на блоках,
+    /// материализуемых другими запросами: ответ собирается, когда готов последний из них.
+    /// Сжатые формы блоков берутся при сборке: после материализации блок уже в кэше,
+    /// и сжатая форма либо готова, либо сжимается из него. Сжатый ответ, ждавший чужих
+    /// материализаций, собирается в пуле, а не в потоке, завершившем материализацию.
+    /// @param store хранилище блоков данных
+    /// @param client_to_server распаршенный запрос клиента
+    /// @param encoding сжатие тела ответа
+    /// @param pool пул, в котором собирается сжатый ответ после чужих материализаций;
+    /// nullptr — в потоке, завершившем материализацию последнего блока
+    /// @param done вызывается с телом ответа или std::nullopt, если блок получить не удалось:
+    /// сразу, если все блоки готовы, иначе в потоке, завершившем материализацию последнего блока, или в пуле
+    template <typename Done>
+    void GetServerResponseAsync(storage::BlockSource& store, std::shared_ptr<const ClientToServerView> client_to_server,
+        ContentEncoding encoding, ComputePool* pool, Done&& done) {
+        const uint64_t started = metrics::Now();
+        const auto failed = [](const std::exception& e) {
+            static logging::Site site{logging::Level::ERROR, "Failed to get block: {}"sv, 10};
+            logging::Log(site, e.what());
+        };
+
+        struct State {
+            storage::BlockSource& store;
+            std::shared_ptr<const ClientToServerView> client_to_server;
+            ContentEncoding encoding;
+            uint64_t started;
+            std::decay_t<Done> done;
+            std::vector<storage::BlockData> blocks;
+            // номер токена и материализация его блока
+            std::vector<std::pair<size_t, std::shared_ptr<storage::BlockFlight>>> pending;
+            std::atomic<size_t> remaining{0};
+        };
+        auto state = std::make_shared<State>(store, std::move(client_to_server), encoding, started, std::forward<Done>(done));
+        const auto hashes = state->client_to_server->Hashes();
+        state->blocks.resize(hashes.size());
+        for (size_t i = 0; i < hashes.size(); ++i) {
+            if (hashes[i].size() != storage::MAX_HASH_SIZE) {
+                continue;
+            }
+            storage::BlockLookup found;
+            try {
+                found = store.LookupBlock(hashes[i]);
+            } catch (const std::exception& e) {
+                failed(e);
+                return state->done(std::optional<ServerToClientBody::value_type>{});
+            }
+            if (found.flight) {
+                state->pending.emplace_back(i, std::move(found.flight));
+            } else {
+                state->blocks[i] = std::move(found.record.data);
+            }
+        }
+
+        const auto finish = [failed](State& state) {
+            ServerToClientBody::value_type server_to_client(state.encoding);
+            try {
+                for (auto& [i, flight] : state.pending) {
+                    state.blocks[i] = flight->Wait().data;
+                }
+                const auto hashes = state.client_to_server->Hashes();
+                server_to_client.Reserve(hashes.size(), storage::MAX_HASH_SIZE);
+                for (size_t i = 0; i < hashes.size(); ++i) {
+                    if (hashes[i].size() != storage::MAX_HASH_SIZE) {
+                        continue;
+                    }
+                    if (const auto ranges = state.client_to_server->Ranges(i); !ranges.empty()) {
+                        server_to_client.AddRanges(hashes[i], state.blocks[i], ranges);
+                    } else if (state.encoding == ContentEncoding::IDENTITY) {
+                        server_to_client.Add(hashes[i], std::move(state.blocks[i]));
+                    } else {
+                        server_to_client.AddDeflated(hashes[i], state.store.GetDeflatedBlock(hashes[i]));
+                    }
+                }
+            } catch (const std::exception& e) {
+                failed(e);
+                metrics::Observe(metrics::Stage::BLOCKS, metrics::Now() - state.started);
+                return state.done(std::optional<ServerToClientBody::value_type>{});
+            }
+            metrics::Observe(metrics::Stage::BLOCKS, metrics::Now() - state.started);
+            server_to_client.Finish();
+            state.done(std::optional{std::move(server_to_client)});
+        };
+
+        if (state->pending.empty()) {
+            return finish(*state);
+        }
+        // счётчик взведён до подписок: последний готовый блок, в каком бы потоке это ни случилось, собирает ответ
+        state->remaining.store(state->pending.size(), std::memory_order_relaxed);
+        // сжатие блоков ответа не ложится на поток чужого запроса, завершивший материализацию
+        ComputePool* const deflate_pool = encoding == ContentEncoding::IDENTITY ? nullptr : pool;
+        for (auto& [i, flight] : state->pending) {
+            const auto ready = [state, finish, deflate_pool] {
+                if (state->remaining.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+                    return;
+                }
+                if (deflate_pool) {
+                    deflate_pool->Submit([state, finish] {
+                        finish(*state);
+                    });
+                } else {
+                    finish(*state);
+                }
+            };
+            if (!flight->OnReady(ready)) {
+                ready();
+            }
+        }
+    }
+
+    /// @brief Формировщик ответа сервера, блоки которого берутся из хранилища параллельно
+    /// в пуле вычислений, по задаче на токен. Блоки складываются в ответ в порядке токенов запроса.
+    /// @param pool пул вычислений
+    /// @param store хранилище блоков данных
+    /// @param client_to_server распаршенный запрос клиента
+    /// @param encoding сжатие тела ответа
+    /// @param done вызывается в потоке пула с телом ответа или std::nullopt, если блок получить не удалось
+    template <typename Done>
+    void GetServerResponseParallel(ComputePool& pool, storage::BlockSource& store,
+        std::shared_ptr<const ClientToServerView> client_to_server, ContentEncoding encoding, Done&& done) {
+        struct State {
+            std::shared_ptr<const ClientToServerView> client_to_server;
+            ContentEncoding encoding;
+            std::vector<storage::BlockData> blocks;
+            std::vector<storage::DeflatedBlockPtr> deflated;
+            std::atomic<bool> failed{false};
+        };
+        auto state = std::make_shared<State>();
+        state->client_to_server = std::move(client_to_server);
+        state->encoding = encoding;
+        const uint64_t started = metrics::Now();
+        // части блоков вырезаются из исходного блока и при сжатии ответа
+        state->blocks.resize(state->client_to_server->HashCount());
+        if (encoding != ContentEncoding::IDENTITY) {
+            state->deflated.resize(state->client_to_server->HashCount());
+        }
+
+        pool.ForEach(state->client_to_server->HashCount(),
+            [&store, state](size_t i) {
+                const std::string_view hash = state->client_to_server->Hashes()[i];
+                if (hash.size() != storage::MAX_HASH_SIZE) {
+                    return;
+                }
+                try {
+                    if (state->encoding == ContentEncoding::IDENTITY || !state->client_to_server->Ranges(i).empty()) {
+                        state->blocks[i] = store.GetBlock(hash).data;
+                    } else {
+                        state->deflated[i] = store.GetDeflatedBlock(hash);
+                    }
+                } catch (const std::exception& e) {
+                    static logging::Site site{logging::Level::ERROR, "Failed to get block: {}"sv, 10};
+                    logging::Log(site, e.what());
+                    state->failed = true;
+                }
+            },
+            [state, started, done = std::forward<Done>(done)]() mutable {
+                metrics::Observe(metrics::Stage::BLOCKS, metrics::Now() - started);
+                if (state->failed) {
+                    return done(std::optional<ServerToClientBody::value_type>{});
+                }
+                ServerToClientBody::value_type server_to_client(state->encoding);
+                const auto hashes = state->client_to_server->Hashes();
+                server_to_client.Reserve(hashes.size(), storage::MAX_HASH_SIZE);
+                for (size_t i = 0; i < hashes.size(); ++i) {
+                    if (hashes[i].size() != storage::MAX_HASH_SIZE) {
+                        continue;
+                    }
+                    if (const auto ranges = state->client_to_server->Ranges(i); !ranges.empty()) {
+                        server_to_client.AddRanges(hashes[i], state->blocks[i], ranges);
+                    } else if (state->encoding == ContentEncoding::IDENTITY) {
+                        server_to_client.Add(hashes[i], std::move(state->blocks[i]));
+                    } else {
+                        server_to_client.AddDeflated(hashes[i], std::move(state->deflated[i]));
+                    }
+                }
+                server_to_client.Finish();
+                done(std::optional{std::move(server_to_client)});
+            });
+    }
+
+    /// @brief Заголовок успешного ответа на запрос, тело которого отправляется отдельно
+    /// @param req запрос на сервер
+    /// @param encoding сжатие тела
+    http::response<http::empty_body> MakeEmptyResponse(const StringRequest& req, ContentEncoding encoding = ContentEncoding::IDENTITY);
+
+    // цель запроса метрик в формате Prometheus
+    constexpr std::string_view METRICS_TARGET = "/metrics"sv;
+
+    // число токенов в запросе, начиная с которого ответ отправляется потоково
+    constexpr int STREAMING_HASH_COUNT{4};
+
+    /// @brief Отправлять ли ответ потоково, по блоку на часть chunked encoding.
+    /// Chunked encoding есть только в HTTP/1.1, а на HEAD запрос тело не отправляется.
+    /// @param req запрос на сервер
+    /// @param client_to_server распаршенный запрос клиента
+    bool UseStreaming(const StringRequest& req, const ClientToServerView& client_to_server);
+
+    /// @brief Отправка ответа с готовым телом ServerToClient
+    /// @param req запрос на сервер
+    /// @param server_to_client тело ответа
+    /// @param send функция отправки http ответа
+    template <typename Send>
+    void SendServerResponse(const StringRequest& req, ServerToClientBody::value_type&& server_to_client, Send&& send) {
+        if (req.method() == http::verb::get && server_to_client.HasFileBlocks()) {
+            // блоки из файла отдаём через sendfile
+            SendfileResponse sendfile_response;
+            sendfile_response.header = MakeEmptyResponse(req);
+            sendfile_response.header.content_length(server_to_client.Size());
+            auto body = std::make_shared<const ServerToClientBody::value_type>(std::move(server_to_client));
+            {
+                metrics::ScopedTimer timer(metrics::Stage::SERIALIZE);
+                sendfile_response.parts = body->Parts();
+            }
+            sendfile_response.owner = std::move(body);
+            return send(std::move(sendfile_response));
+        }
+
+        ServerToClientResponse response(http::status::ok, req.version());
+        response.set(http::field::content_type, ContentType::TEXT_HTML);
+        response.set(http::field::vary, "Accept-Encoding"sv);
+        if (server_to_client.Encoding() != ContentEncoding::IDENTITY) {
+            response.set(http::field::content_encoding, EncodingName(server_to_client.Encoding()));
+        }
+        response.content_length(server_to_client.Size());
+        response.keep_alive(req.keep_alive());
+        if (req.method() != http::verb::head) {
+            // для HEAD отдаём только заголовки, сохранив размер полного ответа
+            response.body() = std::move(server_to_client);
+        }
+        send(std::move(response));
+    }
+
+    /// @brief Оценка тела ответа в байтах в полёте, пока его блоки собираются: по блоку наибольшего
+    /// размера на токен, часть блока держит в памяти весь блок. Запросы, допущенные, пока тело собирается,
+    /// уже видят его в лимите. Оценка снимается, когда send учтёт собранное тело.
+    /// @return nullptr, если контроля допуска нет
+    std::shared_ptr<const InflightBytes> ReserveInflight(AdmissionController* admission, const ClientToServerView& client_to_server);
+
+    // Обработка запросов в пуле вычислений
+    struct ParallelOptions {
+        // nullptr — все запросы обрабатываются в потоке io_context
+        ComputePool* pool{nullptr};
+        // число токенов в запросе, начиная с которого блоки берутся в пуле параллельно;
+        // потоковые ответы готовят блоки в пуле по одному при любом числе токенов
+        int threshold{64};
+    };
+
+    /// @brief Обработка запроса на сервер
+    /// @param store хранилище блоков данных
+    /// @param parallel обработка больших запросов в пуле вычислений
+    /// @param admission контроль допуска, ограничивающий число токенов и частей блоков в запросе
+    /// и учитывающий ответ в байтах в полёте, пока он собирается; nullptr — без ограничения
+    /// @param req запрос на сервер 
+    /// @param send функция отправки http ответа
+    template <typename Send>
+    void HandleServerRequest(storage::BlockSource& store, const ParallelOptions& parallel, AdmissionController* admission,
+        StringRequest&& req, Send&& send) {
+        const auto text_response = [&req](http::status status, std::string_view text) {
+            if (req.method() == http::verb::get || req.method() == http::verb::head) {
+                return MakeStringResponse(status, text, req.version(), req.keep_alive(), req.method());
+            }
+            return MakeStringResponse(http::status::method_not_allowed, "Invalid method", req.version(), req.keep_alive(), req.method());
+        };
+
+        if (req.method() != http::verb::get && req.method() != http::verb::head) {
+            return send(text_response(http::status::method_not_allowed, "Invalid method"sv));
+        }
+
+        if (req.target() == METRICS_TARGET) {
+            return send(MakeStringResponse(http::status::ok, metrics::RenderPrometheus(), req.version(),
+                req.keep_alive(), req.method(), ContentType::TEXT_PROMETHEUS));
+        }
+
+        // сжатые формы блоков готовятся один раз, поэтому сжатие почти ничего не стоит на запрос
+        const ContentEncoding encoding = NegotiateEncoding(req[http::field::accept_encoding]);
+
+        // тело запроса переходит в client_to_server, токены ссылаются на него без копирования
+        auto client_to_server = std::make_shared<ClientToServerView>();
+        try {
+            bool parsed = false;
+            {
+                metrics::ScopedTimer timer(metrics::Stage::PARSE);
+                parsed = client_to_server->Parse(std::move(req.body()));
+            }
+            if(parsed){
+                if (admission && admission->TooManyHashes(client_to_server->HashCount())) {
+                    // запрос отклоняется до работы с блоками
+                    return send(text_response(http::status::payload_too_large, "Too many hashes"sv));
+                }
+                if (admission && admission->TooManyRanges(client_to_server->MaxRangesPerHash(), client_to_server->RangeCount())) {
+                    return send(text_response(http::status::payload_too_large, "Too many ranges"sv));
+                }
+                metrics::Add(metrics::Counter::HASHES, client_to_server->HashCount());
+                static logging::Site parse_ok{logging::Level::DEBUG, "Parse Ok, hash count {}"sv};
+                logging::Log(parse_ok, client_to_server->HashCount());
+                if (UseStreaming(req, *client_to_server)) {
+                    // потоковая отправка раньше пула: тело не собирается в памяти целиком,
+                    // а с пулом блоки по очереди готовятся в нём, не занимая поток io_context
+                    StreamResponse stream_response;
+                    stream_response.header = MakeEmptyResponse(req, encoding);
+                    stream_response.source = std::make_shared<ServerToClientStream>(store, std::move(client_to_server), encoding,
+                        parallel.pool);
+                    return send(std::move(stream_response));
+                }
+                // пока блоки собираются, в полёте числится оценка тела; при отправке её сменяет его размер
+                auto reserved = ReserveInflight(admission, *client_to_server);
+                if (parallel.pool && client_to_server->HashCount() >= parallel.threshold) {
+                    // большой запрос не занимает поток io_context: блоки готовятся в пуле,
+                    // ответ отправляется из потока пула, запись переходит в strand сессии
+                    GetServerResponseParallel(*parallel.pool, store, std::move(client_to_server), encoding,
+                        [req = std::move(req), send = std::forward<Send>(send), reserved = std::move(reserved)](
+                            std::optional<ServerToClientBody::value_type>&& result) mutable {
+                            const auto estimate = std::move(reserved);
+                            if (!result) {
+                                return send(MakeStringResponse(http::status::internal_server_error, "Block error"sv,
+                                    req.version(), req.keep_alive(), req.method()));
+                            }
+                            SendServerResponse(req, std::move(*result), send);
+                        });
+                    return;
+                }
+                // блок, который материализует другой запрос, не блокирует поток io_context:
+                // ответ отправится из потока, завершившего материализацию
+                GetServerResponseAsync(store, std::move(client_to_server), encoding, parallel.pool,
+                    [req = std::move(req), send = std::forward<Send>(send), reserved = std::move(reserved)](
+                        std::optional<ServerToClientBody::value_type>&& result) mutable {
+                        const auto estimate = std::move(reserved);
+                        if (!result) {
+                            return send(MakeStringResponse(http::status::internal_server_error, "Block error"sv,
+                                req.version(), req.keep_alive(), req.method()));
+                        }
+                        SendServerResponse(req, std::move(*result), send);
+                    });
+                return;
+            }else{
+                static logging::Site parse_error{logging::Level::WARNING, "Parse error"sv, 10};
+                logging::Log(parse_error);
+                return send(text_response(http::status::bad_request, "Parse error"sv));
+            }
+        }
+        catch (...) {
+            static logging::Site parse_exception{logging::Level::WARNING, "Parse error by exception"sv, 10};
+            logging::Log(parse_exception);
+            return send(text_response(http::status::bad_request, "Parse error by exception"sv));
+        }
+    };
+
+    /// @brief Обработка запроса на сервер с подсчётом выделений памяти на запрос.
+    /// Учитываются выделения в потоке io_context, включая постановку ответа в очередь сессии.
+    template <typename Send>
+    void HandleRequest(storage::BlockSource& store, const ParallelOptions& parallel, AdmissionController* admission,
+        StringRequest&& req, Send&& send) {
+        const uint64_t allocations = ThreadAllocationCount();
+        HandleServerRequest(store, parallel, admission, std::move(req), std::forward<Send>(send));
+        const uint64_t request_allocations = ThreadAllocationCount() - allocations;
+        metrics::Add(metrics::Counter::ALLOCATIONS, request_allocations);
+        static logging::Site site{logging::Level::DEBUG, "Request allocations {}"sv};
+        logging::Log(site, request_allocations);
+    }
+
+    /// @brief Обработка запроса двоичного протокола: тот же разбор ClientToServer и сбор блоков,
+    /// что и для HTTP, но без заголовков и без сжатия
+    /// @param store хранилище блоков данных
+    /// @param parallel обработка больших запросов в пуле вычислений
+    /// @param admission контроль допуска, ограничивающий число токенов и частей блоков в запросе
+    /// и учитывающий ответ в байтах в полёте, пока он собирается; nullptr — без ограничения
+    /// @param req запрос с номером
+    /// @param send функция отправки ответа, принимает BinaryResponse
+    template <typename Send>
+    void HandleBinaryRequest(storage::BlockSource& store, const ParallelOptions& parallel, AdmissionController* admission,
+        BinaryRequest&& req, Send&& send) {
+        const uint64_t id = req.id;
+        auto client_to_server = std::make_shared<ClientToServerView>();
+        bool parsed = false;
+        try {
+            metrics::ScopedTimer timer(metrics::Stage::PARSE);
+            parsed = client_to_server->Parse(std::move(req.body));
+        } catch (...) {
+            parsed = false;
+        }
+        if (!parsed) {
+            static logging::Site parse_error{logging::Level::WARNING, "Binary request {}: parse error"sv, 10};
+            logging::Log(parse_error, id);
+            return send(BinaryResponse::Error(id, FrameStatus::BAD_REQUEST, "Parse error"sv));
+        }
+        if (admission && admission->TooManyHashes(client_to_server->HashCount())) {
+            return send(BinaryResponse::Error(id, FrameStatus::TOO_LARGE, "Too many hashes"sv));
+        }
+        if (admission && admission->TooManyRanges(client_to_server->MaxRangesPerHash(), client_to_server->RangeCount())) {
+            return send(BinaryResponse::Error(id, FrameStatus::TOO_LARGE, "Too many ranges"sv));
+        }
+        metrics::Add(metrics::Counter::HASHES, client_to_server->HashCount());
+        auto reserved = ReserveInflight(admission, *client_to_server);
+
+        if (parallel.pool && client_to_server->HashCount() >= parallel.threshold) {
+            GetServerResponseParallel(*parallel.pool, store, std::move(client_to_server), ContentEncoding::IDENTITY,
+                [id, send = std::forward<Send>(send), reserved = std::move(reserved)](std::optional<ServerToClientBody::value_type>&& result) mutable {
+                    const auto estimate = std::move(reserved);
+                    if (!result) {
+                        return send(BinaryResponse::Error(id, FrameStatus::INTERNAL_ERROR, "Block error"sv));
+                    }
+                    send(BinaryResponse{id, FrameStatus::OK, std::move(*result), {}});
+                });
+            return;
+        }
+
+        GetServerResponseAsync(store, std::move(client_to_server), ContentEncoding::IDENTITY, parallel.pool,
+            [id, send = std::forward<Send>(send), reserved = std::move(reserved)](std::optional<ServerToClientBody::value_type>&& result) mutable {
+                const auto estimate = std::move(reserved);
+                if (!result) {
+                    return send(BinaryResponse::Error(id, FrameStatus::INTERNAL_ERROR, "Block error"sv));
+                }
+                send(BinaryResponse{id, FrameStatus::OK, std::move(*result), {}});
+            });
+    }
+
+    /// @brief Ответ 503 с Retry-After на запрос, отклонённый из-за нагрузки
+    StringResponse MakeRejection(const StringRequest& req, const Rejection& rejection);
+
+    /// @brief Ответ со статусом OVERLOADED на запрос двоичного протокола, отклонённый из-за нагрузки
+    BinaryResponse MakeRejection(const BinaryRequest& req, const Rejection& rejection);
+
+    /// @brief Учёт тела ответа, собранного в памяти, как байтов в полёте до его отправки.
+    /// Тела из файла (sendfile) и потоковые ответы, держащие в памяти один блок, не учитываются.
+    void HoldInflight(AdmissionController& admission, ServerToClientResponse& response);
+    void HoldInflight(AdmissionController& admission, BinaryResponse& response);
+
+    template <typename Response>
+    void HoldInflight(AdmissionController&, Response&) {
+    }
+
+    /// @brief Обработчик запросов под контролем допуска, обёртка над обработчиком HTTP или двоичного протокола.
+    /// Слушатель получает через Admit копию обработчика на каждое соединение: копия знает адрес клиента
+    /// и занимает место в лимите сессий, пока жива сессия. Запрос сверх доли клиента или при превышении
+    /// байтов в полёте получает отказ, не доходя до обработчика.
+    template <typename Handler>
+    class AdmittedHandler {
+    public:
+        /// @param admission контроль допуска
+        /// @param handler обработчик запросов
+        /// @param rejection что записать в соединение сверх лимита сессий перед закрытием; пустая — просто закрыть
+        AdmittedHandler(AdmissionController& admission, Handler handler, std::string_view rejection = {}) :
+            admission_(&admission),
+            handler_(std::move(handler)),
+            rejection_(rejection) {
+        }
+
+        /// @brief Допуск нового соединения
+        /// @return обработчик для сессии соединения или std::nullopt, если сессий уже слишком много
+        std::optional<AdmittedHandler> Admit(const tcp::socket& socket) const {
+            if (!admission_->TryOpenSession()) {
+                return std::nullopt;
+            }
+            std::optional<AdmittedHandler> connection(*this);
+            // место в лимите освобождается, когда разрушается последняя копия обработчика сессии
+            connection->session_ = std::shared_ptr<AdmissionController>(admission_, [](AdmissionController* admission) {
+                admission->CloseSession();
+            });
+            if (admission_->Options().client_rate > 0) {
+                beast::error_code ec;
+                connection->client_ = socket.remote_endpoint(ec).address();
+            }
+            return connection;
+        }
+
+        /// @brief Отказ соединению сверх лимита сессий
+        void Reject(tcp::socket&& socket) const {
+            if (rejection_.empty()) {
+                return;
+            }
+            auto rejected = std::make_shared<tcp::socket>(std::move(socket));
+            net::async_write(*rejected, net::buffer(rejection_.data(), rejection_.size()),
+                [rejected](beast::error_code ec, size_t) {
+                    rejected->shutdown(tcp::socket::shutdown_send, ec);
+                });
+        }
+
+        template <typename Request, typename Send>
+        void operator()(Request&& req, Send&& send) {
+            if (const auto rejection = admission_->AdmitRequest(client_)) {
+                return send(MakeRejection(req, *rejection));
+            }
+            handler_(std::forward<Request>(req),
+                [admission = admission_, send = std::forward<Send>(send)](auto&& response) mutable {
+                    HoldInflight(*admission, response);
+                    send(std::forward<decltype(response)>(response));
+                });
+        }
+
+    private:
+        AdmissionController* admission_;
+        Handler handler_;
+        std::string_view rejection_;
+        std::shared_ptr<AdmissionController> session_;
+        boost::asio::ip::address client_;
+    };
+
+} // namespace http_server
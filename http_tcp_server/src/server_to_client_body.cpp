@@ -0,0 +1,312 @@
+#include "server_to_client_body.h"
+#include "metrics.h"
+
+#include <algorithm>
+
+namespace http_server {
+	ServerToClientBody::value_type::value_type(ContentEncoding encoding) :
+		encoding_(encoding) {
+		if (encoding_ != ContentEncoding::IDENTITY) {
+			framer_.emplace(encoding_);
+			framer_->AppendHeader(heads_);
+		}
+	}
+
+	void ServerToClientBody::value_type::Reserve(size_t count, size_t hash_size) {
+		const size_t head_size = storage::HashAndBlockHeadSize(hash_size, storage::MAX_BLOCK_SIZE);
+		if (!framer_) {
+			records_.reserve(count);
+			heads_.reserve(count * head_size);
+			return;
+		}
+		// и запись с трейлером
+		records_.reserve(count + 1);
+		heads_.reserve(heads_.size() + count * DeflateFramer::StoredSize(head_size) + DeflateFramer::TrailerSize(encoding_));
+	}
+
+	void ServerToClientBody::value_type::Add(std::string_view hash, storage::BlockData block, std::optional<storage::ServedRange> range) {
+		Record record;
+		if (!range && !block.wire_head.empty()) {
+			record.wire_head = block.wire_head;
+			record.head_offset = 0;
+			record.head_size = record.wire_head.size();
+		} else {
+			record.head_offset = next_head_;
+			storage::AppendHashAndBlockHead(heads_, hash, block.size(), range);
+			record.head_size = heads_.size() - record.head_offset;
+			next_head_ = heads_.size();
+		}
+		record.block = std::move(block);
+
+		size_ += record.head_size + record.block.size();
+		records_.push_back(std::move(record));
+		if (range) {
+			storage::AppendServedRange(heads_, *range);
+			AddHeadOnly();
+		}
+	}
+
+	void ServerToClientBody::value_type::AddDeflated(std::string_view hash, storage::DeflatedBlockPtr block, std::optional<storage::ServedRange> range) {
+		proto_head_.clear();
+		storage::AppendHashAndBlockHead(proto_head_, hash, block->raw_size, range);
+		framer_->AppendStored(heads_, proto_head_);
+		framer_->AddSegment(*block);
+
+		Record record;
+		record.head_offset = next_head_;
+		record.head_size = heads_.size() - record.head_offset;
+		next_head_ = heads_.size();
+		record.block.bytes = block->bytes;
+		record.block.owner = std::move(block);
+
+		size_ += record.head_size + record.block.size();
+		records_.push_back(std::move(record));
+		if (range) {
+			proto_head_.clear();
+			storage::AppendServedRange(proto_head_, *range);
+			framer_->AppendStored(heads_, proto_head_);
+			AddHeadOnly();
+		}
+	}
+
+	void ServerToClientBody::value_type::AddRanges(std::string_view hash, const storage::BlockData& block,
+		std::span<const ByteRange> ranges) {
+		if (!framer_) {
+			range_blocks_size_ += block.size();
+		}
+		for (const auto& range : ranges) {
+			auto slice = block.Slice(range.offset, range.length);
+			const storage::ServedRange served{static_cast<uint64_t>(slice.data() - block.data()), block.size()};
+			if (framer_) {
+				AddDeflated(hash, storage::DeflateBlock(slice.bytes), served);
+			} else {
+				Add(hash, std::move(slice), served);
+			}
+		}
+	}
+
+	void ServerToClientBody::value_type::Finish() {
+		if (!framer_) {
+			return;
+		}
+		framer_->AppendTrailer(heads_);
+		AddHeadOnly();
+		framer_.reset();
+	}
+
+	void ServerToClientBody::value_type::AddHeadOnly() {
+		Record record;
+		record.head_offset = next_head_;
+		record.head_size = heads_.size() - record.head_offset;
+		next_head_ = heads_.size();
+		size_ += record.head_size;
+		records_.push_back(std::move(record));
+	}
+
+	bool ServerToClientBody::value_type::HasFileBlocks() const {
+		return std::any_of(records_.begin(), records_.end(), [](const Record& record) {
+			return record.block.file.fd >= 0;
+		});
+	}
+
+	void ServerToClientBody::value_type::AppendBuffers(std::vector<net::const_buffer>& buffers) const {
+		buffers.reserve(buffers.size() + records_.size() * 2);
+		for (const auto& record : records_) {
+			buffers.push_back(Head(record));
+			if (record.block.size() > 0) {
+				buffers.emplace_back(record.block.data(), record.block.size());
+			}
+		}
+	}
+
+	std::vector<BodyPart> ServerToClientBody::value_type::Parts() const {
+		std::vector<BodyPart> parts;
+		parts.reserve(records_.size() * 2);
+		for (const auto& record : records_) {
+			parts.push_back({Head(record)});
+			if (record.block.size() > 0) {
+				parts.push_back({net::const_buffer(record.block.data(), record.block.size()),
+					record.block.file.fd, record.block.file.offset});
+			}
+		}
+		return parts;
+	}
+
+	std::string ServerToClientBody::value_type::Serialize() const {
+		std::string out;
+		out.reserve(size_);
+		for (const auto& record : records_) {
+			const auto head = Head(record);
+			out.append(static_cast<const char*>(head.data()), head.size());
+			out.append(record.block.bytes);
+		}
+		return out;
+	}
+
+	ServerToClientStream::ServerToClientStream(storage::BlockSource& store, std::shared_ptr<const ClientToServerView> client_to_server,
+		ContentEncoding encoding, ComputePool* pool) :
+		store_(store),
+		client_to_server_(std::move(client_to_server)),
+		pool_(pool) {
+		if (encoding != ContentEncoding::IDENTITY) {
+			framer_.emplace(encoding);
+		}
+	}
+
+	bool ServerToClientStream::Wait(std::function<void()> resume) {
+		if (fetching_) {
+			// задача пула завершилась и разбудила отправителя
+			fetching_ = false;
+			return false;
+		}
+		if (flight_) {
+			// материализация завершилась; ошибка источника уходит отправителю из Next
+			try {
+				block_ = flight_->Wait().data;
+			} catch (...) {
+				fetch_error_ = std::current_exception();
+			}
+			flight_.reset();
+			if (!framer_ || fetch_error_) {
+				block_ready_ = true;
+				return false;
+			}
+			return LookupDeflated(std::move(resume));
+		}
+		if (deflate_flight_) {
+			try {
+				deflated_ = deflate_flight_->Wait();
+			} catch (...) {
+				fetch_error_ = std::current_exception();
+			}
+			deflate_flight_.reset();
+			block_ready_ = true;
+			return false;
+		}
+		if (block_ready_) {
+			return false;
+		}
+		const auto hashes = client_to_server_->Hashes();
+		while (next_hash_ < client_to_server_->HashCount() && hashes[next_hash_].size() != storage::MAX_HASH_SIZE) {
+			++next_hash_;
+		}
+		if (next_hash_ == client_to_server_->HashCount()) {
+			return false;
+		}
+
+		if (pool_) {
+			// поток отправки не материализует и не сжимает блоки: следующий блок
+			// готовится в пуле только после отправки предыдущего, порядок записей сохраняется
+			fetching_ = true;
+			pool_->Submit([self = shared_from_this(), hash = hashes[next_hash_], resume = std::move(resume)] {
+				try {
+					metrics::ScopedTimer timer(metrics::Stage::BLOCKS);
+					if (self->framer_) {
+						self->deflated_ = self->store_.GetDeflatedBlock(hash);
+					} else {
+						self->block_ = self->store_.GetBlock(hash).data;
+					}
+				} catch (...) {
+					self->fetch_error_ = std::current_exception();
+				}
+				self->block_ready_ = true;
+				resume();
+			});
+			return true;
+		}
+
+		// сжатая форма берётся, когда исходный блок уже материализован:
+		// чужая материализация ожидается подпиской, а не блокировкой потока
+		storage::BlockLookup found;
+		try {
+			metrics::ScopedTimer timer(metrics::Stage::BLOCKS);
+			found = store_.LookupBlock(hashes[next_hash_]);
+		} catch (...) {
+			fetch_error_ = std::current_exception();
+			block_ready_ = true;
+			return false;
+		}
+		if (found.flight) {
+			flight_ = std::move(found.flight);
+			// false: блок успел материализоваться между поиском и подпиской
+			return flight_->OnReady(resume) || Wait(std::move(resume));
+		}
+		if (!framer_) {
+			block_ = std::move(found.record.data);
+			block_ready_ = true;
+			return false;
+		}
+		return LookupDeflated(std::move(resume));
+	}
+
+	bool ServerToClientStream::LookupDeflated(std::function<void()> resume) {
+		// исходный блок лежит в кэше, в потоке отправки он сжимается не больше одного раза,
+		// а сжатие, начатое другим запросом, ожидается подпиской
+		block_ = {};
+		storage::DeflatedLookup found;
+		try {
+			metrics::ScopedTimer timer(metrics::Stage::BLOCKS);
+			found = store_.LookupDeflatedBlock(client_to_server_->Hashes()[next_hash_]);
+		} catch (...) {
+			fetch_error_ = std::current_exception();
+			block_ready_ = true;
+			return false;
+		}
+		if (found.flight) {
+			deflate_flight_ = std::move(found.flight);
+			return deflate_flight_->OnReady(std::move(resume)) || Wait({});
+		}
+		deflated_ = std::move(found.deflated);
+		block_ready_ = true;
+		return false;
+	}
+
+	bool ServerToClientStream::Next(std::vector<net::const_buffer>& buffers) {
+		// буфер заголовка переиспользуется, выделение памяти только на первой записи;
+		// первая часть сжатого потока начинается с заголовка gzip или zlib
+		head_.clear();
+		if (framer_ && !started_) {
+			framer_->AppendHeader(head_);
+		}
+		started_ = true;
+
+		while (next_hash_ < client_to_server_->HashCount()) {
+			const std::string_view hash = client_to_server_->Hashes()[next_hash_++];
+			if (hash.size() != storage::MAX_HASH_SIZE) {
+				continue;
+			}
+			if (fetch_error_) {
+				std::rethrow_exception(std::exchange(fetch_error_, nullptr));
+			}
+			// блок или его сжатую форму приготовил Wait
+			block_ready_ = false;
+			if (framer_) {
+				proto_head_.clear();
+				storage::AppendHashAndBlockHead(proto_head_, hash, deflated_->raw_size);
+				framer_->AppendStored(head_, proto_head_);
+				framer_->AddSegment(*deflated_);
+				buffers.emplace_back(head_.data(), head_.size());
+				buffers.emplace_back(deflated_->bytes.data(), deflated_->bytes.size());
+				return true;
+			}
+			if (!block_.wire_head.empty()) {
+				buffers.emplace_back(block_.wire_head.data(), block_.wire_head.size());
+			} else {
+				storage::AppendHashAndBlockHead(head_, hash, block_.size());
+				buffers.emplace_back(head_.data(), head_.size());
+			}
+			buffers.emplace_back(block_.data(), block_.size());
+			return true;
+		}
+
+		if (framer_ && !finished_) {
+			// сжатый поток закрывается отдельной последней частью
+			finished_ = true;
+			deflated_.reset();
+			framer_->AppendTrailer(head_);
+			buffers.emplace_back(head_.data(), head_.size());
+			return true;
+		}
+		return false;
+	}
+}  // namespace http_server
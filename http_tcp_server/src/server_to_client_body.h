@@ -0,0 +1,240 @@
+#pragma once
+#include "sdk.h"
+#define BOOST_BEAST_USE_STD_STRING_VIEW
+
+#include <boost/beast/core.hpp>
+#include <boost/beast/http.hpp>
+#include <boost/optional.hpp>
+
+#include <exception>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "admission.h"
+#include "block_store.h"
+#include "client_to_server_view.h"
+#include "compute_pool.h"
+#include "content_encoding.h"
+#include "hash_and_block.h"
+#include "http_server.h"
+
+namespace http_server {
+
+    namespace net = boost::asio;
+    namespace beast = boost::beast;
+    namespace http = beast::http;
+
+    /// @brief Тело HTTP-ответа с сообщением Exchange::ServerToClient.
+    /// Вместо сериализации всего сообщения в память хранит для каждого HashAndBlock
+    /// только protobuf-заголовки записи вместе с токеном и ссылку на блок из хранилища.
+    /// Заголовки всех записей лежат подряд в одной строке, а не в строке на запись;
+    /// блоки из кэша приносят готовые заголовки, и на них ответ только ссылается.
+    /// При отправке получается scatter/gather последовательность буферов,
+    /// которую http::async_write передаёт в сокет одним writev.
+    /// Сжатое тело собирается так же: заголовки записей идут несжатыми блоками deflate,
+    /// а вместо блоков — их готовые сжатые формы, так что ничего не пересжимается.
+    struct ServerToClientBody {
+        class value_type {
+        public:
+            value_type() = default;
+
+            /// @brief Пустое тело с заданным кодированием. Для сжатого тела
+            /// записи добавляются через AddDeflated, а в конце вызывается Finish.
+            explicit value_type(ContentEncoding encoding);
+
+            /// @brief Резервирует память под записи, чтобы Add не выделял её повторно
+            /// @param count число записей
+            /// @param hash_size размер токена
+            void Reserve(size_t count, size_t hash_size);
+
+            /// @brief Добавляет в ответ запись HashAndBlock. Если у блока есть готовый
+            /// заголовок записи, он отправляется как есть, без кодирования.
+            /// @param hash токен
+            /// @param block блок данных, на который ссылается ответ
+            /// @param range отданная часть блока, std::nullopt — блок целиком
+            void Add(std::string_view hash, storage::BlockData block, std::optional<storage::ServedRange> range = std::nullopt);
+
+            /// @brief Добавляет в сжатый ответ запись HashAndBlock
+            /// @param hash токен
+            /// @param block сжатая форма блока, на которую ссылается ответ
+            /// @param range отданная часть блока, std::nullopt — блок целиком
+            void AddDeflated(std::string_view hash, storage::DeflatedBlockPtr block, std::optional<storage::ServedRange> range = std::nullopt);
+
+            /// @brief Добавляет по записи HashAndBlock на каждую запрошенную часть блока.
+            /// Части ссылаются на блок без копирования; в сжатый ответ части сжимаются
+            /// при добавлении, сжатая форма целого блока для них не подходит.
+            /// @param hash токен
+            /// @param block блок целиком
+            /// @param ranges запрошенные части блока, непустой список
+            void AddRanges(std::string_view hash, const storage::BlockData& block, std::span<const ByteRange> ranges);
+
+            /// @brief Завершает сжатый поток трейлером. Для несжатого тела ничего не делает.
+            void Finish();
+
+            ContentEncoding Encoding() const {
+                return encoding_;
+            }
+
+            /// @brief Размер тела в байтах, для сжатого тела — после сжатия
+            uint64_t Size() const {
+                return size_;
+            }
+
+            /// @brief Байты, которые тело держит в памяти: само тело и блоки, на части которых
+            /// ссылаются несжатые записи диапазонов, — часть держит весь блок, а не только свои байты
+            uint64_t InflightSize() const {
+                return size_ + range_blocks_size_;
+            }
+
+            /// @brief Число фрагментов тела: записей HashAndBlock, полей частей блоков, идущих после их байтов,
+            /// и трейлера сжатого потока
+            size_t Count() const {
+                return records_.size();
+            }
+
+            /// @brief Есть ли в ответе блоки, лежащие в файле
+            bool HasFileBlocks() const;
+
+            /// @brief Дописывает буферы сериализованного сообщения: заголовки записей и блоки.
+            /// Буферы ссылаются на тело и остаются валидными, пока оно живо.
+            void AppendBuffers(std::vector<net::const_buffer>& buffers) const;
+
+            /// @brief Части сериализованного сообщения: заголовки записей из памяти,
+            /// а блоки из файла — диапазонами файла для sendfile
+            std::vector<BodyPart> Parts() const;
+
+            /// @brief Сериализованное сообщение одной строкой (для отладки и сравнения)
+            std::string Serialize() const;
+
+            /// @brief Учёт байтов тела в полёте, который снимается вместе с разрушением тела
+            void Hold(InflightBytes inflight) {
+                inflight_ = std::move(inflight);
+            }
+
+        private:
+            friend struct ServerToClientBody;
+
+            struct Record {
+                // положение в heads_ заголовка записи:
+                // тег и длина HashAndBlock, тег и длина токена, токен, тег и длина блока
+                size_t head_offset;
+                size_t head_size;
+                storage::BlockData block;
+                // заголовок записи, закодированный заранее и хранящийся вместе с блоком;
+                // если пуст, заголовок лежит в heads_
+                std::string_view wire_head;
+            };
+
+            /// @brief Фрагмент без блока из байтов heads_, дописанных после предыдущего заголовка
+            void AddHeadOnly();
+
+            net::const_buffer Head(const Record& record) const {
+                if (!record.wire_head.empty()) {
+                    return {record.wire_head.data(), record.wire_head.size()};
+                }
+                return {heads_.data() + record.head_offset, record.head_size};
+            }
+
+            std::vector<Record> records_;
+            std::string heads_;
+            // начало заголовка следующей записи в heads_: перед первой записью сжатого тела
+            // лежит заголовок gzip или zlib
+            size_t next_head_{0};
+            uint64_t size_{0};
+            uint64_t range_blocks_size_{0};
+            ContentEncoding encoding_{ContentEncoding::IDENTITY};
+            std::optional<DeflateFramer> framer_;
+            std::string proto_head_;
+            InflightBytes inflight_;
+        };
+
+        static uint64_t size(const value_type& body) {
+            return body.Size();
+        }
+
+        class writer {
+        public:
+            using const_buffers_type = std::span<const net::const_buffer>;
+
+            template <bool isRequest, class Fields>
+            writer(const http::header<isRequest, Fields>&, const value_type& body) :
+                body_(body) {
+            }
+
+            void init(beast::error_code& ec) {
+                buffers_.clear();
+                body_.AppendBuffers(buffers_);
+                ec = {};
+            }
+
+            boost::optional<std::pair<const_buffers_type, bool>> get(beast::error_code& ec) {
+                ec = {};
+                if (done_) {
+                    return boost::none;
+                }
+                done_ = true;
+                return std::make_pair(const_buffers_type{buffers_}, false);
+            }
+
+        private:
+            const value_type& body_;
+            std::vector<net::const_buffer> buffers_;
+            bool done_{false};
+        };
+    };
+
+    /// @brief Потоковая отправка сообщения ServerToClient: каждая запись HashAndBlock
+    /// становится отдельной частью chunked ответа, а следующий блок берётся
+    /// из хранилища только после отправки предыдущего. В памяти одновременно
+    /// находится не больше одного блока ответа, а склеенные части образуют
+    /// корректное сообщение ServerToClient. Сжатый поток собирается из сжатых форм
+    /// блоков, как в ServerToClientBody, трейлер уходит последней частью.
+    /// Создаётся через std::make_shared: задача пула держит поток живым до своего завершения.
+    class ServerToClientStream : public ChunkSource, public std::enable_shared_from_this<ServerToClientStream> {
+    public:
+        /// @param pool пул, в котором по одному и по порядку готовятся блоки ответа;
+        /// nullptr — блоки готовятся в потоке, отправляющем ответ
+        ServerToClientStream(storage::BlockSource& store, std::shared_ptr<const ClientToServerView> client_to_server,
+            ContentEncoding encoding = ContentEncoding::IDENTITY, ComputePool* pool = nullptr);
+
+        bool Next(std::vector<net::const_buffer>& buffers) override;
+
+        /// @brief Блок, который материализует другой запрос, ожидается без блокировки.
+        /// С пулом очередной блок или его сжатая форма готовится в пуле. Без пула
+        /// подпиской ожидаются и материализация исходного блока, и чужое сжатие его формы,
+        /// а Next только отдаёт то, что приготовил Wait.
+        bool Wait(std::function<void()> resume) override;
+
+    private:
+        // сжатая форма материализованного блока очередного токена: готовая, сжатая
+        // в этом потоке или ожидаемая подпиской на чужое сжатие
+        bool LookupDeflated(std::function<void()> resume);
+
+    private:
+        storage::BlockSource& store_;
+        std::shared_ptr<const ClientToServerView> client_to_server_;
+        int next_hash_{0};
+        std::string head_;
+        storage::BlockData block_;
+        // блок очередного токена уже получен в Wait
+        bool block_ready_{false};
+        std::shared_ptr<storage::BlockFlight> flight_;
+        std::shared_ptr<storage::DeflateFlight> deflate_flight_;
+        ComputePool* pool_;
+        // задача пула готовит блок очередного токена, поток ждёт её завершения
+        bool fetching_{false};
+        // ошибка получения блока в Wait или в задаче пула, передаётся отправителю из Next
+        std::exception_ptr fetch_error_;
+        std::optional<DeflateFramer> framer_;
+        storage::DeflatedBlockPtr deflated_;
+        std::string proto_head_;
+        bool started_{false};
+        bool finished_{false};
+    };
+
+} // namespace http_server
@@ -0,0 +1,395 @@
+#include "uring_stream.h"
+#include "logging.h"
+#include "metrics.h"
+
+#include <boost/asio/post.hpp>
+
+#include <linux/io_uring.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <utility>
+
+namespace http_server {
+	namespace {
+		using namespace std::literals;
+
+		static_assert(sizeof(UringOperation::timespec) == sizeof(__kernel_timespec));
+
+		// размер очереди завершений относительно очереди отправки: CQE приходят и от таймаутов
+		constexpr unsigned CQ_ENTRIES_FACTOR{4};
+
+		// операции, без которых сессия на io_uring не работает
+		constexpr std::array REQUIRED_OPS{
+			IORING_OP_READ_FIXED, IORING_OP_RECV, IORING_OP_SEND,
+			IORING_OP_RECVMSG, IORING_OP_SENDMSG, IORING_OP_LINK_TIMEOUT};
+
+		[[noreturn]] void ThrowErrno(const char* what) {
+			throw sys::system_error(sys::error_code(errno, sys::system_category()), what);
+		}
+
+		int UringSetup(unsigned entries, io_uring_params& params) {
+			return static_cast<int>(::syscall(__NR_io_uring_setup, entries, &params));
+		}
+
+		int UringRegister(int fd, unsigned opcode, const void* arg, unsigned count) {
+			return static_cast<int>(::syscall(__NR_io_uring_register, fd, opcode, arg, count));
+		}
+
+		void* MapRing(int fd, size_t size, off_t offset) {
+			void* pointer = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, offset);
+			if (pointer == MAP_FAILED) {
+				ThrowErrno("io_uring mmap");
+			}
+			return pointer;
+		}
+
+		template <typename T>
+		T* At(void* base, uint32_t offset) {
+			return reinterpret_cast<T*>(static_cast<char*>(base) + offset);
+		}
+
+		/// @brief Поддерживает ли ядро все операции REQUIRED_OPS
+		bool ProbeOps(int fd) {
+			constexpr size_t PROBE_OPS{256};
+			std::vector<char> storage(sizeof(io_uring_probe) + PROBE_OPS * sizeof(io_uring_probe_op));
+			auto* probe = reinterpret_cast<io_uring_probe*>(storage.data());
+			if (UringRegister(fd, IORING_REGISTER_PROBE, probe, PROBE_OPS) < 0) {
+				return false;
+			}
+			for (const auto op : REQUIRED_OPS) {
+				if (op > probe->last_op || !(probe->ops[op].flags & IO_URING_OP_SUPPORTED)) {
+					return false;
+				}
+			}
+			return true;
+		}
+	}
+
+	UringService::UringService(net::execution_context& context, UringOptions options) :
+		execution_context_service_base(context),
+		// служба создаётся только для io_context, которому принадлежат сокеты сессий
+		ioc_(static_cast<net::io_context&>(context)),
+		options_(options),
+		event_(ioc_) {
+		io_uring_params params{};
+		params.flags = IORING_SETUP_CQSIZE;
+		params.cq_entries = options_.entries * CQ_ENTRIES_FACTOR;
+		ring_fd_ = UringSetup(options_.entries, params);
+		if (ring_fd_ < 0) {
+			ThrowErrno("io_uring_setup");
+		}
+		try {
+			if (!(params.features & IORING_FEAT_NODROP) || !ProbeOps(ring_fd_)) {
+				throw sys::system_error(sys::error_code(ENOSYS, sys::system_category()), "io_uring operations"s);
+			}
+
+			sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+			cq_ring_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+			if (params.features & IORING_FEAT_SINGLE_MMAP) {
+				sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+			}
+			sq_ring_ = MapRing(ring_fd_, sq_ring_size_, IORING_OFF_SQ_RING);
+			cq_ring_ = (params.features & IORING_FEAT_SINGLE_MMAP) ? sq_ring_ : MapRing(ring_fd_, cq_ring_size_, IORING_OFF_CQ_RING);
+			sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+			sqes_ = MapRing(ring_fd_, sqes_size_, IORING_OFF_SQES);
+
+			sq_head_ = At<unsigned>(sq_ring_, params.sq_off.head);
+			sq_tail_ = At<unsigned>(sq_ring_, params.sq_off.tail);
+			sq_mask_ = *At<unsigned>(sq_ring_, params.sq_off.ring_mask);
+			sq_entries_ = params.sq_entries;
+			sq_array_ = At<unsigned>(sq_ring_, params.sq_off.array);
+			cq_head_ = At<unsigned>(cq_ring_, params.cq_off.head);
+			cq_tail_ = At<unsigned>(cq_ring_, params.cq_off.tail);
+			cq_mask_ = *At<unsigned>(cq_ring_, params.cq_off.ring_mask);
+			cqes_ = At<io_uring_cqe>(cq_ring_, params.cq_off.cqes);
+
+			event_fd_ = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+			if (event_fd_ < 0) {
+				ThrowErrno("eventfd");
+			}
+			// eventfd закрывает event_
+			event_.assign(event_fd_);
+			if (UringRegister(ring_fd_, IORING_REGISTER_EVENTFD, &event_fd_, 1) < 0) {
+				ThrowErrno("io_uring eventfd");
+			}
+		} catch (...) {
+			Close();
+			throw;
+		}
+
+		if (options_.buffers > 0 && options_.buffer_size > 0) {
+			buffers_size_ = options_.buffers * options_.buffer_size;
+			void* buffers = ::mmap(nullptr, buffers_size_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+			const iovec region{buffers, buffers_size_};
+			if (buffers != MAP_FAILED && UringRegister(ring_fd_, IORING_REGISTER_BUFFERS, &region, 1) == 0) {
+				buffers_ = static_cast<char*>(buffers);
+				free_buffers_.reserve(options_.buffers);
+				for (size_t i = options_.buffers; i > 0; --i) {
+					free_buffers_.push_back(static_cast<uint32_t>(i - 1));
+				}
+			} else {
+				// обычно упирается в RLIMIT_MEMLOCK: чтение работает и без пула, только дороже
+				static logging::Site site{logging::Level::WARNING, "io_uring buffers are not registered, {} MB: {}"sv};
+				logging::Log(site, buffers_size_ / (1024 * 1024), sys::error_code(errno, sys::system_category()));
+				if (buffers != MAP_FAILED) {
+					::munmap(buffers, buffers_size_);
+				}
+				buffers_size_ = 0;
+			}
+		}
+
+		WaitCompletions();
+	}
+
+	UringService::~UringService() {
+		Close();
+	}
+
+	void UringService::Close() {
+		if (buffers_) {
+			::munmap(buffers_, buffers_size_);
+			buffers_ = nullptr;
+		}
+		if (sqes_) {
+			::munmap(sqes_, sqes_size_);
+			sqes_ = nullptr;
+		}
+		if (cq_ring_ && cq_ring_ != sq_ring_) {
+			::munmap(cq_ring_, cq_ring_size_);
+		}
+		cq_ring_ = nullptr;
+		if (sq_ring_) {
+			::munmap(sq_ring_, sq_ring_size_);
+			sq_ring_ = nullptr;
+		}
+		if (ring_fd_ >= 0) {
+			::close(ring_fd_);
+			ring_fd_ = -1;
+		}
+	}
+
+	void UringService::shutdown() {
+		// Операции в полёте больше не завершатся: разрушаем их обработчики, а с ними и сессии
+		UringOperation* op = nullptr;
+		{
+			std::lock_guard lock(mutex_);
+			op = std::exchange(pending_, nullptr);
+		}
+		while (op) {
+			auto* next = op->next;
+			op->complete(op, 0, true);
+			op = next;
+		}
+	}
+
+	void UringService::Link(UringOperation* op) {
+		op->prev = nullptr;
+		op->next = pending_;
+		if (pending_) {
+			pending_->prev = op;
+		}
+		pending_ = op;
+	}
+
+	void UringService::Unlink(UringOperation* op) {
+		if (op->prev) {
+			op->prev->next = op->next;
+		} else {
+			pending_ = op->next;
+		}
+		if (op->next) {
+			op->next->prev = op->prev;
+		}
+	}
+
+	bool UringService::Reserve(std::unique_lock<std::mutex>& lock, unsigned count) {
+		const std::atomic_ref head(*sq_head_);
+		if (*sq_tail_ + count - head.load(std::memory_order_acquire) <= sq_entries_) {
+			return true;
+		}
+		// очередь отправки полна: отправляем её сразу, не дожидаясь отложенного Flush
+		lock.unlock();
+		Enter(sq_entries_);
+		lock.lock();
+		return *sq_tail_ + count - head.load(std::memory_order_acquire) <= sq_entries_;
+	}
+
+	void* UringService::SqeAt(unsigned position) {
+		const unsigned index = position & sq_mask_;
+		sq_array_[index] = index;
+		return static_cast<io_uring_sqe*>(sqes_) + index;
+	}
+
+	void UringService::Start(UringOperation* op) {
+		const unsigned count = op->timeout ? 2 : 1;
+		std::unique_lock lock(mutex_);
+		if (!Reserve(lock, count)) {
+			lock.unlock();
+			// кольцо не принимает записи: завершаем операцию ошибкой через io_context
+			return net::post(ioc_, [op] {
+				op->complete(op, -EBUSY, false);
+			});
+		}
+
+		const unsigned tail = *sq_tail_;
+		auto& entry = *static_cast<io_uring_sqe*>(SqeAt(tail));
+		entry = io_uring_sqe{};
+		entry.fd = op->fd;
+		entry.user_data = reinterpret_cast<uint64_t>(op);
+		if (op->msg.msg_iovlen == 1) {
+			const iovec& buffer = op->msg.msg_iov[0];
+			entry.opcode = op->fixed ? IORING_OP_READ_FIXED : op->read ? IORING_OP_RECV : IORING_OP_SEND;
+			entry.addr = reinterpret_cast<uint64_t>(buffer.iov_base);
+			entry.len = static_cast<uint32_t>(buffer.iov_len);
+			// область зарегистрирована одним буфером с индексом 0
+			entry.buf_index = 0;
+		} else {
+			entry.opcode = op->read ? IORING_OP_RECVMSG : IORING_OP_SENDMSG;
+			entry.addr = reinterpret_cast<uint64_t>(&op->msg);
+			entry.len = 1;
+		}
+		if (!op->fixed) {
+			entry.msg_flags = op->read ? 0 : MSG_NOSIGNAL;
+		}
+		if (op->timeout) {
+			op->timespec.tv_sec = op->timeout->count() / 1'000'000'000;
+			op->timespec.tv_nsec = op->timeout->count() % 1'000'000'000;
+			// связанный таймаут стоит сразу за операцией
+			entry.flags |= IOSQE_IO_LINK;
+			auto& timeout_entry = *static_cast<io_uring_sqe*>(SqeAt(tail + 1));
+			timeout_entry = io_uring_sqe{};
+			timeout_entry.opcode = IORING_OP_LINK_TIMEOUT;
+			timeout_entry.fd = -1;
+			timeout_entry.addr = reinterpret_cast<uint64_t>(&op->timespec);
+			timeout_entry.len = 1;
+			// завершение таймаута не несёт операции
+			timeout_entry.user_data = 0;
+		}
+		Link(op);
+		// записи становятся видны ядру только после сдвига хвоста
+		std::atomic_ref(*sq_tail_).store(tail + count, std::memory_order_release);
+
+		if (!flush_posted_) {
+			flush_posted_ = true;
+			lock.unlock();
+			PostFlush();
+		}
+	}
+
+	void UringService::PostFlush() {
+		// Отправка откладывается в конец очереди io_context: обработчики, готовые к запуску,
+		// успеют поставить свои записи, и все они уйдут одним io_uring_enter
+		net::post(ioc_, [this] {
+			Flush();
+		});
+	}
+
+	void UringService::Flush() {
+		{
+			std::lock_guard lock(mutex_);
+			flush_posted_ = false;
+			if (*sq_tail_ == std::atomic_ref(*sq_head_).load(std::memory_order_acquire)) {
+				return;
+			}
+		}
+		Enter(sq_entries_);
+	}
+
+	void UringService::Enter(unsigned to_submit) {
+		// ядро забирает не больше записей, чем лежит в очереди
+		while (true) {
+			const long submitted = ::syscall(__NR_io_uring_enter, ring_fd_, to_submit, 0, 0, nullptr, 0);
+			metrics::Add(metrics::Counter::URING_SUBMITS);
+			if (submitted >= 0 || errno != EINTR) {
+				if (submitted < 0 && errno != EAGAIN && errno != EBUSY) {
+					static logging::Site site{logging::Level::ERROR, "io_uring_enter: {}"sv};
+					logging::Log(site, sys::error_code(errno, sys::system_category()));
+				}
+				// при EAGAIN и EBUSY записи остаются в очереди и уйдут после разбора завершений
+				return;
+			}
+		}
+	}
+
+	void UringService::WaitCompletions() {
+		event_.async_wait(net::posix::stream_descriptor::wait_read, [this](beast::error_code ec) {
+			if (ec) {
+				return;
+			}
+			uint64_t value = 0;
+			[[maybe_unused]] const auto bytes = ::read(event_fd_, &value, sizeof(value));
+			Drain();
+			// записи, поставленные обработчиками завершений, уходят сразу
+			Flush();
+			WaitCompletions();
+		});
+	}
+
+	void UringService::Drain() {
+		const std::atomic_ref tail(*cq_tail_);
+		const std::atomic_ref head(*cq_head_);
+		while (true) {
+			unsigned current = head.load(std::memory_order_relaxed);
+			const unsigned last = tail.load(std::memory_order_acquire);
+			if (current == last) {
+				return;
+			}
+			completed_.clear();
+			for (; current != last; ++current) {
+				const auto& cqe = static_cast<const io_uring_cqe*>(cqes_)[current & cq_mask_];
+				if (cqe.user_data != 0) {
+					completed_.emplace_back(reinterpret_cast<UringOperation*>(cqe.user_data), cqe.res);
+				}
+			}
+			head.store(last, std::memory_order_release);
+			metrics::Add(metrics::Counter::URING_COMPLETIONS, completed_.size());
+
+			{
+				std::lock_guard lock(mutex_);
+				for (const auto& [op, result] : completed_) {
+					Unlink(op);
+				}
+			}
+			for (const auto& [op, result] : completed_) {
+				op->complete(op, result, false);
+			}
+		}
+	}
+
+	bool UringService::IsRegistered(const void* data, size_t size) const {
+		const auto* begin = static_cast<const char*>(data);
+		return buffers_ && begin >= buffers_ && begin + size <= buffers_ + buffers_size_;
+	}
+
+	void* UringService::AllocateBuffer(size_t size) {
+		if (size > options_.buffer_size) {
+			return nullptr;
+		}
+		std::lock_guard lock(mutex_);
+		if (free_buffers_.empty()) {
+			return nullptr;
+		}
+		const uint32_t index = free_buffers_.back();
+		free_buffers_.pop_back();
+		return buffers_ + index * options_.buffer_size;
+	}
+
+	bool UringService::ReleaseBuffer(void* pointer) {
+		if (!IsRegistered(pointer, 0)) {
+			return false;
+		}
+		const auto offset = static_cast<size_t>(static_cast<char*>(pointer) - buffers_);
+		std::lock_guard lock(mutex_);
+		free_buffers_.push_back(static_cast<uint32_t>(offset / options_.buffer_size));
+		return true;
+	}
+
+	UringStream::UringStream(tcp::socket&& socket) :
+		socket_(std::move(socket)),
+		service_(&net::use_service<UringService>(net::query(socket_.get_executor(), net::execution::context))) {
+	}
+}  // namespace http_server
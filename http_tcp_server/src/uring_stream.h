@@ -0,0 +1,347 @@
+#pragma once
+#include "sdk.h"
+#define BOOST_BEAST_USE_STD_STRING_VIEW
+
+#include <boost/asio/associated_executor.hpp>
+#include <boost/asio/async_result.hpp>
+#include <boost/asio/buffer.hpp>
+#include <boost/asio/dispatch.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/posix/stream_descriptor.hpp>
+#include <boost/beast/core/bind_handler.hpp>
+#include <boost/beast/core/error.hpp>
+#include <boost/beast/core/flat_buffer.hpp>
+
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include <array>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <new>
+#include <optional>
+#include <vector>
+
+#include "recycling_allocator.h"
+
+namespace http_server {
+
+    namespace net = boost::asio;
+    using tcp = net::ip::tcp;
+    namespace beast = boost::beast;
+    namespace sys = boost::system;
+
+    /// @brief Параметры кольца io_uring
+    struct UringOptions {
+        // размер очереди отправки, каждая операция с таймаутом занимает две записи
+        unsigned entries{4096};
+        // буферы чтения, зарегистрированные в ядре; 0 — чтение в обычную память
+        size_t buffers{256};
+        size_t buffer_size{16 * 1024};
+    };
+
+    /// @brief Чтение или запись сокета в кольце: user_data записи — указатель на операцию.
+    /// Один буфер уходит через recv/send или read_fixed, несколько — через recvmsg/sendmsg.
+    struct UringOperation {
+        // result — res из CQE; destroy — служба останавливается, обработчик не вызывается
+        void (*complete)(UringOperation* op, int result, bool destroy);
+        int fd{-1};
+        bool read{false};
+        // читать в зарегистрированный буфер через IORING_OP_READ_FIXED
+        bool fixed{false};
+        // буферы операции, msg_iov и msg_iovlen
+        msghdr msg{};
+        // сколько ждать завершения, по истечении операция отменяется
+        std::optional<std::chrono::nanoseconds> timeout;
+        // таймаут связанной записи IORING_OP_LINK_TIMEOUT в раскладке __kernel_timespec,
+        // ядро читает его при отправке
+        struct {
+            int64_t tv_sec;
+            int64_t tv_nsec;
+        } timespec{};
+        // операции в полёте, чтобы разрушить их при остановке службы
+        UringOperation* prev{nullptr};
+        UringOperation* next{nullptr};
+    };
+
+    /// @brief Кольцо io_uring на io_context. Записи из всех потоков копятся в очереди отправки
+    /// и уходят в ядро одним io_uring_enter, отложенным через post: операции, запущенные
+    /// подряд разными сессиями, стоят один системный вызов. О завершениях ядро сообщает
+    /// через eventfd, который ждёт реактор io_context, поэтому io_uring работает рядом
+    /// с остальными операциями Asio без отдельного потока. Обработчики завершений
+    /// вызываются в своих исполнителях.
+    /// Буферы чтения берутся из пула, зарегистрированного в ядре (IORING_REGISTER_BUFFERS):
+    /// чтение в них идёт через IORING_OP_READ_FIXED без отображения страниц на каждую операцию.
+    /// Пока служба жива, run() io_context сам не возвращается.
+    class UringService : public net::detail::execution_context_service_base<UringService> {
+    public:
+        /// @throw sys::system_error, если ядро не поддерживает io_uring или нужные операции
+        explicit UringService(net::execution_context& context, UringOptions options = {});
+
+        UringService(const UringService&) = delete;
+        UringService& operator=(const UringService&) = delete;
+
+        ~UringService() override;
+
+        void shutdown() override;
+
+        /// @brief Ставит операцию в очередь отправки. Если задан timeout, за ней идёт
+        /// связанный таймаут: по его истечении операция завершится с -ECANCELED.
+        void Start(UringOperation* op);
+
+        /// @return лежит ли [data, data + size) целиком в зарегистрированных буферах
+        bool IsRegistered(const void* data, size_t size) const;
+
+        /// @brief Зарегистрированный буфер не меньше size байт или nullptr, если пул исчерпан
+        void* AllocateBuffer(size_t size);
+
+        /// @return false, если pointer не из пула
+        bool ReleaseBuffer(void* pointer);
+
+    private:
+        void PostFlush();
+
+        /// @brief Отправка накопленных записей в ядро
+        void Flush();
+
+        void WaitCompletions();
+
+        /// @brief Разбор очереди завершений, вызывается только из ожидания eventfd
+        void Drain();
+
+        /// @brief Освобождает место под count записей, при нехватке отправляя очередь в ядро
+        /// @return false, если ядро не забрало записи
+        bool Reserve(std::unique_lock<std::mutex>& lock, unsigned count);
+
+        /// @brief Запись очереди отправки на позиции position
+        void* SqeAt(unsigned position);
+
+        void Enter(unsigned to_submit);
+
+        void Close();
+
+        void Link(UringOperation* op);
+        void Unlink(UringOperation* op);
+
+        net::io_context& ioc_;
+        UringOptions options_;
+        int ring_fd_{-1};
+        int event_fd_{-1};
+        net::posix::stream_descriptor event_;
+
+        // отображения колец
+        void* sq_ring_{nullptr};
+        size_t sq_ring_size_{0};
+        void* cq_ring_{nullptr};
+        size_t cq_ring_size_{0};
+        // записи очереди отправки, io_uring_sqe
+        void* sqes_{nullptr};
+        size_t sqes_size_{0};
+
+        unsigned* sq_head_{nullptr};
+        unsigned* sq_tail_{nullptr};
+        unsigned sq_mask_{0};
+        unsigned sq_entries_{0};
+        unsigned* sq_array_{nullptr};
+        unsigned* cq_head_{nullptr};
+        unsigned* cq_tail_{nullptr};
+        unsigned cq_mask_{0};
+        // записи очереди завершений, io_uring_cqe
+        void* cqes_{nullptr};
+
+        // пул зарегистрированных буферов: одна область из равных ячеек
+        char* buffers_{nullptr};
+        size_t buffers_size_{0};
+        std::vector<uint32_t> free_buffers_;
+
+        // очередь отправки, список операций в полёте и пул буферов
+        mutable std::mutex mutex_;
+        bool flush_posted_{false};
+        UringOperation* pending_{nullptr};
+        // завершённые операции очередного разбора
+        std::vector<std::pair<UringOperation*, int>> completed_;
+    };
+
+    /// @brief Аллокатор буфера чтения сессии из зарегистрированного пула службы;
+    /// когда пул исчерпан или буфер больше ячейки, память берётся из кучи
+    template <typename T>
+    class RegisteredAllocator {
+    public:
+        using value_type = T;
+
+        explicit RegisteredAllocator(UringService& service) noexcept :
+            service_(&service) {}
+
+        template <typename U>
+        RegisteredAllocator(const RegisteredAllocator<U>& other) noexcept :
+            service_(other.service_) {}
+
+        T* allocate(size_t n) {
+            if (void* pointer = service_->AllocateBuffer(n * sizeof(T))) {
+                return static_cast<T*>(pointer);
+            }
+            return static_cast<T*>(::operator new(n * sizeof(T)));
+        }
+
+        void deallocate(T* pointer, size_t) noexcept {
+            if (!service_->ReleaseBuffer(pointer)) {
+                ::operator delete(pointer);
+            }
+        }
+
+        template <typename U>
+        bool operator==(const RegisteredAllocator<U>& other) const noexcept {
+            return service_ == other.service_;
+        }
+
+    private:
+        template <typename U>
+        friend class RegisteredAllocator;
+
+        UringService* service_;
+    };
+
+    /// @brief TCP-поток, чтение и запись которого идут через кольцо UringService io_context сокета.
+    /// Повторяет то, что SessionBase берёт у beast::tcp_stream: async_read_some, async_write_some,
+    /// expires_after и socket(). Таймаут операции — связанный IORING_OP_LINK_TIMEOUT,
+    /// истечение даёт beast::error::timeout. Сокет должен принадлежать io_context.
+    class UringStream {
+    public:
+        using executor_type = tcp::socket::executor_type;
+        using ReadBuffer = beast::basic_flat_buffer<RegisteredAllocator<char>>;
+
+        explicit UringStream(tcp::socket&& socket);
+
+        executor_type get_executor() noexcept {
+            return socket_.get_executor();
+        }
+
+        tcp::socket& socket() noexcept {
+            return socket_;
+        }
+
+        void expires_after(std::chrono::steady_clock::duration duration) {
+            deadline_ = std::chrono::steady_clock::now() + duration;
+        }
+
+        void expires_never() {
+            deadline_.reset();
+        }
+
+        /// @brief Буфер чтения запросов в зарегистрированной памяти
+        ReadBuffer MakeReadBuffer() {
+            return ReadBuffer(RegisteredAllocator<char>(*service_));
+        }
+
+        template <typename MutableBufferSequence, typename ReadHandler>
+        auto async_read_some(const MutableBufferSequence& buffers, ReadHandler&& handler) {
+            return net::async_initiate<ReadHandler, void(beast::error_code, size_t)>(
+                [this](auto&& handler, const MutableBufferSequence& buffers) {
+                    Start<true>(std::move(handler), buffers);
+                }, handler, buffers);
+        }
+
+        template <typename ConstBufferSequence, typename WriteHandler>
+        auto async_write_some(const ConstBufferSequence& buffers, WriteHandler&& handler) {
+            return net::async_initiate<WriteHandler, void(beast::error_code, size_t)>(
+                [this](auto&& handler, const ConstBufferSequence& buffers) {
+                    Start<false>(std::move(handler), buffers);
+                }, handler, buffers);
+        }
+
+    private:
+        // буферов в одной операции, остальные уйдут следующей: запись короче — не ошибка
+        static constexpr size_t MAX_IOV{64};
+
+        template <typename Handler>
+        struct Io final : UringOperation {
+            Io(Handler&& h, UringStream& stream, bool is_read) :
+                handler(std::move(h)),
+                executor(stream.get_executor()),
+                service(stream.service_) {
+                complete = &Complete;
+                fd = stream.socket_.native_handle();
+                read = is_read;
+                msg.msg_iov = iov.data();
+            }
+
+            static void Complete(UringOperation* base, int result, bool destroy) {
+                auto* self = static_cast<Io*>(base);
+                if (!destroy && result == -EAGAIN && self->fixed) {
+                    // чтение с фиксированным буфером из неблокирующего сокета на старых ядрах
+                    // не ждёт данных, повторяем обычным recv, который ядро умеет ждать само
+                    self->fixed = false;
+                    return self->service->Start(self);
+                }
+                Handler handler = std::move(self->handler);
+                const auto executor = self->executor;
+                const bool read = self->read;
+                const size_t requested = self->requested;
+                self->~Io();
+                DeallocateRecycled(self, sizeof(Io));
+                if (destroy) {
+                    return;
+                }
+
+                beast::error_code ec;
+                size_t bytes = 0;
+                if (result >= 0) {
+                    bytes = static_cast<size_t>(result);
+                    if (read && bytes == 0 && requested > 0) {
+                        ec = net::error::eof;
+                    }
+                } else if (result == -ECANCELED) {
+                    // операцию отменил связанный таймаут
+                    ec = beast::error::timeout;
+                } else {
+                    ec.assign(-result, sys::system_category());
+                }
+                const auto handler_executor = net::get_associated_executor(handler, executor);
+                net::dispatch(handler_executor, beast::bind_front_handler(std::move(handler), ec, bytes));
+            }
+
+            Handler handler;
+            executor_type executor;
+            UringService* service;
+            std::array<iovec, MAX_IOV> iov{};
+            size_t requested{0};
+        };
+
+        template <bool IsRead, typename Handler, typename Buffers>
+        void Start(Handler&& handler, const Buffers& buffers) {
+            using Op = Io<std::decay_t<Handler>>;
+            auto* op = new (AllocateRecycled(sizeof(Op))) Op(std::move(handler), *this, IsRead);
+
+            size_t count = 0;
+            for (auto it = net::buffer_sequence_begin(buffers); it != net::buffer_sequence_end(buffers) && count < MAX_IOV; ++it) {
+                const auto buffer = *it;
+                if (buffer.size() == 0) {
+                    continue;
+                }
+                op->iov[count++] = {const_cast<void*>(static_cast<const void*>(buffer.data())), buffer.size()};
+                op->requested += buffer.size();
+            }
+            // пустой буфер — операция над нулём байт, которая сразу завершится успешно
+            op->msg.msg_iovlen = std::max<size_t>(count, 1);
+
+            if (deadline_) {
+                // просроченный таймаут всё равно ставится, чтобы операция завершилась через кольцо
+                op->timeout = std::max(std::chrono::nanoseconds(1),
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(*deadline_ - std::chrono::steady_clock::now()));
+            }
+
+            // В неблокирующий сокет (после sendfile) старые ядра не ждут данных для READ_FIXED
+            op->fixed = IsRead && count == 1 && !socket_.native_non_blocking()
+                && service_->IsRegistered(op->iov[0].iov_base, op->iov[0].iov_len);
+            service_->Start(op);
+        }
+
+        tcp::socket socket_;
+        UringService* service_;
+        std::optional<std::chrono::steady_clock::time_point> deadline_;
+    };
+
+} // namespace http_server
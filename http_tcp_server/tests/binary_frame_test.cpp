@@ -0,0 +1,64 @@
+#include <catch2/catch.hpp>
+
+#include <boost/asio/connect.hpp>
+#include <boost/asio/read.hpp>
+#include <boost/asio/write.hpp>
+
+#include <string>
+#include <thread>
+
+#include "binary_protocol.h"
+#include "binary_server.h"
+#include "random_generator.h"
+
+namespace {
+	namespace net = boost::asio;
+	using tcp = net::ip::tcp;
+
+	TEST_CASE("BinarySession: a response over 4 GiB is refused, not truncated", "[binary]") {
+		constexpr unsigned short PORT{18292};
+		// больше 4 ГБ тела из ссылок на один блок: память под сами блоки не выделяется
+		const auto block = storage::MakeBlockData(std::string(1 << 20, 'x'));
+		const auto hash = RandomString(storage::MAX_HASH_SIZE);
+		constexpr size_t RECORDS{4100};
+		{
+			http_server::ServerToClientBody::value_type body;
+			for (size_t i = 0; i < RECORDS; ++i) {
+				body.Add(hash, block);
+			}
+			REQUIRE(body.Size() > http_server::MAX_RESPONSE_FRAME_SIZE);
+		}
+
+		net::io_context server_ioc(1);
+		http_server::ServerBinary(server_ioc, {net::ip::make_address("127.0.0.1"), PORT},
+			[&block, &hash](http_server::BinaryRequest&& req, auto&& send) {
+				http_server::BinaryResponse response;
+				response.id = req.id;
+				for (size_t i = 0; i < RECORDS; ++i) {
+					response.body.Add(hash, block);
+				}
+				send(std::move(response));
+			});
+		std::jthread server_thread([&server_ioc] {
+			server_ioc.run();
+		});
+
+		net::io_context client_ioc;
+		tcp::socket socket(client_ioc);
+		net::connect(socket, std::vector{tcp::endpoint{net::ip::make_address("127.0.0.1"), PORT}});
+		const auto request = http_server::EncodeFrameHeader({0, http_server::FrameStatus::OK, 7});
+		net::write(socket, net::buffer(request));
+
+		http_server::FrameHeaderBytes header_bytes;
+		net::read(socket, net::buffer(header_bytes));
+		const auto header = http_server::DecodeFrameHeader(header_bytes.data());
+		CHECK(header.request_id == 7);
+		CHECK(header.status == http_server::FrameStatus::TOO_LARGE);
+		std::string text(header.size, '\0');
+		net::read(socket, net::buffer(text));
+		CHECK(text == "Response too large");
+
+		socket.close();
+		server_ioc.stop();
+	}
+}
@@ -0,0 +1,59 @@
+#include <catch2/catch.hpp>
+
+#include <algorithm>
+#include <array>
+#include <string>
+#include <string_view>
+
+#include "block_generator.h"
+
+namespace {
+	constexpr std::string_view ALPHABET{"0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwyz"};
+
+	/// @brief Эталон FillAlphabet: по 4 символа на случайное число, номер (bits * 61) >> 16
+	std::string Reference(size_t length, uint64_t seed) {
+		generator::WyRand random(seed);
+		std::string out;
+		while (out.size() < length) {
+			uint64_t word = random.Next();
+			for (int i = 0; i < 4 && out.size() < length; ++i, word >>= 16) {
+				out.push_back(ALPHABET[((word & 0xffff) * ALPHABET.size()) >> 16]);
+			}
+		}
+		return out;
+	}
+
+	TEST_CASE("FillAlphabet: the active kernel matches the scalar reference", "[generator]") {
+		INFO("kernel " << generator::ActiveKernel());
+		// длины захватывают векторные шаги и скалярные хвосты
+		for (const size_t length : {0, 1, 3, 4, 15, 16, 17, 31, 32, 33, 100, 4096, 4099}) {
+			std::string buffer(length, '\0');
+			generator::WyRand random(length + 1);
+			generator::FillAlphabet(buffer.data(), length, random);
+			INFO("length " << length);
+			REQUIRE(buffer == Reference(length, length + 1));
+		}
+	}
+
+	TEST_CASE("FillAlphabet: symbols are close to uniform", "[generator]") {
+		constexpr size_t LENGTH{61 * 100000};
+		std::string buffer(LENGTH, '\0');
+		generator::WyRand random(7);
+		generator::FillAlphabet(buffer.data(), LENGTH, random);
+
+		std::array<size_t, 256> counts{};
+		for (const unsigned char c : buffer) {
+			++counts[c];
+		}
+		for (size_t c = 0; c < counts.size(); ++c) {
+			if (ALPHABET.find(static_cast<char>(c)) == std::string_view::npos) {
+				REQUIRE(counts[c] == 0);
+				continue;
+			}
+			// ожидается 100000 на символ; 2% — больше 6 сигм, а перекос байтового отображения был 25%
+			INFO("symbol " << static_cast<char>(c));
+			REQUIRE(counts[c] > 98000);
+			REQUIRE(counts[c] < 102000);
+		}
+	}
+}
@@ -0,0 +1,82 @@
+#include <catch2/catch.hpp>
+
+#include <algorithm>
+#include <functional>
+#include <latch>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "block_store.h"
+#include "random_generator.h"
+
+namespace {
+	/// @brief Что поток узнал о токене
+	struct Observed {
+		uint32_t block_num{0};
+		size_t block_size{0};
+		size_t data_size{0};
+		size_t data_hash{0};
+
+		bool operator==(const Observed&) const = default;
+	};
+
+	std::vector<std::string> MakeHashes(size_t count) {
+		std::vector<std::string> hashes;
+		for (size_t i = 0; i < count; ++i) {
+			hashes.push_back(RandomString(storage::MAX_HASH_SIZE));
+		}
+		return hashes;
+	}
+
+	// Потоки одновременно вставляют и читают пересекающиеся токены в разном порядке:
+	// каждый токен должен получить один номер, один размер и одно содержимое на всех
+	TEST_CASE("BlockStore: concurrent inserts and lookups agree on every hash", "[block_store]") {
+		constexpr size_t THREADS{8};
+		constexpr size_t HASHES{512};
+		// мало шардов — больше столкновений за одну блокировку
+		storage::BlockStore store(storage::BlockOrigin::RANDOM, 4);
+		const auto hashes = MakeHashes(HASHES);
+
+		std::vector<std::vector<Observed>> observed(THREADS, std::vector<Observed>(HASHES));
+		std::latch start(THREADS);
+		std::vector<std::jthread> threads;
+		for (size_t t = 0; t < THREADS; ++t) {
+			threads.emplace_back([&, t] {
+				std::vector<size_t> order(HASHES);
+				for (size_t i = 0; i < HASHES; ++i) {
+					order[i] = i;
+				}
+				std::shuffle(order.begin(), order.end(), std::mt19937_64(t));
+				start.arrive_and_wait();
+				for (const size_t i : order) {
+					auto& seen = observed[t][i];
+					// номер и размер запрашиваются отдельно от блока: вставка может прийти по любому пути
+					if (t % 2 == 0) {
+						seen.block_num = store.GetBlockNumber(hashes[i]);
+						seen.block_size = store.GetBlockSize(hashes[i]);
+					}
+					const auto record = store.GetBlock(hashes[i]);
+					if (t % 2 != 0) {
+						seen.block_num = record.block_num;
+						seen.block_size = record.block_size;
+					}
+					seen.data_size = record.data.size();
+					seen.data_hash = std::hash<std::string_view>{}(record.data.bytes);
+				}
+			});
+		}
+		threads.clear();
+
+		REQUIRE(store.Size() == HASHES);
+		for (size_t i = 0; i < HASHES; ++i) {
+			INFO("hash " << i);
+			REQUIRE(observed[0][i].block_size == observed[0][i].data_size);
+			for (size_t t = 1; t < THREADS; ++t) {
+				INFO("thread " << t);
+				REQUIRE(observed[t][i] == observed[0][i]);
+			}
+		}
+	}
+}
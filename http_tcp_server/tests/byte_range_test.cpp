@@ -0,0 +1,108 @@
+#include <catch2/catch.hpp>
+
+#include <optional>
+#include <string>
+#include <type_traits>
+
+#include "admission.h"
+#include "request_handler.h"
+#include "test_support.h"
+
+namespace {
+	namespace http = boost::beast::http;
+
+	/// @brief Запрос из hash_count токенов, каждый просит range_count частей блока по 16 байт
+	std::string MakeRangeRequest(size_t hash_count, size_t range_count) {
+		return test_support::MakeClientToServer(test_support::MakeHashes(hash_count), range_count);
+	}
+
+	http::status HttpStatus(storage::BlockSource& store, http_server::AdmissionController& admission, std::string body) {
+		std::optional<http::status> status;
+		http_server::HandleServerRequest(store, {}, &admission, test_support::MakeHttpRequest(std::move(body)), [&status](auto&& response) {
+			// потоковые ответы и ответы через sendfile хранят заголовок отдельно от тела
+			if constexpr (requires { response.result(); }) {
+				status = response.result();
+			} else {
+				status = response.header.result();
+			}
+		});
+		REQUIRE(status);
+		return *status;
+	}
+
+	http_server::FrameStatus BinaryStatus(storage::BlockSource& store, http_server::AdmissionController& admission,
+		std::string body) {
+		std::optional<http_server::FrameStatus> status;
+		http_server::HandleBinaryRequest(store, {}, &admission, http_server::BinaryRequest{1, std::move(body)},
+			[&status](http_server::BinaryResponse&& response) {
+				status = response.status;
+			});
+		REQUIRE(status);
+		return *status;
+	}
+
+	TEST_CASE("HandleServerRequest: requests over the range limits get 413", "[ranges]") {
+		test_support::StubBlockSource store;
+		http_server::AdmissionController admission({.max_ranges_per_hash = 4, .max_ranges = 6});
+
+		CHECK(HttpStatus(store, admission, MakeRangeRequest(2, 3)) == http::status::ok);
+		// частей у одного токена больше лимита на токен
+		CHECK(HttpStatus(store, admission, MakeRangeRequest(1, 5)) == http::status::payload_too_large);
+		// у каждого токена частей в пределах лимита, но во всём запросе больше
+		CHECK(HttpStatus(store, admission, MakeRangeRequest(2, 4)) == http::status::payload_too_large);
+
+		CHECK(BinaryStatus(store, admission, MakeRangeRequest(2, 3)) == http_server::FrameStatus::OK);
+		CHECK(BinaryStatus(store, admission, MakeRangeRequest(1, 5)) == http_server::FrameStatus::TOO_LARGE);
+		CHECK(BinaryStatus(store, admission, MakeRangeRequest(2, 4)) == http_server::FrameStatus::TOO_LARGE);
+	}
+
+	TEST_CASE("HoldInflight: ranged records count the whole block they keep alive", "[ranges]") {
+		test_support::StubBlockSource store;
+		http_server::AdmissionController admission({});
+
+		std::optional<http_server::ServerToClientResponse> held;
+		http_server::HandleServerRequest(store, {}, &admission, test_support::MakeHttpRequest(MakeRangeRequest(1, 2)), [&](auto&& response) {
+			if constexpr (std::is_same_v<std::decay_t<decltype(response)>, http_server::ServerToClientResponse>) {
+				http_server::HoldInflight(admission, response);
+				held.emplace(std::move(response));
+			}
+		});
+		REQUIRE(held);
+		// тело — две части по 16 байт, но держит весь блок
+		CHECK(held->body().Size() < test_support::STUB_BLOCK_SIZE);
+		CHECK(admission.Inflight() == held->body().Size() + test_support::STUB_BLOCK_SIZE);
+		held.reset();
+		CHECK(admission.Inflight() == 0);
+	}
+
+	TEST_CASE("HandleServerRequest: the response is reserved in flight until its body is counted", "[ranges]") {
+		test_support::StubBlockSource store;
+		http_server::AdmissionController admission({.max_inflight_bytes = storage::MAX_BLOCK_SIZE});
+		const auto client = boost::asio::ip::make_address("127.0.0.1");
+
+		for (const bool binary : {false, true}) {
+			INFO("binary " << binary);
+			std::optional<uint64_t> reserved;
+			bool rejected = false;
+			const auto check = [&] {
+				// тело ещё не учтено, в полёте оценка по блоку наибольшего размера на токен
+				reserved = admission.Inflight();
+				rejected = admission.AdmitRequest(client).has_value();
+			};
+			if (binary) {
+				http_server::HandleBinaryRequest(store, {}, &admission, http_server::BinaryRequest{1, MakeRangeRequest(2, 1)},
+					[&](http_server::BinaryResponse&&) {
+						check();
+					});
+			} else {
+				http_server::HandleServerRequest(store, {}, &admission, test_support::MakeHttpRequest(MakeRangeRequest(2, 1)), [&](auto&&) {
+					check();
+				});
+			}
+			REQUIRE(reserved);
+			CHECK(*reserved == 2 * storage::MAX_BLOCK_SIZE);
+			CHECK(rejected);
+			CHECK(admission.Inflight() == 0);
+		}
+	}
+}
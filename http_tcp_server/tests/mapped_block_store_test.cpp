@@ -0,0 +1,93 @@
+#include <catch2/catch.hpp>
+
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "deflated_block.h"
+#include "mapped_block_store.h"
+#include "random_generator.h"
+
+namespace {
+	/// @brief Каталог хранилища с блоками, удаляется вместе с объектом
+	class TestStore {
+	public:
+		TestStore(size_t block_count, size_t block_size) :
+			directory_(std::filesystem::temp_directory_path() / ("mapped_store_test_" + std::to_string(::getpid()))) {
+			std::filesystem::remove_all(directory_);
+			{
+				storage::BlockSegmentWriter writer(directory_);
+				for (size_t i = 0; i < block_count; ++i) {
+					hashes_.push_back(RandomString(storage::MAX_HASH_SIZE));
+					blocks_.push_back(RandomString(block_size));
+					writer.Append(hashes_.back(), static_cast<uint32_t>(i), blocks_.back());
+				}
+			}
+			storage::MappedBlockStore::BuildIndex(directory_);
+		}
+
+		~TestStore() {
+			std::filesystem::remove_all(directory_);
+		}
+
+		const std::filesystem::path& Directory() const {
+			return directory_;
+		}
+
+		const std::vector<std::string>& Hashes() const {
+			return hashes_;
+		}
+
+		const std::vector<std::string>& Blocks() const {
+			return blocks_;
+		}
+
+	private:
+		std::filesystem::path directory_;
+		std::vector<std::string> hashes_;
+		std::vector<std::string> blocks_;
+	};
+
+	TEST_CASE("MappedBlockStore: compressed forms stay within the budget", "[mapped_store]") {
+		constexpr size_t BLOCKS{32};
+		constexpr size_t BLOCK_SIZE{16 << 10};
+		const TestStore files(BLOCKS, BLOCK_SIZE);
+		const uint64_t form_size = storage::DeflateBlock(files.Blocks().front())->bytes.size();
+		// бюджет на четыре сжатые формы
+		const uint64_t capacity = 4 * form_size + form_size / 2;
+		storage::MappedBlockStore store(files.Directory(), nullptr, capacity);
+
+		for (size_t i = 0; i < BLOCKS; ++i) {
+			const auto deflated = store.GetDeflatedBlock(files.Hashes()[i]);
+			REQUIRE(deflated->raw_size == BLOCK_SIZE);
+			REQUIRE(deflated->bytes == storage::DeflateBlock(files.Blocks()[i])->bytes);
+			REQUIRE(store.DeflatedBytes() <= capacity);
+			// первый блок горячий: обращения дают ему второй шанс в каждом обходе
+			REQUIRE(store.GetDeflatedBlock(files.Hashes().front()) != nullptr);
+		}
+		CHECK(store.DeflatedEvictions() >= BLOCKS - 4);
+		CHECK(store.DeflatedBytes() > 0);
+
+		// горячая форма не вытеснена: повторный запрос отдаёт тот же объект
+		const auto hot = store.GetDeflatedBlock(files.Hashes().front());
+		CHECK(store.GetDeflatedBlock(files.Hashes().front()) == hot);
+	}
+
+	TEST_CASE("MappedBlockStore: a form larger than the budget is served but not kept", "[mapped_store]") {
+		const TestStore files(2, 16 << 10);
+		storage::MappedBlockStore store(files.Directory(), nullptr, 16);
+
+		const auto deflated = store.GetDeflatedBlock(files.Hashes().front());
+		REQUIRE(deflated->bytes == storage::DeflateBlock(files.Blocks().front())->bytes);
+		CHECK(store.DeflatedBytes() == 0);
+		CHECK(store.DeflatedEvictions() == 1);
+	}
+
+	TEST_CASE("MappedBlockStore: the indexed block count is read from the index header", "[mapped_store]") {
+		const TestStore files(5, 4 << 10);
+		CHECK(storage::MappedBlockStore::IndexedBlockCount(files.Directory()) == 5);
+		CHECK(storage::MappedBlockStore(files.Directory()).Size() == 5);
+	}
+}
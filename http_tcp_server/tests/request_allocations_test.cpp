@@ -0,0 +1,44 @@
+#include <catch2/catch.hpp>
+
+#include "allocation_counter.h"
+#include "block_cache.h"
+#include "request_handler.h"
+#include "test_support.h"
+
+namespace {
+	// выделений на запрос из тёплого кэша: токены не выделяют память по одному,
+	// от 1 до 512 токенов выходит от 9 до 18 выделений, рост — удвоение буферов
+	constexpr uint64_t MAX_ALLOCATIONS{24};
+
+	/// @brief Выделений памяти в потоке на обработку запроса, включая передачу ответа в send
+	uint64_t RequestAllocations(storage::BlockSource& store, http_server::StringRequest req) {
+		bool sent = false;
+		const uint64_t before = http_server::ThreadAllocationCount();
+		http_server::HandleServerRequest(store, {}, nullptr, std::move(req), [&sent](auto&&) {
+			sent = true;
+		});
+		const uint64_t allocations = http_server::ThreadAllocationCount() - before;
+		REQUIRE(sent);
+		return allocations;
+	}
+
+	TEST_CASE("HandleServerRequest: a cached request allocates a bounded number of times", "[allocations]") {
+		// блоки по 4 КБ, чтобы все токены запроса поместились в кэш
+		test_support::StubBlockSource upstream;
+		storage::BlockCache cache(upstream, 64 << 20);
+
+		for (const size_t hash_count : {1, 16, 128, 512}) {
+			const auto body = test_support::MakeClientToServer(test_support::MakeHashes(hash_count));
+			// первый запрос материализует блоки, повторный берёт их из кэша
+			RequestAllocations(cache, test_support::MakeHttpRequest(body, 10));
+
+			INFO("hashes " << hash_count);
+			// HTTP/1.0 собирает тело целиком, HTTP/1.1 отправляет его потоково
+			const uint64_t assembled = RequestAllocations(cache, test_support::MakeHttpRequest(body, 10));
+			const uint64_t streamed = RequestAllocations(cache, test_support::MakeHttpRequest(body, 11));
+			INFO("assembled " << assembled << ", streamed " << streamed);
+			CHECK(assembled <= MAX_ALLOCATIONS);
+			CHECK(streamed <= MAX_ALLOCATIONS);
+		}
+	}
+}
@@ -0,0 +1,145 @@
+#include <catch2/catch.hpp>
+
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+#include <zlib.h>
+
+#include <exchange.pb.h>
+
+#include "block_cache.h"
+#include "block_store.h"
+#include "mapped_block_store.h"
+#include "server_to_client_body.h"
+#include "test_support.h"
+
+namespace {
+	constexpr size_t HASHES{16};
+
+	/// @brief Запись HashAndBlock так, как её сериализует protobuf
+	void AddExpected(Exchange::ServerToClient& expected, std::string_view hash, std::string_view block,
+		std::optional<storage::ServedRange> range = std::nullopt) {
+		auto* hash_and_block = expected.add_hash_and_block();
+		hash_and_block->set_hash(std::string(hash));
+		hash_and_block->set_block(std::string(block));
+		if (range) {
+			hash_and_block->set_offset(range->offset);
+			hash_and_block->set_total_size(range->total_size);
+		}
+	}
+
+	/// @brief Распаковка тела в gzip
+	std::string Gunzip(const std::string& compressed) {
+		z_stream stream{};
+		REQUIRE(inflateInit2(&stream, 16 + MAX_WBITS) == Z_OK);
+		std::string out;
+		char buffer[1 << 16];
+		stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(compressed.data()));
+		stream.avail_in = static_cast<uInt>(compressed.size());
+		int result = Z_OK;
+		while (result == Z_OK) {
+			stream.next_out = reinterpret_cast<Bytef*>(buffer);
+			stream.avail_out = sizeof(buffer);
+			result = inflate(&stream, Z_NO_FLUSH);
+			out.append(buffer, sizeof(buffer) - stream.avail_out);
+		}
+		inflateEnd(&stream);
+		REQUIRE(result == Z_STREAM_END);
+		CHECK(stream.avail_in == 0);
+		return out;
+	}
+
+	TEST_CASE("ServerToClientBody: records of cached blocks reuse their heads byte-identically", "[body]") {
+		test_support::StubBlockSource upstream({.varied = true});
+		storage::BlockCache cache(upstream, 64 << 20);
+		const auto hashes = test_support::MakeHashes(HASHES);
+
+		http_server::ServerToClientBody::value_type body;
+		Exchange::ServerToClient expected;
+		for (const auto& hash : hashes) {
+			const auto record = cache.GetBlock(hash);
+			// заголовок записи закодирован кэшем при материализации блока
+			REQUIRE(record.data.wire_head == storage::MakeHashAndBlockHead(hash, record.data.size()));
+			body.Add(hash, record.data);
+			AddExpected(expected, hash, record.data.bytes);
+		}
+		CHECK(body.Serialize() == expected.SerializeAsString());
+		CHECK(body.Size() == expected.ByteSizeLong());
+	}
+
+	TEST_CASE("ServerToClientBody: records of mapped blocks are byte-identical", "[body]") {
+		const auto directory = std::filesystem::temp_directory_path() / ("body_test_" + std::to_string(::getpid()));
+		std::filesystem::remove_all(directory);
+		test_support::StubBlockSource upstream({.varied = true});
+		const auto hashes = test_support::MakeHashes(HASHES);
+		{
+			storage::BlockSegmentWriter writer(directory);
+			for (const auto& hash : hashes) {
+				writer.Append(hash, 0, upstream.GetBlock(hash).data.bytes);
+			}
+		}
+		storage::MappedBlockStore::BuildIndex(directory);
+		{
+			storage::MappedBlockStore store(directory);
+			http_server::ServerToClientBody::value_type body;
+			Exchange::ServerToClient expected;
+			for (const auto& hash : hashes) {
+				const auto record = store.GetBlock(hash);
+				// блоки из файла идут без готового заголовка, он кодируется в ответе
+				REQUIRE(record.data.wire_head.empty());
+				REQUIRE(record.data.file.fd >= 0);
+				body.Add(hash, record.data);
+				AddExpected(expected, hash, record.data.bytes);
+			}
+			CHECK(body.HasFileBlocks());
+			CHECK(body.Serialize() == expected.SerializeAsString());
+			CHECK(body.Size() == expected.ByteSizeLong());
+		}
+		std::filesystem::remove_all(directory);
+	}
+
+	TEST_CASE("ServerToClientBody: ranged records bypass the cached head and stay byte-identical", "[body]") {
+		test_support::StubBlockSource upstream({.varied = true});
+		storage::BlockCache cache(upstream, 64 << 20);
+		const auto hashes = test_support::MakeHashes(HASHES);
+		// часть с начала, из середины, до конца блока и за его концом
+		const std::vector<http_server::ByteRange> ranges{{0, 10}, {50, 20}, {90}, {1 << 20, 5}};
+
+		for (const auto encoding : {http_server::ContentEncoding::IDENTITY, http_server::ContentEncoding::GZIP}) {
+			INFO("encoding " << static_cast<int>(encoding));
+			http_server::ServerToClientBody::value_type body(encoding);
+			Exchange::ServerToClient expected;
+			for (size_t i = 0; i < hashes.size(); ++i) {
+				const auto record = cache.GetBlock(hashes[i]);
+				REQUIRE_FALSE(record.data.wire_head.empty());
+				// целые блоки вперемешку с частями: готовые заголовки не сбивают заголовки частей
+				if (i % 2 == 0) {
+					if (encoding == http_server::ContentEncoding::IDENTITY) {
+						body.Add(hashes[i], record.data);
+					} else {
+						body.AddDeflated(hashes[i], cache.GetDeflatedBlock(hashes[i]));
+					}
+					AddExpected(expected, hashes[i], record.data.bytes);
+					continue;
+				}
+				body.AddRanges(hashes[i], record.data, ranges);
+				for (const auto& range : ranges) {
+					const auto slice = record.data.Slice(range.offset, range.length);
+					AddExpected(expected, hashes[i], slice.bytes,
+						storage::ServedRange{static_cast<uint64_t>(slice.data() - record.data.data()), record.data.size()});
+				}
+			}
+			body.Finish();
+			const auto serialized = body.Serialize();
+			CHECK(serialized.size() == body.Size());
+			if (encoding == http_server::ContentEncoding::IDENTITY) {
+				CHECK(serialized == expected.SerializeAsString());
+			} else {
+				CHECK(Gunzip(serialized) == expected.SerializeAsString());
+			}
+		}
+	}
+}
@@ -0,0 +1,111 @@
+#include <catch2/catch.hpp>
+
+#include <boost/asio/connect.hpp>
+#include <boost/asio/write.hpp>
+
+#include <chrono>
+#include <limits>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "coro_session.h"
+#include "http_server.h"
+
+namespace {
+	using namespace std::literals;
+	namespace net = boost::asio;
+	namespace beast = boost::beast;
+	namespace http = beast::http;
+	using tcp = net::ip::tcp;
+
+	constexpr auto IO_TIMEOUT{1s};
+	constexpr size_t CHUNKS{24};
+	constexpr size_t CHUNK_SIZE{1 << 20};
+	// клиент читает так медленно, что ответ пишется в несколько раз дольше IO_TIMEOUT
+	constexpr size_t READ_SIZE{64 << 10};
+	constexpr auto READ_PAUSE{8ms};
+
+	/// @brief Потоковый ответ из CHUNKS частей по мегабайту
+	class LargeChunks : public http_server::ChunkSource {
+	public:
+		bool Next(std::vector<net::const_buffer>& buffers) override {
+			if (sent_ == CHUNKS) {
+				return false;
+			}
+			++sent_;
+			buffers.emplace_back(chunk_.data(), chunk_.size());
+			return true;
+		}
+
+	private:
+		std::string chunk_ = std::string(CHUNK_SIZE, 'x');
+		size_t sent_{0};
+	};
+
+	template <template <typename> typename SessionType>
+	void CheckSlowReader(unsigned short port) {
+		net::io_context server_ioc(1);
+		http_server::ServerHttp<SessionType>(server_ioc, {net::ip::make_address("127.0.0.1"), port},
+			[](http::request<http::string_body>&&, auto&& send) {
+				http_server::StreamResponse response;
+				response.header = http::response<http::empty_body>(http::status::ok, 11);
+				response.header.keep_alive(true);
+				response.source = std::make_shared<LargeChunks>();
+				send(std::move(response));
+			}, {.io_timeout = IO_TIMEOUT});
+		std::jthread server_thread([&server_ioc] {
+			server_ioc.run();
+		});
+		// сервер останавливается и при провале проверки, иначе поток сервера не завершится
+		const std::unique_ptr<net::io_context, void (*)(net::io_context*)> stop_server(&server_ioc, [](net::io_context* ioc) {
+			ioc->stop();
+		});
+
+		net::io_context client_ioc;
+		tcp::socket socket(client_ioc);
+		socket.open(tcp::v4());
+		socket.set_option(net::socket_base::receive_buffer_size(READ_SIZE));
+		socket.connect({net::ip::make_address("127.0.0.1"), port});
+		http::request<http::empty_body> request{http::verb::get, "/", 11};
+		request.keep_alive(true);
+		http::write(socket, request);
+
+		// паузы между чтениями делают клиента медленным; тело разбирается, когда прочитано целиком
+		std::string raw;
+		std::string chunk(READ_SIZE, '\0');
+		beast::error_code ec;
+		const auto started = std::chrono::steady_clock::now();
+		while (!ec && !raw.ends_with("\r\n0\r\n\r\n"sv)) {
+			raw.append(chunk.data(), socket.read_some(net::buffer(chunk), ec));
+			std::this_thread::sleep_for(READ_PAUSE);
+		}
+		const auto elapsed = std::chrono::steady_clock::now() - started;
+		REQUIRE_FALSE(ec);
+		CHECK(elapsed > 2 * IO_TIMEOUT);
+
+		http::response_parser<http::string_body> parser;
+		parser.body_limit(std::numeric_limits<uint64_t>::max());
+		parser.eager(true);
+		for (size_t parsed = 0; !ec && !parser.is_done();) {
+			parsed += parser.put(net::buffer(raw.data() + parsed, raw.size() - parsed), ec);
+		}
+		REQUIRE_FALSE(ec);
+		CHECK(parser.get().body().size() == CHUNKS * CHUNK_SIZE);
+
+		// после ответа соединение простаивает и закрывается по сроку простоя
+		const auto idle_started = std::chrono::steady_clock::now();
+		char byte;
+		socket.read_some(net::buffer(&byte, 1), ec);
+		CHECK(ec == net::error::eof);
+		CHECK(std::chrono::steady_clock::now() - idle_started < 4 * IO_TIMEOUT);
+	}
+
+	TEST_CASE("Session: a response written longer than the read timeout is not cut off", "[session]") {
+		CheckSlowReader<http_server::Session>(18293);
+	}
+
+	TEST_CASE("CoroSession: a response written longer than the read timeout is not cut off", "[session]") {
+		CheckSlowReader<http_server::CoroSession>(18294);
+	}
+}
@@ -0,0 +1,127 @@
+#include <catch2/catch.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <latch>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "block_cache.h"
+#include "random_generator.h"
+#include "request_handler.h"
+#include "test_support.h"
+
+namespace {
+	using namespace std::literals;
+
+	// материализация блока в медленном источнике
+	constexpr auto MATERIALIZATION_TIME{200ms};
+
+	// Одинаковые запросы приходят одновременно: каждый блок материализуется один раз,
+	// а потоки, не готовящие блок сами, не ждут чужую материализацию.
+	// Сжатый ответ, ждавший чужой материализации, собирается в пуле, а не в потоке другого запроса
+	TEST_CASE("GetServerResponseAsync: simultaneous identical requests share one materialization", "[single_flight]") {
+		constexpr size_t REQUESTS{8};
+		constexpr size_t HASHES{4};
+		const auto request = test_support::MakeRequestView(test_support::MakeHashes(HASHES));
+		http_server::ComputePool pool(2);
+
+		for (const auto encoding : {http_server::ContentEncoding::IDENTITY, http_server::ContentEncoding::GZIP}) {
+			INFO("encoding " << static_cast<int>(encoding));
+			// источник долго готовит блок и считает обращения к себе
+			test_support::StubBlockSource upstream({.delay = MATERIALIZATION_TIME});
+			storage::BlockCache cache(upstream, 64 << 20);
+
+			std::mutex mutex;
+			std::vector<std::string> bodies;
+			std::latch start(REQUESTS);
+			std::latch answered(REQUESTS);
+			std::atomic<size_t> fast_calls{0};
+			// потоки запросов и потоки, в которых ответ собран не потоком своего запроса
+			std::vector<std::thread::id> requesters;
+			std::vector<std::thread::id> foreign;
+			{
+				std::vector<std::jthread> threads;
+				for (size_t t = 0; t < REQUESTS; ++t) {
+					threads.emplace_back([&] {
+						const auto requester = std::this_thread::get_id();
+						{
+							std::lock_guard lock(mutex);
+							requesters.push_back(requester);
+						}
+						start.arrive_and_wait();
+						const auto started = std::chrono::steady_clock::now();
+						http_server::GetServerResponseAsync(cache, request, encoding, &pool,
+							[&, requester](std::optional<http_server::ServerToClientBody::value_type>&& body) {
+								{
+									std::lock_guard lock(mutex);
+									bodies.push_back(body ? body->Serialize() : std::string{});
+									if (std::this_thread::get_id() != requester) {
+										foreign.push_back(std::this_thread::get_id());
+									}
+								}
+								answered.count_down();
+							});
+						if (std::chrono::steady_clock::now() - started < MATERIALIZATION_TIME / 2) {
+							fast_calls.fetch_add(1, std::memory_order_relaxed);
+						}
+					});
+				}
+			}
+			answered.wait();
+
+			CHECK(upstream.Calls() == HASHES);
+			CHECK(cache.Stats().materializations == HASHES);
+			CHECK(cache.Stats().deflations == (encoding == http_server::ContentEncoding::IDENTITY ? 0 : HASHES));
+			// медленными могут быть только вызовы, которые сами материализовали блок
+			CHECK(fast_calls.load() >= REQUESTS - HASHES);
+			REQUIRE(bodies.size() == REQUESTS);
+			CHECK_FALSE(bodies.front().empty());
+			for (const auto& body : bodies) {
+				CHECK(body == bodies.front());
+			}
+			if (encoding != http_server::ContentEncoding::IDENTITY) {
+				CHECK_FALSE(foreign.empty());
+				for (const auto& thread : foreign) {
+					CHECK(std::find(requesters.begin(), requesters.end(), thread) == requesters.end());
+				}
+			}
+		}
+	}
+
+	// Сжатая форма запрашивается одновременно для блока, который уже в кэше:
+	// блок сжимается один раз, остальные запросы получают ту же форму
+	TEST_CASE("BlockCache: simultaneous requests of a compressed form share one deflate", "[single_flight]") {
+		constexpr size_t REQUESTS{8};
+		constexpr size_t BLOCK_SIZE{1 << 20};
+		// случайный текст сжимается долго, одновременные запросы успевают совпасть
+		test_support::StubBlockSource upstream({.block = RandomString(BLOCK_SIZE)});
+		storage::BlockCache cache(upstream, 64 << 20);
+		const auto hash = RandomString(storage::MAX_HASH_SIZE);
+		cache.GetBlock(hash);
+
+		std::vector<storage::DeflatedBlockPtr> deflated(REQUESTS);
+		std::latch start(REQUESTS);
+		{
+			std::vector<std::jthread> threads;
+			for (size_t t = 0; t < REQUESTS; ++t) {
+				threads.emplace_back([&, t] {
+					start.arrive_and_wait();
+					deflated[t] = cache.GetDeflatedBlock(hash);
+				});
+			}
+		}
+
+		CHECK(cache.Stats().deflations == 1);
+		CHECK(cache.Stats().deflated_blocks == 1);
+		for (const auto& form : deflated) {
+			REQUIRE(form);
+			CHECK(form == deflated.front());
+		}
+		CHECK(cache.GetDeflatedBlock(hash) == deflated.front());
+		CHECK(cache.Stats().deflations == 1);
+	}
+}
@@ -0,0 +1,85 @@
+#include <catch2/catch.hpp>
+
+#include <boost/asio/connect.hpp>
+#include <boost/asio/read.hpp>
+#include <boost/asio/write.hpp>
+
+#include <chrono>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+#include "coro_session.h"
+#include "http_server.h"
+#include "request_handler.h"
+
+namespace {
+	namespace net = boost::asio;
+	namespace http = boost::beast::http;
+	using tcp = net::ip::tcp;
+	using namespace std::literals;
+
+	/// @brief Источник, который отдаёт одну часть, а на следующей бросает исключение
+	class FailingSource : public http_server::ChunkSource {
+	public:
+		bool Next(std::vector<net::const_buffer>& buffers) override {
+			if (sent_) {
+				throw std::runtime_error("block lookup failed");
+			}
+			sent_ = true;
+			buffers.emplace_back(net::buffer(PART));
+			return true;
+		}
+
+	private:
+		static constexpr std::string_view PART{"first part"};
+		bool sent_{false};
+	};
+
+	/// @brief Ответ сервера на один запрос до закрытия соединения сервером
+	std::string Exchange(unsigned short port) {
+		net::io_context ioc;
+		tcp::socket socket(ioc);
+		net::connect(socket, std::vector{tcp::endpoint{net::ip::make_address("127.0.0.1"), port}});
+		net::write(socket, net::buffer("GET / HTTP/1.1\r\nHost: test\r\nContent-Length: 0\r\n\r\n"sv));
+		std::string response;
+		boost::system::error_code ec;
+		net::read(socket, net::dynamic_buffer(response), ec);
+		return response;
+	}
+
+	template <template <typename> typename SessionType>
+	void CheckAbortedStream(unsigned short port) {
+		net::io_context server_ioc(1);
+		http_server::ServerHttp<SessionType>(server_ioc, {net::ip::make_address("127.0.0.1"), port},
+			[](auto&& req, auto&& send) {
+				http_server::StreamResponse response;
+				response.header = http_server::MakeEmptyResponse(req);
+				response.source = std::make_shared<FailingSource>();
+				send(std::move(response));
+			});
+		std::jthread server_thread([&server_ioc] {
+			server_ioc.run();
+		});
+
+		const auto started = std::chrono::steady_clock::now();
+		const auto response = Exchange(port);
+		// соединение закрыто сразу, а не по таймауту записи
+		CHECK(std::chrono::steady_clock::now() - started < 5s);
+		CHECK(response.find("first part"sv) != std::string::npos);
+		// без завершающей части клиент видит оборванное тело
+		CHECK(response.find("\r\n0\r\n\r\n"sv) == std::string::npos);
+
+		// исключение не вышло из io_context::run: сервер принимает новые соединения
+		CHECK(Exchange(port).find("first part"sv) != std::string::npos);
+		server_ioc.stop();
+	}
+
+	TEST_CASE("Session: a throwing chunk source aborts the response, not the server", "[stream]") {
+		CheckAbortedStream<http_server::Session>(18290);
+	}
+
+	TEST_CASE("CoroSession: a throwing chunk source aborts the response, not the server", "[stream]") {
+		CheckAbortedStream<http_server::CoroSession>(18291);
+	}
+}
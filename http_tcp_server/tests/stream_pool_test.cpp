@@ -0,0 +1,91 @@
+#include <catch2/catch.hpp>
+
+#include <chrono>
+#include <future>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "block_cache.h"
+#include "block_store.h"
+#include "compute_pool.h"
+#include "server_to_client_body.h"
+#include "test_support.h"
+
+namespace {
+	namespace net = boost::asio;
+
+	/// @brief Тело ответа так, как его отправила бы сессия: Wait до готовности, затем Next
+	std::string Drain(http_server::ChunkSource& source) {
+		std::string body;
+		std::vector<net::const_buffer> buffers;
+		for (;;) {
+			for (;;) {
+				auto resumed = std::make_shared<std::promise<void>>();
+				auto done = resumed->get_future();
+				if (!source.Wait([resumed] { resumed->set_value(); })) {
+					break;
+				}
+				done.wait();
+			}
+			buffers.clear();
+			if (!source.Next(buffers)) {
+				return body;
+			}
+			for (const auto& buffer : buffers) {
+				body.append(static_cast<const char*>(buffer.data()), buffer.size());
+			}
+		}
+	}
+
+	TEST_CASE("ServerToClientStream: blocks prepared in the pool keep the response byte-identical", "[stream]") {
+		storage::BlockStore store(storage::BlockOrigin::FROM_HASH);
+		http_server::ComputePool pool(2);
+		const auto request = test_support::MakeRequestView(test_support::MakeHashes(64));
+
+		for (const auto encoding : {http_server::ContentEncoding::IDENTITY, http_server::ContentEncoding::GZIP}) {
+			INFO("encoding " << static_cast<int>(encoding));
+			// отдельные кэши: в пуле блоки материализуются и сжимаются заново
+			storage::BlockCache inline_cache(store, 64 << 20);
+			storage::BlockCache pool_cache(store, 64 << 20);
+			auto inline_stream = std::make_shared<http_server::ServerToClientStream>(inline_cache, request, encoding);
+			auto pool_stream = std::make_shared<http_server::ServerToClientStream>(pool_cache, request, encoding, &pool);
+
+			const auto expected = Drain(*inline_stream);
+			REQUIRE_FALSE(expected.empty());
+			REQUIRE(Drain(*pool_stream) == expected);
+		}
+	}
+
+	TEST_CASE("ServerToClientStream: a compressed stream without a pool subscribes to another materialization", "[stream]") {
+		test_support::StubBlockSource gated({.gated = true});
+		storage::BlockCache cache(gated, 64 << 20);
+		const auto request = test_support::MakeRequestView(test_support::MakeHashes(4));
+
+		// другой запрос материализует первый блок ответа и ждёт источник
+		std::jthread other([&cache, hash = request->Hashes()[0]] {
+			cache.GetBlock(hash);
+		});
+		while (cache.Stats().materializations == 0) {
+			std::this_thread::sleep_for(std::chrono::milliseconds{1});
+		}
+
+		auto stream = std::make_shared<http_server::ServerToClientStream>(cache, request, http_server::ContentEncoding::GZIP);
+		auto resumed = std::make_shared<std::promise<void>>();
+		auto done = resumed->get_future();
+		// поток отправки не блокируется на чужой материализации и не сжимает блок в Next
+		const bool waiting = stream->Wait([resumed] { resumed->set_value(); });
+		// источник открывается и при провале проверки, иначе поток другого запроса не завершится
+		gated.Open();
+		REQUIRE(waiting);
+		done.wait();
+		const auto body = Drain(*stream);
+
+		test_support::StubBlockSource store;
+		storage::BlockCache fresh_cache(store, 64 << 20);
+		auto expected = std::make_shared<http_server::ServerToClientStream>(fresh_cache, request, http_server::ContentEncoding::GZIP);
+		CHECK(body == Drain(*expected));
+		CHECK(cache.Stats().deflations == 4);
+	}
+}
@@ -0,0 +1,76 @@
+#include "test_support.h"
+
+#include <catch2/catch.hpp>
+
+#include <thread>
+
+#include <exchange.pb.h>
+
+#include "random_generator.h"
+
+namespace test_support {
+	StubBlockSource::StubBlockSource(StubOptions options) :
+		delay_(options.delay),
+		opened_(options.gated ? 1 : 0) {
+		if (!options.varied) {
+			block_ = storage::MakeBlockData(std::move(options.block));
+		}
+	}
+
+	storage::BlockRecord StubBlockSource::GetBlock(std::string_view hash) {
+		calls_.fetch_add(1, std::memory_order_relaxed);
+		opened_.wait();
+		if (delay_.count() > 0) {
+			std::this_thread::sleep_for(delay_);
+		}
+		if (block_) {
+			return {0, block_.size(), block_};
+		}
+		// длина блока в заголовке записи бывает и больше одного байта varint
+		const size_t size = 100 + static_cast<unsigned char>(hash.front()) * 257;
+		return {0, size, storage::MakeBlockData(std::string(size, hash.back()))};
+	}
+
+	void StubBlockSource::Open() {
+		opened_.count_down();
+	}
+
+	std::vector<std::string> MakeHashes(size_t count) {
+		std::vector<std::string> hashes;
+		hashes.reserve(count);
+		for (size_t i = 0; i < count; ++i) {
+			hashes.push_back(RandomString(storage::MAX_HASH_SIZE));
+		}
+		return hashes;
+	}
+
+	std::string MakeClientToServer(const std::vector<std::string>& hashes, size_t ranges_per_hash) {
+		Exchange::ClientToServer client_to_server;
+		for (const auto& hash : hashes) {
+			client_to_server.add_hashes(hash);
+			if (ranges_per_hash == 0) {
+				continue;
+			}
+			auto* block_range = client_to_server.add_ranges();
+			for (size_t r = 0; r < ranges_per_hash; ++r) {
+				auto* range = block_range->add_ranges();
+				range->set_offset(r * 16);
+				range->set_length(16);
+			}
+		}
+		return client_to_server.SerializeAsString();
+	}
+
+	std::shared_ptr<http_server::ClientToServerView> MakeRequestView(const std::vector<std::string>& hashes) {
+		auto view = std::make_shared<http_server::ClientToServerView>();
+		REQUIRE(view->Parse(MakeClientToServer(hashes)));
+		return view;
+	}
+
+	http_server::StringRequest MakeHttpRequest(std::string body, unsigned version) {
+		http_server::StringRequest req{boost::beast::http::verb::get, "/", version};
+		req.body() = std::move(body);
+		req.prepare_payload();
+		return req;
+	}
+}  // namespace test_support
@@ -0,0 +1,68 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <latch>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "block_store.h"
+#include "client_to_server_view.h"
+#include "request_handler.h"
+
+// Общие заглушки тестов: источник блоков и построение запросов ClientToServer
+namespace test_support {
+
+    // размер блока заглушки по умолчанию: все токены запроса помещаются в кэш
+    inline constexpr size_t STUB_BLOCK_SIZE{4096};
+
+    /// @brief Параметры заглушки источника блоков
+    struct StubOptions {
+        // блок, который отдаётся по любому токену без копирования
+        std::string block = std::string(STUB_BLOCK_SIZE, 'x');
+        // вместо block у каждого токена свой блок размером от 100 байт до 64 КБ
+        bool varied{false};
+        // сколько длится материализация блока
+        std::chrono::milliseconds delay{0};
+        // блоки отдаются только после Open
+        bool gated{false};
+    };
+
+    /// @brief Источник блоков для тестов, считает обращения к себе
+    class StubBlockSource : public storage::BlockSource {
+    public:
+        explicit StubBlockSource(StubOptions options = {});
+
+        storage::BlockRecord GetBlock(std::string_view hash) override;
+
+        /// @brief Пропускает материализации закрытого источника, вызывается один раз
+        void Open();
+
+        size_t Calls() const {
+            return calls_.load(std::memory_order_relaxed);
+        }
+
+    private:
+        storage::BlockData block_;
+        std::chrono::milliseconds delay_;
+        std::latch opened_;
+        std::atomic<size_t> calls_{0};
+    };
+
+    /// @brief Случайные токены
+    std::vector<std::string> MakeHashes(size_t count);
+
+    /// @brief Тело запроса ClientToServer
+    /// @param hashes токены запроса
+    /// @param ranges_per_hash сколько частей блока по 16 байт просит каждый токен; 0 — блоки целиком
+    std::string MakeClientToServer(const std::vector<std::string>& hashes, size_t ranges_per_hash = 0);
+
+    /// @brief Разобранный запрос ClientToServer
+    std::shared_ptr<http_server::ClientToServerView> MakeRequestView(const std::vector<std::string>& hashes);
+
+    /// @brief HTTP-запрос GET с телом ClientToServer
+    http_server::StringRequest MakeHttpRequest(std::string body, unsigned version = 10);
+
+} // namespace test_support